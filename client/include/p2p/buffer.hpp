@@ -0,0 +1,83 @@
+#pragma once
+
+#include "export.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace p2p {
+
+namespace detail {
+struct BufferBlock;
+}
+
+/**
+ * 池化的引用计数缓冲区
+ *
+ * 内存按大小分级 (256B ~ 1MB) 从线程本地缓存中分配。拷贝 Buffer 只增加引用计数，
+ * 最后一个引用释放时内存回到当前线程的缓存，供后续消息复用；超过 1MB 的缓冲区直接分配和释放。
+ * 多个 Buffer 拷贝共享同一块内存，修改数据前请确认没有其他持有者。
+ */
+class P2P_API Buffer {
+public:
+    Buffer() noexcept = default;
+    Buffer(const Buffer& other) noexcept;
+    Buffer(Buffer&& other) noexcept;
+    Buffer& operator=(const Buffer& other) noexcept;
+    Buffer& operator=(Buffer&& other) noexcept;
+    ~Buffer();
+
+    /**
+     * 分配 size 字节的缓冲区 (内容未初始化)
+     */
+    static Buffer allocate(size_t size);
+
+    /**
+     * 分配缓冲区并拷贝数据
+     */
+    static Buffer copyOf(const void* data, size_t size);
+
+    uint8_t* data() noexcept { return data_; }
+    const uint8_t* data() const noexcept { return data_; }
+    size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    size_t capacity() const noexcept;
+
+    const uint8_t* begin() const noexcept { return data_; }
+    const uint8_t* end() const noexcept { return data_ + size_; }
+
+    /**
+     * 调整有效长度，newSize 不能超过 capacity()
+     */
+    void resize(size_t newSize) noexcept;
+
+    /**
+     * 当前引用计数 (空缓冲区返回 0)
+     */
+    long useCount() const noexcept;
+
+    /**
+     * 拷贝为 std::vector
+     */
+    std::vector<uint8_t> toVector() const { return std::vector<uint8_t>(begin(), end()); }
+
+    // 缓冲池统计 (所有线程合计)
+    struct PoolStats {
+        uint64_t cacheHits = 0;     // 从线程缓存复用
+        uint64_t cacheMisses = 0;   // 新分配
+        uint64_t oversized = 0;     // 超出分级范围的分配
+        uint64_t released = 0;      // 回到缓存的块
+        uint64_t remoteReleased = 0; // 其中在其他线程释放、归还给分配线程缓存的块
+    };
+    static PoolStats poolStats();
+
+private:
+    explicit Buffer(detail::BufferBlock* block, size_t size) noexcept;
+    void release() noexcept;
+
+    detail::BufferBlock* block_ = nullptr;
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace p2p
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "export.hpp"
+#include "types.hpp"
+#include "p2p_client.hpp"
+#include <memory>
+#include <string>
+
+namespace p2p {
+
+class GatewayImpl;
+
+/**
+ * 网关：多个本地 ID 共用一条信令连接
+ *
+ * 网关只建立一条 WebSocket 并以 config.peerId 注册，createEndpoint() 返回的每个 P2PClient
+ * 调用 connect() 时在这条连接上注册一个虚拟 ID，不再各自建立连接、注册和线程；
+ * 端点的其余用法 (直连、中继、RPC、流等) 与独立的 P2PClient 相同。
+ * 需要服务端支持协议版本 4。
+ *
+ * 使用示例:
+ * @code
+ * p2p::Gateway gateway(config);
+ * gateway.connect();
+ *
+ * std::vector<p2p::P2PClient> endpoints;
+ * for (int i = 0; i < 1000; ++i) {
+ *     auto& endpoint = endpoints.emplace_back(gateway.createEndpoint("sensor_" + std::to_string(i)));
+ *     endpoint.setOnTextMessage(...);
+ *     endpoint.connect();
+ * }
+ * @endcode
+ */
+class P2P_API Gateway {
+public:
+    /**
+     * @param config 所有端点共用的配置 (信令服务器、STUN/TURN、压缩等)，peerId 为网关自身的 ID
+     */
+    explicit Gateway(const ClientConfig& config = ClientConfig());
+
+    ~Gateway();
+
+    Gateway(const Gateway&) = delete;
+    Gateway& operator=(const Gateway&) = delete;
+
+    /**
+     * 连接信令服务器并注册网关自身
+     * @return 服务端不支持网关模式时返回 false
+     */
+    bool connect();
+
+    /**
+     * 断开共享连接，所有端点随之断开 (服务端注销全部虚拟 ID)
+     */
+    void disconnect();
+
+    bool isConnected() const;
+
+    /**
+     * 获取网关自身的 ID
+     */
+    std::string getLocalId() const;
+
+    /**
+     * 创建一个端点，connect() 时在共享连接上注册
+     * @param peerId 请求的 ID (可选，为空或已被占用时由服务端分配)
+     */
+    P2PClient createEndpoint(const std::string& peerId = "");
+
+    /**
+     * 已注册的端点数量
+     */
+    size_t getEndpointCount() const;
+
+    /**
+     * 共享连接断开时的回调 (各端点另外收到自己的 OnDisconnected)
+     */
+    void setOnDisconnected(OnDisconnectedCallback callback);
+
+    void setOnError(OnErrorCallback callback);
+
+private:
+    std::shared_ptr<GatewayImpl> impl_;
+};
+
+} // namespace p2p
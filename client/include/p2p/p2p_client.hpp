@@ -2,15 +2,21 @@
 
 #include "export.hpp"
 #include "types.hpp"
+#include "stream.hpp"
+#include "schema.hpp"
+#include "runtime.hpp"
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 #include <future>
+#include <initializer_list>
 
 namespace p2p {
 
 // 前向声明实现类
 class P2PClientImpl;
+class GatewayImpl;
 
 /**
  * P2P 客户端类
@@ -85,6 +91,14 @@ public:
      */
     void disconnect();
     
+    /**
+     * 在后台线程上断开所有连接
+     * 
+     * 与 disconnect() 相同，PeerConnection 由多个线程并行关闭；返回的 future 包含关闭的连接数和耗时。
+     * 客户端析构时会等待尚未完成的后台断开。
+     */
+    std::future<DisconnectStats> disconnectAsync();
+    
     /**
      * 检查是否已连接到信令服务器
      */
@@ -146,6 +160,13 @@ public:
      */
     std::optional<PeerInfo> getPeerInfo(const std::string& peerId) const;
     
+    /**
+     * 获取与 Peer 之间各传输 (WebRTC 直连、中继) 的统计
+     * 有多个可用的直连传输时，直连消息经由测得时延最小的一个发送 (selected 为 true)
+     * @param peerId 目标 Peer ID
+     */
+    std::vector<TransportStats> getTransportStats(const std::string& peerId) const;
+    
     // ==================== 消息发送 ====================
     
     /**
@@ -181,6 +202,23 @@ public:
      */
     bool send(const std::string& peerId, const Message& message);
     
+    /**
+     * 分段发送一条二进制消息 (scatter-gather)
+     * 各段按顺序组成一条消息，库内只拼接一次，应用无需先把消息头和数据拷贝到一起
+     * @param peerId 目标 Peer ID
+     * @param buffers 数据段数组
+     * @param count 段数
+     * @return 发送成功返回 true
+     */
+    bool sendv(const std::string& peerId, const ConstBuffer* buffers, size_t count);
+    
+    /**
+     * 分段发送 (列表版本)，例如 sendv(peerId, {header, payload})
+     */
+    bool sendv(const std::string& peerId, std::initializer_list<ConstBuffer> buffers) {
+        return sendv(peerId, buffers.begin(), buffers.size());
+    }
+    
     /**
      * 广播文本消息给所有已连接的 Peer
      * @param message 文本内容
@@ -269,6 +307,23 @@ public:
      */
     bool sendViaRelay(const std::string& peerId, const Message& message);
     
+    /**
+     * 通过中继分段发送一条二进制消息
+     * 各段直接流式编码进中继消息，不先拼接原始数据
+     * @param peerId 目标 Peer ID
+     * @param buffers 数据段数组
+     * @param count 段数
+     * @return 发送成功返回 true
+     */
+    bool sendvViaRelay(const std::string& peerId, const ConstBuffer* buffers, size_t count);
+    
+    /**
+     * 通过中继分段发送 (列表版本)
+     */
+    bool sendvViaRelay(const std::string& peerId, std::initializer_list<ConstBuffer> buffers) {
+        return sendvViaRelay(peerId, buffers.begin(), buffers.size());
+    }
+    
     /**
      * 通过中继广播文本消息
      * @param message 文本内容
@@ -294,20 +349,182 @@ public:
      */
     bool isPeerRelayConnected(const std::string& peerId) const;
     
+    // ==================== 压缩 ====================
+    
+    /**
+     * 获取压缩统计 (压缩率、耗时等)
+     * 压缩由 ClientConfig::compression 启用，连接建立时按 Peer 协商
+     */
+    CompressionStats getCompressionStats() const;
+
+    // ==================== RPC ====================
+
+    /**
+     * 向 Peer 发起 RPC 调用
+     * 优先走直连，没有直连时走中继 (双方都需要支持 RPC)；同一 Peer 可以同时有多个在途调用
+     * @param peerId 目标 Peer ID
+     * @param method 方法名
+     * @param request 请求数据
+     * @param timeout 截止时间，超时后以 RpcStatus::Timeout 完成
+     * @return 调用 id 与结果 future；没有可用连接时 future 立即以 Unavailable 完成
+     */
+    RpcCall call(const std::string& peerId, const std::string& method, ConstBuffer request = {},
+                 std::chrono::milliseconds timeout = std::chrono::seconds(30));
+
+    /**
+     * 文本请求版本
+     */
+    RpcCall call(const std::string& peerId, const std::string& method, std::string_view request,
+                 std::chrono::milliseconds timeout = std::chrono::seconds(30)) {
+        return call(peerId, method, ConstBuffer(request), timeout);
+    }
+
+    /**
+     * 取消尚未完成的调用 (以 RpcStatus::Cancelled 完成，之后到达的响应被丢弃)
+     * @return 调用已经完成时返回 false
+     */
+    bool cancelCall(uint64_t callId);
+
+    /**
+     * 注册 RPC 处理函数，handler 为空时注销
+     * 处理函数在接收线程上同步执行，耗时操作请自行转交其他线程
+     */
+    void registerRpcHandler(const std::string& method, RpcHandler handler);
+
+    /**
+     * 获取各方法的调用统计与延迟直方图 (本端作为调用方)
+     */
+    std::vector<RpcMethodStats> getRpcStats() const;
+
+    // ==================== 多路复用流 ====================
+
+    /**
+     * 打开一个到 Peer 的逻辑流
+     * 所有流共用已有的直连或中继连接 (双方都需要支持)，打开不需要往返协商，数量不受 DataChannel 数目限制
+     * @param peerId 目标 Peer ID
+     * @return 没有可用连接时返回无效的 Stream
+     */
+    Stream openStream(const std::string& peerId);
+
+    /**
+     * 设置对方打开新流时的回调 (未设置时拒绝对方打开的流)
+     */
+    void setOnStream(OnStreamCallback callback);
+
+    // ==================== 发布/订阅 ====================
+
+    /**
+     * 订阅主题，订阅会通告给所有已连接 (直连或中继) 且支持发布/订阅的 Peer
+     * 主题按 '/' 分层，'*' 匹配一层，'#' 放在最后匹配其后任意多层 (例如 "sensors/#")
+     * @param pattern 主题或通配模式
+     * @return 模式不合法时返回 false
+     */
+    bool subscribe(const std::string& pattern);
+
+    /**
+     * 取消订阅 (模式需与 subscribe 时完全一致)
+     */
+    void unsubscribe(const std::string& pattern);
+
+    /**
+     * 发布消息，只发给订阅了该主题的 Peer
+     * @param topic 主题 (不能含通配符)
+     * @param data 消息数据
+     * @return 发送成功的 Peer 数量
+     */
+    size_t publish(const std::string& topic, ConstBuffer data);
+
+    /**
+     * 文本消息版本
+     */
+    size_t publish(const std::string& topic, std::string_view text) {
+        return publish(topic, ConstBuffer(text));
+    }
+
+    /**
+     * 获取订阅了该主题的 Peer
+     */
+    std::vector<std::string> getTopicSubscribers(const std::string& topic) const;
+
+    /**
+     * 设置收到已订阅主题的发布时的回调
+     */
+    void setOnPublication(OnPublicationCallback callback);
+
+    // ==================== 状态同步 ====================
+
+    /**
+     * 设置本端状态中的一个键，同步给所有已连接 (直连或中继) 且支持状态同步的 Peer
+     * 每个周期 (stateSyncInterval) 只发送上次发送之后变化过的键的最新值，新连接的 Peer 先收到全量快照
+     * @param key 键
+     * @param value 值 (与当前值相同时不产生新版本)
+     */
+    void setState(const std::string& key, ConstBuffer value);
+
+    /**
+     * 文本值版本
+     */
+    void setState(const std::string& key, std::string_view text) {
+        setState(key, ConstBuffer(text));
+    }
+
+    /**
+     * 删除本端状态中的一个键
+     */
+    void eraseState(const std::string& key);
+
+    /**
+     * 获取本端状态中的值，不存在时返回空
+     */
+    std::optional<Buffer> getState(const std::string& key) const;
+
+    /**
+     * 获取 Peer 同步过来的值，不存在时返回空
+     */
+    std::optional<Buffer> getPeerState(const std::string& peerId, const std::string& key) const;
+
+    /**
+     * 获取 Peer 同步过来的全部状态 (拷贝)
+     */
+    std::map<std::string, Buffer> getPeerStateMap(const std::string& peerId) const;
+
+    /**
+     * 设置 Peer 的状态发生变化时的回调 (快照到达时只回调实际变化的键)
+     */
+    void setOnStateUpdate(OnStateUpdateCallback callback);
+
+    /**
+     * 获取状态同步统计
+     */
+    StateSyncStats getStateSyncStats() const;
+
     // ==================== 序列化辅助方法 ====================
     
     /**
      * 发送可序列化对象 (模板方法)
-     * 需要对象实现 serialize() 方法返回 BinaryData 或 std::string
+     * 用 P2P_SCHEMA 声明字段的类型：字段直接写入发送帧，不经过中间序列化 (接收端用 ObjectRouter / decodeObject)
+     * 其他类型需要实现 serialize() 方法返回 BinaryData 或 std::string
      */
     template<typename T>
     bool sendObject(const std::string& peerId, const T& obj) {
-        if constexpr (std::is_same_v<decltype(obj.serialize()), std::string>) {
+        if constexpr (schema::isSchema<T>) {
+            schema::Gather<T> gather(obj);
+            return sendv(peerId, gather.parts(), gather.count());
+        } else if constexpr (std::is_same_v<decltype(obj.serialize()), std::string>) {
             return sendText(peerId, obj.serialize());
         } else {
             return sendBinary(peerId, obj.serialize());
         }
     }
+
+    /**
+     * 通过服务器中继发送 P2P_SCHEMA 声明的对象
+     */
+    template<typename T>
+    bool sendObjectViaRelay(const std::string& peerId, const T& obj) {
+        schema::Gather<T> gather(obj);
+        return sendvViaRelay(peerId, gather.parts(), gather.count());
+    }
     
     // ==================== 回调设置 ====================
     
@@ -346,6 +563,14 @@ public:
      */
     void setOnMessage(OnMessageCallback callback);
     
+    /**
+     * 设置接收二进制消息回调 (池化缓冲区版本)
+     * 
+     * 数据位于线程本地缓冲池中，拷贝 Buffer 即可零拷贝地长期持有；
+     * 只设置此回调时接收路径不会为每条消息分配新的内存。
+     */
+    void setOnBufferMessage(OnBufferMessageCallback callback);
+    
     /**
      * 设置 Peer 列表更新回调
      */
@@ -390,6 +615,11 @@ public:
     static std::string getVersion();
     
 private:
+    friend class Gateway;
+    
+    // 网关端点 (由 Gateway::createEndpoint 创建)
+    P2PClient(const ClientConfig& config, std::shared_ptr<GatewayImpl> gateway);
+    
     std::unique_ptr<P2PClientImpl> impl_;
 };
 
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "export.hpp"
+#include <cstdint>
+#include <future>
+#include <vector>
+
+namespace p2p {
+
+// 库全局初始化选项
+struct InitOptions {
+    int logLevel = -1;             // 日志级别 (同 P2PClient::setLogLevel)，-1 表示不修改
+    std::vector<int> networkCpus;  // libdatachannel 线程池与 I/O 线程的 CPU (同 ClientConfig::threading.networkCpus)
+};
+
+// 库全局初始化统计
+struct RuntimeStats {
+    bool initialized = false;  // libdatachannel 已预加载且尚未 shutdown
+    uint64_t initMicros = 0;   // 最近一次预加载的耗时 (libdatachannel / OpenSSL / usrsctp 初始化、创建线程)
+};
+
+/**
+ * 预加载网络库 (可选)
+ *
+ * 不调用时，libdatachannel 在第一个客户端 connect() 时按需初始化，初始化耗时计入这次连接。
+ * 在启动阶段 (或后台线程) 调用 initialize() 可以把这部分开销移出连接的关键路径。
+ * 重复调用是安全的，已初始化时只应用日志级别。
+ */
+P2P_API void initialize(const InitOptions& options = InitOptions());
+
+/**
+ * 释放网络库的全局资源 (线程池、I/O 线程)
+ *
+ * 需在所有 P2PClient / Gateway 销毁之后调用；清理在后台进行，返回的 future 就绪表示清理完成。
+ * 之后仍可再次 initialize() 或创建客户端。
+ */
+P2P_API std::shared_future<void> shutdown();
+
+P2P_API RuntimeStats getRuntimeStats();
+
+} // namespace p2p
@@ -0,0 +1,362 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * 声明消息结构的字段列表 (写在结构体内部)
+ *
+ * @code
+ * struct Position {
+ *     uint32_t entity;
+ *     float x, y, z;
+ *     std::string_view name;            // 接收时指向收到的数据，不拷贝
+ *     p2p::ArrayView<uint16_t> tags;    // 同上；也可以用 std::string / std::vector 接收拷贝
+ *     P2P_SCHEMA(0x0101, entity, x, y, z, name, tags)
+ * };
+ * @endcode
+ *
+ * typeId 在应用内唯一，接收端据此分发 (见 ObjectRouter)。
+ */
+#define P2P_SCHEMA(typeId, ...)                                          \
+    static constexpr uint32_t kSchemaTypeId = (typeId);                  \
+    auto schemaFields() { return std::tie(__VA_ARGS__); }                \
+    auto schemaFields() const { return std::tie(__VA_ARGS__); }
+
+namespace p2p {
+
+/**
+ * 平凡可拷贝元素的只读数组视图
+ *
+ * 发送时指向本地数组；接收时直接指向收到的数据 (不保证对齐，元素按值读取)。
+ */
+template <typename T>
+class ArrayView {
+    static_assert(std::is_trivially_copyable_v<T>, "ArrayView elements must be trivially copyable");
+
+public:
+    using value_type = T;
+
+    ArrayView() = default;
+    ArrayView(const T* data, size_t count) : bytes_(reinterpret_cast<const uint8_t*>(data)), count_(count) {}
+    ArrayView(const std::vector<T>& values) : ArrayView(values.data(), values.size()) {}
+
+    static ArrayView fromBytes(const uint8_t* bytes, size_t count) {
+        ArrayView view;
+        view.bytes_ = bytes;
+        view.count_ = count;
+        return view;
+    }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    const uint8_t* bytes() const { return bytes_; }
+
+    T operator[](size_t i) const {
+        T value;
+        std::memcpy(&value, bytes_ + i * sizeof(T), sizeof(T));
+        return value;
+    }
+
+    std::vector<T> toVector() const {
+        std::vector<T> values(count_);
+        if (count_ > 0) std::memcpy(values.data(), bytes_, count_ * sizeof(T));
+        return values;
+    }
+
+private:
+    const uint8_t* bytes_ = nullptr;
+    size_t count_ = 0;
+};
+
+namespace schema {
+
+/**
+ * 编码格式 (主机字节序，支持的平台均为小端)：
+ *   [类型 ID u32][字段...]
+ *   平凡可拷贝字段按内存表示原样写出；字符串和数组为 [元素数 u32][元素...]；嵌套结构依次写出其字段 (不带类型 ID)
+ */
+constexpr size_t kTypeIdSize = sizeof(uint32_t);
+constexpr size_t kLengthSize = sizeof(uint32_t);
+
+template <typename T, typename = void>
+struct IsSchema : std::false_type {};
+template <typename T>
+struct IsSchema<T, std::void_t<decltype(T::kSchemaTypeId)>> : std::true_type {};
+template <typename T>
+constexpr bool isSchema = IsSchema<T>::value;
+
+template <typename T> struct IsVector : std::false_type {};
+template <typename T, typename A> struct IsVector<std::vector<T, A>> : std::true_type {};
+template <typename T> struct IsArrayView : std::false_type {};
+template <typename T> struct IsArrayView<ArrayView<T>> : std::true_type {};
+
+template <typename T>
+constexpr bool isString = std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>;
+
+// 变长字段：字符串、数组
+template <typename T>
+constexpr bool isVariable = isString<T> || IsVector<T>::value || IsArrayView<T>::value;
+
+template <typename T>
+using FieldsOf = decltype(std::declval<const T&>().schemaFields());
+
+template <typename Tuple, size_t I>
+using FieldType = std::remove_cv_t<std::remove_reference_t<std::tuple_element_t<I, Tuple>>>;
+
+// 编码一个对象需要的分段数 (编译期)
+template <typename T>
+constexpr size_t partCount();
+
+template <typename T, size_t... I>
+constexpr size_t fieldPartCount(std::index_sequence<I...>) {
+    return (size_t(0) + ... + partCount<FieldType<FieldsOf<T>, I>>());
+}
+
+template <typename T>
+constexpr size_t partCount() {
+    if constexpr (isSchema<T>) {
+        return fieldPartCount<T>(std::make_index_sequence<std::tuple_size_v<FieldsOf<T>>>());
+    } else if constexpr (isVariable<T>) {
+        return 2;
+    } else {
+        static_assert(std::is_trivially_copyable_v<T>, "Unsupported schema field type");
+        return 1;
+    }
+}
+
+template <typename T>
+constexpr size_t variableCount();
+
+template <typename T, size_t... I>
+constexpr size_t fieldVariableCount(std::index_sequence<I...>) {
+    return (size_t(0) + ... + variableCount<FieldType<FieldsOf<T>, I>>());
+}
+
+template <typename T>
+constexpr size_t variableCount() {
+    if constexpr (isSchema<T>) {
+        return fieldVariableCount<T>(std::make_index_sequence<std::tuple_size_v<FieldsOf<T>>>());
+    } else {
+        return isVariable<T> ? 1 : 0;
+    }
+}
+
+template <typename T>
+const uint8_t* elementBytes(const T& field, size_t& count, size_t& elementSize) {
+    if constexpr (isString<T>) {
+        count = field.size();
+        elementSize = 1;
+        return reinterpret_cast<const uint8_t*>(field.data());
+    } else if constexpr (IsArrayView<T>::value) {
+        count = field.size();
+        elementSize = sizeof(typename T::value_type);
+        return field.bytes();
+    } else {
+        using Element = typename T::value_type;
+        static_assert(std::is_trivially_copyable_v<Element>, "Vector elements must be trivially copyable");
+        count = field.size();
+        elementSize = sizeof(Element);
+        return reinterpret_cast<const uint8_t*>(field.data());
+    }
+}
+
+/**
+ * 把对象的各字段收集成分段列表，直接指向对象自身的内存 (只额外保存类型 ID 和长度前缀)
+ * 配合 sendv 使用时，字段只在写入发送帧时拷贝一次。对象在 Gather 使用期间不能修改。
+ */
+template <typename T>
+class Gather {
+    static_assert(isSchema<T>, "Gather requires a type declared with P2P_SCHEMA");
+
+public:
+    explicit Gather(const T& object) : typeId_(T::kSchemaTypeId) {
+        parts_[count_++] = ConstBuffer(&typeId_, sizeof(typeId_));
+        add(object);
+    }
+
+    Gather(const Gather&) = delete;
+    Gather& operator=(const Gather&) = delete;
+
+    const ConstBuffer* parts() const { return parts_; }
+    size_t count() const { return count_; }
+
+    size_t size() const {
+        size_t total = 0;
+        for (size_t i = 0; i < count_; ++i) total += parts_[i].size;
+        return total;
+    }
+
+private:
+    template <typename F>
+    void add(const F& field) {
+        if constexpr (isSchema<F>) {
+            std::apply([this](const auto&... fields) { (add(fields), ...); }, field.schemaFields());
+        } else if constexpr (isVariable<F>) {
+            size_t count = 0;
+            size_t elementSize = 0;
+            const uint8_t* bytes = elementBytes(field, count, elementSize);
+            uint32_t& length = lengths_[lengthCount_++];
+            length = static_cast<uint32_t>(count);
+            parts_[count_++] = ConstBuffer(&length, sizeof(length));
+            parts_[count_++] = ConstBuffer(bytes, count * elementSize);
+        } else {
+            parts_[count_++] = ConstBuffer(&field, sizeof(F));
+        }
+    }
+
+    static constexpr size_t kParts = partCount<T>() + 1;
+    static constexpr size_t kLengths = variableCount<T>() > 0 ? variableCount<T>() : 1;
+
+    uint32_t typeId_;
+    uint32_t lengths_[kLengths] = {};
+    ConstBuffer parts_[kParts];
+    size_t count_ = 0;
+    size_t lengthCount_ = 0;
+};
+
+template <typename F>
+bool decodeField(const uint8_t*& p, const uint8_t* end, F& field) {
+    size_t left = static_cast<size_t>(end - p);
+    if constexpr (isSchema<F>) {
+        return std::apply([&](auto&... fields) { return (decodeField(p, end, fields) && ...); },
+                          field.schemaFields());
+    } else if constexpr (isVariable<F>) {
+        uint32_t count = 0;
+        if (left < kLengthSize) return false;
+        std::memcpy(&count, p, kLengthSize);
+        p += kLengthSize;
+        left -= kLengthSize;
+
+        size_t elementSize = sizeof(typename F::value_type);
+        if (count > left / elementSize) return false;
+        size_t bytes = count * elementSize;
+
+        if constexpr (std::is_same_v<F, std::string_view>) {
+            field = std::string_view(reinterpret_cast<const char*>(p), bytes);
+        } else if constexpr (std::is_same_v<F, std::string>) {
+            field.assign(reinterpret_cast<const char*>(p), bytes);
+        } else if constexpr (IsArrayView<F>::value) {
+            field = F::fromBytes(p, count);
+        } else {
+            field.resize(count);
+            if (bytes > 0) std::memcpy(field.data(), p, bytes);
+        }
+        p += bytes;
+        return true;
+    } else {
+        if (left < sizeof(F)) return false;
+        std::memcpy(&field, p, sizeof(F));
+        p += sizeof(F);
+        return true;
+    }
+}
+
+} // namespace schema
+
+/**
+ * 读取编码数据的类型 ID，数据不足 4 字节时返回 false
+ */
+inline bool peekTypeId(const void* data, size_t size, uint32_t& typeId) {
+    if (size < schema::kTypeIdSize) return false;
+    std::memcpy(&typeId, data, schema::kTypeIdSize);
+    return true;
+}
+
+/**
+ * 编码对象到池化缓冲区 (用于 RPC 请求、状态同步的值等)
+ */
+template <typename T>
+Buffer encodeObject(const T& object) {
+    schema::Gather<T> gather(object);
+    Buffer buffer = Buffer::allocate(gather.size());
+    uint8_t* out = buffer.data();
+    for (size_t i = 0; i < gather.count(); ++i) {
+        if (gather.parts()[i].size > 0) {
+            std::memcpy(out, gather.parts()[i].data, gather.parts()[i].size);
+            out += gather.parts()[i].size;
+        }
+    }
+    return buffer;
+}
+
+/**
+ * 解码对象：类型 ID 不符或数据格式错误时返回 false
+ * string_view / ArrayView 字段指向 data，data 释放后不可再访问
+ */
+template <typename T>
+bool decodeObject(const void* data, size_t size, T& out) {
+    static_assert(schema::isSchema<T>, "decodeObject requires a type declared with P2P_SCHEMA");
+    uint32_t typeId = 0;
+    if (!peekTypeId(data, size, typeId) || typeId != T::kSchemaTypeId) return false;
+    const uint8_t* p = static_cast<const uint8_t*>(data) + schema::kTypeIdSize;
+    const uint8_t* end = static_cast<const uint8_t*>(data) + size;
+    return schema::decodeField(p, end, out) && p == end;
+}
+
+template <typename T>
+bool decodeObject(const Buffer& data, T& out) {
+    return decodeObject(data.data(), data.size(), out);
+}
+
+/**
+ * 按类型 ID 把收到的消息解码并交给对应的处理函数
+ *
+ * @code
+ * p2p::ObjectRouter router;
+ * router.on<Position>([](const std::string& from, const Position& pos) { ... });
+ * client.setOnBufferMessage([&](const std::string& from, const p2p::Buffer& data) {
+ *     if (!router.dispatch(from, data)) { ... }  // 未注册的类型或格式错误
+ * });
+ * @endcode
+ *
+ * 处理函数中对象的 string_view / ArrayView 字段指向收到的数据，需要在回调之后使用时请保留 Buffer 的拷贝。
+ * 注册 (on) 需在开始收消息之前完成，dispatch 可以并发调用。
+ */
+class ObjectRouter {
+public:
+    template <typename T>
+    using Handler = std::function<void(const std::string& peerId, const T& object)>;
+
+    template <typename T>
+    void on(Handler<T> handler) {
+        static_assert(schema::isSchema<T>, "ObjectRouter::on requires a type declared with P2P_SCHEMA");
+        handlers_[T::kSchemaTypeId] = [handler = std::move(handler)](const std::string& peerId,
+                                                                     const uint8_t* data, size_t size) {
+            T object{};
+            if (!decodeObject(data, size, object)) return false;
+            handler(peerId, object);
+            return true;
+        };
+    }
+
+    /**
+     * @return 类型未注册或解码失败时返回 false
+     */
+    bool dispatch(const std::string& peerId, const void* data, size_t size) const {
+        uint32_t typeId = 0;
+        if (!peekTypeId(data, size, typeId)) return false;
+        auto it = handlers_.find(typeId);
+        return it != handlers_.end() && it->second(peerId, static_cast<const uint8_t*>(data), size);
+    }
+
+    bool dispatch(const std::string& peerId, const Buffer& data) const {
+        return dispatch(peerId, data.data(), data.size());
+    }
+
+private:
+    std::unordered_map<uint32_t, std::function<bool(const std::string&, const uint8_t*, size_t)>> handlers_;
+};
+
+} // namespace p2p
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "export.hpp"
+#include "types.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace p2p {
+
+namespace detail {
+struct StreamState;
+}
+
+/**
+ * 多路复用的逻辑流
+ *
+ * 同一 Peer 的所有流共用一条连接 (直连的系统通道或中继)，打开流不需要额外的协商。
+ * 每个流有独立的流控窗口，发送端按轮转方式在有信用的流之间分片发送，
+ * 某个流的接收方处理缓慢只会阻塞这个流本身。
+ *
+ * Stream 是引用计数的句柄，拷贝后指向同一个流；默认构造的 Stream 无效。
+ * 回调在接收线程上执行，请在第一次 write() 之前设置，对方发起的流请在 OnStreamCallback 中设置。
+ */
+class P2P_API Stream {
+public:
+    using OnDataCallback = std::function<void(const Buffer& data)>;
+    using OnCloseCallback = std::function<void()>;
+
+    Stream() = default;
+
+    explicit operator bool() const { return state_ != nullptr; }
+
+    uint64_t id() const;
+    std::string peerId() const;
+
+    /**
+     * 流是否仍可写 (本端未关闭且未被对方关闭)
+     */
+    bool isOpen() const;
+
+    /**
+     * 写入一段数据，数据被拷贝进发送队列后立即返回
+     * @return 流已关闭或排队数据超过 streamSendBuffer 时返回 false
+     */
+    bool write(ConstBuffer data);
+
+    /**
+     * 关闭流：已排队的数据发送完后通知对方
+     */
+    void close();
+
+    /**
+     * 排队尚未发出的字节数
+     */
+    size_t bufferedAmount() const;
+
+    void setOnData(OnDataCallback callback);
+    void setOnClose(OnCloseCallback callback);
+
+private:
+    friend class StreamMux;
+    explicit Stream(std::shared_ptr<detail::StreamState> state) : state_(std::move(state)) {}
+
+    std::shared_ptr<detail::StreamState> state_;
+};
+
+// 对方打开了新的流
+using OnStreamCallback = std::function<void(Stream stream)>;
+
+} // namespace p2p
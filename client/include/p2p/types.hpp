@@ -1,14 +1,19 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <array>
 #include <chrono>
+#include <future>
 #include <optional>
 #include <variant>
 
+#include "buffer.hpp"
+
 namespace p2p {
 
 // 连接状态
@@ -46,7 +51,9 @@ enum class ErrorCode {
     InvalidData,
     InternalError,
     RelayAuthFailed,      // 中继认证失败
-    RelayNotAuthenticated // 未进行中继认证
+    RelayNotAuthenticated,// 未进行中继认证
+    RateLimited,          // 被服务端限流
+    WouldBlock            // 发送缓冲区已满，稍后重试
 };
 
 // 错误信息
@@ -60,6 +67,18 @@ struct Error {
 // 二进制数据类型
 using BinaryData = std::vector<uint8_t>;
 
+// 只读数据段 (类似 iovec)，用于 sendv 分段发送
+struct ConstBuffer {
+    const void* data = nullptr;
+    size_t size = 0;
+    
+    ConstBuffer() = default;
+    ConstBuffer(const void* ptr, size_t length) : data(ptr), size(length) {}
+    ConstBuffer(const BinaryData& bytes) : data(bytes.data()), size(bytes.size()) {}
+    ConstBuffer(const Buffer& buffer) : data(buffer.data()), size(buffer.size()) {}
+    ConstBuffer(std::string_view str) : data(str.data()), size(str.size()) {}
+};
+
 // 消息类型 - 可以是文本或二进制
 struct Message {
     enum class Type { Text, Binary };
@@ -67,6 +86,7 @@ struct Message {
     Type type;
     std::string text;
     BinaryData binary;
+    Buffer buffer;  // 接收到的二进制数据的池化副本 (与 binary 内容相同，可零拷贝长期持有)
     
     // 构造文本消息
     static Message fromText(const std::string& str) {
@@ -84,6 +104,25 @@ struct Message {
         return msg;
     }
     
+    static Message fromBinary(BinaryData&& data) {
+        Message msg;
+        msg.type = Type::Binary;
+        msg.binary = std::move(data);
+        return msg;
+    }
+    
+    // 构造基于池化缓冲区的二进制消息 (binary 为空)
+    static Message fromBuffer(Buffer data) {
+        Message msg;
+        msg.type = Type::Binary;
+        msg.buffer = std::move(data);
+        return msg;
+    }
+    
+    // 二进制内容，优先使用 binary，为空时使用 buffer
+    const uint8_t* bytes() const { return binary.empty() ? buffer.data() : binary.data(); }
+    size_t bytesSize() const { return binary.empty() ? buffer.size() : binary.size(); }
+    
     static Message fromBinary(const void* data, size_t size) {
         Message msg;
         msg.type = Type::Binary;
@@ -98,10 +137,142 @@ struct PeerInfo {
     std::string id;
     ChannelState channelState;
     bool relayMode = false;  // 是否通过中继连接
+    std::string transport;   // 直连消息当前使用的传输 ("lan"、"webrtc"；中继连接时为 "relay")
     bool isConnected() const { return channelState == ChannelState::Open; }
 };
 
 // 客户端配置
+// 消息压缩编解码器
+enum class Compression {
+    None,   // 不压缩
+    LZ4,    // 速度优先
+    Zstd    // 压缩率优先
+};
+
+// 压缩统计 (所有 Peer 合计)
+struct CompressionStats {
+    uint64_t messagesCompressed = 0;     // 压缩后发送的消息数
+    uint64_t messagesUncompressed = 0;   // 已协商但低于阈值或压缩无收益、原样发送的消息数
+    uint64_t bytesIn = 0;                // 被压缩消息的原始字节数
+    uint64_t bytesOut = 0;               // 被压缩消息压缩后的字节数
+    uint64_t messagesDecompressed = 0;   // 解压的消息数
+    uint64_t compressMicros = 0;         // 压缩耗时
+    uint64_t decompressMicros = 0;       // 解压耗时
+    
+    // 压缩率 (原始字节 / 压缩后字节)
+    double ratio() const {
+        return bytesOut > 0 ? static_cast<double>(bytesIn) / static_cast<double>(bytesOut) : 1.0;
+    }
+};
+
+// RPC 调用状态
+enum class RpcStatus : uint8_t {
+    Ok = 0,
+    Error,        // 处理函数返回了错误
+    NotFound,     // 对方没有注册该方法
+    Timeout,      // 截止时间前没有收到响应
+    Cancelled,    // 本端已取消
+    Unavailable   // 与对方没有支持 RPC 的直连或中继连接 (新增状态时同步修改 rpc.cpp 中响应的范围检查)
+};
+
+// RPC 结果：调用方收到的响应，也是处理函数的返回值
+struct RpcResult {
+    RpcStatus status = RpcStatus::Ok;
+    Buffer payload;      // 响应数据
+    std::string error;   // 失败原因
+    
+    bool ok() const { return status == RpcStatus::Ok; }
+    
+    // 以文本形式查看响应数据 (不拷贝)
+    std::string_view text() const {
+        return std::string_view(reinterpret_cast<const char*>(payload.data()), payload.size());
+    }
+    
+    static RpcResult success(ConstBuffer data = {}) {
+        RpcResult result;
+        result.payload = Buffer::copyOf(data.data, data.size);
+        return result;
+    }
+    
+    static RpcResult failure(std::string message, RpcStatus status = RpcStatus::Error) {
+        RpcResult result;
+        result.status = status;
+        result.error = std::move(message);
+        return result;
+    }
+};
+
+// 已发起的 RPC 调用，id 用于 cancelCall()
+struct RpcCall {
+    uint64_t id = 0;
+    std::future<RpcResult> result;
+};
+
+// 单个方法的调用统计 (本端作为调用方)
+struct RpcMethodStats {
+    static constexpr size_t kBuckets = 32;
+    
+    std::string method;
+    uint64_t calls = 0;       // 发起的调用数
+    uint64_t succeeded = 0;
+    uint64_t failed = 0;      // Error / NotFound / Unavailable
+    uint64_t timeouts = 0;
+    uint64_t cancelled = 0;
+    
+    // 成功调用的往返延迟直方图：第 i 个桶统计 [2^i, 2^(i+1)) 微秒 (第 0 个桶含 0)
+    std::array<uint64_t, kBuckets> histogram{};
+    
+    // 按直方图估算的延迟分位数 (微秒，取桶上界)，p 取 0~1
+    uint64_t percentileMicros(double p) const {
+        uint64_t total = 0;
+        for (uint64_t count : histogram) total += count;
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += histogram[i];
+            if (seen >= rank) return (uint64_t(1) << (i + 1)) - 1;
+        }
+        return UINT64_MAX;
+    }
+};
+
+// 断开连接的统计 (disconnectAsync 返回)
+struct DisconnectStats {
+    size_t peerConnections = 0;  // 关闭的 PeerConnection 数
+    size_t relayPeers = 0;       // 通知断开的中继 Peer 数
+    uint64_t closeMicros = 0;    // 关闭 PeerConnection 的耗时
+    uint64_t totalMicros = 0;    // 断开的总耗时
+};
+
+// 与一个 Peer 之间某个传输的统计 (getTransportStats 返回，每个传输一项)
+struct TransportStats {
+    std::string transport;          // "lan"、"webrtc" 或 "relay"
+    bool open = false;
+    bool selected = false;          // 直连消息当前经由此传输发送
+    uint64_t messagesSent = 0;
+    uint64_t bytesSent = 0;         // 线上字节数 (压缩后、含帧头；中继为 JSON payload)
+    uint64_t messagesReceived = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t sendFailures = 0;
+    size_t bufferedAmount = 0;      // 已提交尚未发出 (可靠中继为尚未确认) 的字节数
+    uint64_t rttMicros = 0;         // 测得的往返时延，0 表示未测得
+    uint64_t writeCalls = 0;        // 发送用的系统调用次数 (局域网传输合并发送，其他传输为 0)
+};
+
+// 状态同步统计
+struct StateSyncStats {
+    uint64_t version = 0;          // 本端键值表的当前版本
+    size_t keys = 0;               // 本端键数 (不含已删除的)
+    size_t peers = 0;              // 同步中的 Peer 数
+    uint64_t snapshotsSent = 0;    // 发出的快照批次 (新连接的 Peer 或增量无法补齐时)
+    uint64_t deltasSent = 0;       // 发出的增量批次
+    uint64_t entriesSent = 0;      // 各批次包含的条目数合计
+    uint64_t bytesSent = 0;        // 各批次的帧字节数合计
+    uint64_t updatesReceived = 0;  // 应用到 Peer 副本上的变更数
+    uint64_t resyncs = 0;          // 对方发现缺失批次、要求重发的次数
+};
+
 struct ClientConfig {
     // 信令服务器URL
     std::string signalingUrl = "ws://localhost:8080";
@@ -129,6 +300,53 @@ struct ClientConfig {
     // 自动重连
     bool autoReconnect = false;
     uint32_t reconnectInterval = 5000;
+    
+    // 消息压缩 (建立直连或中继连接时按 Peer 协商，双方都启用才生效)
+    Compression compression = Compression::None;  // 优先使用的编解码器，对方不支持时退回双方都支持的
+    int compressionLevel = 0;                     // 0 表示编解码器默认级别
+    size_t compressionThreshold = 256;            // 小于该字节数的消息不压缩
+    BinaryData compressionDictionary;             // 预置字典 (可选)，双方字典一致时使用，适合大量重复的小消息
+    
+    // 可靠中继 (建立中继连接时协商，双方都启用才生效)：中继消息带序号和确认，
+    // 信令连接短暂断开后在服务端宽限期内重新 connect() 即可恢复中继会话，期间的消息不会丢失
+    size_t relayRetransmitBuffer = 4 * 1024 * 1024;  // 每个 Peer 未确认消息的缓冲上限 (字节)，0 表示关闭
+    
+    // 中继流控 (依赖可靠中继)：接收端按字节授予发送信用，每个方向在途数据不超过一个窗口
+    size_t relayWindow = 1024 * 1024;  // 本端接收窗口 (字节)，0 表示不限制对方
+    uint32_t relaySendTimeout = 0;     // 信用不足时 sendXxxViaRelay 最多等待的毫秒数，0 表示立即返回 false
+    
+    // 多路复用流 (openStream)：每个流独立的接收窗口与发送缓冲区
+    size_t streamWindow = 256 * 1024;        // 每个流的接收窗口 (字节)，不小于 64KB
+    size_t streamSendBuffer = 1024 * 1024;   // 每个流排队待发送的上限 (字节)，超过时 write 返回 false
+    
+    // 状态同步 (setState)：一个周期内的修改合并为一批增量发出
+    uint32_t stateSyncInterval = 50;  // 毫秒，0 表示每次修改立即发送
+    
+    // 线程与 CPU 绑定 (CPU 编号列表，为空表示不限制)：把网络线程与应用线程隔离到不同的核上
+    struct Threading {
+        // libdatachannel 线程池与 I/O 线程的 CPU；线程数由 libdatachannel 按核数决定，
+        // 只在进程内首次初始化 libdatachannel 之前 (第一个客户端构造时) 生效
+        std::vector<int> networkCpus;
+        // 消息与 Peer 事件回调的分发线程数，0 表示直接在网络线程上回调；
+        // 大于 0 时同一 Peer 的回调按顺序在同一分发线程上执行
+        size_t dispatchThreads = 0;
+        // 分发线程与客户端内部线程 (RPC 计时、状态同步) 的 CPU
+        std::vector<int> dispatchCpus;
+        // 客户端创建的线程名前缀 (Linux 上线程名最长 15 字符)
+        std::string threadName = "p2p";
+    };
+    Threading threading;
+    
+    // 局域网直连 (双方都启用才生效)：在 offer/answer 中交换本机地址，能直接建立 TCP 连接时
+    // 直连消息改走 TCP，绕过 DTLS/SCTP；WebRTC 连接照常建立，局域网连接断开时自动退回。
+    // 数据不加密，只应在可信网络中启用；目前只支持 POSIX 平台
+    struct Lan {
+        bool enabled = false;
+        std::string bindAddress;                  // 监听地址，为空表示所有 IPv4 地址
+        uint16_t port = 0;                        // 监听端口，0 表示由系统分配
+        size_t socketBufferSize = 4 * 1024 * 1024;  // SO_SNDBUF / SO_RCVBUF，0 表示系统默认
+    };
+    Lan lan;
 };
 
 // 回调函数类型
@@ -139,10 +357,20 @@ using OnPeerDisconnectedCallback = std::function<void(const std::string& peerId)
 using OnTextMessageCallback = std::function<void(const std::string& peerId, const std::string& message)>;
 using OnBinaryMessageCallback = std::function<void(const std::string& peerId, const BinaryData& data)>;
 using OnMessageCallback = std::function<void(const std::string& peerId, const Message& message)>;
+using OnBufferMessageCallback = std::function<void(const std::string& peerId, const Buffer& data)>;
 using OnPeerListCallback = std::function<void(const std::vector<std::string>& peers)>;
 using OnErrorCallback = std::function<void(const Error& error)>;
 using OnStateChangeCallback = std::function<void(ConnectionState state)>;
 
+// 收到订阅主题的发布
+using OnPublicationCallback = std::function<void(const std::string& peerId, const std::string& topic, const Buffer& data)>;
+
+// Peer 的同步状态发生变化，value 为空表示该键已删除
+using OnStateUpdateCallback = std::function<void(const std::string& peerId, const std::string& key, const std::optional<Buffer>& value)>;
+
+// RPC 处理函数：在接收线程上同步执行，返回值作为响应发回调用方
+using RpcHandler = std::function<RpcResult(const std::string& peerId, const Buffer& request)>;
+
 // 中继相关回调
 using OnRelayAuthResultCallback = std::function<void(bool success, const std::string& message)>;
 using OnRelayConnectedCallback = std::function<void(const std::string& peerId)>;
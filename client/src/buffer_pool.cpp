@@ -0,0 +1,350 @@
+#include "p2p/buffer.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace p2p {
+
+// ==================== 分级缓冲池 ====================
+
+namespace {
+
+constexpr size_t kMinClassShift = 8;                     // 最小 256B
+constexpr size_t kNumClasses = 13;                       // 256B ~ 1MB
+constexpr size_t kMaxCachedBytesPerClass = 4 * 1024 * 1024;
+constexpr uint32_t kOversized = UINT32_MAX;
+
+std::atomic<uint64_t> gCacheHits{0};
+std::atomic<uint64_t> gCacheMisses{0};
+std::atomic<uint64_t> gOversized{0};
+std::atomic<uint64_t> gReleased{0};
+std::atomic<uint64_t> gRemoteReleased{0};
+
+size_t classCapacity(uint32_t sizeClass) {
+    return size_t(1) << (kMinClassShift + sizeClass);
+}
+
+uint32_t sizeClassFor(size_t size) {
+    uint32_t sizeClass = 0;
+    while (sizeClass < kNumClasses && classCapacity(sizeClass) < size) {
+        ++sizeClass;
+    }
+    return sizeClass < kNumClasses ? sizeClass : kOversized;
+}
+
+size_t maxCachedBlocks(uint32_t sizeClass) {
+    size_t count = kMaxCachedBytesPerClass / classCapacity(sizeClass);
+    return count < 4 ? 4 : count;
+}
+
+} // namespace
+
+namespace detail {
+
+struct CacheOwner;
+
+struct alignas(16) BufferBlock {
+    std::atomic<long> refs{1};
+    uint32_t sizeClass = 0;
+    size_t capacity = 0;
+    CacheOwner* owner = nullptr;  // 分配该块的线程缓存，超大块为空
+    BufferBlock* next = nullptr;  // 在 CacheOwner::remote 链表中时使用
+
+    uint8_t* bytes() { return reinterpret_cast<uint8_t*>(this + 1); }
+
+    static BufferBlock* create(uint32_t sizeClass, size_t capacity) {
+        void* memory = ::operator new(sizeof(BufferBlock) + capacity);
+        BufferBlock* block = new (memory) BufferBlock();
+        block->sizeClass = sizeClass;
+        block->capacity = capacity;
+        return block;
+    }
+
+    static void destroy(BufferBlock* block) {
+        block->~BufferBlock();
+        ::operator delete(block);
+    }
+};
+
+// 线程缓存的跨线程归还入口。其他线程释放的块压入分配线程的 remote 链表 (无锁栈)，
+// 分配线程在本地缓存耗尽时整体取走；生产者/消费者模式下块不会堆积在释放线程。
+// 对象从不释放，线程退出后关闭链表并留给之后的新线程复用，因此块上的 owner 指针始终有效
+struct CacheOwner {
+    std::array<std::atomic<BufferBlock*>, kNumClasses> remote{};
+    std::array<std::atomic<size_t>, kNumClasses> remoteCount{};
+};
+
+} // namespace detail
+
+using detail::BufferBlock;
+using detail::CacheOwner;
+
+namespace {
+
+// 线程已退出，remote 链表不再接收
+BufferBlock* const kClosed = reinterpret_cast<BufferBlock*>(alignof(BufferBlock));
+
+// 已退出线程留下的 CacheOwner；不析构，进程退出时仍在运行的线程也可以归还
+struct OwnerRegistry {
+    std::mutex mutex;
+    std::vector<CacheOwner*> idle;
+};
+
+OwnerRegistry& ownerRegistry() {
+    static auto* registry = new OwnerRegistry();
+    return *registry;
+}
+
+CacheOwner* acquireOwner() {
+    CacheOwner* owner = nullptr;
+    {
+        auto& registry = ownerRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (!registry.idle.empty()) {
+            owner = registry.idle.back();
+            registry.idle.pop_back();
+        }
+    }
+    if (!owner) {
+        owner = new CacheOwner();
+    }
+    for (size_t i = 0; i < kNumClasses; ++i) {
+        owner->remoteCount[i].store(0, std::memory_order_relaxed);
+        owner->remote[i].store(nullptr, std::memory_order_release);
+    }
+    return owner;
+}
+
+// 压入 owner 的 remote 链表；链表已关闭或已满时返回 false
+bool pushRemote(CacheOwner* owner, BufferBlock* block) {
+    uint32_t sizeClass = block->sizeClass;
+    if (owner->remoteCount[sizeClass].fetch_add(1, std::memory_order_relaxed) >= maxCachedBlocks(sizeClass)) {
+        owner->remoteCount[sizeClass].fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    auto& head = owner->remote[sizeClass];
+    BufferBlock* expected = head.load(std::memory_order_relaxed);
+    do {
+        if (expected == kClosed) {
+            return false;  // 计数随 acquireOwner() 重置
+        }
+        block->next = expected;
+    } while (!head.compare_exchange_weak(expected, block, std::memory_order_release, std::memory_order_relaxed));
+    return true;
+}
+
+// 线程本地缓存：块回到分配它的线程的缓存，本线程分配的直接入本地空闲表，
+// 其他线程分配的经 CacheOwner 归还
+struct ThreadCache {
+    std::array<std::vector<BufferBlock*>, kNumClasses> freeLists;
+    CacheOwner* owner = acquireOwner();
+
+    // 取走其他线程归还的块，返回是否取到
+    bool drainRemote(uint32_t sizeClass);
+
+    ~ThreadCache();
+};
+
+// 线程退出时缓存先于部分 Buffer 析构，此后释放的块直接归还系统
+enum class CacheState : uint8_t { Uninitialized, Alive, Destroyed };
+thread_local CacheState tCacheState = CacheState::Uninitialized;
+
+ThreadCache* threadCache() {
+    if (tCacheState == CacheState::Destroyed) {
+        return nullptr;
+    }
+    thread_local ThreadCache cache;
+    tCacheState = CacheState::Alive;
+    return &cache;
+}
+
+bool ThreadCache::drainRemote(uint32_t sizeClass) {
+    auto& head = owner->remote[sizeClass];
+    if (head.load(std::memory_order_relaxed) == nullptr) {
+        return false;
+    }
+    BufferBlock* block = head.exchange(nullptr, std::memory_order_acquire);
+    auto& list = freeLists[sizeClass];
+    size_t count = 0;
+    while (block) {
+        BufferBlock* next = block->next;
+        ++count;
+        if (list.size() < maxCachedBlocks(sizeClass)) {
+            try {
+                list.push_back(block);
+                block = next;
+                continue;
+            } catch (...) {
+            }
+        }
+        BufferBlock::destroy(block);
+        block = next;
+    }
+    owner->remoteCount[sizeClass].fetch_sub(count, std::memory_order_relaxed);
+    return !list.empty();
+}
+
+ThreadCache::~ThreadCache() {
+    tCacheState = CacheState::Destroyed;
+    for (size_t i = 0; i < kNumClasses; ++i) {
+        BufferBlock* block = owner->remote[i].exchange(kClosed, std::memory_order_acquire);
+        while (block) {
+            BufferBlock* next = block->next;
+            BufferBlock::destroy(block);
+            block = next;
+        }
+    }
+    for (auto& list : freeLists) {
+        for (auto* block : list) {
+            BufferBlock::destroy(block);
+        }
+        list.clear();
+    }
+    auto& registry = ownerRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.idle.push_back(owner);
+}
+
+} // namespace
+
+Buffer::Buffer(BufferBlock* block, size_t size) noexcept
+    : block_(block), data_(block->bytes()), size_(size) {}
+
+Buffer::Buffer(const Buffer& other) noexcept
+    : block_(other.block_), data_(other.data_), size_(other.size_) {
+    if (block_) {
+        block_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+Buffer::Buffer(Buffer&& other) noexcept
+    : block_(std::exchange(other.block_, nullptr))
+    , data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0)) {}
+
+Buffer& Buffer::operator=(const Buffer& other) noexcept {
+    if (this != &other) {
+        Buffer copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+Buffer& Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        block_ = std::exchange(other.block_, nullptr);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+Buffer::~Buffer() {
+    release();
+}
+
+Buffer Buffer::allocate(size_t size) {
+    if (size == 0) {
+        return Buffer();
+    }
+
+    uint32_t sizeClass = sizeClassFor(size);
+    if (sizeClass == kOversized) {
+        gOversized.fetch_add(1, std::memory_order_relaxed);
+        return Buffer(BufferBlock::create(kOversized, size), size);
+    }
+
+    ThreadCache* cache = threadCache();
+    if (cache && (!cache->freeLists[sizeClass].empty() || cache->drainRemote(sizeClass))) {
+        auto& list = cache->freeLists[sizeClass];
+        BufferBlock* block = list.back();
+        list.pop_back();
+        block->refs.store(1, std::memory_order_relaxed);
+        block->owner = cache->owner;
+        gCacheHits.fetch_add(1, std::memory_order_relaxed);
+        return Buffer(block, size);
+    }
+
+    gCacheMisses.fetch_add(1, std::memory_order_relaxed);
+    BufferBlock* block = BufferBlock::create(sizeClass, classCapacity(sizeClass));
+    block->owner = cache ? cache->owner : nullptr;
+    return Buffer(block, size);
+}
+
+Buffer Buffer::copyOf(const void* data, size_t size) {
+    Buffer buffer = allocate(size);
+    if (size > 0) {
+        std::memcpy(buffer.data(), data, size);
+    }
+    return buffer;
+}
+
+size_t Buffer::capacity() const noexcept {
+    return block_ ? block_->capacity : 0;
+}
+
+void Buffer::resize(size_t newSize) noexcept {
+    if (block_ && newSize <= block_->capacity) {
+        size_ = newSize;
+    }
+}
+
+long Buffer::useCount() const noexcept {
+    return block_ ? block_->refs.load(std::memory_order_relaxed) : 0;
+}
+
+void Buffer::release() noexcept {
+    BufferBlock* block = std::exchange(block_, nullptr);
+    data_ = nullptr;
+    size_ = 0;
+
+    if (!block || block->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    if (block->sizeClass == kOversized) {
+        BufferBlock::destroy(block);
+        return;
+    }
+    ThreadCache* cache = threadCache();
+    if (block->owner && (!cache || block->owner != cache->owner)) {
+        if (pushRemote(block->owner, block)) {
+            gReleased.fetch_add(1, std::memory_order_relaxed);
+            gRemoteReleased.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // 分配线程已退出或其归还链表已满：按本线程的块处理
+    }
+    if (cache) {
+        block->owner = cache->owner;
+        auto& list = cache->freeLists[block->sizeClass];
+        if (list.size() < maxCachedBlocks(block->sizeClass)) {
+            try {
+                list.push_back(block);
+                gReleased.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } catch (...) {
+                // 缓存扩容失败时直接释放
+            }
+        }
+    }
+    BufferBlock::destroy(block);
+}
+
+Buffer::PoolStats Buffer::poolStats() {
+    PoolStats stats;
+    stats.cacheHits = gCacheHits.load(std::memory_order_relaxed);
+    stats.cacheMisses = gCacheMisses.load(std::memory_order_relaxed);
+    stats.oversized = gOversized.load(std::memory_order_relaxed);
+    stats.released = gReleased.load(std::memory_order_relaxed);
+    stats.remoteReleased = gRemoteReleased.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace p2p
@@ -0,0 +1,47 @@
+// client/src/callback_slot.hpp
+#pragma once
+
+#include <memory>
+#include <utility>
+
+namespace p2p {
+
+/**
+ * 可在任意线程替换的回调
+ *
+ * 回调以不可变的 shared_ptr 发布，set() 原子地替换指针，调用方原子地取得快照后执行，
+ * 网络线程执行回调的同时应用可以安全地重新设置或清除它 (正在执行的旧回调执行完才释放)。
+ * 调用时不持有任何锁，回调中可以调用客户端的任意方法。
+ */
+template<typename F>
+class CallbackSlot {
+public:
+    void set(F callback) {
+        std::shared_ptr<const F> next;
+        if (callback) {
+            next = std::make_shared<const F>(std::move(callback));
+        }
+        std::atomic_store(&callback_, std::move(next));
+    }
+
+    std::shared_ptr<const F> get() const {
+        return std::atomic_load(&callback_);
+    }
+
+    explicit operator bool() const {
+        return get() != nullptr;
+    }
+
+    // 取快照后调用，未设置时什么都不做
+    template<typename... Args>
+    void operator()(Args&&... args) const {
+        if (auto callback = get()) {
+            (*callback)(std::forward<Args>(args)...);
+        }
+    }
+
+private:
+    std::shared_ptr<const F> callback_;
+};
+
+} // namespace p2p
@@ -0,0 +1,376 @@
+#include "compression.hpp"
+#include "frames.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef P2P_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef P2P_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace p2p {
+
+namespace {
+
+constexpr uint8_t kCodecMask = 0x07;
+constexpr uint8_t kDictionaryFlag = 0x08;
+constexpr uint8_t kTextFlag = 0x80;
+constexpr uint64_t kMaxOriginalSize = 64 * 1024 * 1024;  // 拒绝解压出超大消息
+
+// 编译时可用的编解码器
+const std::vector<Compression>& availableCodecs() {
+    static const std::vector<Compression> codecs = {
+#ifdef P2P_HAVE_LZ4
+        Compression::LZ4,
+#endif
+#ifdef P2P_HAVE_ZSTD
+        Compression::Zstd,
+#endif
+    };
+    return codecs;
+}
+
+bool isAvailable(Compression codec) {
+    for (Compression available : availableCodecs()) {
+        if (available == codec) return true;
+    }
+    return false;
+}
+
+const char* codecName(Compression codec) {
+    switch (codec) {
+        case Compression::LZ4: return "lz4";
+        case Compression::Zstd: return "zstd";
+        default: return "none";
+    }
+}
+
+uint8_t codecId(Compression codec) {
+    switch (codec) {
+        case Compression::LZ4: return 1;
+        case Compression::Zstd: return 2;
+        default: return 0;
+    }
+}
+
+Compression codecFromId(uint8_t id) {
+    switch (id) {
+        case 1: return Compression::LZ4;
+        case 2: return Compression::Zstd;
+        default: return Compression::None;
+    }
+}
+
+// 字典标识：FNV-1a 64 位哈希的十六进制
+std::string dictionaryId(const BinaryData& dictionary) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : dictionary) {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+    static const char* hex = "0123456789abcdef";
+    std::string id(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        id[static_cast<size_t>(i)] = hex[hash & 0xF];
+        hash >>= 4;
+    }
+    return id;
+}
+
+uint64_t microsSince(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+#ifdef P2P_HAVE_LZ4
+// 带字典压缩需要流状态 (约 16KB)，每线程复用一个
+LZ4_stream_t* lz4Stream() {
+    struct Holder {
+        LZ4_stream_t* stream = LZ4_createStream();
+        ~Holder() { LZ4_freeStream(stream); }
+    };
+    thread_local Holder holder;
+    return holder.stream;
+}
+#endif
+
+#ifdef P2P_HAVE_ZSTD
+struct ZstdContexts {
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+};
+
+ZstdContexts& zstdContexts() {
+    thread_local ZstdContexts contexts;
+    return contexts;
+}
+#endif
+
+} // namespace
+
+// 预处理过的字典 (Zstd 需要单独构建，LZ4 直接使用原始字典)
+struct Compressor::Dictionaries {
+#ifdef P2P_HAVE_ZSTD
+    ZSTD_CDict* cdict = nullptr;
+    ZSTD_DDict* ddict = nullptr;
+
+    ~Dictionaries() {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+    }
+#endif
+};
+
+Compressor::Compressor(const ClientConfig& config)
+    : level_(config.compressionLevel)
+    , threshold_(config.compressionThreshold)
+    , dictionary_(config.compressionDictionary)
+    , dictionaries_(std::make_unique<Dictionaries>()) {
+    if (config.compression != Compression::None) {
+        if (isAvailable(config.compression)) {
+            preferred_ = config.compression;
+        } else if (!availableCodecs().empty()) {
+            preferred_ = availableCodecs().front();
+        }
+    }
+
+    if (!dictionary_.empty()) {
+        dictionaryId_ = dictionaryId(dictionary_);
+#ifdef P2P_HAVE_ZSTD
+        int zstdLevel = level_ > 0 ? level_ : ZSTD_CLEVEL_DEFAULT;
+        dictionaries_->cdict = ZSTD_createCDict(dictionary_.data(), dictionary_.size(), zstdLevel);
+        dictionaries_->ddict = ZSTD_createDDict(dictionary_.data(), dictionary_.size());
+#endif
+    }
+}
+
+Compressor::~Compressor() = default;
+
+nlohmann::json Compressor::advertisement() const {
+    if (!enabled()) {
+        return nullptr;
+    }
+    nlohmann::json codecs = nlohmann::json::array();
+    for (Compression codec : availableCodecs()) {
+        codecs.push_back(codecName(codec));
+    }
+    nlohmann::json result = {{"codecs", codecs}};
+    if (!dictionaryId_.empty()) {
+        result["dict"] = dictionaryId_;
+    }
+    return result;
+}
+
+std::optional<PeerCompression> Compressor::negotiate(const nlohmann::json& remote) const {
+    if (!enabled() || !remote.is_object()) {
+        return std::nullopt;
+    }
+    auto codecsIt = remote.find("codecs");
+    if (codecsIt == remote.end() || !codecsIt->is_array()) {
+        return std::nullopt;
+    }
+
+    auto accepts = [&](Compression codec) {
+        for (const auto& name : *codecsIt) {
+            if (name.is_string() && name.get_ref<const std::string&>() == codecName(codec)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    PeerCompression result;
+    if (accepts(preferred_)) {
+        result.codec = preferred_;
+    } else {
+        for (Compression codec : availableCodecs()) {
+            if (accepts(codec)) {
+                result.codec = codec;
+                break;
+            }
+        }
+    }
+    if (result.codec == Compression::None) {
+        return std::nullopt;
+    }
+
+    auto dictIt = remote.find("dict");
+    result.useDictionary = !dictionaryId_.empty() && dictIt != remote.end() && dictIt->is_string() &&
+                           dictIt->get_ref<const std::string&>() == dictionaryId_;
+    return result;
+}
+
+bool Compressor::encode(const PeerCompression& peer, const void* data, size_t size, bool isText,
+                        std::vector<std::byte>& frame) {
+    if (peer.codec == Compression::None || size < threshold_ || size > kMaxOriginalSize) {
+        messagesUncompressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t bound = compressBound(peer.codec, size);
+    frame.resize(1 + kMaxVarintSize + bound);
+    uint8_t* out = reinterpret_cast<uint8_t*>(frame.data());
+    size_t headerSize = 1 + writeVarint(out + 1, size);
+    size_t compressed = compressInto(peer, static_cast<const uint8_t*>(data), size, out + headerSize, bound);
+    compressMicros_.fetch_add(microsSince(start), std::memory_order_relaxed);
+
+    // 压缩后不比原始帧小则不值得让对方解压
+    if (compressed == 0 || headerSize + compressed >= 1 + size) {
+        messagesUncompressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    out[0] = static_cast<uint8_t>(codecId(peer.codec) | (peer.useDictionary ? kDictionaryFlag : 0) |
+                                  (isText ? kTextFlag : 0));
+    frame.resize(headerSize + compressed);
+
+    messagesCompressed_.fetch_add(1, std::memory_order_relaxed);
+    bytesIn_.fetch_add(size, std::memory_order_relaxed);
+    bytesOut_.fetch_add(frame.size(), std::memory_order_relaxed);
+    return true;
+}
+
+Buffer Compressor::decode(const void* frame, size_t size, bool& isText) {
+    const uint8_t* p = static_cast<const uint8_t*>(frame);
+    const uint8_t* end = p + size;
+    if (size == 0) {
+        throw std::runtime_error("Empty message frame");
+    }
+
+    uint8_t flags = *p++;
+    isText = (flags & kTextFlag) != 0;
+    uint8_t id = flags & kCodecMask;
+    if (id == 0) {
+        return Buffer::copyOf(p, static_cast<size_t>(end - p));
+    }
+
+    Compression codec = codecFromId(id);
+    if (!isAvailable(codec)) {
+        throw std::runtime_error("Unsupported compression codec " + std::to_string(id));
+    }
+    uint64_t originalSize = 0;
+    if (!readVarint(p, end, originalSize) || originalSize > kMaxOriginalSize) {
+        throw std::runtime_error("Invalid compressed frame header");
+    }
+    bool useDictionary = (flags & kDictionaryFlag) != 0;
+    if (useDictionary && dictionary_.empty()) {
+        throw std::runtime_error("Compressed frame requires a dictionary");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Buffer buffer = Buffer::allocate(static_cast<size_t>(originalSize));
+    if (originalSize > 0 &&
+        !decompressInto(codec, useDictionary, p, static_cast<size_t>(end - p), buffer.data(),
+                        static_cast<size_t>(originalSize))) {
+        throw std::runtime_error(std::string("Corrupted ") + codecName(codec) + " frame");
+    }
+    decompressMicros_.fetch_add(microsSince(start), std::memory_order_relaxed);
+    messagesDecompressed_.fetch_add(1, std::memory_order_relaxed);
+    return buffer;
+}
+
+CompressionStats Compressor::stats() const {
+    CompressionStats stats;
+    stats.messagesCompressed = messagesCompressed_.load(std::memory_order_relaxed);
+    stats.messagesUncompressed = messagesUncompressed_.load(std::memory_order_relaxed);
+    stats.bytesIn = bytesIn_.load(std::memory_order_relaxed);
+    stats.bytesOut = bytesOut_.load(std::memory_order_relaxed);
+    stats.messagesDecompressed = messagesDecompressed_.load(std::memory_order_relaxed);
+    stats.compressMicros = compressMicros_.load(std::memory_order_relaxed);
+    stats.decompressMicros = decompressMicros_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+size_t Compressor::compressBound(Compression codec, size_t size) const {
+    switch (codec) {
+#ifdef P2P_HAVE_LZ4
+        case Compression::LZ4:
+            return static_cast<size_t>(LZ4_compressBound(static_cast<int>(size)));
+#endif
+#ifdef P2P_HAVE_ZSTD
+        case Compression::Zstd:
+            return ZSTD_compressBound(size);
+#endif
+        default:
+            return size;
+    }
+}
+
+size_t Compressor::compressInto(const PeerCompression& peer, const uint8_t* src, size_t size,
+                                uint8_t* dst, size_t capacity) {
+    switch (peer.codec) {
+#ifdef P2P_HAVE_LZ4
+        case Compression::LZ4: {
+            // LZ4 的 level 为加速因子，越大越快、压缩率越低
+            int acceleration = level_ > 0 ? level_ : 1;
+            int written;
+            if (peer.useDictionary) {
+                LZ4_stream_t* stream = lz4Stream();
+                LZ4_loadDict(stream, reinterpret_cast<const char*>(dictionary_.data()),
+                             static_cast<int>(dictionary_.size()));
+                written = LZ4_compress_fast_continue(stream, reinterpret_cast<const char*>(src),
+                                                     reinterpret_cast<char*>(dst), static_cast<int>(size),
+                                                     static_cast<int>(capacity), acceleration);
+            } else {
+                written = LZ4_compress_fast(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+                                            static_cast<int>(size), static_cast<int>(capacity), acceleration);
+            }
+            return written > 0 ? static_cast<size_t>(written) : 0;
+        }
+#endif
+#ifdef P2P_HAVE_ZSTD
+        case Compression::Zstd: {
+            ZSTD_CCtx* cctx = zstdContexts().cctx;
+            size_t written = (peer.useDictionary && dictionaries_->cdict)
+                ? ZSTD_compress_usingCDict(cctx, dst, capacity, src, size, dictionaries_->cdict)
+                : ZSTD_compressCCtx(cctx, dst, capacity, src, size, level_ > 0 ? level_ : ZSTD_CLEVEL_DEFAULT);
+            return ZSTD_isError(written) ? 0 : written;
+        }
+#endif
+        default:
+            (void)src; (void)size; (void)dst; (void)capacity;
+            return 0;
+    }
+}
+
+bool Compressor::decompressInto(Compression codec, bool useDictionary, const uint8_t* src, size_t size,
+                                uint8_t* dst, size_t originalSize) {
+    switch (codec) {
+#ifdef P2P_HAVE_LZ4
+        case Compression::LZ4: {
+            int read = useDictionary
+                ? LZ4_decompress_safe_usingDict(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+                                                static_cast<int>(size), static_cast<int>(originalSize),
+                                                reinterpret_cast<const char*>(dictionary_.data()),
+                                                static_cast<int>(dictionary_.size()))
+                : LZ4_decompress_safe(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+                                      static_cast<int>(size), static_cast<int>(originalSize));
+            return read >= 0 && static_cast<size_t>(read) == originalSize;
+        }
+#endif
+#ifdef P2P_HAVE_ZSTD
+        case Compression::Zstd: {
+            ZSTD_DCtx* dctx = zstdContexts().dctx;
+            size_t read = (useDictionary && dictionaries_->ddict)
+                ? ZSTD_decompress_usingDDict(dctx, dst, originalSize, src, size, dictionaries_->ddict)
+                : ZSTD_decompressDCtx(dctx, dst, originalSize, src, size);
+            return !ZSTD_isError(read) && read == originalSize;
+        }
+#endif
+        default:
+            (void)useDictionary; (void)src; (void)size; (void)dst; (void)originalSize;
+            return false;
+    }
+}
+
+} // namespace p2p
@@ -0,0 +1,85 @@
+// client/src/compression.hpp
+#pragma once
+
+#include "p2p/types.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace p2p {
+
+// 与某个 Peer 协商出的压缩参数 (两个方向各自计算，结果一致)
+struct PeerCompression {
+    Compression codec = Compression::None;  // 发往该 Peer 时使用的编解码器
+    bool useDictionary = false;             // 双方预置字典一致
+};
+
+/**
+ * 消息压缩
+ *
+ * 协商：建立连接时交换 advertisement() ({"codecs": [...], "dict": "..."})，
+ * 双方都启用压缩且有共同支持的编解码器时 negotiate() 返回参数。
+ *
+ * 帧格式: [flags][原始长度 varint][数据]
+ *   flags 低 3 位为编解码器 (0 表示未压缩，此时没有长度字段)，bit3 表示使用字典，bit7 表示文本消息
+ */
+class Compressor {
+public:
+    explicit Compressor(const ClientConfig& config);
+    ~Compressor();
+
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+    // 本端启用了压缩且至少编译了一个编解码器
+    bool enabled() const { return preferred_ != Compression::None; }
+
+    size_t threshold() const { return threshold_; }
+
+    // 本端的协商信息；未启用时返回 null
+    nlohmann::json advertisement() const;
+
+    // 根据对方的协商信息计算发送参数；任一方未启用或没有共同编解码器时返回 nullopt
+    std::optional<PeerCompression> negotiate(const nlohmann::json& remote) const;
+
+    // 编码一帧，返回 true 表示数据已压缩；低于阈值或压缩无收益时写入未压缩帧
+    bool encode(const PeerCompression& peer, const void* data, size_t size, bool isText,
+                std::vector<std::byte>& frame);
+
+    // 解码一帧到池化缓冲区，格式错误或数据损坏时抛出 std::runtime_error
+    Buffer decode(const void* frame, size_t size, bool& isText);
+
+    CompressionStats stats() const;
+
+private:
+    struct Dictionaries;
+
+    size_t compressBound(Compression codec, size_t size) const;
+    size_t compressInto(const PeerCompression& peer, const uint8_t* src, size_t size,
+                        uint8_t* dst, size_t capacity);
+    bool decompressInto(Compression codec, bool useDictionary, const uint8_t* src, size_t size,
+                        uint8_t* dst, size_t originalSize);
+
+    Compression preferred_ = Compression::None;
+    int level_ = 0;
+    size_t threshold_ = 0;
+    BinaryData dictionary_;
+    std::string dictionaryId_;
+    std::unique_ptr<Dictionaries> dictionaries_;
+
+    std::atomic<uint64_t> messagesCompressed_{0};
+    std::atomic<uint64_t> messagesUncompressed_{0};
+    std::atomic<uint64_t> bytesIn_{0};
+    std::atomic<uint64_t> bytesOut_{0};
+    std::atomic<uint64_t> messagesDecompressed_{0};
+    std::atomic<uint64_t> compressMicros_{0};
+    std::atomic<uint64_t> decompressMicros_{0};
+};
+
+} // namespace p2p
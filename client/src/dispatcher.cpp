@@ -0,0 +1,72 @@
+#include "dispatcher.hpp"
+#include "thread_affinity.hpp"
+
+namespace p2p {
+
+CallbackDispatcher::CallbackDispatcher(size_t threads, const std::vector<int>& cpus, const std::string& name) {
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        auto worker = std::make_shared<Worker>();
+        // 线程持有 Worker 的引用：在回调中销毁客户端时线程被分离，返回后仍要访问队列
+        worker->thread = std::thread([worker, cpus, threadName = name + std::to_string(i)] {
+            configureCurrentThread(threadName, cpus);
+            run(*worker);
+        });
+        workers_.push_back(std::move(worker));
+    }
+}
+
+CallbackDispatcher::~CallbackDispatcher() {
+    stop();
+}
+
+void CallbackDispatcher::post(const std::string& key, Task task) {
+    if (workers_.empty()) {
+        return;
+    }
+    Worker& worker = *workers_[std::hash<std::string>()(key) % workers_.size()];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.stopping) {
+        return;
+    }
+    worker.queue.push_back(std::move(task));
+    worker.cv.notify_one();  // 持锁通知：任务执行时 (可能销毁分发器) post 已经返回
+}
+
+void CallbackDispatcher::stop() {
+    for (auto& worker : workers_) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->stopping = true;
+            worker->queue.clear();
+        }
+        worker->cv.notify_one();
+    }
+    for (auto& worker : workers_) {
+        if (!worker->thread.joinable()) {
+            continue;
+        }
+        if (worker->thread.get_id() == std::this_thread::get_id()) {
+            worker->thread.detach();  // 在回调中销毁客户端：当前任务返回后线程自行退出
+        } else {
+            worker->thread.join();
+        }
+    }
+}
+
+void CallbackDispatcher::run(Worker& worker) {
+    std::unique_lock<std::mutex> lock(worker.mutex);
+    while (true) {
+        worker.cv.wait(lock, [&] { return worker.stopping || !worker.queue.empty(); });
+        if (worker.stopping) {
+            return;
+        }
+        Task task = std::move(worker.queue.front());
+        worker.queue.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+} // namespace p2p
@@ -0,0 +1,81 @@
+// client/src/dispatcher.hpp
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace p2p {
+
+/**
+ * 回调分发线程
+ *
+ * 把应用回调从 libdatachannel 的网络线程转移到专用线程上执行，网络线程只做收发和解帧。
+ * 任务按 key (Peer ID) 散列到固定的线程，同一 Peer 的消息和事件按提交顺序执行；
+ * 每个线程一个队列，不同 Peer 之间互不阻塞。
+ */
+class CallbackDispatcher {
+public:
+    using Task = std::function<void()>;
+
+    // threads 个线程，名字为 name + 序号，启动时绑定到 cpus (为空时不绑定)
+    CallbackDispatcher(size_t threads, const std::vector<int>& cpus, const std::string& name);
+    ~CallbackDispatcher();
+
+    CallbackDispatcher(const CallbackDispatcher&) = delete;
+    CallbackDispatcher& operator=(const CallbackDispatcher&) = delete;
+
+    void post(const std::string& key, Task task);
+
+    // 停止并等待线程退出，尚未执行的任务被丢弃；可在分发线程上调用 (该线程不等待自身)
+    void stop();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Task> queue;
+        bool stopping = false;
+        std::thread thread;
+    };
+
+    static void run(Worker& worker);
+
+    std::vector<std::shared_ptr<Worker>> workers_;
+};
+
+/**
+ * 一个客户端提交到分发线程的任务的生命周期
+ *
+ * 网关的各端点共用网关的分发线程，端点销毁时 close() 跳过它尚未执行的任务，
+ * 并等待正在执行的任务结束；在自己的回调中销毁客户端不会死锁 (递归锁)。
+ */
+class DispatchScope {
+public:
+    // 包装任务：执行时持有锁，scope 已关闭时跳过
+    static CallbackDispatcher::Task wrap(std::shared_ptr<DispatchScope> scope, CallbackDispatcher::Task task) {
+        return [scope = std::move(scope), task = std::move(task)] {
+            std::lock_guard<std::recursive_mutex> lock(scope->mutex_);
+            if (scope->open_) {
+                task();
+            }
+        };
+    }
+
+    void close() {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        open_ = false;
+    }
+
+private:
+    std::recursive_mutex mutex_;
+    bool open_ = true;
+};
+
+} // namespace p2p
@@ -0,0 +1,50 @@
+// client/src/frames.hpp
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace p2p {
+
+/**
+ * 内部子协议帧 (RPC 等)
+ *
+ * 与应用消息共用连接但互不干扰：直连时走单独的 "p2p-sys" DataChannel，每条消息为 [kind][帧体]；
+ * 中继时在 payload 中带 "kind" 字段。双方在 offer/answer 或 relay_connect 中通告 "sys" 后才发送。
+ */
+enum class FrameKind : uint8_t {
+    Rpc = 1,
+    Stream = 2,
+    PubSub = 3,
+    StateSync = 4,
+};
+
+constexpr const char* kSystemChannelLabel = "p2p-sys";
+constexpr int kSystemProtocolVersion = 1;  // "sys" 协商值
+constexpr size_t kSystemChannelHighWater = 1024 * 1024;  // 系统通道发送缓冲区超过此值时暂停流的发送
+
+constexpr size_t kMaxVarintSize = 10;
+
+// LEB128 无符号变长整数，out 至少 kMaxVarintSize 字节，返回写入的字节数
+inline size_t writeVarint(uint8_t* out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+// 读取成功时 p 前移到变长整数之后
+inline bool readVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+} // namespace p2p
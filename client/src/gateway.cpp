@@ -0,0 +1,399 @@
+#include "p2p/gateway.hpp"
+#include "gateway.hpp"
+#include "runtime.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace p2p {
+
+using json = nlohmann::json;
+
+// ==================== GatewayImpl ====================
+
+GatewayImpl::GatewayImpl(const ClientConfig& config) : config_(config) {
+    const auto& threading = config_.threading;
+    if (threading.dispatchThreads > 0) {
+        dispatcher_ = std::make_shared<CallbackDispatcher>(
+            threading.dispatchThreads, threading.dispatchCpus, threading.threadName + "-cb");
+    }
+}
+
+GatewayImpl::~GatewayImpl() {
+    disconnect();
+    if (dispatcher_) {
+        dispatcher_->stop();
+    }
+}
+
+bool GatewayImpl::connect() {
+    ensureRuntime(config_.threading.networkCpus);
+    try {
+        state_ = ConnectionState::Connecting;
+
+        auto ws = std::make_shared<rtc::WebSocket>();
+        std::weak_ptr<GatewayImpl> weak = weak_from_this();
+
+        ws->onOpen([weak, ws]() {
+            auto self = weak.lock();
+            if (!self) return;
+            std::cout << "[Gateway] Connected to signaling server" << std::endl;
+            SignalingMessage msg;
+            msg.type = MessageType::Register;
+            msg.payload = self->config_.peerId;
+            msg.version = kProtocolVersion;
+            ws->send(msg.serialize());
+        });
+
+        ws->onMessage([weak](auto message) {
+            auto self = weak.lock();
+            if (self && std::holds_alternative<std::string>(message)) {
+                self->handleMessage(std::get<std::string>(message));
+            }
+        });
+
+        ws->onClosed([weak, closed = ws.get()]() {
+            auto self = weak.lock();
+            auto current = self ? self->socket() : nullptr;
+            // 重新 connect() 之后旧连接迟到的关闭通知不影响新连接
+            if (self && (!current || current.get() == closed)) {
+                std::cout << "[Gateway] Disconnected from signaling server" << std::endl;
+                self->handleClosed();
+            }
+        });
+
+        ws->onError([weak](const std::string& error) {
+            if (auto self = weak.lock()) {
+                std::cerr << "[Gateway] WebSocket error: " << error << std::endl;
+                self->state_ = ConnectionState::Failed;
+                self->reportError(ErrorCode::SignalingError, error);
+            }
+        });
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ws_ = ws;
+        }
+        ws->open(config_.signalingUrl);
+
+        // 注册回复到达后才能 Attach
+        auto timeout = std::chrono::milliseconds(config_.connectionTimeout);
+        auto start = std::chrono::steady_clock::now();
+        while (state_ == ConnectionState::Connecting) {
+            if (std::chrono::steady_clock::now() - start > timeout) {
+                state_ = ConnectionState::Failed;
+                reportError(ErrorCode::Timeout, "Connection timeout");
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return state_ == ConnectionState::Connected;
+    } catch (const std::exception& e) {
+        state_ = ConnectionState::Failed;
+        reportError(ErrorCode::ConnectionFailed, e.what());
+        return false;
+    }
+}
+
+void GatewayImpl::disconnect() {
+    std::shared_ptr<rtc::WebSocket> ws;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ws = std::move(ws_);
+    }
+    if (ws && ws->isOpen()) {
+        ws->close();  // 服务端随连接注销所有虚拟 ID
+    }
+    handleClosed();
+}
+
+bool GatewayImpl::isConnected() const {
+    auto ws = socket();
+    return state_ == ConnectionState::Connected && ws && ws->isOpen();
+}
+
+std::string GatewayImpl::localId() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return localId_;
+}
+
+std::shared_ptr<rtc::WebSocket> GatewayImpl::socket() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ws_;
+}
+
+std::shared_ptr<GatewayImpl::Slot> GatewayImpl::attach(GatewayEndpoint* endpoint, const std::string& requestedId) {
+    auto slot = std::make_shared<Slot>();
+    slot->endpoint = endpoint;
+
+    SignalingMessage msg;
+    msg.type = MessageType::Attach;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot->tag = ++nextTag_;
+        pending_[slot->tag] = slot;
+        msg.from = localId_;
+    }
+    msg.setJsonPayload(json({{"id", requestedId}, {"tag", slot->tag}}).dump(), true);
+
+    if (!send(msg)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.erase(slot->tag);
+        slot->endpoint = nullptr;
+        return nullptr;
+    }
+    return slot;
+}
+
+template <typename Fn>
+bool GatewayImpl::dispatch(const std::shared_ptr<Slot>& slot, Fn&& fn) {
+    GatewayEndpoint* endpoint;
+    {
+        std::lock_guard<std::mutex> lock(slot->mutex);
+        endpoint = slot->endpoint;
+        if (!endpoint) {
+            return false;
+        }
+        slot->dispatching.push_back(std::this_thread::get_id());
+    }
+
+    struct Done {
+        Slot& slot;
+        ~Done() {
+            {
+                std::lock_guard<std::mutex> lock(slot.mutex);
+                auto& threads = slot.dispatching;
+                threads.erase(std::find(threads.begin(), threads.end(), std::this_thread::get_id()));
+            }
+            slot.idle.notify_all();
+        }
+    } done{*slot};
+    fn(*endpoint);
+    return true;
+}
+
+void GatewayImpl::detach(const std::shared_ptr<Slot>& slot) {
+    if (!slot) {
+        return;
+    }
+    {
+        // 等待其他线程上的派发结束；当前线程正在派发 (端点在回调中注销自己) 时不等待自身
+        std::unique_lock<std::mutex> lock(slot->mutex);
+        slot->endpoint = nullptr;
+        auto self = std::this_thread::get_id();
+        slot->idle.wait(lock, [&] {
+            return std::all_of(slot->dispatching.begin(), slot->dispatching.end(),
+                               [&](std::thread::id id) { return id == self; });
+        });
+    }
+
+    SignalingMessage msg;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.erase(slot->tag);  // 之后到达的回复由 handleAttachReply 注销
+        auto it = endpoints_.find(slot->id);
+        if (it == endpoints_.end() || it->second != slot) {
+            return;
+        }
+        endpoints_.erase(it);
+        msg.from = slot->id;
+    }
+    msg.type = MessageType::Detach;
+    send(msg);
+}
+
+size_t GatewayImpl::endpointCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return endpoints_.size();
+}
+
+void GatewayImpl::handleMessage(const std::string& msgStr) {
+    SignalingMessage msg;
+    try {
+        msg = SignalingMessage::deserialize(msgStr);
+    } catch (const std::exception& e) {
+        reportError(ErrorCode::InvalidData, e.what());
+        return;
+    }
+
+    switch (msg.type) {
+        case MessageType::Register:
+            handleRegister(msg);
+            return;
+        case MessageType::Attach:
+            handleAttachReply(msg);
+            return;
+        default:
+            break;
+    }
+
+    std::shared_ptr<Slot> slot;
+    std::vector<std::shared_ptr<Slot>> all;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = endpoints_.find(msg.to);
+        if (it != endpoints_.end()) {
+            slot = it->second;
+        } else if (msg.type == MessageType::Throttled) {
+            all.reserve(endpoints_.size());
+            for (const auto& [id, s] : endpoints_) {
+                all.push_back(s);
+            }
+        }
+    }
+    if (!slot) {
+        // 发给网关自身的消息：只关心错误和限流通知
+        if (msg.type == MessageType::Error || msg.type == MessageType::Throttled) {
+            reportError(msg.type == MessageType::Error ? ErrorCode::SignalingError : ErrorCode::RateLimited,
+                        msg.payload);
+        }
+        // 连接级限流作用于共享连接上的所有虚拟 ID，逐个分发以便各端点退避
+        for (const auto& s : all) {
+            dispatch(s, [&](GatewayEndpoint& endpoint) { endpoint.handleGatewayMessage(msg); });
+        }
+        return;
+    }
+
+    dispatch(slot, [&](GatewayEndpoint& endpoint) { endpoint.handleGatewayMessage(msg); });
+}
+
+void GatewayImpl::handleRegister(const SignalingMessage& msg) {
+    protocolVersion_ = std::clamp(msg.version, kProtocolVersionStringPayload, kProtocolVersion);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        localId_ = msg.payload;
+    }
+    if (protocolVersion_ < kProtocolVersionMultiplex) {
+        std::cerr << "[Gateway] Server does not support gateway mode (protocol v"
+                  << protocolVersion_ << ")" << std::endl;
+        state_ = ConnectionState::Failed;
+        reportError(ErrorCode::SignalingError, "Server does not support gateway mode");
+        return;
+    }
+    std::cout << "[Gateway] Registered as: " << msg.payload << std::endl;
+    state_ = ConnectionState::Connected;
+}
+
+void GatewayImpl::handleAttachReply(const SignalingMessage& msg) {
+    uint64_t tag = 0;
+    std::string id;
+    std::string error;
+    try {
+        auto reply = json::parse(msg.payload);
+        tag = reply.value("tag", uint64_t(0));
+        id = reply.value("id", "");
+        error = reply.value("error", "");
+    } catch (const std::exception& e) {
+        reportError(ErrorCode::InvalidData, e.what());
+        return;
+    }
+    if (id.empty() && error.empty()) {
+        error = "Malformed attach reply";
+    }
+
+    std::shared_ptr<Slot> slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pending_.find(tag);
+        if (it != pending_.end()) {
+            slot = std::move(it->second);
+            pending_.erase(it);
+            if (!id.empty()) {
+                slot->id = id;
+                endpoints_[id] = slot;
+            }
+        }
+    }
+
+    if (slot) {
+        if (!dispatch(slot, [&](GatewayEndpoint& endpoint) { endpoint.handleAttached(id, error); })) {
+            detach(slot);  // 端点已注销：撤销刚登记的 ID
+        }
+        return;
+    }
+
+    // 端点在回复到达前已经 detach：注销服务端已分配的 ID
+    if (!id.empty()) {
+        SignalingMessage detachMsg;
+        detachMsg.type = MessageType::Detach;
+        detachMsg.from = id;
+        send(detachMsg);
+    }
+}
+
+void GatewayImpl::handleClosed() {
+    bool wasConnected = state_.exchange(ConnectionState::Disconnected) == ConnectionState::Connected;
+
+    std::vector<std::shared_ptr<Slot>> slots;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& [tag, slot] : pending_) {
+            slots.push_back(std::move(slot));
+        }
+        for (auto& [id, slot] : endpoints_) {
+            slots.push_back(std::move(slot));
+        }
+        pending_.clear();
+        endpoints_.clear();
+    }
+
+    for (const auto& slot : slots) {
+        dispatch(slot, [](GatewayEndpoint& endpoint) { endpoint.handleGatewayClosed(); });
+    }
+
+    if (wasConnected && onDisconnected_) {
+        onDisconnected_(Error{ErrorCode::None, "Connection closed"});
+    }
+}
+
+bool GatewayImpl::send(const SignalingMessage& msg) {
+    auto ws = socket();
+    if (!ws || !ws->isOpen()) {
+        return false;
+    }
+    try {
+        ws->send(msg.serialize());
+        return true;
+    } catch (const std::exception& e) {
+        reportError(ErrorCode::SignalingError, e.what());
+        return false;
+    }
+}
+
+void GatewayImpl::reportError(ErrorCode code, const std::string& message) {
+    if (onError_) {
+        onError_(Error{code, message});
+    }
+}
+
+// ==================== Gateway ====================
+
+Gateway::Gateway(const ClientConfig& config)
+    : impl_(std::make_shared<GatewayImpl>(config)) {}
+
+Gateway::~Gateway() {
+    impl_->disconnect();
+}
+
+bool Gateway::connect() { return impl_->connect(); }
+void Gateway::disconnect() { impl_->disconnect(); }
+bool Gateway::isConnected() const { return impl_->isConnected(); }
+std::string Gateway::getLocalId() const { return impl_->localId(); }
+
+P2PClient Gateway::createEndpoint(const std::string& peerId) {
+    ClientConfig config = impl_->config();
+    config.peerId = peerId;
+    return P2PClient(config, impl_);
+}
+
+size_t Gateway::getEndpointCount() const { return impl_->endpointCount(); }
+
+void Gateway::setOnDisconnected(OnDisconnectedCallback cb) { impl_->setOnDisconnected(std::move(cb)); }
+void Gateway::setOnError(OnErrorCallback cb) { impl_->setOnError(std::move(cb)); }
+
+} // namespace p2p
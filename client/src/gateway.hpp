@@ -0,0 +1,119 @@
+// client/src/gateway.hpp
+#pragma once
+
+#include "p2p/types.hpp"
+#include "protocol.hpp"
+#include "dispatcher.hpp"
+#include "callback_slot.hpp"
+
+#include <rtc/rtc.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace p2p {
+
+// 网关端点：在网关的共享信令连接上注册的一个本地 ID (由网关模式的 P2PClientImpl 实现)
+class GatewayEndpoint {
+public:
+    // Attach 的回复：成功时 id 为服务端分配的 ID，失败时 error 非空
+    virtual void handleAttached(const std::string& id, const std::string& error) = 0;
+
+    // 发给该 ID 的信令消息 (已解析)
+    virtual void handleGatewayMessage(const SignalingMessage& msg) = 0;
+
+    // 共享连接已断开，该 ID 随之注销
+    virtual void handleGatewayClosed() = 0;
+
+protected:
+    ~GatewayEndpoint() = default;
+};
+
+/**
+ * 网关的共享信令连接
+ *
+ * 网关自身以 config.peerId 注册 (协议版本 4)，之后每个端点用 Attach 在同一连接上注册一个虚拟 ID。
+ * 服务端发出的消息都带 to，收到后按 to 查表交给对应端点，每个端点只占一个表项，
+ * 不再各自持有 WebSocket；端点发出的消息以 from 指明自己的 ID。
+ * 调用端点时不持有任何锁 (端点会在其中调用用户回调)；detach 关闭槽位并等待其他线程上
+ * 正在进行的派发结束，之后不会再调用该端点。在端点自己的派发中 detach 不等待自身。
+ */
+class GatewayImpl : public std::enable_shared_from_this<GatewayImpl> {
+public:
+    // 一个端点的注册状态，attach 返回，detach 时交回
+    struct Slot {
+        std::mutex mutex;                           // 只保护 endpoint 和 dispatching，派发期间不持有
+        std::condition_variable idle;               // dispatching 减少时通知 detach
+        GatewayEndpoint* endpoint = nullptr;        // detach 后置空，之后不再开始新的派发
+        std::vector<std::thread::id> dispatching;   // 正在调用该端点的线程
+        std::string id;                             // 服务端分配的 ID，Attach 回复前为空 (由 GatewayImpl::mutex_ 保护)
+        uint64_t tag = 0;                           // Attach 请求编号
+    };
+
+    explicit GatewayImpl(const ClientConfig& config);
+    ~GatewayImpl();
+
+    GatewayImpl(const GatewayImpl&) = delete;
+    GatewayImpl& operator=(const GatewayImpl&) = delete;
+
+    bool connect();
+    void disconnect();
+    bool isConnected() const;
+
+    std::string localId() const;
+    const ClientConfig& config() const { return config_; }
+    uint32_t protocolVersion() const { return protocolVersion_; }
+    std::shared_ptr<rtc::WebSocket> socket() const;
+
+    // 请求注册虚拟 ID (requestedId 为空或已被占用时由服务端分配)，结果通过 handleAttached 回调
+    std::shared_ptr<Slot> attach(GatewayEndpoint* endpoint, const std::string& requestedId);
+
+    // 注销端点：返回后不会再回调该端点
+    void detach(const std::shared_ptr<Slot>& slot);
+
+    size_t endpointCount() const;
+
+    // 各端点共用的回调分发线程，未配置时为空
+    std::shared_ptr<CallbackDispatcher> dispatcher() const { return dispatcher_; }
+
+    void setOnDisconnected(OnDisconnectedCallback callback) { onDisconnected_.set(std::move(callback)); }
+    void setOnError(OnErrorCallback callback) { onError_.set(std::move(callback)); }
+
+private:
+    // 在锁外调用槽位上的端点；槽位已关闭时返回 false
+    template <typename Fn>
+    bool dispatch(const std::shared_ptr<Slot>& slot, Fn&& fn);
+
+    void handleMessage(const std::string& msgStr);
+    void handleRegister(const SignalingMessage& msg);
+    void handleAttachReply(const SignalingMessage& msg);
+    void handleClosed();
+
+    bool send(const SignalingMessage& msg);
+    void reportError(ErrorCode code, const std::string& message);
+
+    ClientConfig config_;
+    std::atomic<ConnectionState> state_{ConnectionState::Disconnected};
+    std::atomic<uint32_t> protocolVersion_{kProtocolVersionStringPayload};
+
+    mutable std::mutex mutex_;
+    std::shared_ptr<rtc::WebSocket> ws_;
+    std::string localId_;
+    uint64_t nextTag_ = 0;
+    std::unordered_map<uint64_t, std::shared_ptr<Slot>> pending_;       // 等待 Attach 回复
+    std::unordered_map<std::string, std::shared_ptr<Slot>> endpoints_;  // 已注册的 ID -> 端点
+
+    CallbackSlot<OnDisconnectedCallback> onDisconnected_;
+    CallbackSlot<OnErrorCallback> onError_;
+    
+    std::shared_ptr<CallbackDispatcher> dispatcher_;
+};
+
+} // namespace p2p
@@ -0,0 +1,892 @@
+#include "lan_transport.hpp"
+#include "thread_affinity.hpp"
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace p2p {
+
+namespace {
+
+constexpr char kMagic[4] = {'P', '2', 'P', 'L'};
+constexpr uint8_t kVersion = 1;
+constexpr size_t kMacSize = 32;
+constexpr size_t kMaxIdLength = 256;
+
+std::string toHex(const uint8_t* data, size_t size) {
+    static const char* digits = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i) {
+        hex += digits[data[i] >> 4];
+        hex += digits[data[i] & 0x0f];
+    }
+    return hex;
+}
+
+bool fromHex(const std::string& hex, uint8_t* out, size_t size) {
+    if (hex.size() != size * 2) {
+        return false;
+    }
+    auto value = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    for (size_t i = 0; i < size; ++i) {
+        int high = value(hex[i * 2]);
+        int low = value(hex[i * 2 + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+    return true;
+}
+
+// 密钥 = SHA-256("p2p-lan-v1" | 发起方随机数 | 应答方随机数)
+LanService::Key deriveKey(const std::string& offerNonce, const std::string& answerNonce) {
+    uint8_t material[10 + 2 * LanService::kNonceSize];
+    std::memcpy(material, "p2p-lan-v1", 10);
+    LanService::Key key{};
+    if (!fromHex(offerNonce, material + 10, LanService::kNonceSize) ||
+        !fromHex(answerNonce, material + 10 + LanService::kNonceSize, LanService::kNonceSize)) {
+        return key;
+    }
+    SHA256(material, sizeof(material), key.data());
+    return key;
+}
+
+// HMAC-SHA256(key, role | first | second)，role 区分两个方向，防止把对方的应答原样反射回去
+void handshakeMac(const LanService::Key& key, char role, const uint8_t* first, const uint8_t* second, uint8_t* out) {
+    uint8_t data[1 + 2 * LanService::kNonceSize];
+    data[0] = static_cast<uint8_t>(role);
+    std::memcpy(data + 1, first, LanService::kNonceSize);
+    std::memcpy(data + 1 + LanService::kNonceSize, second, LanService::kNonceSize);
+    unsigned int length = 0;
+    HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()), data, sizeof(data), out, &length);
+}
+
+} // namespace
+
+#ifndef _WIN32
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+constexpr int kConnectTimeoutMs = 1000;
+constexpr int kHandshakeTimeoutMs = 3000;
+constexpr int kAcceptPollMs = 200;
+constexpr size_t kMaxPendingHandshakes = 64;  // 同时进行握手的入站连接上限，超过时直接关闭
+
+constexpr size_t kHeaderSize = 5;                   // 4 字节长度 (大端) + 1 字节类型
+constexpr size_t kMaxFrameSize = 64 * 1024 * 1024;  // 超过时视为协议错误
+constexpr size_t kReadBufferSize = 256 * 1024;
+constexpr size_t kMaxBatch = 256;                   // 一次 sendmsg 最多合并的消息数
+constexpr size_t kMaxIov = 1024;
+constexpr uint8_t kFrameBinary = 0;
+constexpr uint8_t kFrameText = 1;
+
+void setTimeouts(int fd, int milliseconds) {
+    timeval tv{};
+    tv.tv_sec = milliseconds / 1000;
+    tv.tv_usec = (milliseconds % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+void configureSocket(int fd, size_t bufferSize) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    if (bufferSize > 0) {
+        int size = static_cast<int>(std::min<size_t>(bufferSize, INT32_MAX));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+}
+
+bool sendAll(int fd, const void* data, size_t size) {
+    auto* p = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = ::send(fd, p, size, kSendFlags);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool recvAll(int fd, void* data, size_t size) {
+    auto* p = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = ::recv(fd, p, size, 0);
+        if (n == 0) return false;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// "ip:port" 或 "[ipv6]:port"
+bool splitAddress(const std::string& address, std::string& host, std::string& port) {
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == address.size()) {
+        return false;
+    }
+    host = address.substr(0, colon);
+    port = address.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    return true;
+}
+
+// 非阻塞连接，超时或失败返回 -1；成功后恢复为阻塞模式
+// 连接超时前按 kAcceptPollMs 分段等待，running 变为 false 时放弃
+int connectTo(const std::string& address, const std::atomic<bool>& running) {
+    std::string host, port;
+    if (!splitAddress(address, host, port)) {
+        return -1;
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || !result) {
+        return -1;
+    }
+
+    int fd = ::socket(result->ai_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        freeaddrinfo(result);
+        return -1;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = ::connect(fd, result->ai_addr, result->ai_addrlen);
+    freeaddrinfo(result);
+    if (rc < 0 && errno == EINPROGRESS) {
+        pollfd pfd{fd, POLLOUT, 0};
+        int ready = 0;
+        for (int waited = 0; ready == 0 && waited < kConnectTimeoutMs && running; waited += kAcceptPollMs) {
+            ready = poll(&pfd, 1, std::min(kAcceptPollMs, kConnectTimeoutMs - waited));
+        }
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (ready == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0) {
+            rc = 0;
+        }
+    }
+    if (rc < 0) {
+        ::close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, flags);
+    return fd;
+}
+
+// 本机可用于局域网连接的 IPv4 地址，回环地址排在最后 (同一台机器上的 Peer)
+std::vector<std::string> localAddresses(uint16_t port) {
+    std::vector<std::string> addresses;
+    std::vector<std::string> loopback;
+    ifaddrs* list = nullptr;
+    if (getifaddrs(&list) != 0) {
+        return addresses;
+    }
+    for (ifaddrs* it = list; it; it = it->ifa_next) {
+        if (!it->ifa_addr || it->ifa_addr->sa_family != AF_INET || !(it->ifa_flags & IFF_UP)) {
+            continue;
+        }
+        char text[INET_ADDRSTRLEN] = {};
+        auto* addr = reinterpret_cast<sockaddr_in*>(it->ifa_addr);
+        if (!inet_ntop(AF_INET, &addr->sin_addr, text, sizeof(text))) {
+            continue;
+        }
+        std::string address = std::string(text) + ":" + std::to_string(port);
+        if (it->ifa_flags & IFF_LOOPBACK) {
+            loopback.push_back(std::move(address));
+        } else {
+            addresses.push_back(std::move(address));
+        }
+    }
+    freeifaddrs(list);
+    addresses.insert(addresses.end(), loopback.begin(), loopback.end());
+    return addresses;
+}
+
+/**
+ * 已完成握手的 TCP 连接
+ *
+ * 帧格式为 4 字节长度 + 1 字节类型 + 数据。发送线程把队列中的消息合并成一次 sendmsg (每条消息两段 iovec，
+ * 不拼接数据)；接收线程每次读满缓冲区后拆出其中的所有帧。
+ * 接收线程在运行期间持有传输的强引用，在回调中移除最后一个引用也是安全的。
+ */
+class LanTransport : public Transport, public std::enable_shared_from_this<LanTransport> {
+public:
+    explicit LanTransport(int fd) : Transport(Kind::Lan), fd_(fd) {}
+
+    ~LanTransport() override {
+        close();
+        for (auto* thread : {&reader_, &writer_}) {
+            if (thread->joinable()) {
+                if (thread->get_id() == std::this_thread::get_id()) {
+                    thread->detach();  // 接收线程释放最后一个引用，线程函数随即返回
+                } else {
+                    thread->join();
+                }
+            }
+        }
+        ::close(fd_);
+    }
+
+    void start(const std::string& threadName, const std::vector<int>& cpus) {
+        auto self = shared_from_this();
+        reader_ = std::thread([self, name = threadName + "-lanr", cpus]() mutable {
+            configureCurrentThread(name, cpus);
+            self->readLoop();
+            self.reset();
+        });
+        writer_ = std::thread([this, name = threadName + "-lanw", cpus] {
+            configureCurrentThread(name, cpus);
+            writeLoop();
+        });
+    }
+
+    ChannelState state() const override { return open_ ? ChannelState::Open : ChannelState::Closed; }
+
+    size_t bufferedAmount() const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queuedBytes_;
+    }
+
+    // 内核平滑后的 TCP 往返时延
+    uint64_t rttMicros() const override {
+#if defined(__linux__) && defined(TCP_INFO)
+        tcp_info info{};
+        socklen_t length = sizeof(info);
+        if (getsockopt(fd_, IPPROTO_TCP, TCP_INFO, &info, &length) == 0) {
+            return info.tcpi_rtt;
+        }
+#endif
+        return 0;
+    }
+
+    // 关闭连接并等待收发线程退出 (在收发线程自身上调用时不等待自身)
+    void close() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            open_ = false;
+            queue_.clear();
+            queuedBytes_ = 0;
+        }
+        cv_.notify_all();
+        ::shutdown(fd_, SHUT_RDWR);
+        for (auto* thread : {&reader_, &writer_}) {
+            if (thread->joinable() && thread->get_id() != std::this_thread::get_id()) {
+                thread->join();
+            }
+        }
+    }
+
+protected:
+    bool write(Message message) override {
+        size_t size = std::visit([](const auto& data) { return data.size(); }, message);
+        if (size > kMaxFrameSize) {
+            throw std::length_error("LAN message too large");
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!open_) {
+                return false;
+            }
+            queue_.push_back(std::move(message));
+            queuedBytes_ += size;
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    void setWritableThreshold(size_t lowWater) override { lowWater_ = lowWater; }
+
+    uint64_t writeCalls() const override { return writeCalls_.load(std::memory_order_relaxed); }
+
+private:
+    void readLoop() {
+        std::vector<uint8_t> buffer(kReadBufferSize);
+        size_t begin = 0;
+        size_t end = 0;
+        size_t needed = kHeaderSize;  // 当前帧需要的连续字节数
+
+        while (open_) {
+            // 剩余空间放不下当前帧时先把未处理的数据移到开头，仍放不下则扩大缓冲区
+            if (buffer.size() - begin < needed || end == buffer.size()) {
+                std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+                if (buffer.size() < needed) {
+                    buffer.resize(needed);
+                }
+            }
+            ssize_t n = ::recv(fd_, buffer.data() + end, buffer.size() - end, 0);
+            if (n == 0) break;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            end += static_cast<size_t>(n);
+
+            bool invalid = false;
+            while (end - begin >= kHeaderSize) {
+                const uint8_t* header = buffer.data() + begin;
+                size_t length = (size_t(header[0]) << 24) | (size_t(header[1]) << 16) |
+                                (size_t(header[2]) << 8) | size_t(header[3]);
+                if (length > kMaxFrameSize || header[4] > kFrameText) {
+                    invalid = true;
+                    break;
+                }
+                needed = kHeaderSize + length;
+                if (end - begin < needed) {
+                    break;
+                }
+                const uint8_t* data = header + kHeaderSize;
+                if (header[4] == kFrameText) {
+                    received(std::string(reinterpret_cast<const char*>(data), length));
+                } else {
+                    auto* bytes = reinterpret_cast<const std::byte*>(data);
+                    received(rtc::binary(bytes, bytes + length));
+                }
+                begin += needed;
+                needed = kHeaderSize;
+            }
+            if (invalid) {
+                failed("Invalid LAN frame");
+                break;
+            }
+            if (begin == end) {
+                begin = end = 0;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            open_ = false;
+        }
+        cv_.notify_all();
+        ::shutdown(fd_, SHUT_RDWR);
+        closed();
+    }
+
+    void writeLoop() {
+        std::vector<Message> batch;
+        std::vector<std::array<uint8_t, kHeaderSize>> headers;
+        std::vector<iovec> iov;
+        batch.reserve(kMaxBatch);
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return !queue_.empty() || !open_; });
+                if (!open_) {
+                    return;
+                }
+                while (!queue_.empty() && batch.size() < kMaxBatch) {
+                    batch.push_back(std::move(queue_.front()));
+                    queue_.pop_front();
+                }
+            }
+
+            headers.resize(batch.size());
+            iov.clear();
+            size_t bytes = 0;
+            for (size_t i = 0; i < batch.size(); ++i) {
+                const void* data;
+                size_t size;
+                uint8_t type;
+                if (auto* text = std::get_if<std::string>(&batch[i])) {
+                    data = text->data();
+                    size = text->size();
+                    type = kFrameText;
+                } else {
+                    const auto& binary = std::get<rtc::binary>(batch[i]);
+                    data = binary.data();
+                    size = binary.size();
+                    type = kFrameBinary;
+                }
+                auto& header = headers[i];
+                header[0] = static_cast<uint8_t>(size >> 24);
+                header[1] = static_cast<uint8_t>(size >> 16);
+                header[2] = static_cast<uint8_t>(size >> 8);
+                header[3] = static_cast<uint8_t>(size);
+                header[4] = type;
+                iov.push_back(iovec{header.data(), kHeaderSize});
+                if (size > 0) {
+                    iov.push_back(iovec{const_cast<void*>(data), size});
+                }
+                bytes += size;
+            }
+
+            if (!writeAll(iov)) {
+                ::shutdown(fd_, SHUT_RDWR);  // 接收线程随之退出并报告关闭
+                return;
+            }
+            batch.clear();
+
+            bool notify = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                size_t before = queuedBytes_;
+                queuedBytes_ -= std::min(queuedBytes_, bytes);
+                size_t lowWater = lowWater_;
+                notify = before > lowWater && queuedBytes_ <= lowWater;
+            }
+            if (notify) {
+                writable();
+            }
+        }
+    }
+
+    // 部分写入时跳过已写出的 iovec 继续
+    bool writeAll(std::vector<iovec>& iov) {
+        size_t index = 0;
+        while (index < iov.size()) {
+            msghdr msg{};
+            msg.msg_iov = &iov[index];
+            msg.msg_iovlen = std::min(iov.size() - index, kMaxIov);
+            ssize_t n = ::sendmsg(fd_, &msg, kSendFlags);
+            writeCalls_.fetch_add(1, std::memory_order_relaxed);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            size_t written = static_cast<size_t>(n);
+            while (index < iov.size() && written >= iov[index].iov_len) {
+                written -= iov[index].iov_len;
+                ++index;
+            }
+            if (written > 0) {
+                iov[index].iov_base = static_cast<uint8_t*>(iov[index].iov_base) + written;
+                iov[index].iov_len -= written;
+            }
+        }
+        return true;
+    }
+
+    int fd_;
+    std::atomic<bool> open_{true};  // 在 mutex_ 内修改，以便发送线程的等待不丢失通知
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Message> queue_;
+    size_t queuedBytes_ = 0;
+    std::atomic<size_t> lowWater_{0};
+    std::atomic<uint64_t> writeCalls_{0};
+    std::thread reader_;
+    std::thread writer_;
+};
+
+} // namespace
+
+#endif // _WIN32
+
+// ==================== LanService ====================
+
+LanService::LanService(Options options, OnTransport onTransport)
+    : options_(std::move(options)), onTransport_(std::move(onTransport)) {}
+
+LanService::~LanService() {
+    stop();
+}
+
+std::optional<LanService::Advertisement> LanService::advertise(const std::string& peerId, bool offerer) {
+    if (!running_) {
+        return std::nullopt;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = peers_.find(peerId);
+    if (!offerer && (it == peers_.end() || it->second.remoteNonce.empty())) {
+        return std::nullopt;
+    }
+    auto& peer = peers_[peerId];
+    uint8_t nonce[kNonceSize];
+    RAND_bytes(nonce, sizeof(nonce));
+    peer.localNonce = toHex(nonce, sizeof(nonce));
+    peer.ready = false;
+    if (offerer) {
+        peer.localIsOfferer = true;
+        peer.remoteNonce.clear();  // 新一轮协商，等 answer 中的随机数
+    } else {
+        peer.key = deriveKey(peer.remoteNonce, peer.localNonce);
+        peer.ready = true;
+    }
+    return Advertisement{addresses_, peer.localNonce};
+}
+
+void LanService::setRemote(const std::string& peerId, const std::string& nonce, bool remoteIsOfferer) {
+    uint8_t check[kNonceSize];
+    if (!fromHex(nonce, check, sizeof(check))) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& peer = peers_[peerId];
+    peer.remoteNonce = nonce;
+    peer.localIsOfferer = !remoteIsOfferer;
+    peer.ready = false;
+    if (remoteIsOfferer) {
+        peer.localNonce.clear();  // 本端 answer 时生成
+    } else if (!peer.localNonce.empty()) {
+        peer.key = deriveKey(peer.localNonce, peer.remoteNonce);
+        peer.ready = true;
+    }
+}
+
+void LanService::forget(const std::string& peerId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    peers_.erase(peerId);
+}
+
+bool LanService::keyFor(const std::string& peerId, Key& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = peers_.find(peerId);
+    if (it == peers_.end() || !it->second.ready) {
+        return false;
+    }
+    key = it->second.key;
+    return true;
+}
+
+#ifndef _WIN32
+
+bool LanService::start() {
+    if (running_) {
+        return true;
+    }
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options_.port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    bool anyAddress = options_.bindAddress.empty() || options_.bindAddress == "0.0.0.0";
+    if (!anyAddress && inet_pton(AF_INET, options_.bindAddress.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "[P2P] Invalid LAN bind address " << options_.bindAddress << std::endl;
+        ::close(fd);
+        return false;
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(fd, 64) < 0) {
+        std::cerr << "[P2P] Cannot listen for LAN connections: " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    socklen_t length = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length);
+
+    listenFd_ = fd;
+    port_ = ntohs(addr.sin_port);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        addresses_ = anyAddress ? localAddresses(port_)
+                                : std::vector<std::string>{options_.bindAddress + ":" + std::to_string(port_)};
+    }
+    running_ = true;
+    acceptThread_ = std::thread([this] {
+        configureCurrentThread(options_.threadName + "-lan", options_.cpus);
+        acceptLoop();
+    });
+    std::cout << "[P2P] Listening for LAN peers on port " << port_ << std::endl;
+    return true;
+}
+
+void LanService::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    {
+        // 唤醒阻塞在握手读写上的线程，不必等满 kHandshakeTimeoutMs
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int fd : handshakes_) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+    if (acceptThread_.joinable()) {
+        acceptThread_.join();
+    }
+    ::close(listenFd_);
+    listenFd_ = -1;
+
+    std::vector<std::pair<std::thread, std::shared_ptr<std::atomic<bool>>>> workers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        workers.swap(workers_);
+    }
+    for (auto& [thread, done] : workers) {
+        thread.join();
+    }
+}
+
+void LanService::acceptLoop() {
+    while (running_) {
+        pollfd pfd{listenFd_, POLLIN, 0};
+        if (poll(&pfd, 1, kAcceptPollMs) <= 0) {
+            continue;
+        }
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        // 握手最长阻塞 kHandshakeTimeoutMs，交给工作线程，不耽误后续连接
+        if (!beginHandshake(fd, kMaxPendingHandshakes) || !spawnWorker([this, fd] { handleAccepted(fd); })) {
+            endHandshake(fd);
+            ::close(fd);
+        }
+    }
+}
+
+// 应答方：读 hello，用对方 ID 对应的密钥回应质询，再校验对方的应答
+void LanService::handleAccepted(int fd) {
+    setTimeouts(fd, kHandshakeTimeoutMs);
+
+    char magic[4];
+    uint8_t version;
+    uint8_t idLength[2];
+    std::string peerId;
+    uint8_t remoteNonce[kNonceSize];
+    Key key;
+    bool ok = recvAll(fd, magic, sizeof(magic)) && std::memcmp(magic, kMagic, sizeof(magic)) == 0 &&
+              recvAll(fd, &version, 1) && version == kVersion &&
+              recvAll(fd, idLength, sizeof(idLength));
+    if (ok) {
+        size_t size = size_t(idLength[0]) << 8 | idLength[1];
+        peerId.resize(size);
+        ok = size > 0 && size <= kMaxIdLength && recvAll(fd, peerId.data(), size) &&
+             recvAll(fd, remoteNonce, sizeof(remoteNonce)) && keyFor(peerId, key);
+    }
+
+    if (ok) {
+        uint8_t reply[kNonceSize + kMacSize];
+        RAND_bytes(reply, kNonceSize);
+        handshakeMac(key, 'A', remoteNonce, reply, reply + kNonceSize);
+        uint8_t mac[kMacSize];
+        uint8_t expected[kMacSize];
+        handshakeMac(key, 'C', reply, remoteNonce, expected);
+        ok = sendAll(fd, reply, sizeof(reply)) && recvAll(fd, mac, sizeof(mac)) &&
+             CRYPTO_memcmp(mac, expected, kMacSize) == 0;
+    }
+
+    endHandshake(fd);
+    if (!ok || !running_) {
+        if (running_) {
+            std::cerr << "[P2P] Rejected LAN connection" << (peerId.empty() ? "" : " from " + peerId) << std::endl;
+        }
+        ::close(fd);
+        return;
+    }
+    if (auto transport = createTransport(fd)) {
+        std::cout << "[P2P] LAN connection from " << peerId << std::endl;
+        onTransport_(peerId, transport);
+        std::static_pointer_cast<LanTransport>(transport)->start(options_.threadName, options_.cpus);
+    }
+}
+
+void LanService::connect(const std::string& localId, const std::string& peerId,
+                         const std::vector<std::string>& addresses) {
+    if (!running_ || addresses.empty()) {
+        return;
+    }
+    spawnWorker([this, localId, peerId, addresses] {
+        connectLoop(localId, peerId, addresses);
+    });
+}
+
+// 在工作线程上执行 task；已调用 stop() 时不启动并返回 false
+bool LanService::spawnWorker(std::function<void()> task) {
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 与 stop() 在同一把锁下检查，stop() 取走 workers_ 之后不会再加入新线程
+    if (!running_) {
+        return false;
+    }
+    reapWorkers();
+    std::thread thread([this, task = std::move(task), done] {
+        configureCurrentThread(options_.threadName + "-lan", options_.cpus);
+        task();
+        *done = true;
+    });
+    workers_.emplace_back(std::move(thread), std::move(done));
+    return true;
+}
+
+// 登记握手中的连接，stop() 时 shutdown 它们；已停止或超过 limit 时返回 false
+bool LanService::beginHandshake(int fd, size_t limit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_ || handshakes_.size() >= limit) {
+        return false;
+    }
+    handshakes_.insert(fd);
+    return true;
+}
+
+// 必须在 close(fd) 之前调用，否则 stop() 可能 shutdown 复用了同一编号的其他连接
+void LanService::endHandshake(int fd) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    handshakes_.erase(fd);
+}
+
+// 调用方持有 mutex_
+void LanService::reapWorkers() {
+    for (auto it = workers_.begin(); it != workers_.end();) {
+        if (*it->second) {
+            it->first.join();
+            it = workers_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// 发起方：依次尝试对方的地址，直到一个地址完成握手
+void LanService::connectLoop(std::string localId, std::string peerId, std::vector<std::string> addresses) {
+    Key key;
+    if (localId.empty() || localId.size() > kMaxIdLength || !keyFor(peerId, key)) {
+        return;
+    }
+
+    for (const auto& address : addresses) {
+        if (!running_) {
+            return;
+        }
+        int fd = connectTo(address, running_);
+        if (fd < 0) {
+            continue;
+        }
+        if (!beginHandshake(fd)) {
+            ::close(fd);
+            return;
+        }
+        setTimeouts(fd, kHandshakeTimeoutMs);
+
+        std::vector<uint8_t> hello(kMagic, kMagic + sizeof(kMagic));
+        hello.push_back(kVersion);
+        hello.push_back(static_cast<uint8_t>(localId.size() >> 8));
+        hello.push_back(static_cast<uint8_t>(localId.size()));
+        hello.insert(hello.end(), localId.begin(), localId.end());
+        uint8_t nonce[kNonceSize];
+        RAND_bytes(nonce, sizeof(nonce));
+        hello.insert(hello.end(), nonce, nonce + sizeof(nonce));
+
+        uint8_t reply[kNonceSize + kMacSize];
+        uint8_t expected[kMacSize];
+        bool ok = sendAll(fd, hello.data(), hello.size()) && recvAll(fd, reply, sizeof(reply));
+        if (ok) {
+            handshakeMac(key, 'A', nonce, reply, expected);
+            ok = CRYPTO_memcmp(reply + kNonceSize, expected, kMacSize) == 0;
+        }
+        if (ok) {
+            uint8_t mac[kMacSize];
+            handshakeMac(key, 'C', reply, nonce, mac);
+            ok = sendAll(fd, mac, sizeof(mac));
+        }
+        endHandshake(fd);
+        if (!ok || !running_) {
+            ::close(fd);
+            continue;
+        }
+
+        if (auto transport = createTransport(fd)) {
+            std::cout << "[P2P] LAN connection to " << peerId << " via " << address << std::endl;
+            onTransport_(peerId, transport);
+            std::static_pointer_cast<LanTransport>(transport)->start(options_.threadName, options_.cpus);
+        }
+        return;
+    }
+    std::cout << "[P2P] No LAN route to " << peerId << ", using WebRTC" << std::endl;
+}
+
+std::shared_ptr<Transport> LanService::createTransport(int fd) {
+    setTimeouts(fd, 0);
+    configureSocket(fd, options_.socketBufferSize);
+    return std::make_shared<LanTransport>(fd);
+}
+
+#else // _WIN32
+
+bool LanService::start() {
+    std::cerr << "[P2P] LAN transport is not supported on this platform" << std::endl;
+    return false;
+}
+
+void LanService::stop() {}
+
+void LanService::acceptLoop() {}
+
+void LanService::handleAccepted(int) {}
+
+void LanService::connect(const std::string&, const std::string&, const std::vector<std::string>&) {}
+
+void LanService::reapWorkers() {}
+
+bool LanService::spawnWorker(std::function<void()>) {
+    return false;
+}
+
+bool LanService::beginHandshake(int, size_t) {
+    return false;
+}
+
+void LanService::endHandshake(int) {}
+
+void LanService::connectLoop(std::string, std::string, std::vector<std::string>) {}
+
+std::shared_ptr<Transport> LanService::createTransport(int) {
+    return nullptr;
+}
+
+#endif // _WIN32
+
+} // namespace p2p
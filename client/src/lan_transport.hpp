@@ -0,0 +1,111 @@
+// client/src/lan_transport.hpp
+#pragma once
+
+#include "transport.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace p2p {
+
+/**
+ * 局域网直连 (TCP)
+ *
+ * 同一可信局域网内的 Peer 绕过 ICE/DTLS/SCTP，直接用 TCP 收发直连消息：
+ * 双方在 offer/answer 中交换本机地址和随机数，发起方收到 answer 后连接对方的监听端口。
+ * 连接建立时用两端随机数派生的密钥做双向 HMAC 质询，只接受持有同一密钥的 Peer；
+ * 之后的数据不加密 (与 WebRTC 一样信任信令服务器，适用于可信网络)。
+ * 建立成功后作为 Transport::Kind::Lan 加入 Peer 的传输集合，直连消息优先经由它发送。
+ * 目前只支持 POSIX 平台，其他平台上 start() 返回 false。
+ */
+class LanService {
+public:
+    static constexpr size_t kNonceSize = 16;
+    using Key = std::array<uint8_t, 32>;
+
+    struct Options {
+        std::string bindAddress;         // 为空表示所有 IPv4 地址
+        uint16_t port = 0;               // 0 表示由系统分配
+        size_t socketBufferSize = 0;     // SO_SNDBUF / SO_RCVBUF，0 表示系统默认
+        std::string threadName = "p2p";  // 线程名前缀
+        std::vector<int> cpus;           // 收发线程的 CPU
+    };
+
+    // 写入 offer/answer 的本端信息
+    struct Advertisement {
+        std::vector<std::string> addresses;  // "ip:port"
+        std::string nonce;                   // 十六进制
+    };
+
+    // 握手成功的连接；回调返回后传输才开始收发，回调中应先设置传输的回调
+    using OnTransport = std::function<void(const std::string& peerId, std::shared_ptr<Transport> transport)>;
+
+    LanService(Options options, OnTransport onTransport);
+    ~LanService();
+
+    LanService(const LanService&) = delete;
+    LanService& operator=(const LanService&) = delete;
+
+    // 开始监听，失败时返回 false
+    bool start();
+
+    // 停止监听，中断进行中的连接和握手并等待其线程退出；已建立的传输不受影响，由客户端关闭
+    void stop();
+
+    // 本端地址和与该 Peer 的随机数 (每次 offer/answer 生成新的)；未在监听，
+    // 或作为应答方而对方的 offer 中没有局域网信息时为空
+    std::optional<Advertisement> advertise(const std::string& peerId, bool offerer);
+
+    // 对方 offer/answer 中的随机数；两端随机数都已知时派生密钥
+    void setRemote(const std::string& peerId, const std::string& nonce, bool remoteIsOfferer);
+
+    // 后台依次尝试对方的地址，握手成功后回调 OnTransport
+    void connect(const std::string& localId, const std::string& peerId, const std::vector<std::string>& addresses);
+
+    void forget(const std::string& peerId);
+
+private:
+    struct PeerKey {
+        std::string localNonce;
+        std::string remoteNonce;
+        bool localIsOfferer = false;
+        bool ready = false;
+        Key key{};
+    };
+
+    void acceptLoop();
+    void handleAccepted(int fd);
+    void connectLoop(std::string localId, std::string peerId, std::vector<std::string> addresses);
+    bool keyFor(const std::string& peerId, Key& key) const;
+    std::shared_ptr<Transport> createTransport(int fd);
+    void reapWorkers();
+    bool spawnWorker(std::function<void()> task);
+    bool beginHandshake(int fd, size_t limit = SIZE_MAX);
+    void endHandshake(int fd);
+
+    Options options_;
+    OnTransport onTransport_;
+
+    int listenFd_ = -1;
+    uint16_t port_ = 0;
+    std::vector<std::string> addresses_;
+    std::atomic<bool> running_{false};
+    std::thread acceptThread_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, PeerKey> peers_;
+    std::vector<std::pair<std::thread, std::shared_ptr<std::atomic<bool>>>> workers_;  // 连接/握手线程及其完成标记
+    std::unordered_set<int> handshakes_;  // 正在握手的 socket，stop() 时 shutdown 以唤醒阻塞的读写
+};
+
+} // namespace p2p
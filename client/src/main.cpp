@@ -11,6 +11,13 @@
 #include <thread>
 #include <chrono>
 #include <iomanip> // 添加这个头文件
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <ctime>
+#include <condition_variable>
+#include <mutex>
+#include <set>
 
 #include "p2p/p2p_client.hpp"
 
@@ -49,6 +56,12 @@ void printHelp()
     std::cout << "  relaysend <id> <msg> - Send via relay" << std::endl;
     std::cout << "  relaypeers        - List relay connected peers" << std::endl;
     std::cout << "  relaydisconnect <id> - Disconnect relay" << std::endl;
+    std::cout << "\n--- Diagnostics ---" << std::endl;
+    std::cout << "  bench <id> <size> <count>      - Throughput/latency test (P2P)" << std::endl;
+    std::cout << "  relaybench <id> <size> <count> - Throughput/latency test (relay)" << std::endl;
+    std::cout << "  ping <id> [n]     - Round-trip latency (P2P, or relay if not directly connected)" << std::endl;
+    std::cout << "  stats             - Show connection and protocol statistics" << std::endl;
+    std::cout << "  responder on|off  - Answer remote bench/ping probes (default: on)" << std::endl;
     std::cout << "\n  help              - Show this help" << std::endl;
     std::cout << "  quit              - Exit" << std::endl;
     std::cout << "===========================\n"
@@ -79,6 +92,311 @@ std::string bytesToHex(const p2p::BinaryData &bytes)
     return oss.str();
 }
 
+// ==================== 诊断：bench / ping ====================
+
+// 探测消息：对端的应答器收到后回复 BenchEcho
+struct BenchProbe
+{
+    uint32_t run;             // 测试编号，用于丢弃上一轮迟到的应答
+    uint32_t seq;
+    uint64_t sentMicros;      // 本端发送时刻，由应答原样带回
+    uint8_t viaRelay;         // 应答走同一条路径
+    std::string_view payload;
+    P2P_SCHEMA(0x50420001, run, seq, sentMicros, viaRelay, payload)
+};
+
+struct BenchEcho
+{
+    uint32_t run;
+    uint32_t seq;
+    uint64_t sentMicros;
+    P2P_SCHEMA(0x50420002, run, seq, sentMicros)
+};
+
+uint64_t nowMicros()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+}
+
+// 一轮测试的应答收集 (回调线程写入，命令线程等待)
+class BenchRun
+{
+public:
+    uint32_t start()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rtts_.clear();
+        return ++run_;
+    }
+
+    // 结束本轮，之后到达的应答被丢弃
+    std::vector<uint64_t> finish()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++run_;
+        return std::move(rtts_);
+    }
+
+    void onEcho(const BenchEcho &echo)
+    {
+        uint64_t rtt = nowMicros() - echo.sentMicros;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (echo.run != run_)
+                return;
+            rtts_.push_back(rtt);
+        }
+        cv_.notify_all();
+    }
+
+    // 等待在途 (已发送未应答) 的探测数降到 limit 以下，超时返回 false
+    bool waitInFlight(size_t sent, size_t limit, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_for(lock, timeout, [&]
+                            { return rtts_.size() + limit > sent; });
+    }
+
+    // 最近一个应答的往返时间 (微秒)
+    uint64_t last()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return rtts_.empty() ? 0 : rtts_.back();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    uint32_t run_ = 0;
+    std::vector<uint64_t> rtts_;
+};
+
+constexpr size_t kBenchWindow = 64;           // 在途探测上限，避免发送缓冲区堆积
+constexpr size_t kBenchMaxPayload = 60 * 1024; // 单条消息不超过 SCTP 默认消息上限
+constexpr auto kBenchEchoTimeout = std::chrono::seconds(5);
+
+double toMillis(uint64_t micros)
+{
+    return static_cast<double>(micros) / 1000.0;
+}
+
+double elapsedMillis(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 取已排序样本的分位数 (最近秩)
+uint64_t percentile(const std::vector<uint64_t> &sorted, double p)
+{
+    size_t rank = static_cast<size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+void printLatency(std::vector<uint64_t> rtts)
+{
+    if (rtts.empty())
+    {
+        std::cout << "  rtt: no replies (is the remote responder on?)" << std::endl;
+        return;
+    }
+    std::sort(rtts.begin(), rtts.end());
+    uint64_t total = 0;
+    for (uint64_t rtt : rtts)
+        total += rtt;
+    std::cout << std::fixed << std::setprecision(3)
+              << "  rtt (ms): min " << toMillis(rtts.front())
+              << "  avg " << toMillis(total / rtts.size())
+              << "  p50 " << toMillis(percentile(rtts, 0.50))
+              << "  p90 " << toMillis(percentile(rtts, 0.90))
+              << "  p99 " << toMillis(percentile(rtts, 0.99))
+              << "  max " << toMillis(rtts.back()) << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+// 进程累计占用的 CPU 时间 (秒，所有线程合计)
+double processCpuSeconds()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+    auto ticks = [](const FILETIME &t)
+    { return (static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime; };
+    return static_cast<double>(ticks(kernel) + ticks(user)) / 1e7;
+#else
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+bool sendProbe(p2p::P2PClient &client, const std::string &peerId, const BenchProbe &probe)
+{
+    return probe.viaRelay ? client.sendObjectViaRelay(peerId, probe) : client.sendObject(peerId, probe);
+}
+
+// 以 kBenchWindow 为窗口连续发送 count 条 size 字节的探测，等全部应答后统计吞吐和延迟
+void runBench(p2p::P2PClient &client, BenchRun &bench, const std::string &peerId,
+              size_t size, size_t count, bool viaRelay)
+{
+    std::string payload(size, '\xA5');
+    uint32_t run = bench.start();
+    auto begin = std::chrono::steady_clock::now();
+    double cpuBegin = processCpuSeconds();
+
+    size_t sent = 0;
+    for (uint32_t seq = 0; seq < count; ++seq)
+    {
+        if (!bench.waitInFlight(sent, kBenchWindow, kBenchEchoTimeout))
+        {
+            std::cout << "  timed out waiting for replies after " << sent << " messages" << std::endl;
+            break;
+        }
+        BenchProbe probe{run, seq, nowMicros(), viaRelay, payload};
+        if (!sendProbe(client, peerId, probe))
+        {
+            std::cout << "  send failed after " << sent << " messages" << std::endl;
+            break;
+        }
+        ++sent;
+    }
+    bench.waitInFlight(sent, 1, kBenchEchoTimeout);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double cpuSeconds = processCpuSeconds() - cpuBegin;
+    auto rtts = bench.finish();
+    double bytes = static_cast<double>(rtts.size()) * static_cast<double>(size);
+
+    std::string transport = "relay";
+    if (!viaRelay)
+    {
+        auto info = client.getPeerInfo(peerId);
+        transport = info && !info->transport.empty() ? info->transport : "P2P";
+    }
+    std::cout << "[Bench] " << peerId << " (" << transport << "): "
+              << sent << " x " << size << " bytes in " << std::fixed << std::setprecision(3) << seconds << " s"
+              << std::endl;
+    std::cout << "  echoed " << rtts.size() << ", lost " << (sent - rtts.size()) << std::endl;
+    if (seconds > 0)
+    {
+        std::cout << std::setprecision(1)
+                  << "  throughput: " << static_cast<double>(rtts.size()) / seconds << " msg/s, "
+                  << bytes / seconds / (1024.0 * 1024.0) << " MiB/s ("
+                  << bytes * 8.0 / seconds / 1e6 << " Mbit/s)" << std::endl;
+    }
+    // 本进程同时负责发送探测和接收应答；对端回显的开销不计入
+    if (cpuSeconds > 0 && seconds > 0)
+    {
+        std::cout << std::setprecision(1)
+                  << "  cpu: " << cpuSeconds << " s (" << cpuSeconds / seconds * 100.0 << "% of one core), "
+                  << static_cast<double>(rtts.size()) / cpuSeconds << " msg/s per core" << std::endl;
+    }
+    std::cout.unsetf(std::ios::floatfield);
+    printLatency(std::move(rtts));
+}
+
+// 逐个发送探测并等待应答，每次间隔 200ms
+void runPing(p2p::P2PClient &client, BenchRun &bench, const std::string &peerId, size_t count, bool viaRelay)
+{
+    uint32_t run = bench.start();
+    size_t sent = 0;
+    for (uint32_t seq = 0; seq < count; ++seq)
+    {
+        if (seq > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        BenchProbe probe{run, seq, nowMicros(), viaRelay, {}};
+        if (!sendProbe(client, peerId, probe))
+        {
+            std::cout << "  seq=" << seq << " send failed" << std::endl;
+            continue;
+        }
+        ++sent;
+        if (bench.waitInFlight(sent, 1, std::chrono::seconds(1)))
+        {
+            std::cout << "  seq=" << seq << " time=" << std::fixed << std::setprecision(3)
+                      << toMillis(bench.last()) << " ms" << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+        }
+        else
+        {
+            std::cout << "  seq=" << seq << " timeout" << std::endl;
+            // 迟到的应答会打乱计数，换一轮编号
+            bench.finish();
+            run = bench.start();
+            sent = 0;
+        }
+    }
+    printLatency(bench.finish());
+}
+
+void printStats(const p2p::P2PClient &client)
+{
+    const char *relayStateStr[] = {"NotAuthenticated", "Authenticating", "Authenticated", "AuthFailed"};
+
+    std::cout << "\n=== Statistics ===" << std::endl;
+    std::cout << "Local ID: " << client.getLocalId()
+              << "  relay: " << relayStateStr[static_cast<int>(client.getRelayState())] << std::endl;
+    auto runtime = p2p::getRuntimeStats();
+    std::cout << "Runtime: " << (runtime.initialized ? "preloaded" : "on demand") << ", init "
+              << std::fixed << std::setprecision(3) << toMillis(runtime.initMicros) << " ms" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+
+    auto peers = client.getConnectedPeers();
+    auto relayPeers = client.getRelayConnectedPeers();
+    std::cout << "Peers: " << peers.size() << " P2P, " << relayPeers.size() << " relay" << std::endl;
+    for (const auto &p : peers)
+        std::cout << "  - " << p << " (P2P)" << std::endl;
+    for (const auto &p : relayPeers)
+        std::cout << "  - " << p << " (relay)" << std::endl;
+    std::set<std::string> known(peers.begin(), peers.end());
+    known.insert(relayPeers.begin(), relayPeers.end());
+    for (const auto &p : known)
+    {
+        for (const auto &t : client.getTransportStats(p))
+        {
+            std::cout << "    " << p << " " << t.transport << (t.selected ? "*" : "") << (t.open ? "" : " (closed)")
+                      << ": sent " << t.messagesSent << "/" << t.bytesSent << "B, recv "
+                      << t.messagesReceived << "/" << t.bytesReceived << "B, failures " << t.sendFailures
+                      << ", buffered " << t.bufferedAmount << "B, rtt " << t.rttMicros << "us";
+            if (t.writeCalls > 0)
+            {
+                std::cout << ", " << std::fixed << std::setprecision(1)
+                          << static_cast<double>(t.messagesSent) / static_cast<double>(t.writeCalls) << " msg/syscall";
+                std::cout.unsetf(std::ios::floatfield);
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    auto compression = client.getCompressionStats();
+    std::cout << "Compression: " << compression.messagesCompressed << " compressed, "
+              << compression.messagesUncompressed << " uncompressed, "
+              << compression.messagesDecompressed << " decompressed, ratio "
+              << std::fixed << std::setprecision(2) << compression.ratio() << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+
+    auto rpc = client.getRpcStats();
+    if (!rpc.empty())
+    {
+        std::cout << "RPC:" << std::endl;
+        for (const auto &m : rpc)
+        {
+            std::cout << "  " << m.method << ": " << m.calls << " calls, " << m.succeeded << " ok, "
+                      << m.failed << " failed, " << m.timeouts << " timeouts"
+                      << "  p50<" << m.percentileMicros(0.5) << "us p99<" << m.percentileMicros(0.99) << "us"
+                      << std::endl;
+        }
+    }
+
+    auto state = client.getStateSyncStats();
+    std::cout << "State sync: v" << state.version << ", " << state.keys << " keys, " << state.peers << " peers, "
+              << state.snapshotsSent << " snapshots / " << state.deltasSent << " deltas sent ("
+              << state.bytesSent << " bytes), " << state.updatesReceived << " updates received" << std::endl;
+    std::cout << "==================\n"
+              << std::endl;
+}
+
 int main(int argc, char *argv[])
 {
 #ifdef _WIN32
@@ -103,7 +421,12 @@ int main(int argc, char *argv[])
     std::cout << "[Example] Server: " << serverUrl << std::endl;
 
     // 设置日志级别
-    p2p::P2PClient::setLogLevel(2); // Warning
+    // 预加载网络库并设置日志级别 (Warning)，初始化开销不计入连接
+    auto startupBegin = std::chrono::steady_clock::now();
+    p2p::InitOptions initOptions;
+    initOptions.logLevel = 2;
+    p2p::initialize(initOptions);
+    std::cout << "[Example] Library initialized in " << elapsedMillis(startupBegin) << " ms" << std::endl;
 
     // 创建配置
     p2p::ClientConfig config;
@@ -111,6 +434,11 @@ int main(int argc, char *argv[])
     config.peerId = peerId;
     config.connectionTimeout = 10000;
 
+    // 诊断状态 (先于客户端构造，客户端析构时回调仍可安全访问)
+    BenchRun bench;
+    std::atomic<bool> responder{true};
+    p2p::ObjectRouter router;
+
     // 创建客户端
     p2p::P2PClient client(config);
 
@@ -147,9 +475,24 @@ int main(int argc, char *argv[])
     client.setOnTextMessage([](const std::string &from, const std::string &msg)
                             { std::cout << "\n[Message] From " << from << ": " << msg << std::endl; });
 
-    client.setOnBinaryMessage([](const std::string &from, const p2p::BinaryData &data)
-                              { std::cout << "\n[Binary] From " << from << ": " << bytesToHex(data)
-                                          << " (" << data.size() << " bytes)" << std::endl; });
+    // 诊断探测按类型分发，其余二进制消息以十六进制显示
+    router.on<BenchProbe>([&client, &responder](const std::string &from, const BenchProbe &probe)
+                          {
+        if (!responder) return;
+        BenchEcho echo{probe.run, probe.seq, probe.sentMicros};
+        if (probe.viaRelay) {
+            client.sendObjectViaRelay(from, echo);
+        } else {
+            client.sendObject(from, echo);
+        } });
+    router.on<BenchEcho>([&bench](const std::string &, const BenchEcho &echo)
+                         { bench.onEcho(echo); });
+
+    client.setOnBufferMessage([&router](const std::string &from, const p2p::Buffer &data)
+                              {
+        if (router.dispatch(from, data)) return;
+        std::cout << "\n[Binary] From " << from << ": " << bytesToHex(data.toVector())
+                  << " (" << data.size() << " bytes)" << std::endl; });
 
     client.setOnPeerList([](const std::vector<std::string> &peers)
                          {
@@ -167,13 +510,15 @@ int main(int argc, char *argv[])
         std::cout << "[State] " << stateStr[static_cast<int>(state)] << std::endl; });
 
     // 连接
+    auto connectBegin = std::chrono::steady_clock::now();
     if (!client.connect())
     {
         std::cerr << "[Example] Failed to connect to signaling server" << std::endl;
         return 1;
     }
 
-    std::cout << "[Example] My ID: " << client.getLocalId() << std::endl;
+    std::cout << "[Example] My ID: " << client.getLocalId() << " (connected in " << elapsedMillis(connectBegin)
+              << " ms, " << elapsedMillis(startupBegin) << " ms since start)" << std::endl;
 
     printHelp();
 
@@ -378,6 +723,79 @@ int main(int argc, char *argv[])
                 std::cout << "Usage: relaydisconnect <peer_id>" << std::endl;
             }
         }
+        else if (command == "bench" || command == "relaybench")
+        {
+            bool viaRelay = command == "relaybench";
+            size_t size = 0;
+            size_t count = 0;
+            if (tokens.size() >= 4)
+            {
+                try
+                {
+                    size = std::stoul(tokens[2]);
+                    count = std::stoul(tokens[3]);
+                }
+                catch (const std::exception &)
+                {
+                    count = 0;
+                }
+            }
+            if (count == 0 || size > kBenchMaxPayload)
+            {
+                std::cout << "Usage: " << command << " <peer_id> <size> <count>  (size <= " << kBenchMaxPayload
+                          << ")" << std::endl;
+                std::cout << "Example: " << command << " peer_1 1024 1000" << std::endl;
+            }
+            else if (viaRelay ? !client.isPeerRelayConnected(tokens[1]) : !client.isPeerConnected(tokens[1]))
+            {
+                std::cout << "Not " << (viaRelay ? "relay" : "P2P") << " connected to " << tokens[1] << std::endl;
+            }
+            else
+            {
+                runBench(client, bench, tokens[1], size, count, viaRelay);
+            }
+        }
+        else if (command == "ping")
+        {
+            size_t count = 4;
+            if (tokens.size() >= 3)
+            {
+                try
+                {
+                    count = std::stoul(tokens[2]);
+                }
+                catch (const std::exception &)
+                {
+                    count = 0;
+                }
+            }
+            if (tokens.size() < 2 || count == 0)
+            {
+                std::cout << "Usage: ping <peer_id> [count]" << std::endl;
+            }
+            else if (client.isPeerConnected(tokens[1]) || client.isPeerRelayConnected(tokens[1]))
+            {
+                bool viaRelay = !client.isPeerConnected(tokens[1]);
+                std::cout << "[Ping] " << tokens[1] << (viaRelay ? " (relay)" : " (P2P)") << std::endl;
+                runPing(client, bench, tokens[1], count, viaRelay);
+            }
+            else
+            {
+                std::cout << "Not connected to " << tokens[1] << std::endl;
+            }
+        }
+        else if (command == "stats")
+        {
+            printStats(client);
+        }
+        else if (command == "responder")
+        {
+            if (tokens.size() >= 2 && (tokens[1] == "on" || tokens[1] == "off"))
+            {
+                responder = tokens[1] == "on";
+            }
+            std::cout << "Responder: " << (responder ? "on" : "off") << std::endl;
+        }
 
         else
         {
@@ -385,7 +803,10 @@ int main(int argc, char *argv[])
         }
     }
 
-    client.disconnect();
+    auto teardown = client.disconnectAsync().get();
+    std::cout << "[Example] Disconnected in " << toMillis(teardown.totalMicros) << " ms ("
+              << teardown.peerConnections << " peer connections closed in " << toMillis(teardown.closeMicros)
+              << " ms)" << std::endl;
     std::cout << "[Example] Goodbye!" << std::endl;
 
     return 0;
@@ -1,5 +1,19 @@
 #include "p2p/p2p_client.hpp"
 #include "protocol.hpp"
+#include "compression.hpp"
+#include "relay_session.hpp"
+#include "frames.hpp"
+#include "rpc.hpp"
+#include "stream_mux.hpp"
+#include "pubsub.hpp"
+#include "state_sync.hpp"
+#include "gateway.hpp"
+#include "dispatcher.hpp"
+#include "callback_slot.hpp"
+#include "transport.hpp"
+#include "lan_transport.hpp"
+#include "runtime.hpp"
+#include "thread_affinity.hpp"
 
 #include <rtc/rtc.hpp>
 #include <nlohmann/json.hpp>
@@ -11,6 +25,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <thread>
+#include <algorithm>
+#include <map>
 
 namespace p2p {
 
@@ -57,14 +73,56 @@ static ParsedTurnUrl parseTurnUrl(const std::string& url) {
 }
 
 // ==================== 实现类 ====================
-class P2PClientImpl {
+class P2PClientImpl final : public GatewayEndpoint {
 public:
-    explicit P2PClientImpl(const ClientConfig& config)
+    explicit P2PClientImpl(const ClientConfig& config, std::shared_ptr<GatewayImpl> gateway = nullptr)
         : config_(config)
+        , gateway_(std::move(gateway))
+        , compressor_(config_)
         , state_(ConnectionState::Disconnected)
         , relayState_(RelayState::NotAuthenticated)
         , running_(false)
+        , pubsub_([this](const std::string& peerId, const ConstBuffer* parts, size_t count) {
+              return sendFrame(peerId, FrameKind::PubSub, parts, count);
+          })
+        , stateSync_([this](const std::string& peerId, const ConstBuffer* parts, size_t count) {
+              return sendFrame(peerId, FrameKind::StateSync, parts, count);
+          }, std::chrono::milliseconds(config_.stateSyncInterval))
+        , rpc_([this](const std::string& peerId, const ConstBuffer* parts, size_t count) {
+              return sendFrame(peerId, FrameKind::Rpc, parts, count);
+          })
     {
+        streams_ = std::make_shared<StreamMux>(
+            [this](const std::string& peerId, const ConstBuffer* parts, size_t count) {
+                return sendFrame(peerId, FrameKind::Stream, parts, count);
+            },
+            [this](const std::string& peerId, size_t size) { return frameWritable(peerId, size); },
+            config_.streamWindow, config_.streamSendBuffer);
+        
+        // 线程：内部线程启动时绑定；网络库初始化和分发线程推迟到 connect()，构造客户端不创建线程
+        const auto& threading = config_.threading;
+        rpc_.setThreadInit([name = threading.threadName + "-rpc", cpus = threading.dispatchCpus] {
+            configureCurrentThread(name, cpus);
+        });
+        stateSync_.setThreadInit([name = threading.threadName + "-state", cpus = threading.dispatchCpus] {
+            configureCurrentThread(name, cpus);
+        });
+        if (gateway_) {
+            dispatcher_ = gateway_->dispatcher();  // 网关的端点共用网关的分发线程
+        }
+        if (config_.lan.enabled && !gateway_) {
+            LanService::Options options;
+            options.bindAddress = config_.lan.bindAddress;
+            options.port = config_.lan.port;
+            options.socketBufferSize = config_.lan.socketBufferSize;
+            options.threadName = threading.threadName;
+            options.cpus = threading.networkCpus;
+            lan_ = std::make_unique<LanService>(std::move(options),
+                [this](const std::string& peerId, std::shared_ptr<Transport> transport) {
+                    attachLanTransport(peerId, std::move(transport));
+                });
+        }
+        
         // 配置 RTC - STUN 服务器
         for (const auto& server : config_.stunServers) {
             rtcConfig_.iceServers.emplace_back(server);
@@ -89,47 +147,67 @@ public:
     }
     
     ~P2PClientImpl() {
+        waitPendingTeardowns();
         disconnect();
+        stopRelayTimer();
+        dispatchScope_->close();  // 跳过尚未执行的回调并等待正在执行的回调，之后不会再回调应用
+        if (dispatcher_ && !gateway_) {
+            dispatcher_->stop();
+        }
     }
     
     bool connect() {
+        if (gateway_) {
+            return attachToGateway();
+        }
+        ensureRuntime(config_.threading.networkCpus);
+        const auto& threading = config_.threading;
+        if (!dispatcher_ && threading.dispatchThreads > 0) {
+            // 在创建连接之前设置，之后网络线程上的回调才会读取
+            dispatcher_ = std::make_shared<CallbackDispatcher>(
+                threading.dispatchThreads, threading.dispatchCpus, threading.threadName + "-cb");
+        }
+        if (lan_ && !lan_->start()) {
+            std::cerr << "[P2P] LAN transport unavailable, using WebRTC only" << std::endl;
+        }
         try {
             running_ = true;
             setState(ConnectionState::Connecting);
             
-            ws_ = std::make_shared<rtc::WebSocket>();
+            auto ws = std::make_shared<rtc::WebSocket>();
+            setSocket(ws);
             
-            ws_->onOpen([this]() {
+            ws->onOpen([this]() {
                 std::cout << "[P2P] Connected to signaling server" << std::endl;
                 setState(ConnectionState::Connected);
                 
+                // 持有会话令牌时以原 ID 重新注册，服务端据此恢复中继会话
                 SignalingMessage msg;
                 msg.type = MessageType::Register;
-                msg.payload = config_.peerId;
-                ws_->send(msg.serialize());
+                msg.payload = sessionToken_.empty() ? config_.peerId : *localId();
+                msg.version = kProtocolVersion;
+                msg.session = sessionToken_;
+                if (auto ws = socket()) {
+                    ws->send(msg.serialize());
+                }
                 
                 if (onConnected_) {
                     onConnected_();
                 }
             });
             
-            ws_->onMessage([this](auto message) {
+            ws->onMessage([this](auto message) {
                 if (std::holds_alternative<std::string>(message)) {
                     handleSignalingMessage(std::get<std::string>(message));
                 }
             });
             
-            ws_->onClosed([this]() {
+            ws->onClosed([this]() {
                 std::cout << "[P2P] Disconnected from signaling server" << std::endl;
-                setState(ConnectionState::Disconnected);
-                setRelayState(RelayState::NotAuthenticated);
-                
-                if (onDisconnected_) {
-                    onDisconnected_(Error{ErrorCode::None, "Connection closed"});
-                }
+                handleSignalingClosed();
             });
             
-            ws_->onError([this](const std::string& error) {
+            ws->onError([this](const std::string& error) {
                 std::cerr << "[P2P] WebSocket error: " << error << std::endl;
                 setState(ConnectionState::Failed);
                 
@@ -138,23 +216,9 @@ public:
                 }
             });
             
-            ws_->open(config_.signalingUrl);
-            
-            auto timeout = std::chrono::milliseconds(config_.connectionTimeout);
-            auto start = std::chrono::steady_clock::now();
-            
-            while (state_ == ConnectionState::Connecting) {
-                if (std::chrono::steady_clock::now() - start > timeout) {
-                    setState(ConnectionState::Failed);
-                    if (onError_) {
-                        onError_(Error{ErrorCode::Timeout, "Connection timeout"});
-                    }
-                    return false;
-                }
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-            }
+            ws->open(config_.signalingUrl);
             
-            return state_ == ConnectionState::Connected;
+            return waitConnected();
         } catch (const std::exception& e) {
             setState(ConnectionState::Failed);
             if (onError_) {
@@ -164,6 +228,95 @@ public:
         }
     }
     
+    // 网关端点：在网关的共享连接上注册虚拟 ID，Attach 回复到达后进入 Connected
+    bool attachToGateway() {
+        running_ = true;
+        setSocket(gateway_->socket());
+        if (!gateway_->isConnected()) {
+            setState(ConnectionState::Failed);
+            if (onError_) {
+                onError_(Error{ErrorCode::ConnectionFailed, "Gateway is not connected"});
+            }
+            return false;
+        }
+        
+        setState(ConnectionState::Connecting);
+        gateway_->detach(gatewaySlot_);
+        auto id = localId();
+        gatewaySlot_ = gateway_->attach(this, id->empty() ? config_.peerId : *id);
+        if (!gatewaySlot_) {
+            setState(ConnectionState::Failed);
+            return false;
+        }
+        if (!waitConnected()) {
+            gateway_->detach(gatewaySlot_);
+            gatewaySlot_.reset();
+            return false;
+        }
+        return true;
+    }
+    
+    bool waitConnected() {
+        auto timeout = std::chrono::milliseconds(config_.connectionTimeout);
+        auto start = std::chrono::steady_clock::now();
+        
+        while (state_ == ConnectionState::Connecting) {
+            if (std::chrono::steady_clock::now() - start > timeout) {
+                setState(ConnectionState::Failed);
+                if (onError_) {
+                    onError_(Error{ErrorCode::Timeout, "Connection timeout"});
+                }
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        
+        return state_ == ConnectionState::Connected;
+    }
+    
+    void handleSignalingClosed() {
+        setState(ConnectionState::Disconnected);
+        resumeRelayState_ = relayState_.load();
+        setRelayState(RelayState::NotAuthenticated);
+        protocolVersion_ = kProtocolVersionStringPayload;
+        
+        if (onDisconnected_) {
+            onDisconnected_(Error{ErrorCode::None, "Connection closed"});
+        }
+    }
+    
+    // ==================== GatewayEndpoint ====================
+    
+    void handleAttached(const std::string& id, const std::string& error) override {
+        if (!error.empty()) {
+            std::cerr << "[P2P] Gateway attach failed: " << error << std::endl;
+            setState(ConnectionState::Failed);
+            if (onError_) {
+                onError_(Error{ErrorCode::SignalingError, error});
+            }
+            return;
+        }
+        
+        setLocalId(id);
+        protocolVersion_ = gateway_->protocolVersion();
+        std::cout << "[P2P] Attached as: " << id << " (gateway " << gateway_->localId() << ")" << std::endl;
+        
+        // 虚拟 ID 不恢复会话；不自动请求 Peer 列表，避免大量端点同时注册时服务端逐个回复全表
+        dropRelayPeers();
+        setState(ConnectionState::Connected);
+        if (onConnected_) {
+            onConnected_();
+        }
+    }
+    
+    void handleGatewayMessage(const SignalingMessage& msg) override {
+        dispatchSignaling(msg);
+    }
+    
+    void handleGatewayClosed() override {
+        handleSignalingClosed();
+    }
+    
     std::future<bool> connectAsync() {
         return std::async(std::launch::async, [this]() {
             return connect();
@@ -171,28 +324,146 @@ public:
     }
     
     void disconnect() {
+        teardown();
+    }
+    
+    std::future<DisconnectStats> disconnectAsync() {
+        {
+            std::lock_guard<std::mutex> lock(teardownMutex_);
+            ++pendingTeardowns_;
+        }
+        return std::async(std::launch::async, [this]() {
+            DisconnectStats stats = teardown();
+            std::lock_guard<std::mutex> lock(teardownMutex_);
+            --pendingTeardowns_;
+            teardownCv_.notify_all();  // 持锁通知：析构函数被唤醒时本任务已不再访问成员
+            return stats;
+        });
+    }
+    
+    // 等待尚未完成的 disconnectAsync (析构前调用)
+    void waitPendingTeardowns() {
+        std::unique_lock<std::mutex> lock(teardownMutex_);
+        teardownCv_.wait(lock, [this] { return pendingTeardowns_ == 0; });
+    }
+    
+    // 关闭 PeerConnection：pc->close() 要等传输层停止，逐个关闭时总耗时随连接数线性增长。
+    // 每 kCloseBatch 个连接用一个线程 (当前线程也参与)，连接不多时 (网关端点、普通客户端) 逐个关闭，不创建线程
+    static void closePeerConnections(const std::vector<std::shared_ptr<rtc::PeerConnection>>& pcs) {
+        size_t workers = std::min<size_t>({(pcs.size() + kCloseBatch - 1) / kCloseBatch, kMaxTeardownThreads,
+                                           std::max(1u, std::thread::hardware_concurrency())});
+        std::atomic<size_t> next{0};
+        auto closeNext = [&pcs, &next]() {
+            for (size_t i = next++; i < pcs.size(); i = next++) {
+                try {
+                    pcs[i]->close();
+                } catch (const std::exception& e) {
+                    std::cerr << "[P2P] Failed to close peer connection: " << e.what() << std::endl;
+                }
+            }
+        };
+        
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < workers; ++i) {
+            threads.emplace_back(closeNext);
+        }
+        closeNext();  // 当前线程也参与
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    
+    DisconnectStats teardown() {
+        auto start = std::chrono::steady_clock::now();
+        DisconnectStats stats;
         running_ = false;
         
+        // 先停止接受局域网连接，握手中的连接完成后会再次获取 peerMutex_
+        if (lan_) {
+            lan_->stop();
+        }
+        
+        // 在锁内只摘下连接表，关闭和释放都在锁外进行：关闭期间触发的回调会再次获取 peerMutex_，
+        // 其他线程上的收发和查询也不必等待整个关闭过程
+        std::vector<std::shared_ptr<rtc::PeerConnection>> pcs;
+        std::unordered_map<std::string, TransportSet> transports;
+        std::unordered_map<std::string, std::shared_ptr<rtc::DataChannel>> systemChannels;
+        std::unordered_map<std::string, std::shared_ptr<RelaySession>> relaySessions;
+        std::vector<std::string> relayPeers;
         {
             std::lock_guard<std::mutex> lock(peerMutex_);
+            pcs.reserve(peerConnections_.size());
             for (auto& [id, pc] : peerConnections_) {
-                if (pc) pc->close();
+                if (pc) pcs.push_back(std::move(pc));
             }
             peerConnections_.clear();
-            dataChannels_.clear();
+            transports.swap(transports_);
+            systemChannels.swap(systemChannels_);
+            relaySessions.swap(relaySessions_);
+            relayPeers.assign(relayPeers_.begin(), relayPeers_.end());
             relayPeers_.clear();
+            relayCompression_.clear();
+            relaySystemPeers_.clear();
+        }
+        
+        auto closeStart = std::chrono::steady_clock::now();
+        closePeerConnections(pcs);
+        for (const auto& [id, set] : transports) {
+            if (auto lan = set.find(Transport::Kind::Lan)) {
+                lan->close();
+            }
         }
+        stats.peerConnections = pcs.size();
+        stats.relayPeers = relayPeers.size();
+        stats.closeMicros = microsSince(closeStart);
         
-        if (ws_ && ws_->isOpen()) {
-            ws_->close();
+        rpc_.cancelAll();
+        streams_->closeAll();
+        pubsub_.clearPeers();
+        stateSync_.clearPeers();
+        
+        auto ws = socket();
+        if (ws && ws->isOpen()) {
+            // 主动断开不恢复会话：先通知中继对端，服务端无需保留中继连接对
+            for (const auto& peerId : relayPeers) {
+                SignalingMessage msg;
+                msg.type = MessageType::RelayDisconnect;
+                msg.from = *localId();
+                msg.to = peerId;
+                ws->send(msg.serialize());
+            }
+            if (!gateway_) {
+                ws->close();
+            }
         }
+        if (gateway_) {
+            // 共享连接保持打开，只注销本端点的 ID
+            gateway_->detach(gatewaySlot_);
+            gatewaySlot_.reset();
+            setSocket(nullptr);
+        }
+        sessionToken_.clear();
         
         setState(ConnectionState::Disconnected);
         setRelayState(RelayState::NotAuthenticated);
+        
+        stats.totalMicros = microsSince(start);
+        if (stats.peerConnections > 0) {
+            std::cout << "[P2P] Closed " << stats.peerConnections << " peer connections in "
+                      << stats.closeMicros / 1000 << " ms (disconnect took " << stats.totalMicros / 1000 << " ms)"
+                      << std::endl;
+        }
+        return stats;
+    }
+    
+    static uint64_t microsSince(std::chrono::steady_clock::time_point start) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
     }
     
     bool isConnected() const {
-        return state_ == ConnectionState::Connected && ws_ && ws_->isOpen();
+        auto ws = socket();
+        return state_ == ConnectionState::Connected && ws && ws->isOpen();
     }
     
     ConnectionState getState() const {
@@ -200,7 +471,7 @@ public:
     }
     
     std::string getLocalId() const {
-        return localId_;
+        return *localId();
     }
     
     bool connectToPeer(const std::string& peerId) {
@@ -234,34 +505,54 @@ public:
     }
     
     void disconnectFromPeer(const std::string& peerId) {
-        std::lock_guard<std::mutex> lock(peerMutex_);
-        
-        auto dcIt = dataChannels_.find(peerId);
-        if (dcIt != dataChannels_.end()) {
-            if (dcIt->second) dcIt->second->close();
-            dataChannels_.erase(dcIt);
+        std::shared_ptr<Transport> transport;
+        std::shared_ptr<Transport> lanTransport;
+        std::shared_ptr<rtc::DataChannel> systemChannel;
+        std::shared_ptr<rtc::PeerConnection> pc;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            
+            transport = detachTransport(peerId, Transport::Kind::WebRtc);
+            lanTransport = detachTransport(peerId, Transport::Kind::Lan);
+            
+            auto sysIt = systemChannels_.find(peerId);
+            if (sysIt != systemChannels_.end()) {
+                systemChannel = std::move(sysIt->second);
+                systemChannels_.erase(sysIt);
+            }
+            
+            auto pcIt = peerConnections_.find(peerId);
+            if (pcIt != peerConnections_.end()) {
+                pc = std::move(pcIt->second);
+                peerConnections_.erase(pcIt);
+            }
+            
+            directCompression_.erase(peerId);
         }
         
-        auto pcIt = peerConnections_.find(peerId);
-        if (pcIt != peerConnections_.end()) {
-            if (pcIt->second) pcIt->second->close();
-            peerConnections_.erase(pcIt);
-        }
+        // 关闭时触发的回调会再次获取 peerMutex_
+        if (lan_) lan_->forget(peerId);
+        if (transport) transport->close();
+        if (lanTransport) lanTransport->close();
+        if (systemChannel) systemChannel->close();
+        if (pc) pc->close();
+        systemPeerLost(peerId);
     }
     
     void requestPeerList() {
-        if (ws_ && ws_->isOpen()) {
+        if (auto ws = socket(); ws && ws->isOpen()) {
             SignalingMessage msg;
             msg.type = MessageType::PeerList;
-            ws_->send(msg.serialize());
+            msg.from = *localId();
+            ws->send(msg.serialize());
         }
     }
     
     std::vector<std::string> getConnectedPeers() const {
         std::lock_guard<std::mutex> lock(peerMutex_);
         std::vector<std::string> peers;
-        for (const auto& [id, dc] : dataChannels_) {
-            if (dc && dc->isOpen()) {
+        for (const auto& [id, transports] : transports_) {
+            if (transports.select()) {
                 peers.push_back(id);
             }
         }
@@ -270,31 +561,24 @@ public:
     
     bool isPeerConnected(const std::string& peerId) const {
         std::lock_guard<std::mutex> lock(peerMutex_);
-        auto it = dataChannels_.find(peerId);
-        return it != dataChannels_.end() && it->second && it->second->isOpen();
+        auto it = transports_.find(peerId);
+        return it != transports_.end() && it->second.select() != nullptr;
     }
     
     std::optional<PeerInfo> getPeerInfo(const std::string& peerId) const {
         std::lock_guard<std::mutex> lock(peerMutex_);
         
         // 检查直连
-        auto it = dataChannels_.find(peerId);
-        if (it != dataChannels_.end()) {
-            PeerInfo info;
-            info.id = peerId;
-            info.relayMode = false;
-            if (it->second) {
-                if (it->second->isOpen()) {
-                    info.channelState = ChannelState::Open;
-                } else if (it->second->isClosed()) {
-                    info.channelState = ChannelState::Closed;
-                } else {
-                    info.channelState = ChannelState::Connecting;
-                }
-            } else {
-                info.channelState = ChannelState::Closed;
+        auto it = transports_.find(peerId);
+        if (it != transports_.end()) {
+            if (auto transport = it->second.direct()) {
+                PeerInfo info;
+                info.id = peerId;
+                info.relayMode = false;
+                info.channelState = transport->state();
+                info.transport = transport->name();
+                return info;
             }
-            return info;
         }
         
         // 检查中继连接
@@ -303,112 +587,108 @@ public:
             info.id = peerId;
             info.relayMode = true;
             info.channelState = ChannelState::Open;
+            info.transport = Transport::kindName(Transport::Kind::Relay);
             return info;
         }
         
         return std::nullopt;
     }
     
-    bool sendText(const std::string& peerId, const std::string& message) {
-        std::lock_guard<std::mutex> lock(peerMutex_);
-        
-        auto it = dataChannels_.find(peerId);
-        if (it == dataChannels_.end() || !it->second || !it->second->isOpen()) {
-            if (onError_) {
-                onError_(Error{ErrorCode::ChannelNotOpen, "Channel not open to " + peerId});
+    std::vector<TransportStats> getTransportStats(const std::string& peerId) const {
+        std::vector<std::shared_ptr<Transport>> transports;
+        std::shared_ptr<Transport> selected;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            auto it = transports_.find(peerId);
+            if (it == transports_.end()) {
+                return {};
             }
-            return false;
+            transports = it->second.all();
+            selected = it->second.select();
         }
         
-        try {
-            it->second->send(message);
-            return true;
-        } catch (const std::exception& e) {
-            if (onError_) {
-                onError_(Error{ErrorCode::InternalError, e.what()});
-            }
-            return false;
+        // 中继的 bufferedAmount 需要会话锁，在 peerMutex_ 之外收集
+        std::vector<TransportStats> stats;
+        for (const auto& transport : transports) {
+            stats.push_back(transport->stats());
+            stats.back().selected = transport == selected;
         }
+        return stats;
     }
     
-    bool sendBinary(const std::string& peerId, const BinaryData& data) {
-        std::lock_guard<std::mutex> lock(peerMutex_);
-        
-        auto it = dataChannels_.find(peerId);
-        if (it == dataChannels_.end() || !it->second || !it->second->isOpen()) {
-            if (onError_) {
-                onError_(Error{ErrorCode::ChannelNotOpen, "Channel not open to " + peerId});
-            }
-            return false;
-        }
-        
-        try {
-            it->second->send(reinterpret_cast<const std::byte*>(data.data()), data.size());
-            return true;
-        } catch (const std::exception& e) {
-            if (onError_) {
-                onError_(Error{ErrorCode::InternalError, e.what()});
+    bool sendText(const std::string& peerId, const std::string& message) {
+        // 已协商压缩时，压缩后的文本以二进制帧发送 (帧头标记为文本)
+        if (auto peer = peerCompression(directCompression_, peerId)) {
+            rtc::binary frame;
+            if (compressor_.encode(*peer, message.data(), message.size(), true, frame)) {
+                return sendOnChannel(peerId, std::move(frame));
             }
-            return false;
         }
+        return sendOnChannel(peerId, message);
+    }
+    
+    bool sendBinary(const std::string& peerId, const BinaryData& data) {
+        return sendBinary(peerId, data.data(), data.size());
     }
     
     bool sendBinary(const std::string& peerId, const void* data, size_t size) {
-        std::lock_guard<std::mutex> lock(peerMutex_);
-        
-        auto it = dataChannels_.find(peerId);
-        if (it == dataChannels_.end() || !it->second || !it->second->isOpen()) {
-            if (onError_) {
-                onError_(Error{ErrorCode::ChannelNotOpen, "Channel not open to " + peerId});
-            }
-            return false;
-        }
-        
-        try {
-            it->second->send(static_cast<const std::byte*>(data), size);
-            return true;
-        } catch (const std::exception& e) {
-            if (onError_) {
-                onError_(Error{ErrorCode::InternalError, e.what()});
-            }
-            return false;
-        }
+        ConstBuffer buffer(data, size);
+        return sendv(peerId, &buffer, 1);
     }
     
     bool send(const std::string& peerId, const Message& message) {
         if (message.type == Message::Type::Text) {
             return sendText(peerId, message.text);
         } else {
-            return sendBinary(peerId, message.binary);
+            return sendBinary(peerId, message.bytes(), message.bytesSize());
         }
     }
     
+    bool sendv(const std::string& peerId, const ConstBuffer* buffers, size_t count) {
+        return sendOnChannel(peerId, buildBinaryFrame(peerCompression(directCompression_, peerId), buffers, count));
+    }
+    
     size_t broadcastText(const std::string& message) {
-        std::lock_guard<std::mutex> lock(peerMutex_);
         size_t count = 0;
+        std::map<int, rtc::binary> frames;  // 压缩参数相同的 Peer 共用一份压缩帧
         
-        for (auto& [peerId, dc] : dataChannels_) {
-            if (dc && dc->isOpen()) {
-                try {
-                    dc->send(message);
-                    ++count;
-                } catch (...) {}
-            }
+        for (auto& [transport, peer] : openChannels()) {
+            try {
+                if (peer) {
+                    int key = compressionKey(*peer);
+                    auto it = frames.find(key);
+                    if (it == frames.end()) {
+                        rtc::binary frame;
+                        if (!compressor_.encode(*peer, message.data(), message.size(), true, frame)) {
+                            frame.clear();  // 空帧表示按原文发送
+                        }
+                        it = frames.emplace(key, std::move(frame)).first;
+                    }
+                    if (!it->second.empty()) {
+                        if (transport->send(it->second)) ++count;
+                        continue;
+                    }
+                }
+                if (transport->send(message)) ++count;
+            } catch (...) {}
         }
         return count;
     }
     
     size_t broadcastBinary(const BinaryData& data) {
-        std::lock_guard<std::mutex> lock(peerMutex_);
         size_t count = 0;
+        std::map<int, rtc::binary> frames;
+        ConstBuffer buffer(data);
         
-        for (auto& [peerId, dc] : dataChannels_) {
-            if (dc && dc->isOpen()) {
-                try {
-                    dc->send(reinterpret_cast<const std::byte*>(data.data()), data.size());
-                    ++count;
-                } catch (...) {}
+        for (auto& [transport, peer] : openChannels()) {
+            int key = peer ? compressionKey(*peer) : -1;
+            auto it = frames.find(key);
+            if (it == frames.end()) {
+                it = frames.emplace(key, buildBinaryFrame(peer, &buffer, 1)).first;
             }
+            try {
+                if (transport->send(it->second)) ++count;
+            } catch (...) {}
         }
         return count;
     }
@@ -427,10 +707,12 @@ public:
         
         SignalingMessage msg;
         msg.type = MessageType::RelayAuth;
-        msg.from = localId_;
+        msg.from = *localId();
         msg.payload = password;
         
-        ws_->send(msg.serialize());
+        if (auto ws = socket()) {
+            ws->send(msg.serialize());
+        }
         
         // 等待认证结果
         auto timeout = std::chrono::milliseconds(config_.connectionTimeout);
@@ -463,10 +745,12 @@ public:
             
             SignalingMessage msg;
             msg.type = MessageType::RelayAuth;
-            msg.from = localId_;
+            msg.from = *localId();
             msg.payload = password;
             
-            ws_->send(msg.serialize());
+            if (auto ws = socket()) {
+                ws->send(msg.serialize());
+            }
             
             auto start = std::chrono::steady_clock::now();
             
@@ -500,21 +784,31 @@ public:
         
         SignalingMessage msg;
         msg.type = MessageType::RelayConnect;
-        msg.from = localId_;
+        msg.from = *localId();
         msg.to = peerId;
+        // 附带压缩、可靠中继和子协议帧协商信息，对方支持时会回复自己的协商信息
+        json offer = json::object();
+        if (compressor_.enabled()) {
+            offer["compression"] = compressor_.advertisement();
+        }
+        if (reliableRelay()) {
+            offer["reliable"] = true;
+            if (config_.relayWindow > 0) {
+                offer["window"] = config_.relayWindow;
+            }
+        }
+        offer["sys"] = kSystemProtocolVersion;
+        msg.setJsonPayload(offer.dump(), nestedPayload());
         
-        ws_->send(msg.serialize());
-        
-        {
-            std::lock_guard<std::mutex> lock(peerMutex_);
-            relayPeers_.insert(peerId);
+        // 先登记再发送，对方的回复可能在 send 返回前到达
+        addRelayPeer(peerId);
+        if (auto ws = socket()) {
+            ws->send(msg.serialize());
         }
         
         std::cout << "[P2P] Relay connected to " << peerId << std::endl;
         
-        if (onRelayConnected_) {
-            onRelayConnected_(peerId);
-        }
+        notifyPeerEvent(onRelayConnected_, peerId);
         
         return true;
     }
@@ -522,104 +816,208 @@ public:
     void disconnectFromPeerViaRelay(const std::string& peerId) {
         SignalingMessage msg;
         msg.type = MessageType::RelayDisconnect;
-        msg.from = localId_;
+        msg.from = *localId();
         msg.to = peerId;
         
-        if (ws_ && ws_->isOpen()) {
-            ws_->send(msg.serialize());
+        if (auto ws = socket(); ws && ws->isOpen()) {
+            ws->send(msg.serialize());
         }
         
+        std::shared_ptr<Transport> transport;
         {
             std::lock_guard<std::mutex> lock(peerMutex_);
             relayPeers_.erase(peerId);
+            relayCompression_.erase(peerId);
+            relaySessions_.erase(peerId);
+            relaySystemPeers_.erase(peerId);
+            transport = detachTransport(peerId, Transport::Kind::Relay);
         }
-        
-        if (onRelayDisconnected_) {
-            onRelayDisconnected_(peerId);
+        if (transport) {
+            transport->close();
         }
+        systemPeerLost(peerId);
+        
+        notifyPeerEvent(onRelayDisconnected_, peerId);
     }
     
     // *** 修改：不再要求本地已认证，只检查是否有中继连接 ***
     bool sendTextViaRelay(const std::string& peerId, const std::string& message) {
-        {
-            std::lock_guard<std::mutex> lock(peerMutex_);
-            if (relayPeers_.count(peerId) == 0) {
-                if (onError_) {
-                    onError_(Error{ErrorCode::ChannelNotOpen, "No relay connection with " + peerId});
-                }
-                return false;
+        if (!checkRelayPeer(peerId)) {
+            return false;
+        }
+        
+        if (auto peer = peerCompression(relayCompression_, peerId)) {
+            std::vector<std::byte> frame;
+            if (compressor_.encode(*peer, message.data(), message.size(), true, frame)) {
+                return sendRelayPayload(peerId, serializeRelayCompressed(frame.data(), frame.size(), true));
             }
         }
         
         RelayDataMessage dataMsg;
         dataMsg.isBinary = false;
         dataMsg.textData = message;
+        return sendRelayPayload(peerId, dataMsg.serialize());
+    }
+    
+    bool sendBinaryViaRelay(const std::string& peerId, const BinaryData& data) {
+        return sendBinaryViaRelay(peerId, data.data(), data.size());
+    }
+    
+    bool sendBinaryViaRelay(const std::string& peerId, const void* data, size_t size) {
+        ConstBuffer buffer(data, size);
+        return sendvViaRelay(peerId, &buffer, 1);
+    }
+    
+    // 各段直接 Base64 编码进 payload，不先拼接原始数据 (需要压缩时先拼接再压缩)
+    bool sendvViaRelay(const std::string& peerId, const ConstBuffer* buffers, size_t count) {
+        if (!checkRelayPeer(peerId)) {
+            return false;
+        }
         
-        SignalingMessage msg;
-        msg.type = MessageType::RelayData;
-        msg.from = localId_;
-        msg.to = peerId;
-        msg.payload = dataMsg.serialize();
-        
-        try {
-            if (ws_ && ws_->isOpen()) {
-                ws_->send(msg.serialize());
-                return true;
+        if (auto peer = peerCompression(relayCompression_, peerId)) {
+            std::vector<std::byte> frame;
+            bool compressed;
+            if (count == 1) {
+                compressed = compressor_.encode(*peer, buffers[0].data, buffers[0].size, false, frame);
+            } else {
+                std::vector<std::byte> joined;
+                for (size_t i = 0; i < count; ++i) {
+                    auto* bytes = static_cast<const std::byte*>(buffers[i].data);
+                    joined.insert(joined.end(), bytes, bytes + buffers[i].size);
+                }
+                compressed = compressor_.encode(*peer, joined.data(), joined.size(), false, frame);
             }
-            return false;
-        } catch (const std::exception& e) {
-            if (onError_) {
-                onError_(Error{ErrorCode::InternalError, e.what()});
+            if (compressed) {
+                return sendRelayPayload(peerId, serializeRelayCompressed(frame.data(), frame.size(), false));
             }
-            return false;
         }
+        return sendRelayPayload(peerId, serializeRelayBinary(buffers, buffers + count));
     }
     
     // *** 修改：不再要求本地已认证，只检查是否有中继连接 ***
-    bool sendBinaryViaRelay(const std::string& peerId, const BinaryData& data) {
+    bool checkRelayPeer(const std::string& peerId) {
+        bool connected;
         {
             std::lock_guard<std::mutex> lock(peerMutex_);
-            if (relayPeers_.count(peerId) == 0) {
-                if (onError_) {
-                    onError_(Error{ErrorCode::ChannelNotOpen, "No relay connection with " + peerId});
-                }
-                return false;
-            }
+            connected = relayPeers_.count(peerId) != 0;
+        }
+        if (!connected) {
+            reportError(ErrorCode::ChannelNotOpen, "No relay connection with " + peerId);
+        }
+        return connected;
+    }
+    
+    // 经由 Peer 的中继传输发送 (计入传输统计)；尚未登记中继连接时直接写入信令连接
+    bool sendRelayPayload(const std::string& peerId, std::string payload) {
+        auto transport = relayTransport(peerId);
+        if (!transport) {
+            return sendRelayRaw(peerId, payload);
+        }
+        return transport->send(std::move(payload));
+    }
+    
+    // 中继传输的写入：可靠中继的消息先进入重传缓冲区，信令断开期间也返回 true，会话恢复后重发
+    // 对方的接收窗口用尽或重传缓冲区已满时最多等待 relaySendTimeout，仍不可写返回 false (WouldBlock)
+    bool pushRelayPayload(const std::string& peerId, const std::shared_ptr<RelaySession>& session,
+                          std::string payload) {
+        if (!session || !session->reliable()) {
+            return sendRelayRaw(peerId, payload);
+        }
+        if (!RelaySession::framable(payload)) {
+            // 序号写在 JSON 对象中，其他 payload 无法可靠发送 (对方也不会交给应用)
+            reportError(ErrorCode::InvalidData, "Relay payload to " + peerId + " is not a JSON object");
+            return false;
         }
         
-        RelayDataMessage dataMsg;
-        dataMsg.isBinary = true;
-        dataMsg.binaryBase64 = base64Encode(data);
-        
-        SignalingMessage msg;
-        msg.type = MessageType::RelayData;
-        msg.from = localId_;
-        msg.to = peerId;
-        msg.payload = dataMsg.serialize();
+        bool pushed = false;
+        bool hasCredit;
+        std::string sendError;
+        {
+            std::unique_lock<std::mutex> lock(session->mutex());
+            size_t size = payload.size();
+            auto writable = [&] { return session->hasRoom(size) && session->hasCredit(size); };
+            if (!writable() && config_.relaySendTimeout > 0) {
+                session->writable().wait_for(lock, std::chrono::milliseconds(config_.relaySendTimeout), writable);
+            }
+            if (writable()) {
+                session->enqueue(relayMessage(peerId, session->push(std::move(payload))));
+                pushed = true;
+            }
+            hasCredit = session->hasCredit(size);
+            if (!pushed && !hasCredit) {
+                session->creditBlocked(size);  // 信用更新可能已丢失，由计时线程探测
+            }
+        }
         
+        // 已进入重传缓冲区的消息即使本次写出失败也会重发，仍返回 true
+        if (pushed) {
+            flushRelay(*session, sendError);
+            if (!sendError.empty()) {
+                reportError(ErrorCode::InternalError, sendError);
+            }
+            return true;
+        }
+        reportError(ErrorCode::WouldBlock, hasCredit
+            ? "Relay retransmit buffer full for " + peerId
+            : "Relay send window exhausted for " + peerId);
+        return false;
+    }
+    
+    // 直接发出一条中继消息 (不分配序号)
+    bool sendRelayRaw(const std::string& peerId, std::string_view payload) {
+        std::string error;
+        bool sent = writeRelay(peerId, payload, error);
+        if (!error.empty()) {
+            reportError(ErrorCode::InternalError, error);
+        }
+        return sent;
+    }
+    
+    // 同 sendRelayRaw，但不调用错误回调，异常信息写入 error，由调用方报告
+    bool writeRelay(const std::string& peerId, std::string_view payload, std::string& error) {
+        return writeSignaling(relayMessage(peerId, payload), error);
+    }
+    
+    // 封装一条中继消息 (不发送)，持有会话锁时用于放入出站队列
+    std::string relayMessage(const std::string& peerId, std::string_view payload) const {
+        std::string out;
+        writeSignalingMessage(out, MessageType::RelayData, *localId(), peerId, payload, nestedPayload(), 0);
+        return out;
+    }
+    
+    bool writeSignaling(std::string message, std::string& error) {
         try {
-            if (ws_ && ws_->isOpen()) {
-                ws_->send(msg.serialize());
+            if (auto ws = socket(); ws && ws->isOpen()) {
+                ws->send(std::move(message));
                 return true;
             }
             return false;
         } catch (const std::exception& e) {
-            if (onError_) {
-                onError_(Error{ErrorCode::InternalError, e.what()});
-            }
+            error = e.what();
             return false;
         }
     }
     
-    bool sendBinaryViaRelay(const std::string& peerId, const void* data, size_t size) {
-        BinaryData binaryData(static_cast<const uint8_t*>(data),
-                              static_cast<const uint8_t*>(data) + size);
-        return sendBinaryViaRelay(peerId, binaryData);
+    // 发出会话出站队列中的消息 (调用方不持有 session.mutex())；写出失败的数据消息由重传恢复
+    void flushRelay(RelaySession& session, std::string& error) {
+        std::lock_guard<std::mutex> sendLock(session.sendMutex());
+        std::string message;
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(session.mutex());
+                if (!session.takeOutbound(message)) {
+                    return;
+                }
+            }
+            writeSignaling(std::move(message), error);
+        }
     }
     
     bool sendViaRelay(const std::string& peerId, const Message& message) {
         if (message.type == Message::Type::Text) {
             return sendTextViaRelay(peerId, message.text);
+        } else if (message.binary.empty() && !message.buffer.empty()) {
+            return sendBinaryViaRelay(peerId, message.buffer.data(), message.buffer.size());
         } else {
             return sendBinaryViaRelay(peerId, message.binary);
         }
@@ -662,27 +1060,99 @@ public:
         return std::vector<std::string>(relayPeers_.begin(), relayPeers_.end());
     }
     
-    bool isPeerRelayConnected(const std::string& peerId) const {
+    CompressionStats getCompressionStats() const {
+        return compressor_.stats();
+    }
+    
+    bool isPeerRelayConnected(const std::string& peerId) const {
         std::lock_guard<std::mutex> lock(peerMutex_);
         return relayPeers_.count(peerId) > 0;
     }
     
+    // RPC
+    RpcCall call(const std::string& peerId, const std::string& method, ConstBuffer request,
+                 std::chrono::milliseconds timeout) {
+        return rpc_.call(peerId, method, request, timeout);
+    }
+    
+    bool cancelCall(uint64_t callId) { return rpc_.cancel(callId); }
+    
+    void registerRpcHandler(const std::string& method, RpcHandler handler) {
+        rpc_.setHandler(method, std::move(handler));
+    }
+    
+    std::vector<RpcMethodStats> getRpcStats() const { return rpc_.stats(); }
+    
+    // 多路复用流
+    Stream openStream(const std::string& peerId) {
+        if (!hasSystemTransport(peerId)) {
+            if (onError_) {
+                onError_(Error{ErrorCode::ChannelNotOpen, "No stream-capable connection with " + peerId});
+            }
+            return Stream();
+        }
+        return streams_->open(peerId);
+    }
+    
+    void setOnStream(OnStreamCallback cb) { streams_->setOnStream(std::move(cb)); }
+    
+    // 发布/订阅
+    bool subscribe(const std::string& pattern) { return pubsub_.subscribe(pattern); }
+    void unsubscribe(const std::string& pattern) { pubsub_.unsubscribe(pattern); }
+    size_t publish(const std::string& topic, ConstBuffer data) { return pubsub_.publish(topic, data); }
+    std::vector<std::string> getTopicSubscribers(const std::string& topic) const {
+        return pubsub_.subscribers(topic);
+    }
+    void setOnPublication(OnPublicationCallback cb) { pubsub_.setOnPublication(std::move(cb)); }
+    
+    // 状态同步
+    void setState(const std::string& key, ConstBuffer value) { stateSync_.set(key, value); }
+    void eraseState(const std::string& key) { stateSync_.erase(key); }
+    std::optional<Buffer> getState(const std::string& key) const { return stateSync_.get(key); }
+    std::optional<Buffer> getPeerState(const std::string& peerId, const std::string& key) const {
+        return stateSync_.peerValue(peerId, key);
+    }
+    std::map<std::string, Buffer> getPeerStateMap(const std::string& peerId) const {
+        return stateSync_.peerState(peerId);
+    }
+    void setOnStateUpdate(OnStateUpdateCallback cb) { stateSync_.setOnUpdate(std::move(cb)); }
+    StateSyncStats getStateSyncStats() const { return stateSync_.stats(); }
+    
     // 回调设置
-    void setOnConnected(OnConnectedCallback cb) { onConnected_ = std::move(cb); }
-    void setOnDisconnected(OnDisconnectedCallback cb) { onDisconnected_ = std::move(cb); }
-    void setOnPeerConnected(OnPeerConnectedCallback cb) { onPeerConnected_ = std::move(cb); }
-    void setOnPeerDisconnected(OnPeerDisconnectedCallback cb) { onPeerDisconnected_ = std::move(cb); }
-    void setOnTextMessage(OnTextMessageCallback cb) { onTextMessage_ = std::move(cb); }
-    void setOnBinaryMessage(OnBinaryMessageCallback cb) { onBinaryMessage_ = std::move(cb); }
-    void setOnMessage(OnMessageCallback cb) { onMessage_ = std::move(cb); }
-    void setOnPeerList(OnPeerListCallback cb) { onPeerList_ = std::move(cb); }
-    void setOnError(OnErrorCallback cb) { onError_ = std::move(cb); }
-    void setOnStateChange(OnStateChangeCallback cb) { onStateChange_ = std::move(cb); }
-    void setOnRelayAuthResult(OnRelayAuthResultCallback cb) { onRelayAuthResult_ = std::move(cb); }
-    void setOnRelayConnected(OnRelayConnectedCallback cb) { onRelayConnected_ = std::move(cb); }
-    void setOnRelayDisconnected(OnRelayDisconnectedCallback cb) { onRelayDisconnected_ = std::move(cb); }
+    void setOnConnected(OnConnectedCallback cb) { onConnected_.set(std::move(cb)); }
+    void setOnDisconnected(OnDisconnectedCallback cb) { onDisconnected_.set(std::move(cb)); }
+    void setOnPeerConnected(OnPeerConnectedCallback cb) { onPeerConnected_.set(std::move(cb)); }
+    void setOnPeerDisconnected(OnPeerDisconnectedCallback cb) { onPeerDisconnected_.set(std::move(cb)); }
+    void setOnTextMessage(OnTextMessageCallback cb) { onTextMessage_.set(std::move(cb)); }
+    void setOnBinaryMessage(OnBinaryMessageCallback cb) { onBinaryMessage_.set(std::move(cb)); }
+    void setOnMessage(OnMessageCallback cb) { onMessage_.set(std::move(cb)); }
+    void setOnBufferMessage(OnBufferMessageCallback cb) { onBufferMessage_.set(std::move(cb)); }
+    void setOnPeerList(OnPeerListCallback cb) { onPeerList_.set(std::move(cb)); }
+    void setOnError(OnErrorCallback cb) { onError_.set(std::move(cb)); }
+    void setOnStateChange(OnStateChangeCallback cb) { onStateChange_.set(std::move(cb)); }
+    void setOnRelayAuthResult(OnRelayAuthResultCallback cb) { onRelayAuthResult_.set(std::move(cb)); }
+    void setOnRelayConnected(OnRelayConnectedCallback cb) { onRelayConnected_.set(std::move(cb)); }
+    void setOnRelayDisconnected(OnRelayDisconnectedCallback cb) { onRelayDisconnected_.set(std::move(cb)); }
     
 private:
+    // 信令连接的快照，调用方持有期间不会被并发的 connect()/disconnect() 释放
+    std::shared_ptr<rtc::WebSocket> socket() const {
+        return std::atomic_load(&ws_);
+    }
+    
+    void setSocket(std::shared_ptr<rtc::WebSocket> ws) {
+        std::atomic_store(&ws_, std::move(ws));
+    }
+    
+    // 本端 ID 的快照 (注册前为空字符串)
+    std::shared_ptr<const std::string> localId() const {
+        return std::atomic_load(&localId_);
+    }
+    
+    void setLocalId(std::string id) {
+        std::atomic_store(&localId_, std::make_shared<const std::string>(std::move(id)));
+    }
+    
     void setState(ConnectionState newState) {
         if (state_ != newState) {
             state_ = newState;
@@ -696,70 +1166,595 @@ private:
         relayState_ = newState;
     }
     
-    void handleSignalingMessage(const std::string& msgStr) {
-        try {
-            auto msg = SignalingMessage::deserialize(msgStr);
+    // 是否以嵌套 JSON 发送结构化 payload (协议版本 2)
+    bool nestedPayload() const {
+        return protocolVersion_ >= kProtocolVersionNestedPayload;
+    }
+    
+    // ==================== 可靠中继 ====================
+    
+    bool reliableRelay() const {
+        return config_.relayRetransmitBuffer > 0;
+    }
+    
+    // 登记中继 Peer；重新连接同一 Peer 时序号和信用从头开始
+    std::shared_ptr<RelaySession> addRelayPeer(const std::string& peerId) {
+        auto session = reliableRelay() ? std::make_shared<RelaySession>(config_.relayRetransmitBuffer) : nullptr;
+        if (session) {
+            session->setLocalWindow(config_.relayWindow);
+            startRelayTimer();
+        }
+        auto transport = std::make_shared<RelayTransport>([this, peerId, session](std::string payload) {
+            return pushRelayPayload(peerId, session, std::move(payload));
+        }, session);
+        
+        std::shared_ptr<Transport> previous;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            relayPeers_.insert(peerId);
+            if (session) {
+                relaySessions_[peerId] = session;
+            } else {
+                relaySessions_.erase(peerId);
+            }
+            previous = transports_[peerId].add(transport);
+        }
+        if (previous) {
+            previous->close();
+        }
+        return session;
+    }
+    
+    std::shared_ptr<RelaySession> relaySession(const std::string& peerId) const {
+        std::lock_guard<std::mutex> lock(peerMutex_);
+        auto it = relaySessions_.find(peerId);
+        return it != relaySessions_.end() ? it->second : nullptr;
+    }
+    
+    // 所有未确认的消息放入出站队列重发 (调用方持有 session.mutex()，释放后 flushRelay)
+    size_t retransmit(const std::string& peerId, RelaySession& session) {
+        for (const auto& outgoing : session.unacked()) {
+            session.enqueue(relayMessage(peerId, outgoing.payload));
+        }
+        return session.unacked().size();
+    }
+    
+    // 处理中继消息中的可靠传输和流控字段，返回数据消息是否应交给应用
+    // payloadSize 为整条 payload 的字节数，用于流控计数
+    bool processRelaySequence(const std::string& peerId, const RelaySession::Control& control,
+                              bool isData, size_t payloadSize) {
+        auto session = relaySession(peerId);
+        if (!session) {
+            return isData;
+        }
+        
+        bool deliver = isData;
+        std::string sendError;
+        {
+            std::lock_guard<std::mutex> lock(session->mutex());
+            if (control.reliable) {
+                session->setReliable(true);
+            }
+            if (control.window) {
+                session->setPeerWindow(*control.window);
+            }
+            if (control.ack || control.credit) {
+                if (control.ack) session->acknowledge(*control.ack);
+                if (control.credit) session->updateCredit(*control.credit);
+                session->writable().notify_all();
+            }
+            if (control.resend) {
+                // 对方刚恢复会话时可能错过了信用更新，重发后附带一次最新状态
+                retransmit(peerId, *session);
+                session->enqueue(relayMessage(peerId, session->controlPayload(false)));
+            } else if (control.probe) {
+                session->enqueue(relayMessage(peerId, session->controlPayload(false)));  // 零窗口探测：回复当前信用
+            }
             
-            switch (msg.type) {
-                case MessageType::Register:
-                    localId_ = msg.payload;
-                    std::cout << "[P2P] Registered as: " << localId_ << std::endl;
-                    requestPeerList();
-                    break;
-                    
-                case MessageType::PeerList: {
-                    auto peers = json::parse(msg.payload);
-                    std::vector<std::string> peerList;
-                    for (const auto& peer : peers) {
-                        peerList.push_back(peer.get<std::string>());
-                    }
-                    if (onPeerList_) {
-                        onPeerList_(peerList);
-                    }
-                    break;
+            if (isData && control.seq) {
+                auto result = session->receive(*control.seq, payloadSize);
+                // 越过缺口的消息已被丢弃，补上缺口 (对方超时重发) 后同样要请求重发其余的
+                bool gap = result == RelaySession::Receive::Gap ||
+                           (result == RelaySession::Receive::Deliver && session->missing());
+                bool requestResend = gap && session->shouldRequestResend();
+                if (requestResend || session->takeAckDue()) {
+                    session->enqueue(relayMessage(peerId, session->controlPayload(requestResend)));
                 }
-                    
-                case MessageType::Offer:
-                    handleOffer(msg);
-                    break;
-                    
-                case MessageType::Answer:
-                    handleAnswer(msg);
-                    break;
-                    
-                case MessageType::Candidate:
-                    handleCandidate(msg);
-                    break;
-                    
-                case MessageType::RelayAuthResult:
-                    handleRelayAuthResult(msg);
-                    break;
-                    
-                case MessageType::RelayData:
-                    handleRelayData(msg);
-                    break;
-                    
-                case MessageType::RelayConnect:
-                    handleRelayConnect(msg);
-                    break;
-                    
-                case MessageType::RelayDisconnect:
-                    handleRelayDisconnect(msg);
-                    break;
-                    
-                case MessageType::Error:
-                    if (onError_) {
-                        onError_(Error{ErrorCode::SignalingError, msg.payload});
-                    }
-                    break;
-                    
-                default:
-                    break;
+                deliver = result == RelaySession::Receive::Deliver;
+            }
+        }
+        flushRelay(*session, sendError);
+        
+        if (!sendError.empty()) {
+            reportError(ErrorCode::InternalError, sendError);
+        }
+        return deliver;
+    }
+    
+    // 中继计时线程：驱动各会话的重传、延迟确认和零窗口探测 (第一个可靠中继会话建立时启动)
+    void startRelayTimer() {
+        std::lock_guard<std::mutex> lock(relayTimerMutex_);
+        if (relayTimer_.joinable() || relayTimerStopping_) {
+            return;
+        }
+        relayTimer_ = std::thread([this] {
+            configureCurrentThread(config_.threading.threadName + "-relay", config_.threading.dispatchCpus);
+            std::unique_lock<std::mutex> lock(relayTimerMutex_);
+            while (!relayTimerCv_.wait_for(lock, kRelayTimerTick, [this] { return relayTimerStopping_; })) {
+                lock.unlock();
+                serviceRelaySessions();
+                lock.lock();
+            }
+        });
+    }
+    
+    void stopRelayTimer() {
+        {
+            std::lock_guard<std::mutex> lock(relayTimerMutex_);
+            relayTimerStopping_ = true;
+        }
+        relayTimerCv_.notify_all();
+        if (relayTimer_.joinable()) {
+            relayTimer_.join();
+        }
+    }
+    
+    // 信令断开期间不计时 (计时器不退避)，恢复会话时 resumeRelaySessions 统一重发
+    void serviceRelaySessions() {
+        if (!isConnected()) {
+            return;
+        }
+        std::vector<std::pair<std::string, std::shared_ptr<RelaySession>>> sessions;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            sessions.assign(relaySessions_.begin(), relaySessions_.end());
+        }
+        
+        auto now = RelaySession::Clock::now();
+        std::string sendError;
+        for (const auto& [peerId, session] : sessions) {
+            {
+                std::lock_guard<std::mutex> lock(session->mutex());
+                if (!session->reliable()) {
+                    continue;
+                }
+                if (session->takeRetransmitDue(now)) {
+                    session->enqueue(relayMessage(peerId, session->unacked().front().payload));
+                }
+                bool probe = session->takeProbeDue(now);
+                if (probe || session->takeAckDue(now)) {
+                    session->enqueue(relayMessage(peerId, session->controlPayload(false, probe)));
+                }
+            }
+            flushRelay(*session, sendError);
+        }
+        if (!sendError.empty()) {
+            reportError(ErrorCode::InternalError, sendError);
+        }
+    }
+    
+    // 会话恢复后：请求对方重发断线期间丢失的消息，并重发本端未确认的消息
+    void resumeRelaySessions() {
+        std::vector<std::pair<std::string, std::shared_ptr<RelaySession>>> sessions;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            sessions.assign(relaySessions_.begin(), relaySessions_.end());
+        }
+        
+        size_t resent = 0;
+        std::string sendError;
+        for (const auto& [peerId, session] : sessions) {
+            {
+                std::lock_guard<std::mutex> lock(session->mutex());
+                if (session->reliable()) {
+                    session->enqueue(relayMessage(peerId, session->controlPayload(true)));
+                    resent += retransmit(peerId, *session);
+                }
+            }
+            flushRelay(*session, sendError);
+        }
+        if (!sendError.empty()) {
+            reportError(ErrorCode::InternalError, sendError);
+        }
+        std::cout << "[P2P] Session resumed, " << sessions.size() << " relay peers, "
+                  << resent << " messages retransmitted" << std::endl;
+    }
+    
+    // 未能恢复会话：上一次连接遗留的中继连接在服务端已不存在
+    void dropRelayPeers() {
+        std::vector<std::string> peers;
+        std::vector<std::shared_ptr<Transport>> transports;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            peers.assign(relayPeers_.begin(), relayPeers_.end());
+            for (const auto& peerId : peers) {
+                if (auto transport = detachTransport(peerId, Transport::Kind::Relay)) {
+                    transports.push_back(std::move(transport));
+                }
+            }
+            relayPeers_.clear();
+            relaySessions_.clear();
+            relayCompression_.clear();
+            relaySystemPeers_.clear();
+        }
+        
+        for (const auto& transport : transports) {
+            transport->close();
+        }
+        for (const auto& peerId : peers) {
+            std::cout << "[P2P] Relay session with " << peerId << " lost" << std::endl;
+            systemPeerLost(peerId);
+            notifyPeerEvent(onRelayDisconnected_, peerId);
+        }
+    }
+    
+    // ==================== 内部子协议 ====================
+    
+    // 与 Peer 是否有可以承载子协议帧的连接 (直连系统通道或支持 "sys" 的中继)
+    bool hasSystemTransport(const std::string& peerId) const {
+        std::lock_guard<std::mutex> lock(peerMutex_);
+        auto it = systemChannels_.find(peerId);
+        return (it != systemChannels_.end() && it->second && it->second->isOpen()) ||
+               relaySystemPeers_.count(peerId) > 0;
+    }
+    
+    // 子协议帧能否立即发出：直连看通道发送缓冲区，可靠中继看重传缓冲区和对方信用
+    // 不可写时多路复用流暂停发送，等 onBufferedAmountLow 或中继确认到达后继续
+    bool frameWritable(const std::string& peerId, size_t size) {
+        std::shared_ptr<rtc::DataChannel> channel;
+        std::shared_ptr<RelaySession> session;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            auto it = systemChannels_.find(peerId);
+            if (it != systemChannels_.end() && it->second && it->second->isOpen()) {
+                channel = it->second;
+            } else if (auto sessionIt = relaySessions_.find(peerId); sessionIt != relaySessions_.end()) {
+                session = sessionIt->second;
+            }
+        }
+        
+        if (channel) {
+            return channel->bufferedAmount() < kSystemChannelHighWater;
+        }
+        if (session) {
+            size_t payloadSize = Base64Encoder::encodedSize(size) + 64;  // 中继 payload 为 Base64 加少量 JSON
+            std::lock_guard<std::mutex> lock(session->mutex());
+            if (!session->reliable()) {
+                return true;
+            }
+            if (!session->hasCredit(payloadSize)) {
+                session->creditBlocked(payloadSize);
+                return false;
+            }
+            return session->hasRoom(payloadSize);
+        }
+        return true;  // 没有连接时由发送失败处理
+    }
+    
+    // 发送内部子协议帧：优先走直连系统通道，否则走中继 (可靠中继时同样有序号和流控)
+    bool sendFrame(const std::string& peerId, FrameKind kind, const ConstBuffer* parts, size_t count) {
+        std::shared_ptr<rtc::DataChannel> channel;
+        bool viaRelay = false;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            auto it = systemChannels_.find(peerId);
+            if (it != systemChannels_.end() && it->second && it->second->isOpen()) {
+                channel = it->second;
+            } else {
+                viaRelay = relaySystemPeers_.count(peerId) > 0;
+            }
+        }
+        
+        if (channel) {
+            size_t total = 1;
+            for (size_t i = 0; i < count; ++i) {
+                total += parts[i].size;
+            }
+            rtc::binary frame;
+            frame.reserve(total);
+            frame.push_back(static_cast<std::byte>(kind));
+            for (size_t i = 0; i < count; ++i) {
+                auto* bytes = static_cast<const std::byte*>(parts[i].data);
+                frame.insert(frame.end(), bytes, bytes + parts[i].size);
+            }
+            try {
+                return channel->send(std::move(frame));
+            } catch (const std::exception& e) {
+                std::cerr << "[P2P] System channel send to " << peerId << " failed: " << e.what() << std::endl;
+                return false;
+            }
+        }
+        if (viaRelay) {
+            return sendRelayPayload(peerId, serializeRelayFrame(static_cast<uint8_t>(kind), parts, parts + count));
+        }
+        return false;
+    }
+    
+    // 收到的内部子协议帧交给对应的处理者，格式错误时抛出异常
+    void dispatchFrame(const std::string& peerId, uint8_t kind, const uint8_t* data, size_t size) {
+        switch (static_cast<FrameKind>(kind)) {
+            case FrameKind::Rpc:
+                rpc_.handleFrame(peerId, data, size);
+                break;
+            case FrameKind::Stream:
+                streams_->handleFrame(peerId, data, size);
+                break;
+            case FrameKind::PubSub:
+                pubsub_.handleFrame(peerId, data, size);
+                break;
+            case FrameKind::StateSync:
+                stateSync_.handleFrame(peerId, data, size);
+                break;
+            default:
+                std::cerr << "[P2P] Ignoring frame of unknown kind " << int(kind) << " from " << peerId << std::endl;
+                break;
+        }
+    }
+    
+    // 与 Peer 已没有可用的子协议通道时结束在途调用、关闭所有流
+    void systemPeerLost(const std::string& peerId) {
+        if (hasSystemTransport(peerId)) {
+            return;
+        }
+        rpc_.failPeer(peerId);
+        streams_->failPeer(peerId);
+        pubsub_.removePeer(peerId);
+        stateSync_.removePeer(peerId);
+    }
+    
+    // 与 Peer 的子协议通道已可用：通告本端订阅，开始同步状态
+    void systemPeerReady(const std::string& peerId) {
+        pubsub_.addPeer(peerId);
+        stateSync_.addPeer(peerId);
+    }
+    
+    void setupSystemChannel(const std::string& peerId, std::shared_ptr<rtc::DataChannel> dc) {
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            systemChannels_[peerId] = dc;
+        }
+        
+        dc->onClosed([this, peerId, weak = std::weak_ptr<rtc::DataChannel>(dc)]() {
+            {
+                std::lock_guard<std::mutex> lock(peerMutex_);
+                auto it = systemChannels_.find(peerId);
+                if (it != systemChannels_.end() && it->second == weak.lock()) {
+                    systemChannels_.erase(it);
+                }
+            }
+            systemPeerLost(peerId);
+        });
+        
+        // 对方创建的通道交给本端时已经打开
+        if (dc->isOpen()) {
+            systemPeerReady(peerId);
+        } else {
+            dc->onOpen([this, peerId]() {
+                systemPeerReady(peerId);
+            });
+        }
+        
+        dc->setBufferedAmountLowThreshold(kSystemChannelHighWater / 2);
+        dc->onBufferedAmountLow([this, peerId]() {
+            streams_->resume(peerId);
+        });
+        
+        dc->onMessage([this, peerId](auto message) {
+            if (!std::holds_alternative<rtc::binary>(message)) {
+                return;
+            }
+            const auto& binary = std::get<rtc::binary>(message);
+            if (binary.empty()) {
+                return;
+            }
+            try {
+                auto* bytes = reinterpret_cast<const uint8_t*>(binary.data());
+                dispatchFrame(peerId, bytes[0], bytes + 1, binary.size() - 1);
+            } catch (const std::exception& e) {
+                if (onError_) {
+                    onError_(Error{ErrorCode::InvalidData, "Invalid system frame from " + peerId + ": " + e.what()});
+                }
+            }
+        });
+    }
+    
+    // ==================== 压缩 ====================
+    
+    std::optional<PeerCompression> peerCompression(
+        const std::unordered_map<std::string, PeerCompression>& table, const std::string& peerId) const {
+        std::lock_guard<std::mutex> lock(peerMutex_);
+        auto it = table.find(peerId);
+        if (it == table.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+    
+    // 根据对方的协商信息更新压缩参数 (remote 为 null 表示对方未启用)
+    void updateCompression(std::unordered_map<std::string, PeerCompression>& table,
+                           const std::string& peerId, const json& remote) {
+        auto negotiated = compressor_.negotiate(remote);
+        std::lock_guard<std::mutex> lock(peerMutex_);
+        if (negotiated) {
+            table[peerId] = *negotiated;
+        } else {
+            table.erase(peerId);
+        }
+    }
+    
+    static int compressionKey(const PeerCompression& peer) {
+        return static_cast<int>(peer.codec) * 2 + (peer.useDictionary ? 1 : 0);
+    }
+    
+    // 组装直连二进制消息：已协商压缩的 Peer 每条消息都带帧头 (压缩或未压缩帧)
+    rtc::binary buildBinaryFrame(const std::optional<PeerCompression>& peer,
+                                 const ConstBuffer* buffers, size_t count) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            total += buffers[i].size;
+        }
+        
+        rtc::binary message;
+        if (peer && count == 1 && compressor_.encode(*peer, buffers[0].data, total, false, message)) {
+            return message;
+        }
+        
+        message.clear();
+        message.reserve(total + (peer ? 1 : 0));
+        if (peer) {
+            message.push_back(std::byte{0});  // 未压缩帧
+        }
+        for (size_t i = 0; i < count; ++i) {
+            auto* bytes = static_cast<const std::byte*>(buffers[i].data);
+            message.insert(message.end(), bytes, bytes + buffers[i].size);
+        }
+        
+        // 多段消息先拼接再压缩
+        if (peer && count != 1) {
+            rtc::binary frame;
+            if (compressor_.encode(*peer, message.data() + 1, total, false, frame)) {
+                return frame;
+            }
+        }
+        return message;
+    }
+    
+    // 发送到 Peer 当前选中的直连传输；拼好的消息直接移交给传输层，不再复制
+    // peerMutex_ 只保护查表，发送和错误回调都在锁外进行
+    bool sendOnChannel(const std::string& peerId, rtc::message_variant message) {
+        std::shared_ptr<Transport> transport;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            auto it = transports_.find(peerId);
+            if (it != transports_.end()) {
+                transport = it->second.select();
             }
+        }
+        
+        if (!transport) {
+            reportError(ErrorCode::ChannelNotOpen, "Channel not open to " + peerId);
+            return false;
+        }
+        
+        try {
+            return transport->send(std::move(message));
+        } catch (const std::exception& e) {
+            reportError(ErrorCode::InternalError, e.what());
+            return false;
+        }
+    }
+    
+    // 已打开的直连传输及其压缩参数 (广播用的快照)
+    std::vector<std::pair<std::shared_ptr<Transport>, std::optional<PeerCompression>>> openChannels() const {
+        std::lock_guard<std::mutex> lock(peerMutex_);
+        std::vector<std::pair<std::shared_ptr<Transport>, std::optional<PeerCompression>>> channels;
+        for (const auto& [peerId, transports] : transports_) {
+            if (auto transport = transports.select()) {
+                auto it = directCompression_.find(peerId);
+                channels.emplace_back(std::move(transport), it != directCompression_.end()
+                    ? std::optional<PeerCompression>(it->second) : std::nullopt);
+            }
+        }
+        return channels;
+    }
+    
+    // 调用方持有 peerMutex_；返回摘下的传输，由调用方在锁外关闭
+    std::shared_ptr<Transport> detachTransport(const std::string& peerId, Transport::Kind kind) {
+        auto it = transports_.find(peerId);
+        if (it == transports_.end()) {
+            return nullptr;
+        }
+        auto transport = it->second.remove(kind);
+        if (it->second.empty()) {
+            transports_.erase(it);
+        }
+        return transport;
+    }
+    
+    std::shared_ptr<RelayTransport> relayTransport(const std::string& peerId) const {
+        std::lock_guard<std::mutex> lock(peerMutex_);
+        auto it = transports_.find(peerId);
+        if (it == transports_.end()) {
+            return nullptr;
+        }
+        return std::static_pointer_cast<RelayTransport>(it->second.find(Transport::Kind::Relay));
+    }
+    
+    void handleSignalingMessage(const std::string& msgStr) {
+        SignalingMessage msg;
+        try {
+            msg = SignalingMessage::deserialize(msgStr);
         } catch (const std::exception& e) {
             if (onError_) {
                 onError_(Error{ErrorCode::InvalidData, e.what()});
             }
+            return;
+        }
+        
+        dispatchSignaling(msg);
+    }
+    
+    // 网关端点的消息由网关解析后按 to 派发到这里 (网关自己处理 Register)
+    void dispatchSignaling(const SignalingMessage& msg) {
+        using Handler = void (P2PClientImpl::*)(const SignalingMessage&);
+        static constexpr auto kHandlers = MessageDispatchTable<Handler>()
+            .on(MessageType::Register, &P2PClientImpl::handleRegister)
+            .on(MessageType::PeerList, &P2PClientImpl::handlePeerList)
+            .on(MessageType::Offer, &P2PClientImpl::handleOffer)
+            .on(MessageType::Answer, &P2PClientImpl::handleAnswer)
+            .on(MessageType::Candidate, &P2PClientImpl::handleCandidate)
+            .on(MessageType::RelayAuthResult, &P2PClientImpl::handleRelayAuthResult)
+            .on(MessageType::RelayData, &P2PClientImpl::handleRelayData)
+            .on(MessageType::RelayConnect, &P2PClientImpl::handleRelayConnect)
+            .on(MessageType::RelayDisconnect, &P2PClientImpl::handleRelayDisconnect)
+            .on(MessageType::Error, &P2PClientImpl::handleServerError)
+            .on(MessageType::Throttled, &P2PClientImpl::handleThrottled);
+        
+        try {
+            if (Handler handler = kHandlers[msg.type]) {
+                (this->*handler)(msg);
+            }
+        } catch (const std::exception& e) {
+            if (onError_) {
+                onError_(Error{ErrorCode::InvalidData, e.what()});
+            }
+        }
+    }
+    
+    void handleRegister(const SignalingMessage& msg) {
+        // 服务端接受了令牌：ID、中继认证和中继连接对都已恢复
+        bool resumed = !sessionToken_.empty() && msg.session == sessionToken_ && msg.payload == *localId();
+        
+        setLocalId(msg.payload);
+        sessionToken_ = msg.session;
+        // 旧服务端不回复 version，此时退回版本 1
+        protocolVersion_ = std::clamp(msg.version, kProtocolVersionStringPayload, kProtocolVersion);
+        std::cout << "[P2P] Registered as: " << msg.payload
+                  << " (protocol v" << protocolVersion_ << ")" << std::endl;
+        
+        if (resumed) {
+            setRelayState(resumeRelayState_);
+            resumeRelaySessions();
+        } else {
+            dropRelayPeers();
+        }
+        requestPeerList();
+    }
+    
+    void handlePeerList(const SignalingMessage& msg) {
+        auto peers = json::parse(msg.payload);
+        std::vector<std::string> peerList;
+        for (const auto& peer : peers) {
+            peerList.push_back(peer.get<std::string>());
+        }
+        if (onPeerList_) {
+            onPeerList_(peerList);
+        }
+    }
+    
+    void handleServerError(const SignalingMessage& msg) {
+        if (onError_) {
+            onError_(Error{ErrorCode::SignalingError, msg.payload});
         }
     }
     
@@ -784,26 +1779,123 @@ private:
         }
     }
     
+    void handleThrottled(const SignalingMessage& msg) {
+        auto notice = json::parse(msg.payload);
+        std::string scope = notice.value("scope", "client");
+        uint32_t retryAfter = notice.value("retry_after_ms", 0u);
+        
+        std::cerr << "[P2P] Throttled by server (" << scope << "), retry after "
+                  << retryAfter << " ms" << std::endl;
+        
+        // 被限流的中继消息已被服务端丢弃：到期后重发最早的未确认消息，而不是等待完整的 RTO
+        // (连接级限流同样丢弃中继消息；中继对限流只影响通知中的 Peer)
+        std::string peer = notice.value("peer", "");
+        std::vector<std::shared_ptr<RelaySession>> sessions;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            for (const auto& [peerId, session] : relaySessions_) {
+                if (peer.empty() || peerId == peer) {
+                    sessions.push_back(session);
+                }
+            }
+        }
+        for (const auto& session : sessions) {
+            std::lock_guard<std::mutex> lock(session->mutex());
+            session->throttled(std::chrono::milliseconds(retryAfter));
+        }
+        
+        if (onError_) {
+            onError_(Error{ErrorCode::RateLimited,
+                           "Rate limited (" + scope + "), retry after " + std::to_string(retryAfter) + " ms"});
+        }
+    }
+    
     void handleRelayData(const SignalingMessage& msg) {
         try {
-            auto dataMsg = RelayDataMessage::deserialize(msg.payload);
+            // 直接在 payload 上定位 data 字段，Base64 解码到池化缓冲区
+            bool isBinary = false;
+            bool compressed = false;
+            JsonRawValue data;
+            JsonRawValue compression;
+            RelaySession::Control control;
+            std::optional<uint64_t> kind;   // 内部子协议帧
+            bool systemFrames = false;      // 协商回复中对方声明支持子协议帧
+            bool ok = forEachJsonMember(msg.payload, [&](std::string_view key, const JsonRawValue& value) {
+                if (key == "is_binary") {
+                    isBinary = (value.raw == "true");
+                } else if (key == "data") {
+                    data = value;
+                } else if (key == "compressed") {
+                    compressed = (value.raw == "true");
+                } else if (key == "compression") {
+                    compression = value;
+                } else if (key == "seq") {
+                    control.seq = RelaySession::parseNumber(value.raw);
+                } else if (key == "ack") {
+                    control.ack = RelaySession::parseNumber(value.raw);
+                } else if (key == "credit") {
+                    control.credit = RelaySession::parseNumber(value.raw);
+                } else if (key == "window") {
+                    control.window = RelaySession::parseNumber(value.raw);
+                } else if (key == "reliable") {
+                    control.reliable = (value.raw == "true");
+                } else if (key == "resend") {
+                    control.resend = (value.raw == "true");
+                } else if (key == "probe") {
+                    control.probe = (value.raw == "true");
+                } else if (key == "kind") {
+                    kind = RelaySession::parseNumber(value.raw);
+                } else if (key == "sys") {
+                    systemFrames = true;
+                }
+            });
+            if (!ok) {
+                throw std::invalid_argument("Malformed relay data message");
+            }
             
-            if (dataMsg.isBinary) {
-                BinaryData data = base64Decode(dataMsg.binaryBase64);
-                
-                if (onBinaryMessage_) {
-                    onBinaryMessage_(msg.from, data);
+            // 确认、信用、重发请求和序号检查；重复或越过缺口的消息不交给应用
+            bool deliver = processRelaySequence(msg.from, control, data.present, msg.payload.size());
+            auto transport = relayTransport(msg.from);
+            if (transport) {
+                transport->received(msg.payload.size());
+            }
+            if (control.ack || control.credit) {
+                streams_->resume(msg.from);  // 重传缓冲区或信用可能已腾出空间
+                if (transport) {
+                    transport->acknowledged();
                 }
-                if (onMessage_) {
-                    onMessage_(msg.from, Message::fromBinary(data));
+            }
+            if (!deliver) {
+                if (compression.present) {
+                    // 协商回复 (不是应用消息)
+                    updateCompression(relayCompression_, msg.from, json::parse(compression.raw));
                 }
-            } else {
-                if (onTextMessage_) {
-                    onTextMessage_(msg.from, dataMsg.textData);
+                if (systemFrames) {
+                    {
+                        std::lock_guard<std::mutex> lock(peerMutex_);
+                        relaySystemPeers_.insert(msg.from);
+                    }
+                    systemPeerReady(msg.from);
                 }
-                if (onMessage_) {
-                    onMessage_(msg.from, Message::fromText(dataMsg.textData));
+                return;
+            }
+            
+            if (kind) {
+                Buffer frame = Buffer::allocate(base64DecodedMaxSize(data.raw.size()));
+                frame.resize(base64Decode(data.raw, frame.data()));
+                dispatchFrame(msg.from, static_cast<uint8_t>(*kind), frame.data(), frame.size());
+            } else if (compressed) {
+                Buffer frame = Buffer::allocate(base64DecodedMaxSize(data.raw.size()));
+                frame.resize(base64Decode(data.raw, frame.data()));
+                deliverFrame(msg.from, frame);
+            } else if (isBinary) {
+                Buffer buffer = Buffer::allocate(base64DecodedMaxSize(data.raw.size()));
+                if (!buffer.empty()) {
+                    buffer.resize(base64Decode(data.raw, buffer.data()));
                 }
+                deliverBinary(msg.from, buffer);
+            } else {
+                deliverText(msg.from, data.toString());
             }
         } catch (const std::exception& e) {
             if (onError_) {
@@ -813,28 +1905,138 @@ private:
     }
     
     void handleRelayConnect(const SignalingMessage& msg) {
-        {
-            std::lock_guard<std::mutex> lock(peerMutex_);
-            relayPeers_.insert(msg.from);
+        auto session = addRelayPeer(msg.from);
+        
+        // 对方附带了协商信息 (旧服务端不转发 payload，此时不压缩、不启用可靠中继)
+        json remote = msg.payload.empty() ? json() : json::parse(msg.payload, nullptr, false);
+        json reply = json::object();
+        if (remote.is_object() && remote.contains("compression")) {
+            updateCompression(relayCompression_, msg.from, remote["compression"]);
+            if (compressor_.enabled()) {
+                reply["compression"] = compressor_.advertisement();
+            }
+        }
+        if (session && remote.is_object() && remote.value("reliable", false)) {
+            std::lock_guard<std::mutex> lock(session->mutex());
+            session->setReliable(true);
+            session->setPeerWindow(remote.value("window", uint64_t(0)));
+            reply["reliable"] = true;
+            if (config_.relayWindow > 0) {
+                reply["window"] = config_.relayWindow;
+            }
+        }
+        if (remote.is_object() && remote.value("sys", 0) >= kSystemProtocolVersion) {
+            {
+                std::lock_guard<std::mutex> lock(peerMutex_);
+                relaySystemPeers_.insert(msg.from);
+            }
+            reply["sys"] = kSystemProtocolVersion;
+        }
+        if (!reply.empty()) {
+            sendRelayRaw(msg.from, reply.dump());
+        }
+        if (reply.contains("sys")) {
+            systemPeerReady(msg.from);
         }
         
         std::cout << "[P2P] Peer " << msg.from << " connected via relay" << std::endl;
         
-        if (onRelayConnected_) {
-            onRelayConnected_(msg.from);
-        }
+        notifyPeerEvent(onRelayConnected_, msg.from);
     }
     
     void handleRelayDisconnect(const SignalingMessage& msg) {
+        std::shared_ptr<Transport> transport;
         {
             std::lock_guard<std::mutex> lock(peerMutex_);
             relayPeers_.erase(msg.from);
+            relayCompression_.erase(msg.from);
+            relaySessions_.erase(msg.from);
+            relaySystemPeers_.erase(msg.from);
+            transport = detachTransport(msg.from, Transport::Kind::Relay);
+        }
+        if (transport) {
+            transport->close();
         }
+        systemPeerLost(msg.from);
         
         std::cout << "[P2P] Peer " << msg.from << " disconnected from relay" << std::endl;
         
-        if (onRelayDisconnected_) {
-            onRelayDisconnected_(msg.from);
+        notifyPeerEvent(onRelayDisconnected_, msg.from);
+    }
+    
+    // 错误回调：调用方不得持有 peerMutex_ 或会话锁
+    void reportError(ErrorCode code, std::string message) {
+        onError_(Error{code, std::move(message)});
+    }
+    
+    void post(const std::string& peerId, CallbackDispatcher::Task task) {
+        dispatcher_->post(peerId, DispatchScope::wrap(dispatchScope_, std::move(task)));
+    }
+    
+    // Peer 事件回调：配置了分发线程时与该 Peer 的消息一起按顺序排队，否则在当前线程执行
+    // 入队时取回调快照，之后重新设置回调不影响已排队的事件
+    void notifyPeerEvent(const CallbackSlot<std::function<void(const std::string&)>>& slot, const std::string& peerId) {
+        auto callback = slot.get();
+        if (!callback) {
+            return;
+        }
+        if (dispatcher_) {
+            post(peerId, [callback, peerId] { (*callback)(peerId); });
+        } else {
+            (*callback)(peerId);
+        }
+    }
+    
+    // 直连与中继共用的消息分发
+    void deliverText(const std::string& peerId, const std::string& text) {
+        if (dispatcher_) {
+            post(peerId, [this, peerId, text] { invokeText(peerId, text); });
+        } else {
+            invokeText(peerId, text);
+        }
+    }
+    
+    void deliverBinary(const std::string& peerId, const Buffer& buffer) {
+        if (dispatcher_) {
+            post(peerId, [this, peerId, buffer] { invokeBinary(peerId, buffer); });
+        } else {
+            invokeBinary(peerId, buffer);
+        }
+    }
+    
+    void invokeText(const std::string& peerId, const std::string& text) {
+        onTextMessage_(peerId, text);
+        if (auto onMessage = onMessage_.get()) {
+            (*onMessage)(peerId, Message::fromText(text));
+        }
+    }
+    
+    // 只有设置了 BinaryData 版本的回调时才拷贝出 std::vector，且最多拷贝一次
+    void invokeBinary(const std::string& peerId, const Buffer& buffer) {
+        onBufferMessage_(peerId, buffer);
+        auto onBinaryMessage = onBinaryMessage_.get();
+        auto onMessage = onMessage_.get();
+        if (onBinaryMessage || onMessage) {
+            BinaryData data = buffer.toVector();
+            if (onBinaryMessage) {
+                (*onBinaryMessage)(peerId, data);
+            }
+            if (onMessage) {
+                Message message = Message::fromBinary(std::move(data));
+                message.buffer = buffer;
+                (*onMessage)(peerId, message);
+            }
+        }
+    }
+    
+    // 解码压缩帧后按帧头中的类型分发
+    void deliverFrame(const std::string& peerId, const Buffer& frame) {
+        bool isText = false;
+        Buffer payload = compressor_.decode(frame.data(), frame.size(), isText);
+        if (isText) {
+            deliverText(peerId, std::string(payload.begin(), payload.end()));
+        } else {
+            deliverBinary(peerId, payload);
         }
     }
     
@@ -849,111 +2051,191 @@ private:
         pc->onLocalDescription([this, peerId, initiator](rtc::Description description) {
             SignalingMessage msg;
             msg.type = initiator ? MessageType::Offer : MessageType::Answer;
-            msg.from = localId_;
+            msg.from = *localId();
             msg.to = peerId;
             
             json descJson = {
                 {"type", description.typeString()},
                 {"sdp", std::string(description)}
             };
-            msg.payload = descJson.dump();
+            // 压缩协商信息随 offer/answer 交换
+            if (compressor_.enabled()) {
+                descJson["compression"] = compressor_.advertisement();
+            }
+            descJson["sys"] = kSystemProtocolVersion;
+            if (lan_) {
+                if (auto lan = lan_->advertise(peerId, initiator)) {
+                    descJson["lan"] = {{"addrs", lan->addresses}, {"nonce", lan->nonce}};
+                }
+            }
+            msg.setJsonPayload(descJson.dump(), nestedPayload());
             
-            if (ws_ && ws_->isOpen()) {
-                ws_->send(msg.serialize());
+            if (auto ws = socket(); ws && ws->isOpen()) {
+                ws->send(msg.serialize());
             }
         });
         
         pc->onLocalCandidate([this, peerId](rtc::Candidate candidate) {
             SignalingMessage msg;
             msg.type = MessageType::Candidate;
-            msg.from = localId_;
+            msg.from = *localId();
             msg.to = peerId;
             
             json candJson = {
                 {"candidate", std::string(candidate)},
                 {"mid", candidate.mid()}
             };
-            msg.payload = candJson.dump();
+            msg.setJsonPayload(candJson.dump(), nestedPayload());
             
-            if (ws_ && ws_->isOpen()) {
-                ws_->send(msg.serialize());
+            if (auto ws = socket(); ws && ws->isOpen()) {
+                ws->send(msg.serialize());
             }
         });
         
         pc->onStateChange([this, peerId](rtc::PeerConnection::State state) {
             if (state == rtc::PeerConnection::State::Failed ||
                 state == rtc::PeerConnection::State::Closed) {
-                if (onPeerDisconnected_) {
-                    onPeerDisconnected_(peerId);
-                }
+                closeLanTransport(peerId);
+                notifyPeerEvent(onPeerDisconnected_, peerId);
             }
         });
         
-        pc->onDataChannel([this, peerId](std::shared_ptr<rtc::DataChannel> dc) {
-            setupDataChannel(peerId, dc);
+        pc->onDataChannel([this, peerId, weak = std::weak_ptr<rtc::PeerConnection>(pc)](std::shared_ptr<rtc::DataChannel> dc) {
+            if (dc->label() == kSystemChannelLabel) {
+                setupSystemChannel(peerId, dc);
+            } else {
+                setupDataChannel(peerId, dc, weak);
+            }
         });
         
         if (initiator) {
             auto dc = pc->createDataChannel("p2p-channel");
-            setupDataChannel(peerId, dc);
+            setupDataChannel(peerId, dc, pc);
         }
     }
     
-    void setupDataChannel(const std::string& peerId, std::shared_ptr<rtc::DataChannel> dc) {
-        {
-            std::lock_guard<std::mutex> lock(peerMutex_);
-            dataChannels_[peerId] = dc;
-        }
+    // 应用消息通道包装为 WebRTC 传输，加入该 Peer 的传输集合
+    void setupDataChannel(const std::string& peerId, std::shared_ptr<rtc::DataChannel> dc,
+                          std::weak_ptr<rtc::PeerConnection> pc) {
+        auto transport = DataChannelTransport::create(std::move(dc), std::move(pc));
         
-        dc->onOpen([this, peerId]() {
+        transport->setOnOpen([this, peerId]() {
             std::cout << "[P2P] DataChannel opened with " << peerId << std::endl;
-            if (onPeerConnected_) {
-                onPeerConnected_(peerId);
-            }
+            notifyPeerEvent(onPeerConnected_, peerId);
         });
         
-        dc->onClosed([this, peerId]() {
+        transport->setOnClosed([this, peerId]() {
             std::cout << "[P2P] DataChannel closed with " << peerId << std::endl;
-            if (onPeerDisconnected_) {
-                onPeerDisconnected_(peerId);
-            }
+            notifyPeerEvent(onPeerDisconnected_, peerId);
         });
         
-        dc->onMessage([this, peerId](auto message) {
-            if (std::holds_alternative<std::string>(message)) {
-                std::string text = std::get<std::string>(message);
-                
-                if (onTextMessage_) {
-                    onTextMessage_(peerId, text);
-                }
-                if (onMessage_) {
-                    onMessage_(peerId, Message::fromText(text));
-                }
-            } else if (std::holds_alternative<rtc::binary>(message)) {
-                auto& binary = std::get<rtc::binary>(message);
-                BinaryData data(reinterpret_cast<const uint8_t*>(binary.data()),
-                               reinterpret_cast<const uint8_t*>(binary.data()) + binary.size());
-                
-                if (onBinaryMessage_) {
-                    onBinaryMessage_(peerId, data);
-                }
-                if (onMessage_) {
-                    onMessage_(peerId, Message::fromBinary(data));
-                }
-            }
+        transport->setOnMessage([this, peerId](Transport::Message message) {
+            handleDirectMessage(peerId, std::move(message));
         });
         
-        dc->onError([this, peerId](const std::string& error) {
+        transport->setOnError([this, peerId](const std::string& error) {
             if (onError_) {
                 onError_(Error{ErrorCode::InternalError, "DataChannel error with " + peerId + ": " + error});
             }
         });
+        
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            transports_[peerId].add(transport);
+        }
+        transport->start();
+    }
+    
+    // 直连传输 (DataChannel、局域网) 上收到的应用消息：二进制帧在协商了压缩时带压缩帧头
+    void handleDirectMessage(const std::string& peerId, Transport::Message message) {
+        if (std::holds_alternative<std::string>(message)) {
+            deliverText(peerId, std::get<std::string>(message));
+            return;
+        }
+        const auto& binary = std::get<rtc::binary>(message);
+        if (!peerCompression(directCompression_, peerId)) {
+            deliverBinary(peerId, Buffer::copyOf(binary.data(), binary.size()));
+            return;
+        }
+        try {
+            bool isText = false;
+            Buffer payload = compressor_.decode(binary.data(), binary.size(), isText);
+            if (isText) {
+                deliverText(peerId, std::string(payload.begin(), payload.end()));
+            } else {
+                deliverBinary(peerId, payload);
+            }
+        } catch (const std::exception& e) {
+            reportError(ErrorCode::InvalidData, "Invalid frame from " + peerId + ": " + e.what());
+        }
+    }
+    
+    // 握手成功的局域网连接加入传输集合；PeerConnection 已不存在 (Peer 已断开) 时丢弃
+    void attachLanTransport(const std::string& peerId, std::shared_ptr<Transport> transport) {
+        std::weak_ptr<Transport> weak = transport;
+        transport->setOnMessage([this, peerId](Transport::Message message) {
+            handleDirectMessage(peerId, std::move(message));
+        });
+        transport->setOnClosed([this, peerId, weak]() {
+            std::cout << "[P2P] LAN connection closed with " << peerId << std::endl;
+            std::shared_ptr<Transport> detached;
+            {
+                std::lock_guard<std::mutex> lock(peerMutex_);
+                auto it = transports_.find(peerId);
+                if (it != transports_.end() && it->second.find(Transport::Kind::Lan) == weak.lock()) {
+                    detached = detachTransport(peerId, Transport::Kind::Lan);
+                }
+            }
+            // detached 在锁外释放；可能是最后一个引用，由接收线程自身析构
+        });
+        transport->setOnError([this, peerId](const std::string& error) {
+            reportError(ErrorCode::InternalError, "LAN transport error with " + peerId + ": " + error);
+        });
+        
+        std::shared_ptr<Transport> previous;
+        bool accepted = false;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            if (running_ && peerConnections_.count(peerId)) {
+                previous = transports_[peerId].add(transport);
+                accepted = true;
+            }
+        }
+        if (previous) previous->close();
+        if (!accepted) transport->close();
+    }
+    
+    void closeLanTransport(const std::string& peerId) {
+        std::shared_ptr<Transport> transport;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            transport = detachTransport(peerId, Transport::Kind::Lan);
+        }
+        if (transport) transport->close();
+    }
+    
+    // 对方 offer/answer 中的局域网信息；发起方收到 answer 后开始连接
+    void updateLan(const std::string& peerId, const json& lan, bool remoteIsOfferer) {
+        if (!lan_ || !lan.is_object()) {
+            return;
+        }
+        try {
+            lan_->setRemote(peerId, lan.value("nonce", ""), remoteIsOfferer);
+            if (!remoteIsOfferer) {
+                lan_->connect(*localId(), peerId, lan.value("addrs", std::vector<std::string>()));
+            }
+        } catch (const json::exception& e) {
+            std::cerr << "[P2P] Ignoring invalid LAN info from " << peerId << ": " << e.what() << std::endl;
+        }
     }
     
     void handleOffer(const SignalingMessage& msg) {
+        auto descJson = json::parse(msg.payload);
+        updateCompression(directCompression_, msg.from, descJson.value("compression", json()));
+        updateLan(msg.from, descJson.value("lan", json()), true);
+        
         createPeerConnection(msg.from, false);
         
-        auto descJson = json::parse(msg.payload);
         rtc::Description description(descJson["sdp"].get<std::string>(), 
                                       descJson["type"].get<std::string>());
         
@@ -966,13 +2248,27 @@ private:
     
     void handleAnswer(const SignalingMessage& msg) {
         auto descJson = json::parse(msg.payload);
+        updateCompression(directCompression_, msg.from, descJson.value("compression", json()));
         rtc::Description description(descJson["sdp"].get<std::string>(), 
                                       descJson["type"].get<std::string>());
         
-        std::lock_guard<std::mutex> lock(peerMutex_);
-        auto it = peerConnections_.find(msg.from);
-        if (it != peerConnections_.end()) {
-            it->second->setRemoteDescription(description);
+        std::shared_ptr<rtc::PeerConnection> pc;
+        {
+            std::lock_guard<std::mutex> lock(peerMutex_);
+            auto it = peerConnections_.find(msg.from);
+            if (it != peerConnections_.end()) {
+                pc = it->second;
+                pc->setRemoteDescription(description);
+            }
+        }
+        
+        if (pc) {
+            updateLan(msg.from, descJson.value("lan", json()), false);
+        }
+        
+        // 对方支持子协议帧时由发起方创建系统通道 (旧版本会把它当成应用通道，所以等 answer 确认后再创建)
+        if (pc && descJson.value("sys", 0) >= kSystemProtocolVersion) {
+            setupSystemChannel(msg.from, pc->createDataChannel(kSystemChannelLabel));
         }
     }
     
@@ -990,33 +2286,69 @@ private:
 
 private:
     ClientConfig config_;
+    std::shared_ptr<GatewayImpl> gateway_;            // 网关端点共用网关的连接，独立客户端为空
+    std::shared_ptr<GatewayImpl::Slot> gatewaySlot_;  // 网关端点的注册状态
+    Compressor compressor_;
     std::atomic<ConnectionState> state_;
     std::atomic<RelayState> relayState_;
     std::atomic<bool> running_;
-    std::string localId_;
+    std::atomic<uint32_t> protocolVersion_{kProtocolVersionStringPayload};
+    // 注册/Attach 回复时在网络线程替换，各线程的发送路径并发读取：只经 localId()/setLocalId() 访问
+    std::shared_ptr<const std::string> localId_ = std::make_shared<const std::string>();
+    std::string sessionToken_;     // 协议版本 3 的会话令牌，主动 disconnect() 时清空
+    RelayState resumeRelayState_ = RelayState::NotAuthenticated;  // 断线前的中继认证状态，会话恢复时还原
     
+    // connect()/disconnect() 替换，网络线程、定时器与状态同步线程并发读取：只经 socket()/setSocket() 访问
     std::shared_ptr<rtc::WebSocket> ws_;
     rtc::Configuration rtcConfig_;
     
     std::unordered_map<std::string, std::shared_ptr<rtc::PeerConnection>> peerConnections_;
-    std::unordered_map<std::string, std::shared_ptr<rtc::DataChannel>> dataChannels_;
+    std::unordered_map<std::string, TransportSet> transports_;  // 每个 Peer 的直连与中继传输
     std::unordered_set<std::string> relayPeers_;  // 通过中继连接的 Peer
+    std::unordered_map<std::string, PeerCompression> directCompression_;  // 直连已协商压缩的 Peer
+    std::unordered_map<std::string, PeerCompression> relayCompression_;   // 中继已协商压缩的 Peer
+    std::unordered_map<std::string, std::shared_ptr<RelaySession>> relaySessions_;  // 可靠中继会话
+    std::unordered_map<std::string, std::shared_ptr<rtc::DataChannel>> systemChannels_;  // 直连子协议通道
+    std::unordered_set<std::string> relaySystemPeers_;  // 中继上支持子协议帧的 Peer
     mutable std::mutex peerMutex_;
+    std::unique_ptr<LanService> lan_;  // 局域网直连，未启用时为空
+    
+    // 中继计时线程 (重传、延迟确认、零窗口探测)
+    static constexpr std::chrono::milliseconds kRelayTimerTick{20};
+    std::thread relayTimer_;
+    std::mutex relayTimerMutex_;
+    std::condition_variable relayTimerCv_;
+    bool relayTimerStopping_ = false;
+    
+    // disconnectAsync 的后台任务数 (析构时等待归零)
+    static constexpr size_t kMaxTeardownThreads = 8;  // 关闭 PeerConnection 的最大并行数
+    static constexpr size_t kCloseBatch = 8;          // 连接数超过该值才用辅助线程并行关闭
+    std::mutex teardownMutex_;
+    std::condition_variable teardownCv_;
+    size_t pendingTeardowns_ = 0;
     
     // 回调
-    OnConnectedCallback onConnected_;
-    OnDisconnectedCallback onDisconnected_;
-    OnPeerConnectedCallback onPeerConnected_;
-    OnPeerDisconnectedCallback onPeerDisconnected_;
-    OnTextMessageCallback onTextMessage_;
-    OnBinaryMessageCallback onBinaryMessage_;
-    OnMessageCallback onMessage_;
-    OnPeerListCallback onPeerList_;
-    OnErrorCallback onError_;
-    OnStateChangeCallback onStateChange_;
-    OnRelayAuthResultCallback onRelayAuthResult_;
-    OnRelayConnectedCallback onRelayConnected_;
-    OnRelayDisconnectedCallback onRelayDisconnected_;
+    CallbackSlot<OnConnectedCallback> onConnected_;
+    CallbackSlot<OnDisconnectedCallback> onDisconnected_;
+    CallbackSlot<OnPeerConnectedCallback> onPeerConnected_;
+    CallbackSlot<OnPeerDisconnectedCallback> onPeerDisconnected_;
+    CallbackSlot<OnTextMessageCallback> onTextMessage_;
+    CallbackSlot<OnBinaryMessageCallback> onBinaryMessage_;
+    CallbackSlot<OnMessageCallback> onMessage_;
+    CallbackSlot<OnBufferMessageCallback> onBufferMessage_;
+    CallbackSlot<OnPeerListCallback> onPeerList_;
+    CallbackSlot<OnErrorCallback> onError_;
+    CallbackSlot<OnStateChangeCallback> onStateChange_;
+    CallbackSlot<OnRelayAuthResultCallback> onRelayAuthResult_;
+    CallbackSlot<OnRelayConnectedCallback> onRelayConnected_;
+    CallbackSlot<OnRelayDisconnectedCallback> onRelayDisconnected_;
+    std::shared_ptr<CallbackDispatcher> dispatcher_;  // 配置了分发线程时非空 (网关端点共用网关的)
+    std::shared_ptr<DispatchScope> dispatchScope_ = std::make_shared<DispatchScope>();
+    
+    std::shared_ptr<StreamMux> streams_;  // Stream 句柄持有弱引用
+    PubSub pubsub_;
+    StateSync stateSync_;
+    RpcEngine rpc_;  // 最后声明、最先析构：计时线程停止后才释放其他成员
 };
 
 // ==================== P2PClient 实现 ====================
@@ -1024,6 +2356,9 @@ private:
 P2PClient::P2PClient(const ClientConfig& config)
     : impl_(std::make_unique<P2PClientImpl>(config)) {}
 
+P2PClient::P2PClient(const ClientConfig& config, std::shared_ptr<GatewayImpl> gateway)
+    : impl_(std::make_unique<P2PClientImpl>(config, std::move(gateway))) {}
+
 P2PClient::P2PClient(const std::string& signalingUrl) {
     ClientConfig config;
     config.signalingUrl = signalingUrl;
@@ -1038,6 +2373,7 @@ P2PClient& P2PClient::operator=(P2PClient&&) noexcept = default;
 bool P2PClient::connect() { return impl_->connect(); }
 std::future<bool> P2PClient::connectAsync() { return impl_->connectAsync(); }
 void P2PClient::disconnect() { impl_->disconnect(); }
+std::future<DisconnectStats> P2PClient::disconnectAsync() { return impl_->disconnectAsync(); }
 bool P2PClient::isConnected() const { return impl_->isConnected(); }
 ConnectionState P2PClient::getState() const { return impl_->getState(); }
 std::string P2PClient::getLocalId() const { return impl_->getLocalId(); }
@@ -1051,6 +2387,9 @@ void P2PClient::requestPeerList() { impl_->requestPeerList(); }
 std::vector<std::string> P2PClient::getConnectedPeers() const { return impl_->getConnectedPeers(); }
 bool P2PClient::isPeerConnected(const std::string& peerId) const { return impl_->isPeerConnected(peerId); }
 std::optional<PeerInfo> P2PClient::getPeerInfo(const std::string& peerId) const { return impl_->getPeerInfo(peerId); }
+std::vector<TransportStats> P2PClient::getTransportStats(const std::string& peerId) const {
+    return impl_->getTransportStats(peerId);
+}
 
 bool P2PClient::sendText(const std::string& peerId, const std::string& message) {
     return impl_->sendText(peerId, message);
@@ -1064,6 +2403,9 @@ bool P2PClient::sendBinary(const std::string& peerId, const void* data, size_t s
 bool P2PClient::send(const std::string& peerId, const Message& message) {
     return impl_->send(peerId, message);
 }
+bool P2PClient::sendv(const std::string& peerId, const ConstBuffer* buffers, size_t count) {
+    return impl_->sendv(peerId, buffers, count);
+}
 size_t P2PClient::broadcastText(const std::string& message) { return impl_->broadcastText(message); }
 size_t P2PClient::broadcastBinary(const BinaryData& data) { return impl_->broadcastBinary(data); }
 
@@ -1090,10 +2432,47 @@ bool P2PClient::sendBinaryViaRelay(const std::string& peerId, const void* data,
 bool P2PClient::sendViaRelay(const std::string& peerId, const Message& message) {
     return impl_->sendViaRelay(peerId, message);
 }
+bool P2PClient::sendvViaRelay(const std::string& peerId, const ConstBuffer* buffers, size_t count) {
+    return impl_->sendvViaRelay(peerId, buffers, count);
+}
 size_t P2PClient::broadcastTextViaRelay(const std::string& message) { return impl_->broadcastTextViaRelay(message); }
 size_t P2PClient::broadcastBinaryViaRelay(const BinaryData& data) { return impl_->broadcastBinaryViaRelay(data); }
 std::vector<std::string> P2PClient::getRelayConnectedPeers() const { return impl_->getRelayConnectedPeers(); }
 bool P2PClient::isPeerRelayConnected(const std::string& peerId) const { return impl_->isPeerRelayConnected(peerId); }
+CompressionStats P2PClient::getCompressionStats() const { return impl_->getCompressionStats(); }
+
+RpcCall P2PClient::call(const std::string& peerId, const std::string& method, ConstBuffer request,
+                        std::chrono::milliseconds timeout) {
+    return impl_->call(peerId, method, request, timeout);
+}
+bool P2PClient::cancelCall(uint64_t callId) { return impl_->cancelCall(callId); }
+void P2PClient::registerRpcHandler(const std::string& method, RpcHandler handler) {
+    impl_->registerRpcHandler(method, std::move(handler));
+}
+std::vector<RpcMethodStats> P2PClient::getRpcStats() const { return impl_->getRpcStats(); }
+
+Stream P2PClient::openStream(const std::string& peerId) { return impl_->openStream(peerId); }
+void P2PClient::setOnStream(OnStreamCallback cb) { impl_->setOnStream(std::move(cb)); }
+
+bool P2PClient::subscribe(const std::string& pattern) { return impl_->subscribe(pattern); }
+void P2PClient::unsubscribe(const std::string& pattern) { impl_->unsubscribe(pattern); }
+size_t P2PClient::publish(const std::string& topic, ConstBuffer data) { return impl_->publish(topic, data); }
+std::vector<std::string> P2PClient::getTopicSubscribers(const std::string& topic) const {
+    return impl_->getTopicSubscribers(topic);
+}
+void P2PClient::setOnPublication(OnPublicationCallback cb) { impl_->setOnPublication(std::move(cb)); }
+
+void P2PClient::setState(const std::string& key, ConstBuffer value) { impl_->setState(key, value); }
+void P2PClient::eraseState(const std::string& key) { impl_->eraseState(key); }
+std::optional<Buffer> P2PClient::getState(const std::string& key) const { return impl_->getState(key); }
+std::optional<Buffer> P2PClient::getPeerState(const std::string& peerId, const std::string& key) const {
+    return impl_->getPeerState(peerId, key);
+}
+std::map<std::string, Buffer> P2PClient::getPeerStateMap(const std::string& peerId) const {
+    return impl_->getPeerStateMap(peerId);
+}
+void P2PClient::setOnStateUpdate(OnStateUpdateCallback cb) { impl_->setOnStateUpdate(std::move(cb)); }
+StateSyncStats P2PClient::getStateSyncStats() const { return impl_->getStateSyncStats(); }
 
 void P2PClient::setOnConnected(OnConnectedCallback cb) { impl_->setOnConnected(std::move(cb)); }
 void P2PClient::setOnDisconnected(OnDisconnectedCallback cb) { impl_->setOnDisconnected(std::move(cb)); }
@@ -1102,6 +2481,7 @@ void P2PClient::setOnPeerDisconnected(OnPeerDisconnectedCallback cb) { impl_->se
 void P2PClient::setOnTextMessage(OnTextMessageCallback cb) { impl_->setOnTextMessage(std::move(cb)); }
 void P2PClient::setOnBinaryMessage(OnBinaryMessageCallback cb) { impl_->setOnBinaryMessage(std::move(cb)); }
 void P2PClient::setOnMessage(OnMessageCallback cb) { impl_->setOnMessage(std::move(cb)); }
+void P2PClient::setOnBufferMessage(OnBufferMessageCallback cb) { impl_->setOnBufferMessage(std::move(cb)); }
 void P2PClient::setOnPeerList(OnPeerListCallback cb) { impl_->setOnPeerList(std::move(cb)); }
 void P2PClient::setOnError(OnErrorCallback cb) { impl_->setOnError(std::move(cb)); }
 void P2PClient::setOnStateChange(OnStateChangeCallback cb) { impl_->setOnStateChange(std::move(cb)); }
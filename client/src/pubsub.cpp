@@ -0,0 +1,245 @@
+#include "pubsub.hpp"
+#include "frames.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+namespace p2p {
+
+namespace {
+
+constexpr uint8_t kSnapshot = 0;
+constexpr uint8_t kSubscribe = 1;
+constexpr uint8_t kUnsubscribe = 2;
+constexpr uint8_t kPublish = 3;
+
+void appendVarint(std::vector<uint8_t>& out, uint64_t value) {
+    uint8_t bytes[kMaxVarintSize];
+    out.insert(out.end(), bytes, bytes + writeVarint(bytes, value));
+}
+
+} // namespace
+
+PubSub::PubSub(SendFrame send) : send_(std::move(send)) {}
+
+bool PubSub::subscribe(const std::string& pattern) {
+    if (!TopicTrie::validPattern(pattern)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> announceLock(announceMutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!localPatterns_.insert(pattern).second) {
+            return true;
+        }
+        localTrie_.add(pattern, 0);
+    }
+    broadcast(encodePatterns(kSubscribe, {pattern}));
+    return true;
+}
+
+void PubSub::unsubscribe(const std::string& pattern) {
+    std::lock_guard<std::mutex> announceLock(announceMutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (localPatterns_.erase(pattern) == 0) {
+            return;
+        }
+        localTrie_.remove(pattern, 0);
+    }
+    broadcast(encodePatterns(kUnsubscribe, {pattern}));
+}
+
+size_t PubSub::publish(std::string_view topic, ConstBuffer data) {
+    if (!TopicTrie::validTopic(topic)) {
+        return 0;
+    }
+
+    std::vector<std::string> peers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SlotSet matched;
+        remoteTrie_.match(topic, matched);
+        matched.forEach([&](size_t slot) { peers.push_back(slotPeers_[slot]); });
+    }
+
+    uint8_t header[1 + kMaxVarintSize];
+    size_t headerSize = 0;
+    header[headerSize++] = kPublish;
+    headerSize += writeVarint(header + headerSize, topic.size());
+    ConstBuffer parts[] = {ConstBuffer(header, headerSize), ConstBuffer(topic), data};
+
+    size_t count = 0;
+    for (const auto& peerId : peers) {
+        if (send_(peerId, parts, 3)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void PubSub::setOnPublication(OnPublicationCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    onPublication_ = std::move(callback);
+}
+
+void PubSub::addPeer(const std::string& peerId) {
+    std::lock_guard<std::mutex> announceLock(announceMutex_);
+    std::vector<std::string> patterns;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        neighbor(peerId);
+        patterns.assign(localPatterns_.begin(), localPatterns_.end());
+    }
+    auto frame = encodePatterns(kSnapshot, patterns);
+    ConstBuffer part(frame.data(), frame.size());
+    send_(peerId, &part, 1);
+}
+
+void PubSub::removePeer(const std::string& peerId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = neighbors_.find(peerId);
+    if (it == neighbors_.end()) {
+        return;
+    }
+    clearPatterns(it->second);
+    slotPeers_[it->second.slot].clear();
+    freeSlots_.push_back(it->second.slot);
+    neighbors_.erase(it);
+}
+
+void PubSub::clearPeers() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [peerId, neighbor] : neighbors_) {
+        clearPatterns(neighbor);
+    }
+    neighbors_.clear();
+    slotPeers_.clear();
+    freeSlots_.clear();
+}
+
+void PubSub::handleFrame(const std::string& peerId, const uint8_t* data, size_t size) {
+    if (size == 0) {
+        throw std::invalid_argument("Empty pubsub frame");
+    }
+    const uint8_t* p = data + 1;
+    const uint8_t* end = data + size;
+
+    if (data[0] == kPublish) {
+        uint64_t topicSize = 0;
+        if (!readVarint(p, end, topicSize) || topicSize > static_cast<uint64_t>(end - p)) {
+            throw std::invalid_argument("Malformed publication");
+        }
+        std::string topic(reinterpret_cast<const char*>(p), static_cast<size_t>(topicSize));
+        p += topicSize;
+
+        OnPublicationCallback onPublication;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            SlotSet matched;
+            localTrie_.match(topic, matched);
+            if (matched.empty()) {
+                return;  // 退订通告到达对方之前发出的
+            }
+            onPublication = onPublication_;
+        }
+        if (onPublication) {
+            onPublication(peerId, topic, Buffer::copyOf(p, static_cast<size_t>(end - p)));
+        }
+        return;
+    }
+
+    if (data[0] > kUnsubscribe) {
+        throw std::invalid_argument("Unknown pubsub frame type");
+    }
+
+    uint64_t count = 0;
+    if (!readVarint(p, end, count)) {
+        throw std::invalid_argument("Malformed subscription frame");
+    }
+    std::vector<std::string> patterns;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t length = 0;
+        if (!readVarint(p, end, length) || length > static_cast<uint64_t>(end - p)) {
+            throw std::invalid_argument("Malformed subscription frame");
+        }
+        patterns.emplace_back(reinterpret_cast<const char*>(p), static_cast<size_t>(length));
+        p += length;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& peer = neighbor(peerId);
+    if (data[0] == kSnapshot) {
+        clearPatterns(peer);
+    }
+    for (const auto& pattern : patterns) {
+        if (data[0] == kUnsubscribe) {
+            if (peer.patterns.erase(pattern) > 0) {
+                remoteTrie_.remove(pattern, peer.slot);
+            }
+        } else if (peer.patterns.size() < kMaxPatternsPerPeer && TopicTrie::validPattern(pattern) &&
+                   peer.patterns.insert(pattern).second) {
+            remoteTrie_.add(pattern, peer.slot);
+        }
+    }
+}
+
+std::vector<std::string> PubSub::subscribers(std::string_view topic) const {
+    std::vector<std::string> peers;
+    std::lock_guard<std::mutex> lock(mutex_);
+    SlotSet matched;
+    remoteTrie_.match(topic, matched);
+    matched.forEach([&](size_t slot) { peers.push_back(slotPeers_[slot]); });
+    return peers;
+}
+
+std::vector<uint8_t> PubSub::encodePatterns(uint8_t type, const std::vector<std::string>& patterns) {
+    std::vector<uint8_t> frame;
+    frame.push_back(type);
+    appendVarint(frame, patterns.size());
+    for (const auto& pattern : patterns) {
+        appendVarint(frame, pattern.size());
+        frame.insert(frame.end(), pattern.begin(), pattern.end());
+    }
+    return frame;
+}
+
+void PubSub::broadcast(const std::vector<uint8_t>& frame) {
+    std::vector<std::string> peers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [peerId, neighbor] : neighbors_) {
+            peers.push_back(peerId);
+        }
+    }
+    ConstBuffer part(frame.data(), frame.size());
+    for (const auto& peerId : peers) {
+        send_(peerId, &part, 1);
+    }
+}
+
+PubSub::Neighbor& PubSub::neighbor(const std::string& peerId) {
+    auto it = neighbors_.find(peerId);
+    if (it != neighbors_.end()) {
+        return it->second;
+    }
+    Neighbor neighbor;
+    if (!freeSlots_.empty()) {
+        neighbor.slot = freeSlots_.back();
+        freeSlots_.pop_back();
+        slotPeers_[neighbor.slot] = peerId;
+    } else {
+        neighbor.slot = slotPeers_.size();
+        slotPeers_.push_back(peerId);
+    }
+    return neighbors_.emplace(peerId, std::move(neighbor)).first->second;
+}
+
+void PubSub::clearPatterns(Neighbor& neighbor) {
+    for (const auto& pattern : neighbor.patterns) {
+        remoteTrie_.remove(pattern, neighbor.slot);
+    }
+    neighbor.patterns.clear();
+}
+
+} // namespace p2p
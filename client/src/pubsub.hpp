@@ -0,0 +1,92 @@
+// client/src/pubsub.hpp
+#pragma once
+
+#include "p2p/types.hpp"
+#include "topic_trie.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace p2p {
+
+/**
+ * 主题发布/订阅
+ *
+ * 每个 Peer 把自己的订阅模式通告给所有支持子协议帧的邻居，发布方按邻居的订阅表只发给匹配的 Peer。
+ * 帧体 (FrameKind::PubSub)：
+ *   全量 [0][数量 varint]{[长度 varint][模式]}   替换该 Peer 的全部订阅 (连接建立时发送)
+ *   订阅 [1][数量 varint]{[长度 varint][模式]}
+ *   退订 [2][数量 varint]{[长度 varint][模式]}
+ *   发布 [3][主题长度 varint][主题][数据]
+ *
+ * 邻居订阅表是一棵 TopicTrie，节点上保存订阅者编号的位集；每个 Peer 分配一个小整数编号，断开后回收。
+ */
+class PubSub {
+public:
+    static constexpr size_t kMaxPatternsPerPeer = 4096;  // 单个 Peer 的订阅上限，超出的订阅被忽略
+
+    using SendFrame = std::function<bool(const std::string& peerId, const ConstBuffer* parts, size_t count)>;
+
+    explicit PubSub(SendFrame send);
+
+    // 本端订阅，变更会通告给所有邻居；模式不合法时返回 false
+    bool subscribe(const std::string& pattern);
+    void unsubscribe(const std::string& pattern);
+
+    // 发给订阅了该主题的邻居，返回发送成功的 Peer 数
+    size_t publish(std::string_view topic, ConstBuffer data);
+
+    void setOnPublication(OnPublicationCallback callback);
+
+    // 与 Peer 的子协议通道已建立：发送本端的全部订阅
+    void addPeer(const std::string& peerId);
+
+    // 与 Peer 已没有子协议通道：删除它的订阅
+    void removePeer(const std::string& peerId);
+
+    // 断开信令连接时删除所有邻居 (本端订阅保留，重新连接后再次通告)
+    void clearPeers();
+
+    void handleFrame(const std::string& peerId, const uint8_t* data, size_t size);
+
+    // 订阅了该主题的邻居
+    std::vector<std::string> subscribers(std::string_view topic) const;
+
+private:
+    struct Neighbor {
+        size_t slot = 0;
+        std::set<std::string, std::less<>> patterns;
+    };
+
+    // 编码订阅变更帧
+    static std::vector<uint8_t> encodePatterns(uint8_t type, const std::vector<std::string>& patterns);
+
+    void broadcast(const std::vector<uint8_t>& frame);
+
+    // 调用方持有 mutex_
+    Neighbor& neighbor(const std::string& peerId);
+    void clearPatterns(Neighbor& neighbor);
+
+    SendFrame send_;
+
+    std::mutex announceMutex_;  // 订阅变更与全量通告按序发出，避免旧的全量覆盖新的变更
+    mutable std::mutex mutex_;
+    std::set<std::string> localPatterns_;
+    TopicTrie localTrie_;  // 只有编号 0，用于过滤收到的发布
+
+    std::unordered_map<std::string, Neighbor> neighbors_;
+    std::vector<std::string> slotPeers_;  // 编号 -> Peer ID (空串为空闲)
+    std::vector<size_t> freeSlots_;
+    TopicTrie remoteTrie_;
+
+    OnPublicationCallback onPublication_;
+};
+
+} // namespace p2p
@@ -0,0 +1,354 @@
+// client/src/relay_session.hpp
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace p2p {
+
+/**
+ * 可靠中继会话 (每个中继 Peer 一个)
+ *
+ * 双方在建立中继连接时交换 "reliable": true 后启用。每条数据消息带递增序号 "seq" 和
+ * 累积确认 "ack" (已按序收到的最大序号)；未确认的消息留在有界重传缓冲区中。
+ * 信令连接恢复或接收端发现序号缺口时发送 "resend": true，发送端从对方确认的位置之后全部重发 (回退 N 帧)。
+ * 接收端只接受下一个期望的序号，重复和越过缺口的消息直接丢弃。
+ * 服务端会静默丢弃中继消息 (限流、对方断线等待重连)，因此发送端另有重传计时器：未确认的消息超过 RTO
+ * 仍未确认时重发最早的一条，RTO 指数退避，确认推进时复位。接收端收到数据后最迟 kAckDelay 内回复确认，
+ * 累计收到 kAckBytes 字节或收到重复消息时立即确认。
+ *
+ * 流控 (可选，双方交换 "window" 后启用)：接收端按字节授予信用，"credit" 为累计允许发送的字节数
+ * (已接收字节数 + 窗口)，随确认发送，消耗超过半个窗口时主动更新。发送端信用不足时不再发出新消息，
+ * 因此每个方向在途 (服务端缓冲区中) 的数据不超过一个窗口加一条消息。
+ * 信用更新本身也可能被丢弃：发送端因信用不足被阻塞时定期发送 "probe": true (零窗口探测，同样退避)，
+ * 接收端对每个探测回复当前信用。
+ * 字节数按 payload 计算，两端看到的 payload 完全相同；重发不重复计算。
+ *
+ * 计时由客户端的中继计时线程驱动 (takeRetransmitDue / takeAckDue / takeProbeDue)，方法接受 now 便于测试。
+ * 所有方法都不加锁，调用方持有 mutex()。发送路径在持锁期间分配序号并把待发消息放入出站队列 (enqueue)，
+ * 释放锁后持有 sendMutex() 按入队顺序发出：写信令连接时不阻塞确认和信用的处理，线上顺序仍与序号一致。
+ */
+class RelaySession {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t kAckEvery = 16;         // 连续收到多少条消息而没有反向数据时单独回复确认
+    static constexpr uint64_t kAckBytes = 64 * 1024;  // 自上次确认以来收到多少字节时立即确认
+    static constexpr std::chrono::milliseconds kAckDelay{40};         // 确认最多延迟多久
+    static constexpr std::chrono::milliseconds kResendInterval{200};  // 同一缺口重复请求重发的最小间隔
+    static constexpr std::chrono::milliseconds kInitialRto{1000};     // 重传计时器初值，也是零窗口探测的初始间隔
+    static constexpr std::chrono::milliseconds kMaxRto{16000};        // 退避上限
+    static constexpr std::string_view kJsonSpace = " \t\r\n";
+
+    enum class Receive {
+        Deliver,    // 下一个期望的序号，交给应用
+        Duplicate,  // 已收到过 (重发导致)
+        Gap         // 前面有消息丢失，等待重发
+    };
+
+    struct Outgoing {
+        uint64_t seq;
+        std::string payload;  // 已写入 seq/ack 的完整 payload
+    };
+
+    // 中继消息中与可靠传输、流控相关的字段
+    struct Control {
+        std::optional<uint64_t> seq;
+        std::optional<uint64_t> ack;
+        std::optional<uint64_t> credit;
+        std::optional<uint64_t> window;
+        bool reliable = false;
+        bool resend = false;
+        bool probe = false;  // 零窗口探测，需回复当前信用
+    };
+
+    explicit RelaySession(size_t maxBufferedBytes) : maxBufferedBytes_(maxBufferedBytes) {}
+
+    std::mutex& mutex() { return mutex_; }
+
+    // 发出出站队列中的消息时持有 (不与 mutex() 嵌套持有)，同一时刻只有一个线程在发
+    std::mutex& sendMutex() { return sendMutex_; }
+
+    // 确认或信用到达时通知等待发送的线程
+    std::condition_variable& writable() { return writable_; }
+
+    // 对方支持可靠中继，此后发出的数据消息带序号
+    bool reliable() const { return reliable_; }
+    void setReliable(bool reliable) { reliable_ = reliable; }
+
+    // 重传缓冲区能否再容纳 size 字节 (缓冲区为空时总能放入一条，避免大消息永远发不出去)
+    bool hasRoom(size_t size) const {
+        return unacked_.empty() || bufferedBytes_ + size <= maxBufferedBytes_;
+    }
+
+    // 对方通告的接收窗口，0 表示对方不做流控。只有建立会话时的第一次通告生效 (初始信用为一个窗口)：
+    // 之后重复到达的通告若再按已发字节加一个窗口，在途的消息就被重复计入，信用只由 updateCredit 推进
+    void setPeerWindow(uint64_t window) {
+        if (peerWindowKnown_) {
+            return;
+        }
+        peerWindowKnown_ = true;
+        peerWindow_ = window;
+        sendLimit_ = sentBytes_ + window;
+    }
+
+    // 对方的累计信用 (只增不减，丢失或乱序的更新被后续更新覆盖)
+    void updateCredit(uint64_t limit) {
+        if (limit > sendLimit_) {
+            sendLimit_ = limit;
+            probeDeadline_.reset();  // 信用已更新，等下次被阻塞时重新开始探测
+            probeInterval_ = kInitialRto;
+        }
+    }
+
+    // 信用是否足够发送 size 字节；超过整个窗口的消息在窗口空闲时也能发出
+    bool hasCredit(size_t size) const {
+        return peerWindow_ == 0 ||
+               sentBytes_ + std::min<uint64_t>(size, peerWindow_) <= sendLimit_;
+    }
+
+    // 发送 size 字节因信用不足被拒绝：开始零窗口探测 (已在探测中时不变)
+    void creditBlocked(size_t size, Clock::time_point now = Clock::now()) {
+        blockedSize_ = size;
+        if (!probeDeadline_) {
+            probeDeadline_ = now + probeInterval_;
+        }
+    }
+
+    // 是否该发送零窗口探测；发送后间隔加倍，直到信用足够发出被拒绝的消息
+    bool takeProbeDue(Clock::time_point now = Clock::now()) {
+        if (probeDeadline_ && hasCredit(blockedSize_)) {
+            probeDeadline_.reset();
+            probeInterval_ = kInitialRto;
+        }
+        if (!probeDeadline_ || now < *probeDeadline_) {
+            return false;
+        }
+        probeInterval_ = std::min(probeInterval_ * 2, kMaxRto);
+        probeDeadline_ = now + probeInterval_;
+        return true;
+    }
+
+    // 本端通告的接收窗口
+    void setLocalWindow(uint64_t window) {
+        window_ = window;
+        granted_ = window;
+    }
+
+    // payload 能否带序号发送：必须是 JSON 对象 (只检查首尾的括号，内容由生成方保证)
+    static bool framable(std::string_view payload) {
+        auto first = payload.find_first_not_of(kJsonSpace);
+        auto last = payload.find_last_not_of(kJsonSpace);
+        return first != std::string_view::npos && payload[first] == '{' && payload[last] == '}';
+    }
+
+    // 在 JSON 对象 payload 末尾写入序号和确认，放入重传缓冲区，返回待发送的 payload
+    // 调用方先用 framable() 检查；序号在检查通过后才分配，不会出现没有 seq 的数据消息
+    const std::string& push(std::string payload, Clock::time_point now = Clock::now()) {
+        uint64_t seq = ++lastSent_;
+        payload.resize(payload.find_last_not_of(kJsonSpace));  // 去掉结尾的 '}' 和空白
+        bool empty = payload.find_last_not_of(kJsonSpace) == payload.find_first_not_of(kJsonSpace);
+        payload += empty ? "\"seq\":" : ",\"seq\":";
+        payload += std::to_string(seq);
+        payload += ",\"ack\":";
+        payload += std::to_string(received_);
+        payload += '}';
+        clearAckDue();  // 确认随数据捎带
+        bufferedBytes_ += payload.size();
+        sentBytes_ += payload.size();
+        if (unacked_.empty()) {
+            retransmitDeadline_ = now + rto_;
+        }
+        unacked_.push_back(Outgoing{seq, std::move(payload)});
+        return unacked_.back().payload;
+    }
+
+    // 对方的累积确认：释放已确认的消息；有进展时重传计时器复位
+    void acknowledge(uint64_t ack, Clock::time_point now = Clock::now()) {
+        bool progressed = false;
+        while (!unacked_.empty() && unacked_.front().seq <= ack) {
+            bufferedBytes_ -= unacked_.front().payload.size();
+            unacked_.pop_front();
+            progressed = true;
+        }
+        if (progressed) {
+            rto_ = kInitialRto;
+            // 超时重发后确认推进而仍有未确认消息：它们多半也已丢失，立即重发下一条
+            recovering_ = recovering_ && !unacked_.empty();
+            retransmitDeadline_ = recovering_ ? now : now + rto_;
+        }
+    }
+
+    // 最早的未确认消息是否该重发 (由调用方重发 unacked().front())；每次重发 RTO 加倍
+    bool takeRetransmitDue(Clock::time_point now = Clock::now()) {
+        if (unacked_.empty() || now < retransmitDeadline_) {
+            return false;
+        }
+        recovering_ = true;
+        rto_ = std::min(rto_ * 2, kMaxRto);
+        retransmitDeadline_ = now + rto_;
+        return true;
+    }
+
+    // 服务端通知消息被限流丢弃：retryAfter 之后重发最早的未确认消息，并在被阻塞时重新探测信用
+    void throttled(std::chrono::milliseconds retryAfter, Clock::time_point now = Clock::now()) {
+        auto at = now + std::max(retryAfter, std::chrono::milliseconds(kAckDelay));
+        if (!unacked_.empty()) {
+            retransmitDeadline_ = std::min(retransmitDeadline_, at);
+        }
+        if (probeDeadline_) {
+            probeDeadline_ = std::min(*probeDeadline_, at);
+        }
+    }
+
+    // size 为 payload 字节数，按序收到时计入已接收字节
+    Receive receive(uint64_t seq, size_t size) {
+        highestSeen_ = std::max(highestSeen_, seq);
+        if (seq == received_ + 1) {
+            ++received_;
+            ++sinceAck_;
+            receivedBytes_ += size;
+            bytesSinceAck_ += size;
+            return Receive::Deliver;
+        }
+        if (seq <= received_) {
+            // 对方在重发，说明确认丢失或被延迟，立即再确认一次
+            ++sinceAck_;
+            ackNow_ = true;
+            return Receive::Duplicate;
+        }
+        return Receive::Gap;
+    }
+
+    // 曾收到越过缺口的消息 (已丢弃)：补上缺口后仍需请求对方从确认位置之后重发
+    bool missing() const { return highestSeen_ > received_; }
+
+    // 是否该单独发送确认：收到足够多消息或字节、收到重复消息、已消耗半个窗口需要更新信用，
+    // 或第一条未确认的消息已等待 kAckDelay (计时线程定期调用，保证最后一批消息也会被确认)
+    bool takeAckDue(Clock::time_point now = Clock::now()) {
+        if (sinceAck_ == 0) {
+            return false;
+        }
+        if (!ackDeadline_) {
+            ackDeadline_ = now + kAckDelay;
+        }
+        bool creditDue = window_ > 0 && receivedBytes_ + window_ >= granted_ + window_ / 2;
+        if (sinceAck_ < kAckEvery && bytesSinceAck_ < kAckBytes && !ackNow_ && !creditDue &&
+            now < *ackDeadline_) {
+            return false;
+        }
+        clearAckDue();
+        return true;
+    }
+
+    // 发现缺口时是否请求重发：同一缺口在间隔内只请求一次
+    bool shouldRequestResend(Clock::time_point now = Clock::now()) {
+        if (resendRequestedAt_ == received_ && now - resendRequestTime_ < kResendInterval) {
+            return false;
+        }
+        resendRequestedAt_ = received_;
+        resendRequestTime_ = now;
+        return true;
+    }
+
+    // 控制消息 (不占序号，不进重传缓冲区)，启用流控时附带最新信用；probe 请求对方回复信用
+    std::string controlPayload(bool resend, bool probe = false) {
+        clearAckDue();
+        std::string payload = "{\"ack\":" + std::to_string(received_);
+        if (window_ > 0) {
+            granted_ = receivedBytes_ + window_;
+            payload += ",\"credit\":" + std::to_string(granted_);
+        }
+        if (resend) {
+            payload += ",\"resend\":true";
+        }
+        if (probe) {
+            payload += ",\"probe\":true";
+        }
+        payload += '}';
+        return payload;
+    }
+
+    // 出站队列：持有 mutex() 时按产生顺序入队 (已封装好的完整消息)，发送线程逐条取出
+    void enqueue(std::string message) { outbound_.push_back(std::move(message)); }
+
+    bool takeOutbound(std::string& message) {
+        if (outbound_.empty()) {
+            return false;
+        }
+        message = std::move(outbound_.front());
+        outbound_.pop_front();
+        return true;
+    }
+
+    const std::deque<Outgoing>& unacked() const { return unacked_; }
+    size_t bufferedBytes() const { return bufferedBytes_; }
+
+    // 解析 seq/ack/credit 等字段的原始 JSON 数字
+    static std::optional<uint64_t> parseNumber(std::string_view raw) {
+        if (raw.empty()) {
+            return std::nullopt;
+        }
+        uint64_t value = 0;
+        for (char c : raw) {
+            if (c < '0' || c > '9') {
+                return std::nullopt;
+            }
+            value = value * 10 + static_cast<uint64_t>(c - '0');
+        }
+        return value;
+    }
+
+private:
+    void clearAckDue() {
+        sinceAck_ = 0;
+        bytesSinceAck_ = 0;
+        ackNow_ = false;
+        ackDeadline_.reset();
+    }
+
+    std::mutex mutex_;
+    std::mutex sendMutex_;
+    std::condition_variable writable_;
+    std::deque<std::string> outbound_;
+    size_t maxBufferedBytes_;
+    bool reliable_ = false;
+
+    // 发送方向
+    uint64_t lastSent_ = 0;
+    std::deque<Outgoing> unacked_;
+    size_t bufferedBytes_ = 0;
+    uint64_t sentBytes_ = 0;   // 累计首次发出的字节数
+    uint64_t sendLimit_ = 0;   // 对方授予的累计信用
+    uint64_t peerWindow_ = 0;
+    bool peerWindowKnown_ = false;
+    std::chrono::milliseconds rto_ = kInitialRto;
+    Clock::time_point retransmitDeadline_;          // unacked_ 非空时有效
+    bool recovering_ = false;                       // 超时重发后、未确认消息清空之前
+    std::chrono::milliseconds probeInterval_ = kInitialRto;
+    std::optional<Clock::time_point> probeDeadline_;  // 因信用不足被阻塞时有值
+    size_t blockedSize_ = 0;
+
+    // 接收方向
+    uint64_t received_ = 0;  // 已按序收到的最大序号
+    uint64_t highestSeen_ = 0;
+    uint64_t receivedBytes_ = 0;
+    uint64_t window_ = 0;    // 本端窗口，0 表示不做流控
+    uint64_t granted_ = 0;   // 已授予对方的累计信用
+    uint32_t sinceAck_ = 0;      // 自上次确认以来收到的消息数 (含重复)
+    uint64_t bytesSinceAck_ = 0;
+    bool ackNow_ = false;
+    std::optional<Clock::time_point> ackDeadline_;
+    uint64_t resendRequestedAt_ = UINT64_MAX;
+    Clock::time_point resendRequestTime_;
+};
+
+} // namespace p2p
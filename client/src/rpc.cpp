@@ -0,0 +1,297 @@
+#include "rpc.hpp"
+#include "frames.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace p2p {
+
+namespace {
+
+constexpr uint8_t kRequest = 0;
+constexpr uint8_t kResponse = 1;
+
+size_t latencyBucket(uint64_t micros) {
+    size_t bucket = 0;
+    while (micros >>= 1) {
+        ++bucket;
+    }
+    return std::min(bucket, RpcMethodStats::kBuckets - 1);
+}
+
+bool readBytes(const uint8_t*& p, const uint8_t* end, std::string& out) {
+    uint64_t length = 0;
+    if (!readVarint(p, end, length) || length > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    out.assign(reinterpret_cast<const char*>(p), static_cast<size_t>(length));
+    p += length;
+    return true;
+}
+
+} // namespace
+
+RpcEngine::RpcEngine(SendFrame send) : send_(std::move(send)) {}
+
+RpcEngine::~RpcEngine() {
+    cancelAll();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    timerCv_.notify_all();
+    if (timerThread_.joinable()) {
+        timerThread_.join();
+    }
+}
+
+RpcCall RpcEngine::call(const std::string& peerId, const std::string& method, ConstBuffer request,
+                        std::chrono::milliseconds timeout) {
+    Pending pending;
+    pending.peerId = peerId;
+    pending.method = method;
+    pending.start = Clock::now();
+    pending.deadline = pending.start + timeout;
+
+    RpcCall call;
+    call.result = pending.promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        call.id = ++nextId_;
+        ++stats_[method].calls;
+        deadlines_.emplace(pending.deadline, call.id);
+        pending_.emplace(call.id, std::move(pending));
+        startTimer();
+    }
+    timerCv_.notify_all();
+
+    uint8_t header[1 + 2 * kMaxVarintSize];
+    size_t headerSize = 0;
+    header[headerSize++] = kRequest;
+    headerSize += writeVarint(header + headerSize, call.id);
+    headerSize += writeVarint(header + headerSize, method.size());
+    ConstBuffer parts[] = {ConstBuffer(header, headerSize), ConstBuffer(method), request};
+
+    // 先登记再发送，响应可能在 send 返回前到达
+    if (!send_(peerId, parts, 3)) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Pending failed;
+        if (takePending(call.id, failed)) {
+            lock.unlock();
+            complete(failed, RpcResult::failure("No RPC channel to " + peerId, RpcStatus::Unavailable));
+        }
+    }
+    return call;
+}
+
+bool RpcEngine::cancel(uint64_t id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Pending pending;
+    if (!takePending(id, pending)) {
+        return false;
+    }
+    lock.unlock();
+    complete(pending, RpcResult::failure("Cancelled", RpcStatus::Cancelled));
+    return true;
+}
+
+void RpcEngine::setHandler(const std::string& method, RpcHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (handler) {
+        handlers_[method] = std::move(handler);
+    } else {
+        handlers_.erase(method);
+    }
+}
+
+void RpcEngine::handleFrame(const std::string& peerId, const uint8_t* data, size_t size) {
+    const uint8_t* p = data + 1;
+    const uint8_t* end = data + size;
+    uint64_t id = 0;
+    if (size < 2 || !readVarint(p, end, id)) {
+        throw std::invalid_argument("Malformed RPC frame");
+    }
+    if (data[0] == kRequest) {
+        handleRequest(peerId, id, p, end);
+    } else if (data[0] == kResponse) {
+        handleResponse(id, p, end);
+    } else {
+        throw std::invalid_argument("Unknown RPC frame type");
+    }
+}
+
+void RpcEngine::handleRequest(const std::string& peerId, uint64_t id, const uint8_t* p, const uint8_t* end) {
+    std::string method;
+    if (!readBytes(p, end, method)) {
+        throw std::invalid_argument("Malformed RPC request");
+    }
+
+    RpcHandler handler;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = handlers_.find(method);
+        if (it != handlers_.end()) {
+            handler = it->second;
+        }
+    }
+
+    RpcResult result;
+    if (!handler) {
+        result = RpcResult::failure("Unknown method: " + method, RpcStatus::NotFound);
+    } else {
+        try {
+            result = handler(peerId, Buffer::copyOf(p, static_cast<size_t>(end - p)));
+        } catch (const std::exception& e) {
+            result = RpcResult::failure(e.what());
+        }
+    }
+
+    uint8_t header[2 + 2 * kMaxVarintSize];
+    size_t headerSize = 0;
+    header[headerSize++] = kResponse;
+    headerSize += writeVarint(header + headerSize, id);
+    header[headerSize++] = static_cast<uint8_t>(result.status);
+    headerSize += writeVarint(header + headerSize, result.error.size());
+    ConstBuffer parts[] = {ConstBuffer(header, headerSize), ConstBuffer(result.error), ConstBuffer(result.payload)};
+    if (!send_(peerId, parts, 3)) {
+        std::cerr << "[P2P] Failed to send RPC response to " << peerId << std::endl;
+    }
+}
+
+void RpcEngine::handleResponse(uint64_t id, const uint8_t* p, const uint8_t* end) {
+    // 状态字节超出 RpcStatus 的范围 (新版本对端或损坏的帧) 同样视为格式错误
+    if (p == end || *p > static_cast<uint8_t>(RpcStatus::Unavailable)) {
+        throw std::invalid_argument("Malformed RPC response");
+    }
+    RpcResult result;
+    result.status = static_cast<RpcStatus>(*p++);
+    if (!readBytes(p, end, result.error)) {
+        throw std::invalid_argument("Malformed RPC response");
+    }
+    result.payload = Buffer::copyOf(p, static_cast<size_t>(end - p));
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    Pending pending;
+    if (!takePending(id, pending)) {
+        return;  // 已超时或取消
+    }
+    lock.unlock();
+    complete(pending, std::move(result));
+}
+
+void RpcEngine::failPeer(const std::string& peerId) {
+    std::vector<Pending> failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<uint64_t> ids;
+        for (const auto& [id, pending] : pending_) {
+            if (pending.peerId == peerId) {
+                ids.push_back(id);
+            }
+        }
+        for (uint64_t id : ids) {
+            takePending(id, failed.emplace_back());
+        }
+    }
+    for (auto& pending : failed) {
+        complete(pending, RpcResult::failure("Connection to " + peerId + " lost", RpcStatus::Unavailable));
+    }
+}
+
+void RpcEngine::cancelAll() {
+    std::vector<Pending> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& [id, pending] : pending_) {
+            cancelled.push_back(std::move(pending));
+        }
+        pending_.clear();
+        deadlines_.clear();
+    }
+    for (auto& pending : cancelled) {
+        complete(pending, RpcResult::failure("Cancelled", RpcStatus::Cancelled));
+    }
+}
+
+std::vector<RpcMethodStats> RpcEngine::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<RpcMethodStats> result;
+    result.reserve(stats_.size());
+    for (const auto& [method, stats] : stats_) {
+        result.push_back(stats);
+        result.back().method = method;
+    }
+    return result;
+}
+
+bool RpcEngine::takePending(uint64_t id, Pending& out) {
+    auto it = pending_.find(id);
+    if (it == pending_.end()) {
+        return false;
+    }
+    deadlines_.erase({it->second.deadline, id});
+    out = std::move(it->second);
+    pending_.erase(it);
+    return true;
+}
+
+void RpcEngine::complete(Pending& pending, RpcResult result) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& stats = stats_[pending.method];
+        switch (result.status) {
+            case RpcStatus::Ok: {
+                ++stats.succeeded;
+                auto micros = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - pending.start);
+                ++stats.histogram[latencyBucket(static_cast<uint64_t>(micros.count()))];
+                break;
+            }
+            case RpcStatus::Timeout: ++stats.timeouts; break;
+            case RpcStatus::Cancelled: ++stats.cancelled; break;
+            default: ++stats.failed; break;
+        }
+    }
+    pending.promise.set_value(std::move(result));
+}
+
+void RpcEngine::startTimer() {
+    if (!timerThread_.joinable()) {
+        timerThread_ = std::thread([this] {
+            if (threadInit_) {
+                threadInit_();
+            }
+            timerLoop();
+        });
+    }
+}
+
+void RpcEngine::timerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (deadlines_.empty()) {
+            timerCv_.wait(lock);
+            continue;
+        }
+
+        auto next = deadlines_.begin()->first;
+        if (Clock::now() < next) {
+            timerCv_.wait_until(lock, next);
+            continue;
+        }
+
+        std::vector<Pending> expired;
+        auto now = Clock::now();
+        while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+            takePending(deadlines_.begin()->second, expired.emplace_back());
+        }
+
+        lock.unlock();
+        for (auto& pending : expired) {
+            complete(pending, RpcResult::failure("Deadline exceeded", RpcStatus::Timeout));
+        }
+        lock.lock();
+    }
+}
+
+} // namespace p2p
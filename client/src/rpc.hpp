@@ -0,0 +1,104 @@
+// client/src/rpc.hpp
+#pragma once
+
+#include "p2p/types.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace p2p {
+
+/**
+ * 请求/响应 RPC
+ *
+ * 帧体 (FrameKind::Rpc)：
+ *   请求 [0][id varint][方法名长度 varint][方法名][请求数据]
+ *   响应 [1][id varint][状态 u8][错误信息长度 varint][错误信息][响应数据]
+ *
+ * id 由调用方分配，同一 Peer 可以有任意多个在途请求，响应按 id 匹配，不要求按序返回。
+ * 截止时间只在调用方检查：计时线程在最早的截止时间醒来，超时或取消的调用立即完成，之后到达的响应直接丢弃。
+ */
+class RpcEngine {
+public:
+    // 发送一帧，parts 依次拼接为帧体；与该 Peer 没有可用通道时返回 false
+    using SendFrame = std::function<bool(const std::string& peerId, const ConstBuffer* parts, size_t count)>;
+
+    explicit RpcEngine(SendFrame send);
+    ~RpcEngine();
+
+    RpcEngine(const RpcEngine&) = delete;
+    RpcEngine& operator=(const RpcEngine&) = delete;
+
+    RpcCall call(const std::string& peerId, const std::string& method, ConstBuffer request,
+                 std::chrono::milliseconds timeout);
+
+    // 调用尚未完成时以 Cancelled 完成，返回 false 表示调用已经完成
+    bool cancel(uint64_t id);
+
+    // handler 为空时注销
+    void setHandler(const std::string& method, RpcHandler handler);
+
+    // 处理收到的 RPC 帧 (请求在当前线程上同步执行处理函数并回复)
+    void handleFrame(const std::string& peerId, const uint8_t* data, size_t size);
+
+    // 与 Peer 的连接已断开：发往该 Peer 的在途调用以 Unavailable 完成
+    void failPeer(const std::string& peerId);
+
+    // 以 Cancelled 完成所有在途调用
+    void cancelAll();
+
+    std::vector<RpcMethodStats> stats() const;
+
+    // 计时线程启动时调用 (设置线程名与 CPU 绑定)，需在第一次 call 之前设置
+    void setThreadInit(std::function<void()> init) { threadInit_ = std::move(init); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending {
+        std::string peerId;
+        std::string method;
+        std::promise<RpcResult> promise;
+        Clock::time_point start;
+        Clock::time_point deadline;
+    };
+
+    void handleRequest(const std::string& peerId, uint64_t id, const uint8_t* p, const uint8_t* end);
+    void handleResponse(uint64_t id, const uint8_t* p, const uint8_t* end);
+
+    // 从在途表中取出调用 (调用方持有 mutex_)，不存在时返回 false
+    bool takePending(uint64_t id, Pending& out);
+
+    // 记录统计并完成调用 (不持锁)
+    void complete(Pending& pending, RpcResult result);
+
+    void startTimer();
+    void timerLoop();
+
+    SendFrame send_;
+    std::function<void()> threadInit_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable timerCv_;
+    std::thread timerThread_;
+    bool stopping_ = false;
+
+    uint64_t nextId_ = 0;
+    std::unordered_map<uint64_t, Pending> pending_;
+    std::set<std::pair<Clock::time_point, uint64_t>> deadlines_;
+    std::unordered_map<std::string, RpcHandler> handlers_;
+    std::unordered_map<std::string, RpcMethodStats> stats_;
+};
+
+} // namespace p2p
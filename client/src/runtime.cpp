@@ -0,0 +1,85 @@
+#include "p2p/runtime.hpp"
+#include "p2p/p2p_client.hpp"
+#include "runtime.hpp"
+#include "thread_affinity.hpp"
+
+#include <rtc/rtc.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+namespace p2p {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::mutex gMutex;
+bool gLoaded = false;          // 已调用 rtc::Preload 且尚未 rtc::Cleanup
+std::vector<int> gNetworkCpus;
+RuntimeStats gStats;
+
+uint64_t microsSince(Clock::time_point start) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+}
+
+// 调用方持有 gMutex
+void preloadLocked(const std::vector<int>& networkCpus) {
+    if (gLoaded) {
+        if (!networkCpus.empty() && networkCpus != gNetworkCpus) {
+            std::cerr << "[P2P] Network threads already initialized on CPUs "
+                      << (gNetworkCpus.empty() ? std::string("(any)") : formatCpuList(gNetworkCpus))
+                      << ", ignoring " << formatCpuList(networkCpus) << std::endl;
+        }
+        return;
+    }
+
+    auto start = Clock::now();
+    {
+        ScopedThreadAffinity affinity(networkCpus);
+        if (!networkCpus.empty() && !affinity.applied()) {
+            std::cerr << "[P2P] Cannot pin network threads to CPUs " << formatCpuList(networkCpus) << std::endl;
+        }
+        rtc::Preload();
+    }
+    gLoaded = true;
+    gNetworkCpus = networkCpus;
+    gStats.initialized = true;
+    gStats.initMicros = microsSince(start);
+}
+
+} // namespace
+
+void ensureRuntime(const std::vector<int>& networkCpus) {
+    std::lock_guard<std::mutex> lock(gMutex);
+    if (networkCpus.empty() && !gLoaded) {
+        return;
+    }
+    preloadLocked(networkCpus);
+}
+
+void initialize(const InitOptions& options) {
+    if (options.logLevel >= 0) {
+        P2PClient::setLogLevel(options.logLevel);
+    }
+    std::lock_guard<std::mutex> lock(gMutex);
+    preloadLocked(options.networkCpus);
+}
+
+std::shared_future<void> shutdown() {
+    std::lock_guard<std::mutex> lock(gMutex);
+    gLoaded = false;
+    gNetworkCpus.clear();
+    gStats.initialized = false;
+    return rtc::Cleanup();
+}
+
+RuntimeStats getRuntimeStats() {
+    std::lock_guard<std::mutex> lock(gMutex);
+    return gStats;
+}
+
+} // namespace p2p
@@ -0,0 +1,17 @@
+// client/src/runtime.hpp
+#pragma once
+
+#include <vector>
+
+namespace p2p {
+
+/**
+ * 确保 libdatachannel 已初始化 (客户端与网关在 connect() 时调用，构造时不调用)
+ *
+ * networkCpus 为空且尚未初始化时什么都不做，由 libdatachannel 在创建第一个对象时按需初始化；
+ * 非空时临时绑定当前线程后预加载，libdatachannel 创建的线程继承该绑定。
+ * 只有第一次预加载时的绑定生效，之后以不同的 CPU 调用时输出警告。
+ */
+void ensureRuntime(const std::vector<int>& networkCpus);
+
+} // namespace p2p
@@ -0,0 +1,534 @@
+#include "state_sync.hpp"
+#include "frames.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace p2p {
+
+namespace {
+
+constexpr uint8_t kSnapshot = 0;
+constexpr uint8_t kDelta = 1;
+constexpr uint8_t kAck = 2;
+constexpr uint8_t kNack = 3;
+
+constexpr uint8_t kFirst = 0x01;
+constexpr uint8_t kLast = 0x02;
+
+void appendVarint(std::vector<uint8_t>& out, uint64_t value) {
+    uint8_t bytes[kMaxVarintSize];
+    out.insert(out.end(), bytes, bytes + writeVarint(bytes, value));
+}
+
+bool sameBytes(const Buffer& buffer, const void* data, size_t size) {
+    return buffer.size() == size && (size == 0 || std::memcmp(buffer.data(), data, size) == 0);
+}
+
+// 把一批条目编码成帧，超过 kMaxFrameSize 时另起一帧；每帧重复同样的头部
+class BatchWriter {
+public:
+    BatchWriter(uint8_t type, uint64_t from, uint64_t to) {
+        header_.push_back(type);
+        header_.push_back(0);  // flags
+        if (type == kDelta) {
+            appendVarint(header_, from);
+        }
+        appendVarint(header_, to);
+        frames_.push_back(header_);
+    }
+
+    void add(const std::string& key, bool deleted, const uint8_t* value, size_t size) {
+        auto* frame = &frames_.back();
+        if (frame->size() > header_.size() &&
+            frame->size() + key.size() + size + 1 + 2 * kMaxVarintSize > StateSync::kMaxFrameSize) {
+            frame = &frames_.emplace_back(header_);
+        }
+        frame->push_back(deleted ? 1 : 0);
+        appendVarint(*frame, key.size());
+        frame->insert(frame->end(), key.begin(), key.end());
+        if (!deleted) {
+            appendVarint(*frame, size);
+            frame->insert(frame->end(), value, value + size);
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> finish() {
+        frames_.front()[1] |= kFirst;
+        frames_.back()[1] |= kLast;
+        return std::move(frames_);
+    }
+
+private:
+    std::vector<uint8_t> header_;
+    std::vector<std::vector<uint8_t>> frames_;
+};
+
+} // namespace
+
+StateSync::StateSync(SendFrame send, std::chrono::milliseconds interval)
+    : send_(std::move(send)), interval_(interval) {}
+
+StateSync::~StateSync() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    flushCv_.notify_all();
+    if (flushThread_.joinable()) {
+        flushThread_.join();
+    }
+}
+
+void StateSync::set(const std::string& key, ConstBuffer value) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end() && !it->second.deleted && sameBytes(it->second.value, value.data, value.size)) {
+            return;  // 值没有变化，不产生新版本
+        }
+        record(key, Buffer::copyOf(value.data, value.size), false);
+        if (interval_.count() > 0) {
+            startFlusher();
+        }
+    }
+    if (interval_.count() > 0) {
+        flushCv_.notify_all();
+    } else {
+        flush();
+    }
+}
+
+void StateSync::erase(const std::string& key) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end() || it->second.deleted) {
+            return;
+        }
+        record(key, Buffer(), true);
+        if (interval_.count() > 0) {
+            startFlusher();
+        }
+    }
+    if (interval_.count() > 0) {
+        flushCv_.notify_all();
+    } else {
+        flush();
+    }
+}
+
+std::optional<Buffer> StateSync::get(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end() || it->second.deleted) {
+        return std::nullopt;
+    }
+    return it->second.value;
+}
+
+std::optional<Buffer> StateSync::peerValue(const std::string& peerId, const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto replica = replicas_.find(peerId);
+    if (replica == replicas_.end()) {
+        return std::nullopt;
+    }
+    auto it = replica->second.values.find(key);
+    if (it == replica->second.values.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::map<std::string, Buffer> StateSync::peerState(const std::string& peerId) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto replica = replicas_.find(peerId);
+    if (replica == replicas_.end()) {
+        return {};
+    }
+    return std::map<std::string, Buffer>(replica->second.values.begin(), replica->second.values.end());
+}
+
+void StateSync::setOnUpdate(OnStateUpdateCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    onUpdate_ = std::move(callback);
+}
+
+void StateSync::addPeer(const std::string& peerId) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        peers_[peerId] = PeerProgress();
+        dirty_ = true;
+        if (interval_.count() > 0) {
+            startFlusher();
+        }
+    }
+    if (interval_.count() > 0) {
+        flushCv_.notify_all();
+    } else {
+        flush();
+    }
+}
+
+void StateSync::removePeer(const std::string& peerId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    peers_.erase(peerId);
+    replicas_.erase(peerId);
+    collectTombstones();
+}
+
+void StateSync::clearPeers() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    peers_.clear();
+    replicas_.clear();
+    collectTombstones();
+}
+
+void StateSync::handleFrame(const std::string& peerId, const uint8_t* data, size_t size) {
+    if (size == 0) {
+        throw std::invalid_argument("Empty state sync frame");
+    }
+    const uint8_t* p = data + 1;
+    const uint8_t* end = data + size;
+
+    switch (data[0]) {
+        case kSnapshot:
+        case kDelta:
+            handleBatch(peerId, data[0] == kSnapshot, p, end);
+            break;
+        case kAck:
+        case kNack: {
+            uint64_t version = 0;
+            if (!readVarint(p, end, version)) {
+                throw std::invalid_argument("Malformed state sync ack");
+            }
+            if (data[0] == kAck) {
+                handleAck(peerId, version);
+            } else {
+                handleNack(peerId, version);
+            }
+            break;
+        }
+        default:
+            throw std::invalid_argument("Unknown state sync frame type");
+    }
+}
+
+StateSyncStats StateSync::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StateSyncStats stats = stats_;
+    stats.version = version_;
+    stats.keys = entries_.size() - tombstones_.size();
+    stats.peers = peers_.size();
+    return stats;
+}
+
+void StateSync::record(const std::string& key, Buffer value, bool deleted) {
+    auto& entry = entries_[key];
+    if (entry.version != 0) {
+        byVersion_.erase(entry.version);
+        if (entry.deleted) {
+            tombstones_.erase(entry.version);
+        }
+    }
+    entry.value = std::move(value);
+    entry.deleted = deleted;
+    entry.version = ++version_;
+    byVersion_.emplace(entry.version, key);
+    if (deleted) {
+        tombstones_.emplace(entry.version, key);
+        collectTombstones();
+    }
+    dirty_ = true;
+}
+
+StateSync::Frames StateSync::encodeSnapshot() const {
+    BatchWriter writer(kSnapshot, 0, version_);
+    for (const auto& [version, key] : byVersion_) {
+        const auto& entry = entries_.at(key);
+        if (!entry.deleted) {
+            writer.add(key, false, entry.value.data(), entry.value.size());
+        }
+    }
+    return writer.finish();
+}
+
+StateSync::Frames StateSync::encodeDelta(uint64_t from) const {
+    BatchWriter writer(kDelta, from, version_);
+    for (auto it = byVersion_.upper_bound(from); it != byVersion_.end(); ++it) {
+        const auto& entry = entries_.at(it->second);
+        writer.add(it->second, entry.deleted, entry.value.data(), entry.value.size());
+    }
+    return writer.finish();
+}
+
+void StateSync::flush() {
+    std::lock_guard<std::mutex> flushLock(flushMutex_);
+
+    std::vector<std::pair<std::string, std::shared_ptr<const Frames>>> batches;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dirty_ = false;
+
+        // 同一版本出发的批次对所有 Peer 相同，只编码一次
+        std::shared_ptr<const Frames> snapshot;
+        std::map<uint64_t, std::shared_ptr<const Frames>> deltas;
+        for (auto& [peerId, peer] : peers_) {
+            std::shared_ptr<const Frames> frames;
+            if (peer.needSnapshot || peer.sent < tombstoneFloor_) {
+                if (!snapshot) {
+                    snapshot = std::make_shared<const Frames>(encodeSnapshot());
+                }
+                frames = snapshot;
+                peer.needSnapshot = false;
+                ++stats_.snapshotsSent;
+                stats_.entriesSent += entries_.size() - tombstones_.size();
+            } else if (peer.sent < version_) {
+                auto& delta = deltas[peer.sent];
+                if (!delta) {
+                    delta = std::make_shared<const Frames>(encodeDelta(peer.sent));
+                }
+                frames = delta;
+                ++stats_.deltasSent;
+                stats_.entriesSent += static_cast<uint64_t>(
+                    std::distance(byVersion_.upper_bound(peer.sent), byVersion_.end()));
+            } else {
+                continue;
+            }
+            peer.sent = version_;
+            for (const auto& frame : *frames) {
+                stats_.bytesSent += frame.size();
+            }
+            batches.emplace_back(peerId, std::move(frames));
+        }
+    }
+
+    for (const auto& [peerId, frames] : batches) {
+        for (const auto& frame : *frames) {
+            ConstBuffer part(frame.data(), frame.size());
+            if (!send_(peerId, &part, 1)) {
+                // 这一批没有完整发出：下一个周期改发快照
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = peers_.find(peerId);
+                if (it != peers_.end()) {
+                    it->second.needSnapshot = true;
+                }
+                break;
+            }
+        }
+    }
+}
+
+void StateSync::startFlusher() {
+    if (!flushThread_.joinable()) {
+        flushThread_ = std::thread([this] {
+            if (threadInit_) {
+                threadInit_();
+            }
+            flushLoop();
+        });
+    }
+}
+
+void StateSync::flushLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (!dirty_) {
+            flushCv_.wait(lock);
+            continue;
+        }
+
+        // 第一个修改开始计时，一个周期内的修改合并成一批
+        flushCv_.wait_for(lock, interval_, [this] { return stopping_; });
+        if (stopping_) {
+            break;
+        }
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+void StateSync::handleBatch(const std::string& peerId, bool snapshot, const uint8_t* p, const uint8_t* end) {
+    if (p == end) {
+        throw std::invalid_argument("Malformed state sync batch");
+    }
+    uint8_t flags = *p++;
+    uint64_t from = 0;
+    uint64_t version = 0;
+    if ((!snapshot && !readVarint(p, end, from)) || !readVarint(p, end, version)) {
+        throw std::invalid_argument("Malformed state sync batch");
+    }
+
+    struct Decoded {
+        std::string key;
+        bool deleted;
+        const uint8_t* value;
+        size_t size;
+    };
+    std::vector<Decoded> decoded;
+    while (p < end) {
+        Decoded entry{};
+        entry.deleted = *p++ != 0;
+        uint64_t keySize = 0;
+        if (!readVarint(p, end, keySize) || keySize > static_cast<uint64_t>(end - p)) {
+            throw std::invalid_argument("Malformed state sync entry");
+        }
+        entry.key.assign(reinterpret_cast<const char*>(p), static_cast<size_t>(keySize));
+        p += keySize;
+        if (!entry.deleted) {
+            uint64_t valueSize = 0;
+            if (!readVarint(p, end, valueSize) || valueSize > static_cast<uint64_t>(end - p)) {
+                throw std::invalid_argument("Malformed state sync entry");
+            }
+            entry.value = p;
+            entry.size = static_cast<size_t>(valueSize);
+            p += valueSize;
+        }
+        decoded.push_back(std::move(entry));
+    }
+
+    std::vector<Update> updates;
+    bool ack = false;
+    bool nack = false;
+    uint64_t replicaVersion = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& replica = replicas_[peerId];
+
+        if (snapshot) {
+            if (flags & kFirst) {
+                replica.staging.clear();
+                replica.receivingSnapshot = true;
+            }
+            if (!replica.receivingSnapshot) {
+                return;  // 丢失了第一帧的快照，等待重发
+            }
+            for (auto& entry : decoded) {
+                if (!entry.deleted) {
+                    replica.staging[entry.key] = Buffer::copyOf(entry.value, entry.size);
+                }
+            }
+            if (flags & kLast) {
+                for (const auto& [key, value] : replica.values) {
+                    if (replica.staging.count(key) == 0) {
+                        updates.push_back({key, std::nullopt});
+                    }
+                }
+                for (const auto& [key, value] : replica.staging) {
+                    auto old = replica.values.find(key);
+                    if (old == replica.values.end() || !sameBytes(old->second, value.data(), value.size())) {
+                        updates.push_back({key, value});
+                    }
+                }
+                replica.values = std::move(replica.staging);
+                replica.staging.clear();
+                replica.receivingSnapshot = false;
+                replica.version = version;
+                ack = true;
+            }
+        } else {
+            if (from > replica.version || replica.receivingSnapshot) {
+                // 中间缺了一批 (例如重新连接后)，整批丢弃，请对方从副本版本重发
+                nack = (flags & kLast) != 0;
+            } else {
+                for (auto& entry : decoded) {
+                    if (entry.deleted) {
+                        if (replica.values.erase(entry.key) > 0) {
+                            updates.push_back({std::move(entry.key), std::nullopt});
+                        }
+                    } else {
+                        Buffer value = Buffer::copyOf(entry.value, entry.size);
+                        replica.values[entry.key] = value;
+                        updates.push_back({std::move(entry.key), std::move(value)});
+                    }
+                }
+                if (flags & kLast) {
+                    replica.version = std::max(replica.version, version);
+                    ack = true;
+                }
+            }
+        }
+        stats_.updatesReceived += updates.size();
+        replicaVersion = replica.version;
+    }
+
+    if (ack || nack) {
+        sendControl(peerId, ack ? kAck : kNack, replicaVersion);
+    }
+    notify(peerId, updates);
+}
+
+void StateSync::handleAck(const std::string& peerId, uint64_t version) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = peers_.find(peerId);
+    if (it == peers_.end()) {
+        return;
+    }
+    it->second.acked = std::max(it->second.acked, std::min(version, it->second.sent));
+    collectTombstones();
+}
+
+void StateSync::handleNack(const std::string& peerId, uint64_t version) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = peers_.find(peerId);
+        if (it == peers_.end()) {
+            return;
+        }
+        ++stats_.resyncs;
+        it->second.sent = std::min(it->second.sent, version);
+        it->second.acked = std::min(it->second.acked, version);
+        dirty_ = true;
+        if (interval_.count() > 0) {
+            startFlusher();
+        }
+    }
+    if (interval_.count() > 0) {
+        flushCv_.notify_all();
+    } else {
+        flush();
+    }
+}
+
+void StateSync::collectTombstones() {
+    uint64_t minAcked = version_;
+    for (const auto& [peerId, peer] : peers_) {
+        minAcked = std::min(minAcked, peer.acked);
+    }
+    while (!tombstones_.empty() && tombstones_.begin()->first <= minAcked) {
+        auto [version, key] = *tombstones_.begin();
+        tombstones_.erase(tombstones_.begin());
+        byVersion_.erase(version);
+        entries_.erase(key);
+        tombstoneFloor_ = std::max(tombstoneFloor_, version);
+    }
+}
+
+bool StateSync::sendControl(const std::string& peerId, uint8_t type, uint64_t version) {
+    uint8_t frame[1 + kMaxVarintSize];
+    frame[0] = type;
+    size_t size = 1 + writeVarint(frame + 1, version);
+    ConstBuffer part(frame, size);
+    return send_(peerId, &part, 1);
+}
+
+void StateSync::notify(const std::string& peerId, std::vector<Update>& updates) {
+    if (updates.empty()) {
+        return;
+    }
+    OnStateUpdateCallback onUpdate;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        onUpdate = onUpdate_;
+    }
+    if (!onUpdate) {
+        return;
+    }
+    for (const auto& update : updates) {
+        onUpdate(peerId, update.key, update.value);
+    }
+}
+
+} // namespace p2p
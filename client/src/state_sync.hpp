@@ -0,0 +1,149 @@
+// client/src/state_sync.hpp
+#pragma once
+
+#include "p2p/types.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace p2p {
+
+/**
+ * 键值状态同步
+ *
+ * 每个客户端维护一份本端的键值表，复制给所有支持子协议帧的 Peer；同时保存每个 Peer 的副本。
+ * 本端每次修改分配递增版本号，按版本号建立索引；对每个 Peer 记录已发出和已确认的版本，
+ * 每个周期 (stateSyncInterval) 只把「已发出版本之后修改过的键」的最新值合并成一批发出，
+ * 同一个键在一个周期内改多次只发最后一次。新连接的 Peer 先收到全量快照。
+ * 删除以墓碑记录，所有 Peer 都确认过后回收；确认版本早于已回收墓碑的 Peer 改发快照。
+ *
+ * 帧体 (FrameKind::StateSync)：
+ *   快照 [0][flags][版本 varint]{条目}
+ *   增量 [1][flags][起始版本 varint][版本 varint]{条目}
+ *   确认 [2][版本 varint]
+ *   缺失 [3][版本 varint]     接收方副本版本早于增量的起始版本，请从该版本重发
+ *   条目 [删除 u8][键长度 varint][键][值长度 varint][值]   删除的条目没有值
+ *   flags bit0 为一批的第一帧，bit1 为最后一帧；较大的一批拆成多帧，最后一帧到达后才更新副本版本并确认
+ */
+class StateSync {
+public:
+    static constexpr size_t kMaxFrameSize = 60 * 1024;
+
+    using SendFrame = std::function<bool(const std::string& peerId, const ConstBuffer* parts, size_t count)>;
+
+    StateSync(SendFrame send, std::chrono::milliseconds interval);
+    ~StateSync();
+
+    StateSync(const StateSync&) = delete;
+    StateSync& operator=(const StateSync&) = delete;
+
+    void set(const std::string& key, ConstBuffer value);
+    void erase(const std::string& key);
+    std::optional<Buffer> get(const std::string& key) const;
+
+    std::optional<Buffer> peerValue(const std::string& peerId, const std::string& key) const;
+    std::map<std::string, Buffer> peerState(const std::string& peerId) const;
+
+    void setOnUpdate(OnStateUpdateCallback callback);
+
+    // 与 Peer 的子协议通道已建立：下一个周期发送快照
+    void addPeer(const std::string& peerId);
+
+    // 与 Peer 已没有子协议通道：丢弃发送进度和它的副本
+    void removePeer(const std::string& peerId);
+    void clearPeers();
+
+    void handleFrame(const std::string& peerId, const uint8_t* data, size_t size);
+
+    StateSyncStats stats() const;
+
+    // 发送线程启动时调用 (设置线程名与 CPU 绑定)，需在第一次 set 之前设置
+    void setThreadInit(std::function<void()> init) { threadInit_ = std::move(init); }
+
+private:
+    struct Entry {
+        Buffer value;
+        uint64_t version = 0;
+        bool deleted = false;
+    };
+
+    struct PeerProgress {
+        uint64_t sent = 0;    // 已发出到的版本
+        uint64_t acked = 0;   // 对方确认的版本
+        bool needSnapshot = true;
+    };
+
+    struct Replica {
+        std::unordered_map<std::string, Buffer> values;
+        uint64_t version = 0;
+        std::unordered_map<std::string, Buffer> staging;  // 接收中的快照
+        bool receivingSnapshot = false;
+    };
+
+    struct Update {
+        std::string key;
+        std::optional<Buffer> value;
+    };
+
+    // 收到的一批在副本上产生的变更，在锁外交给回调
+    void notify(const std::string& peerId, std::vector<Update>& updates);
+
+    // 修改本端条目 (调用方持有 mutex_)
+    void record(const std::string& key, Buffer value, bool deleted);
+
+    using Frames = std::vector<std::vector<uint8_t>>;
+
+    // 编码快照 / 某个版本之后的增量 (调用方持有 mutex_)
+    Frames encodeSnapshot() const;
+    Frames encodeDelta(uint64_t from) const;
+
+    // 发送所有 Peer 的待发送修改
+    void flush();
+    void flushLoop();
+    void startFlusher();
+
+    void handleBatch(const std::string& peerId, bool snapshot, const uint8_t* p, const uint8_t* end);
+    void handleAck(const std::string& peerId, uint64_t version);
+    void handleNack(const std::string& peerId, uint64_t version);
+
+    // 回收所有 Peer 都已确认的墓碑 (调用方持有 mutex_)
+    void collectTombstones();
+
+    bool sendControl(const std::string& peerId, uint8_t type, uint64_t version);
+
+    SendFrame send_;
+    std::function<void()> threadInit_;
+    std::chrono::milliseconds interval_;
+
+    std::mutex flushMutex_;  // 各批按版本顺序发出，避免后一批先于前一批到达
+    mutable std::mutex mutex_;
+    std::condition_variable flushCv_;
+    std::thread flushThread_;
+    bool stopping_ = false;
+    bool dirty_ = false;   // 有待发送的修改或待发快照的 Peer
+
+    uint64_t version_ = 0;
+    std::unordered_map<std::string, Entry> entries_;
+    std::map<uint64_t, std::string> byVersion_;    // 版本 -> 键 (每个键只出现一次)
+    std::map<uint64_t, std::string> tombstones_;   // 未回收的删除
+    uint64_t tombstoneFloor_ = 0;                  // 已回收墓碑的最大版本
+
+    std::unordered_map<std::string, PeerProgress> peers_;
+    std::unordered_map<std::string, Replica> replicas_;
+
+    OnStateUpdateCallback onUpdate_;
+    StateSyncStats stats_;
+};
+
+} // namespace p2p
@@ -0,0 +1,458 @@
+#include "stream_mux.hpp"
+#include "frames.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace p2p {
+
+namespace {
+
+constexpr uint8_t kOpen = 0;
+constexpr uint8_t kData = 1;
+constexpr uint8_t kCredit = 2;
+constexpr uint8_t kClose = 3;
+
+// 收到的流 id 是发送方视角，翻转最低位即为本端视角
+uint64_t localStreamId(uint64_t wireId) {
+    return wireId ^ 1;
+}
+
+} // namespace
+
+// ==================== Stream ====================
+
+uint64_t Stream::id() const {
+    return state_ ? state_->id : 0;
+}
+
+std::string Stream::peerId() const {
+    return state_ ? state_->peerId : std::string();
+}
+
+bool Stream::isOpen() const {
+    auto mux = state_ ? state_->mux.lock() : nullptr;
+    return mux && mux->isOpen(*state_);
+}
+
+bool Stream::write(ConstBuffer data) {
+    auto mux = state_ ? state_->mux.lock() : nullptr;
+    return mux && mux->write(state_, data);
+}
+
+void Stream::close() {
+    if (auto mux = state_ ? state_->mux.lock() : nullptr) {
+        mux->close(state_);
+    }
+}
+
+size_t Stream::bufferedAmount() const {
+    auto mux = state_ ? state_->mux.lock() : nullptr;
+    return mux ? mux->bufferedAmount(*state_) : 0;
+}
+
+void Stream::setOnData(OnDataCallback callback) {
+    if (auto mux = state_ ? state_->mux.lock() : nullptr) {
+        mux->setOnData(*state_, std::move(callback));
+    }
+}
+
+void Stream::setOnClose(OnCloseCallback callback) {
+    if (auto mux = state_ ? state_->mux.lock() : nullptr) {
+        mux->setOnClose(*state_, std::move(callback));
+    }
+}
+
+// ==================== StreamMux ====================
+
+StreamMux::StreamMux(SendFrame send, CanSend canSend, size_t window, size_t sendBufferLimit)
+    : send_(std::move(send))
+    , canSend_(std::move(canSend))
+    , window_(std::max<uint64_t>(window, kInitialWindow))
+    , sendBufferLimit_(sendBufferLimit) {}
+
+Stream StreamMux::open(const std::string& peerId) {
+    auto stream = std::make_shared<detail::StreamState>();
+    stream->mux = weak_from_this();
+    stream->peerId = peerId;
+    stream->sendLimit = kInitialWindow;
+    stream->granted = window_;  // 随打开帧通告
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& peer = peers_[peerId];
+    stream->id = peer.nextId;
+    peer.nextId += 2;
+    peer.streams.emplace(stream->id, stream);
+    return Stream(stream);
+}
+
+void StreamMux::setOnStream(OnStreamCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    onStream_ = std::move(callback);
+}
+
+bool StreamMux::write(const StreamPtr& stream, ConstBuffer data) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stream->closed || stream->closing) {
+            return false;
+        }
+        if (data.size == 0) {
+            return true;
+        }
+        // 队列为空时总能放入一次写入，避免大块数据永远写不进去
+        if (stream->queuedBytes > 0 && stream->queuedBytes + data.size > sendBufferLimit_) {
+            return false;
+        }
+        stream->queue.push_back(Buffer::copyOf(data.data, data.size));
+        stream->queuedBytes += data.size;
+
+        auto peerIt = peers_.find(stream->peerId);
+        if (peerIt != peers_.end()) {
+            markReady(peerIt->second, stream);
+        }
+    }
+    pump(stream->peerId);
+    return true;
+}
+
+void StreamMux::close(const StreamPtr& stream) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stream->closed || stream->closing) {
+            return;
+        }
+        stream->closing = true;
+
+        auto peerIt = peers_.find(stream->peerId);
+        if (peerIt == peers_.end()) {
+            return;
+        }
+        if (!stream->openSent) {
+            // 对方还不知道这个流
+            detach(peerIt->second, *stream);
+            return;
+        }
+        markReady(peerIt->second, stream);
+    }
+    pump(stream->peerId);
+}
+
+bool StreamMux::isOpen(const detail::StreamState& stream) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !stream.closed && !stream.closing;
+}
+
+size_t StreamMux::bufferedAmount(const detail::StreamState& stream) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stream.queuedBytes;
+}
+
+void StreamMux::setOnData(detail::StreamState& stream, Stream::OnDataCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stream.onData = std::move(callback);
+}
+
+void StreamMux::setOnClose(detail::StreamState& stream, Stream::OnCloseCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stream.onClose = std::move(callback);
+}
+
+bool StreamMux::wantsSend(const detail::StreamState& stream) {
+    if (stream.closed) {
+        return false;
+    }
+    if (stream.queuedBytes > 0) {
+        return !stream.openSent || stream.sent < stream.sendLimit;
+    }
+    return stream.closing;
+}
+
+void StreamMux::markReady(PeerStreams& peer, const StreamPtr& stream) {
+    if (!stream->ready && wantsSend(*stream)) {
+        stream->ready = true;
+        peer.ready.push_back(stream);
+    }
+}
+
+void StreamMux::detach(PeerStreams& peer, detail::StreamState& stream) {
+    stream.closed = true;
+    stream.queue.clear();
+    stream.headOffset = 0;
+    stream.queuedBytes = 0;
+    stream.onData = nullptr;   // 回调可能持有 Stream 句柄，清除以打破引用环
+    stream.onClose = nullptr;
+    peer.streams.erase(stream.id);
+}
+
+void StreamMux::pump(const std::string& peerId) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto peerIt = peers_.find(peerId);
+    if (peerIt == peers_.end() || peerIt->second.pumping) {
+        return;  // 正在发送的线程会处理新加入的数据
+    }
+    peerIt->second.pumping = true;
+
+    bool failed = false;
+    while (true) {
+        peerIt = peers_.find(peerId);
+        if (peerIt == peers_.end()) {
+            return;  // 发送期间连接已断开
+        }
+        if (failed || peerIt->second.ready.empty()) {
+            peerIt->second.pumping = false;
+            break;
+        }
+
+        lock.unlock();
+        bool writable = canSend_(peerId, kChunkSize + 1 + 2 * kMaxVarintSize);
+        lock.lock();
+        peerIt = peers_.find(peerId);
+        if (peerIt == peers_.end()) {
+            return;
+        }
+        auto& peer = peerIt->second;
+        if (!writable) {
+            peer.pumping = false;
+            return;  // 等待 resume()
+        }
+        if (peer.ready.empty()) {
+            continue;
+        }
+
+        StreamPtr stream = std::move(peer.ready.front());
+        peer.ready.pop_front();
+        stream->ready = false;
+        if (!wantsSend(*stream)) {
+            continue;
+        }
+
+        uint8_t header[1 + 2 * kMaxVarintSize];
+        size_t headerSize = 0;
+        Buffer chunk;
+        size_t chunkOffset = 0;
+        size_t chunkSize = 0;
+
+        if (!stream->openSent) {
+            header[headerSize++] = kOpen;
+            headerSize += writeVarint(header + headerSize, stream->id);
+            headerSize += writeVarint(header + headerSize, stream->granted);
+            stream->openSent = true;
+        } else if (stream->queuedBytes > 0) {
+            chunk = stream->queue.front();
+            chunkOffset = stream->headOffset;
+            chunkSize = std::min<uint64_t>({kChunkSize, chunk.size() - chunkOffset,
+                                            stream->sendLimit - stream->sent});
+            header[headerSize++] = kData;
+            headerSize += writeVarint(header + headerSize, stream->id);
+
+            stream->sent += chunkSize;
+            stream->queuedBytes -= chunkSize;
+            stream->headOffset += chunkSize;
+            if (stream->headOffset == chunk.size()) {
+                stream->queue.pop_front();
+                stream->headOffset = 0;
+            }
+        } else {
+            header[headerSize++] = kClose;
+            headerSize += writeVarint(header + headerSize, stream->id);
+            detach(peer, *stream);
+        }
+        markReady(peer, stream);
+
+        lock.unlock();
+        ConstBuffer parts[] = {ConstBuffer(header, headerSize), ConstBuffer(chunk.data() + chunkOffset, chunkSize)};
+        failed = !send_(peerId, parts, chunkSize > 0 ? 2 : 1);
+        lock.lock();
+    }
+
+    if (failed) {
+        lock.unlock();
+        failPeer(peerId);
+    }
+}
+
+void StreamMux::handleFrame(const std::string& peerId, const uint8_t* data, size_t size) {
+    const uint8_t* p = data + 1;
+    const uint8_t* end = data + size;
+    uint64_t wireId = 0;
+    if (size < 2 || !readVarint(p, end, wireId)) {
+        throw std::invalid_argument("Malformed stream frame");
+    }
+    uint64_t id = localStreamId(wireId);
+    switch (data[0]) {
+        case kOpen: handleOpen(peerId, id, p, end); break;
+        case kData: handleData(peerId, id, p, end); break;
+        case kCredit: handleCredit(peerId, id, p, end); break;
+        case kClose: handleClose(peerId, id); break;
+        default: throw std::invalid_argument("Unknown stream frame type");
+    }
+}
+
+void StreamMux::handleOpen(const std::string& peerId, uint64_t id, const uint8_t* p, const uint8_t* end) {
+    uint64_t window = 0;
+    if ((id & 1) == 0 || !readVarint(p, end, window)) {
+        throw std::invalid_argument("Malformed stream open");
+    }
+
+    auto stream = std::make_shared<detail::StreamState>();
+    stream->mux = weak_from_this();
+    stream->peerId = peerId;
+    stream->id = id;
+    stream->openSent = true;
+    stream->sendLimit = std::max(window, kInitialWindow);
+    stream->granted = kInitialWindow;
+
+    OnStreamCallback onStream;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        onStream = onStream_;
+        if (onStream) {
+            auto& streams = peers_[peerId].streams;
+            if (!streams.emplace(id, stream).second) {
+                return;  // 重复的打开帧
+            }
+            stream->granted = window_;
+        }
+    }
+
+    if (!onStream) {
+        sendControl(peerId, kClose, id, nullptr);  // 没有人接收，拒绝
+        return;
+    }
+    if (window_ > kInitialWindow) {
+        sendControl(peerId, kCredit, id, &window_);
+    }
+    onStream(Stream(stream));
+}
+
+void StreamMux::handleData(const std::string& peerId, uint64_t id, const uint8_t* p, const uint8_t* end) {
+    StreamPtr stream;
+    Stream::OnDataCallback onData;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto peerIt = peers_.find(peerId);
+        if (peerIt == peers_.end()) {
+            return;
+        }
+        auto it = peerIt->second.streams.find(id);
+        if (it == peerIt->second.streams.end()) {
+            return;  // 本端已关闭
+        }
+        stream = it->second;
+        onData = stream->onData;
+    }
+
+    size_t size = static_cast<size_t>(end - p);
+    if (onData) {
+        onData(Buffer::copyOf(p, size));
+    }
+
+    // 回调返回后才授予新的信用：处理缓慢的流会逐渐停止收到数据
+    uint64_t credit = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stream->received += size;
+        if (stream->closed || stream->received + window_ < stream->granted + window_ / 2) {
+            return;
+        }
+        stream->granted = stream->received + window_;
+        credit = stream->granted;
+    }
+    sendControl(peerId, kCredit, id, &credit);
+}
+
+void StreamMux::handleCredit(const std::string& peerId, uint64_t id, const uint8_t* p, const uint8_t* end) {
+    uint64_t limit = 0;
+    if (!readVarint(p, end, limit)) {
+        throw std::invalid_argument("Malformed stream credit");
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto peerIt = peers_.find(peerId);
+        if (peerIt == peers_.end()) {
+            return;
+        }
+        auto it = peerIt->second.streams.find(id);
+        if (it == peerIt->second.streams.end()) {
+            return;
+        }
+        it->second->sendLimit = std::max(it->second->sendLimit, limit);
+        markReady(peerIt->second, it->second);
+    }
+    pump(peerId);
+}
+
+void StreamMux::handleClose(const std::string& peerId, uint64_t id) {
+    Stream::OnCloseCallback onClose;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto peerIt = peers_.find(peerId);
+        if (peerIt == peers_.end()) {
+            return;
+        }
+        auto it = peerIt->second.streams.find(id);
+        if (it == peerIt->second.streams.end()) {
+            return;  // 双方同时关闭
+        }
+        StreamPtr stream = it->second;
+        onClose = std::move(stream->onClose);
+        detach(peerIt->second, *stream);
+    }
+    if (onClose) {
+        onClose();
+    }
+}
+
+bool StreamMux::sendControl(const std::string& peerId, uint8_t type, uint64_t id, const uint64_t* value) {
+    uint8_t frame[1 + 2 * kMaxVarintSize];
+    size_t size = 0;
+    frame[size++] = type;
+    size += writeVarint(frame + size, id);
+    if (value) {
+        size += writeVarint(frame + size, *value);
+    }
+    ConstBuffer part(frame, size);
+    return send_(peerId, &part, 1);
+}
+
+void StreamMux::failPeer(const std::string& peerId) {
+    std::vector<Stream::OnCloseCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto peerIt = peers_.find(peerId);
+        if (peerIt == peers_.end()) {
+            return;
+        }
+        for (auto& [id, stream] : peerIt->second.streams) {
+            stream->closed = true;
+            stream->queue.clear();
+            stream->queuedBytes = 0;
+            stream->onData = nullptr;
+            if (stream->onClose) {
+                callbacks.push_back(std::move(stream->onClose));
+            }
+        }
+        peers_.erase(peerIt);
+    }
+    for (auto& onClose : callbacks) {
+        onClose();
+    }
+}
+
+void StreamMux::closeAll() {
+    std::vector<std::string> peers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [peerId, peer] : peers_) {
+            peers.push_back(peerId);
+        }
+    }
+    for (const auto& peerId : peers) {
+        failPeer(peerId);
+    }
+}
+
+} // namespace p2p
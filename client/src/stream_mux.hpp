@@ -0,0 +1,136 @@
+// client/src/stream_mux.hpp
+#pragma once
+
+#include "p2p/stream.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace p2p {
+
+class StreamMux;
+
+namespace detail {
+
+// 单个流的状态；除 peerId 和 id 外都由 StreamMux 的互斥锁保护
+struct StreamState {
+    std::weak_ptr<StreamMux> mux;
+    std::string peerId;
+    uint64_t id = 0;  // 本端视角：偶数为本端打开，奇数为对方打开
+
+    bool openSent = false;  // 对方已知道这个流 (本端打开的流在第一次发送时才通知对方)
+    bool closing = false;   // 本端已调用 close()，队列发完后通知对方
+    bool closed = false;    // 已从流表中移除
+    bool ready = false;     // 在发送轮转队列中
+
+    // 发送方向
+    std::deque<Buffer> queue;
+    size_t headOffset = 0;    // queue.front() 中已发出的字节数
+    size_t queuedBytes = 0;
+    uint64_t sent = 0;        // 累计发出的字节数
+    uint64_t sendLimit = 0;   // 对方授予的累计信用
+
+    // 接收方向
+    uint64_t received = 0;
+    uint64_t granted = 0;     // 已授予对方的累计信用
+
+    Stream::OnDataCallback onData;
+    Stream::OnCloseCallback onClose;
+};
+
+} // namespace detail
+
+/**
+ * 流多路复用
+ *
+ * 帧体 (FrameKind::Stream)，id 为发送方视角的流 id，接收方翻转最低位得到本端视角：
+ *   打开 [0][id varint][窗口 varint]    打开方的接收窗口
+ *   数据 [1][id varint][数据]
+ *   信用 [2][id varint][累计信用 varint]
+ *   关闭 [3][id varint]
+ *
+ * 流控按流进行：双方在打开时都假定对方至少有 kInitialWindow 的窗口，因此打开后可以立即发送数据；
+ * 接收方的数据回调返回后才计入已处理字节，消耗超过半个窗口时发送新的累计信用。
+ * 发送调度：每个 Peer 一个轮转队列，只有有数据且有信用的流在队列中，每次出队发送至多 kChunkSize 字节，
+ * 同一时刻每个 Peer 只有一个线程在发送，保证同一个流的分片按序发出。
+ * 底层连接不可写 (发送缓冲区积压或中继信用不足) 时暂停，连接恢复可写后调用 resume() 继续。
+ */
+class StreamMux : public std::enable_shared_from_this<StreamMux> {
+public:
+    static constexpr uint64_t kInitialWindow = 64 * 1024;
+    static constexpr size_t kChunkSize = 16 * 1024;
+
+    using SendFrame = std::function<bool(const std::string& peerId, const ConstBuffer* parts, size_t count)>;
+    // 底层连接能否立即发送 size 字节的帧
+    using CanSend = std::function<bool(const std::string& peerId, size_t size)>;
+
+    StreamMux(SendFrame send, CanSend canSend, size_t window, size_t sendBufferLimit);
+
+    Stream open(const std::string& peerId);
+
+    void setOnStream(OnStreamCallback callback);
+
+    // 处理收到的流帧，格式错误时抛出 std::invalid_argument
+    void handleFrame(const std::string& peerId, const uint8_t* data, size_t size);
+
+    // 与 Peer 的连接已断开：关闭该 Peer 的所有流
+    void failPeer(const std::string& peerId);
+
+    // 关闭所有流 (断开信令连接时)
+    void closeAll();
+
+    // 底层连接恢复可写
+    void resume(const std::string& peerId) { pump(peerId); }
+
+    // Stream 句柄的操作
+    bool write(const std::shared_ptr<detail::StreamState>& stream, ConstBuffer data);
+    void close(const std::shared_ptr<detail::StreamState>& stream);
+    bool isOpen(const detail::StreamState& stream) const;
+    size_t bufferedAmount(const detail::StreamState& stream) const;
+    void setOnData(detail::StreamState& stream, Stream::OnDataCallback callback);
+    void setOnClose(detail::StreamState& stream, Stream::OnCloseCallback callback);
+
+private:
+    using StreamPtr = std::shared_ptr<detail::StreamState>;
+
+    struct PeerStreams {
+        std::unordered_map<uint64_t, StreamPtr> streams;
+        std::deque<StreamPtr> ready;  // 轮转发送队列
+        uint64_t nextId = 0;
+        bool pumping = false;
+    };
+
+    // 是否有可以立即发出的帧 (调用方持有 mutex_)
+    static bool wantsSend(const detail::StreamState& stream);
+    void markReady(PeerStreams& peer, const StreamPtr& stream);
+
+    // 轮流发送该 Peer 所有流中可发送的数据
+    void pump(const std::string& peerId);
+
+    void handleOpen(const std::string& peerId, uint64_t id, const uint8_t* p, const uint8_t* end);
+    void handleData(const std::string& peerId, uint64_t id, const uint8_t* p, const uint8_t* end);
+    void handleCredit(const std::string& peerId, uint64_t id, const uint8_t* p, const uint8_t* end);
+    void handleClose(const std::string& peerId, uint64_t id);
+
+    bool sendControl(const std::string& peerId, uint8_t type, uint64_t id, const uint64_t* value);
+
+    // 从流表中移除 (调用方持有 mutex_)
+    void detach(PeerStreams& peer, detail::StreamState& stream);
+
+    SendFrame send_;
+    CanSend canSend_;
+    uint64_t window_;
+    size_t sendBufferLimit_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, PeerStreams> peers_;
+    OnStreamCallback onStream_;
+};
+
+} // namespace p2p
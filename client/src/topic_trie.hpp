@@ -0,0 +1,185 @@
+// client/src/topic_trie.hpp
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace p2p {
+
+// 以小整数编号的集合 (每个订阅者一个编号)，按 64 位字存储
+class SlotSet {
+public:
+    void set(size_t slot) {
+        if (slot / 64 >= words_.size()) {
+            words_.resize(slot / 64 + 1, 0);
+        }
+        words_[slot / 64] |= uint64_t(1) << (slot % 64);
+    }
+
+    void reset(size_t slot) {
+        if (slot / 64 < words_.size()) {
+            words_[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+        }
+    }
+
+    bool test(size_t slot) const {
+        return slot / 64 < words_.size() && (words_[slot / 64] >> (slot % 64)) & 1;
+    }
+
+    bool empty() const {
+        for (uint64_t word : words_) {
+            if (word != 0) return false;
+        }
+        return true;
+    }
+
+    SlotSet& operator|=(const SlotSet& other) {
+        if (other.words_.size() > words_.size()) {
+            words_.resize(other.words_.size(), 0);
+        }
+        for (size_t i = 0; i < other.words_.size(); ++i) {
+            words_[i] |= other.words_[i];
+        }
+        return *this;
+    }
+
+    template <typename F>
+    void forEach(F&& f) const {
+        for (size_t i = 0; i < words_.size(); ++i) {
+            uint64_t word = words_[i];
+            while (word != 0) {
+                size_t bit = 0;
+                while (((word >> bit) & 1) == 0) ++bit;
+                f(i * 64 + bit);
+                word &= word - 1;
+            }
+        }
+    }
+
+private:
+    std::vector<uint64_t> words_;
+};
+
+/**
+ * 主题订阅树
+ *
+ * 主题按 '/' 分层，订阅模式中 '*' 匹配恰好一层，'#' 只能出现在最后一层，匹配其后任意多层 (包括零层)。
+ * 每个节点只保存以该节点结尾的订阅者集合；匹配一个主题时沿精确层、'*'、'#' 三条分支下行，
+ * 把经过的订阅者集合按位或起来，开销与主题层数和命中的通配分支成正比，与订阅者总数无关。
+ */
+class TopicTrie {
+public:
+    // 模式是否合法：非空，'#' 只出现在最后一层，通配符必须独占一层
+    static bool validPattern(std::string_view pattern) {
+        if (pattern.empty()) {
+            return false;
+        }
+        size_t start = 0;
+        while (true) {
+            size_t end = pattern.find('/', start);
+            std::string_view level = pattern.substr(start, end == std::string_view::npos ? end : end - start);
+            bool last = end == std::string_view::npos;
+            if (level.size() > 1 && level.find_first_of("*#") != std::string_view::npos) {
+                return false;
+            }
+            if (level == "#" && !last) {
+                return false;
+            }
+            if (last) {
+                return true;
+            }
+            start = end + 1;
+        }
+    }
+
+    // 发布的主题不能含通配符
+    static bool validTopic(std::string_view topic) {
+        return !topic.empty() && topic.find_first_of("*#") == std::string_view::npos;
+    }
+
+    void add(std::string_view pattern, size_t slot) {
+        Node* node = &root_;
+        forEachLevel(pattern, [&](std::string_view level) {
+            auto it = node->children.find(level);
+            if (it == node->children.end()) {
+                it = node->children.emplace(std::string(level), std::make_unique<Node>()).first;
+            }
+            node = it->second.get();
+        });
+        node->subscribers.set(slot);
+    }
+
+    void remove(std::string_view pattern, size_t slot) {
+        std::vector<std::string_view> levels;
+        forEachLevel(pattern, [&](std::string_view level) { levels.push_back(level); });
+        removeFrom(root_, levels, 0, slot);
+    }
+
+    // 匹配主题的所有订阅者并入 out
+    void match(std::string_view topic, SlotSet& out) const {
+        std::vector<std::string_view> levels;
+        forEachLevel(topic, [&](std::string_view level) { levels.push_back(level); });
+        matchFrom(root_, levels, 0, out);
+    }
+
+private:
+    struct Node {
+        std::map<std::string, std::unique_ptr<Node>, std::less<>> children;  // 含 "*" 和 "#"
+        SlotSet subscribers;
+    };
+
+    template <typename F>
+    static void forEachLevel(std::string_view s, F&& f) {
+        size_t start = 0;
+        while (true) {
+            size_t end = s.find('/', start);
+            if (end == std::string_view::npos) {
+                f(s.substr(start));
+                return;
+            }
+            f(s.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+    static void matchFrom(const Node& node, const std::vector<std::string_view>& levels, size_t i, SlotSet& out) {
+        auto hash = node.children.find(std::string_view("#"));
+        if (hash != node.children.end()) {
+            out |= hash->second->subscribers;
+        }
+        if (i == levels.size()) {
+            out |= node.subscribers;
+            return;
+        }
+        auto exact = node.children.find(levels[i]);
+        if (exact != node.children.end()) {
+            matchFrom(*exact->second, levels, i + 1, out);
+        }
+        auto star = node.children.find(std::string_view("*"));
+        if (star != node.children.end()) {
+            matchFrom(*star->second, levels, i + 1, out);
+        }
+    }
+
+    // 返回节点是否已空 (可以删除)
+    static bool removeFrom(Node& node, const std::vector<std::string_view>& levels, size_t i, size_t slot) {
+        if (i == levels.size()) {
+            node.subscribers.reset(slot);
+        } else {
+            auto it = node.children.find(levels[i]);
+            if (it != node.children.end() && removeFrom(*it->second, levels, i + 1, slot)) {
+                node.children.erase(it);
+            }
+        }
+        return node.children.empty() && node.subscribers.empty();
+    }
+
+    Node root_;
+};
+
+} // namespace p2p
@@ -0,0 +1,254 @@
+#include "transport.hpp"
+
+#include <algorithm>
+
+namespace p2p {
+
+// ==================== Transport ====================
+
+const char* Transport::kindName(Kind kind) {
+    switch (kind) {
+        case Kind::Lan:    return "lan";
+        case Kind::WebRtc: return "webrtc";
+        case Kind::Relay:  return "relay";
+    }
+    return "unknown";
+}
+
+size_t Transport::sizeOf(const Message& message) {
+    return std::visit([](const auto& data) { return data.size(); }, message);
+}
+
+bool Transport::send(Message message) {
+    if (!isOpen()) {
+        return false;
+    }
+    size_t size = sizeOf(message);
+    try {
+        if (!write(std::move(message))) {
+            sendFailures_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    } catch (...) {
+        sendFailures_.fetch_add(1, std::memory_order_relaxed);
+        throw;
+    }
+    messagesSent_.fetch_add(1, std::memory_order_relaxed);
+    bytesSent_.fetch_add(size, std::memory_order_relaxed);
+    return true;
+}
+
+void Transport::received(Message message) {
+    countReceived(sizeOf(message));
+    onMessage_(std::move(message));
+}
+
+void Transport::countReceived(size_t bytes) {
+    messagesReceived_.fetch_add(1, std::memory_order_relaxed);
+    bytesReceived_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+TransportStats Transport::stats() const {
+    TransportStats stats;
+    stats.transport = name();
+    stats.open = isOpen();
+    stats.messagesSent = messagesSent_.load(std::memory_order_relaxed);
+    stats.bytesSent = bytesSent_.load(std::memory_order_relaxed);
+    stats.messagesReceived = messagesReceived_.load(std::memory_order_relaxed);
+    stats.bytesReceived = bytesReceived_.load(std::memory_order_relaxed);
+    stats.sendFailures = sendFailures_.load(std::memory_order_relaxed);
+    stats.bufferedAmount = bufferedAmount();
+    stats.rttMicros = rttMicros();
+    stats.writeCalls = writeCalls();
+    return stats;
+}
+
+// ==================== DataChannelTransport ====================
+
+std::shared_ptr<DataChannelTransport> DataChannelTransport::create(std::shared_ptr<rtc::DataChannel> channel,
+                                                                   std::weak_ptr<rtc::PeerConnection> connection) {
+    return std::shared_ptr<DataChannelTransport>(new DataChannelTransport(std::move(channel), std::move(connection)));
+}
+
+// DataChannel 的回调持有弱引用，传输被移除后迟到的事件直接丢弃
+void DataChannelTransport::start() {
+    std::weak_ptr<DataChannelTransport> weak = shared_from_this();
+    channel_->onOpen([weak]() {
+        if (auto self = weak.lock()) self->opened();
+    });
+    channel_->onClosed([weak]() {
+        if (auto self = weak.lock()) self->closed();
+    });
+    channel_->onError([weak](std::string error) {
+        if (auto self = weak.lock()) self->failed(error);
+    });
+    channel_->onBufferedAmountLow([weak]() {
+        if (auto self = weak.lock()) self->writable();
+    });
+    channel_->onMessage([weak](rtc::message_variant message) {
+        if (auto self = weak.lock()) self->received(std::move(message));
+    });
+}
+
+ChannelState DataChannelTransport::state() const {
+    if (channel_->isOpen()) {
+        return ChannelState::Open;
+    }
+    return channel_->isClosed() ? ChannelState::Closed : ChannelState::Connecting;
+}
+
+uint64_t DataChannelTransport::rttMicros() const {
+    auto connection = connection_.lock();
+    if (!connection) {
+        return 0;
+    }
+    auto rtt = connection->rtt();
+    return rtt ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(*rtt).count()) : 0;
+}
+
+// ==================== RelayTransport ====================
+
+size_t RelayTransport::bufferedAmount() const {
+    if (!session_) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(session_->mutex());
+    return session_->bufferedBytes();
+}
+
+void RelayTransport::close() {
+    if (open_.exchange(false)) {
+        closed();
+    }
+}
+
+bool RelayTransport::write(Message message) {
+    if (auto* text = std::get_if<std::string>(&message)) {
+        return writer_(std::move(*text));
+    }
+    const auto& binary = std::get<rtc::binary>(message);
+    return writer_(std::string(reinterpret_cast<const char*>(binary.data()), binary.size()));
+}
+
+// ==================== TransportSet ====================
+
+std::shared_ptr<Transport> TransportSet::add(std::shared_ptr<Transport> transport) {
+    auto previous = remove(transport->kind());
+    auto it = std::find_if(transports_.begin(), transports_.end(), [&](const auto& existing) {
+        return existing->kind() > transport->kind();
+    });
+    transports_.insert(it, std::move(transport));
+    reselectAt_ = {};  // 下次 select() 立即评估新传输
+    return previous;
+}
+
+std::shared_ptr<Transport> TransportSet::remove(Transport::Kind kind) {
+    auto it = std::find_if(transports_.begin(), transports_.end(), [kind](const auto& transport) {
+        return transport->kind() == kind;
+    });
+    if (it == transports_.end()) {
+        return nullptr;
+    }
+    auto removed = std::move(*it);
+    transports_.erase(it);
+    if (selected_ == removed) {
+        selected_.reset();
+    }
+    if (candidate_ == removed) {
+        candidate_.reset();
+        candidateSamples_ = 0;
+    }
+    return removed;
+}
+
+std::shared_ptr<Transport> TransportSet::find(Transport::Kind kind) const {
+    for (const auto& transport : transports_) {
+        if (transport->kind() == kind) {
+            return transport;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<Transport> TransportSet::select() const {
+    auto now = std::chrono::steady_clock::now();
+    bool current = selected_ && selected_->isOpen();
+    if (current && now < reselectAt_) {
+        return selected_;
+    }
+    reselectAt_ = now + kReselectInterval;
+
+    std::vector<const std::shared_ptr<Transport>*> open;
+    for (const auto& transport : transports_) {
+        if (transport->kind() != Transport::Kind::Relay && transport->isOpen()) {
+            open.push_back(&transport);
+        }
+    }
+
+    // 只有一个可用时不查询时延 (WebRTC 的 RTT 需要访问 SCTP 关联)
+    std::shared_ptr<Transport> best = open.empty() ? nullptr : *open.front();
+    uint64_t bestRtt = 0;
+    if (open.size() > 1) {
+        bool allMeasured = true;
+        for (auto* transport : open) {
+            uint64_t rtt = (*transport)->rttMicros();
+            if (rtt == 0) {
+                allMeasured = false;
+                break;
+            }
+            if (bestRtt == 0 || rtt < bestRtt) {
+                bestRtt = rtt;
+                best = *transport;
+            }
+        }
+        if (!allMeasured) {
+            best = *open.front();  // 按 Kind 顺序
+            bestRtt = 0;
+        }
+    }
+
+    if (!current || best == selected_ || !best) {
+        if (!current) {
+            selected_ = best;
+        }
+        candidate_.reset();
+        candidateSamples_ = 0;
+        return selected_;
+    }
+
+    // 已有可用的传输时，候选者要连续 kSwitchSamples 次明显更优才切换，避免时延抖动导致来回切换
+    bool better = true;
+    if (bestRtt > 0) {
+        uint64_t currentRtt = selected_->rttMicros();
+        better = currentRtt > 0 && bestRtt * 100 < currentRtt * (100 - kSwitchMarginPercent);
+    }
+    if (!better) {
+        candidate_.reset();
+        candidateSamples_ = 0;
+        return selected_;
+    }
+    if (candidate_ != best) {
+        candidate_ = best;
+        candidateSamples_ = 0;
+    }
+    // 当前传输仍有积压时暂不切换，否则积压的消息会晚于新传输上的后续消息到达
+    if (++candidateSamples_ >= kSwitchSamples && selected_->bufferedAmount() == 0) {
+        selected_ = std::move(candidate_);
+        candidateSamples_ = 0;
+    }
+    return selected_;
+}
+
+std::shared_ptr<Transport> TransportSet::direct() const {
+    if (auto selected = select()) {
+        return selected;
+    }
+    for (const auto& transport : transports_) {
+        if (transport->kind() != Transport::Kind::Relay) {
+            return transport;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace p2p
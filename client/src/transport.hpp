@@ -0,0 +1,210 @@
+// client/src/transport.hpp
+#pragma once
+
+#include "p2p/types.hpp"
+#include "callback_slot.hpp"
+#include "relay_session.hpp"
+
+#include <rtc/rtc.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace p2p {
+
+/**
+ * 到一个 Peer 的消息传输
+ *
+ * 客户端经由传输层收发消息，不直接操作 DataChannel 或信令连接；新的传输 (局域网、共享内存等)
+ * 实现这个接口后加入 Peer 的 TransportSet，直连消息自动改走更快的一个。
+ * 消息的格式 (压缩帧头、中继 JSON) 由客户端决定，传输层只负责原样送达。
+ * 回调在传输自己的线程上执行，实现不得在持有内部锁时调用回调。
+ */
+class Transport {
+public:
+    // 枚举顺序即没有测得时延时的优先顺序
+    enum class Kind {
+        Lan,     // 局域网 TCP 直连 (见 lan_transport.hpp)
+        WebRtc,  // WebRTC DataChannel (DTLS/SCTP)
+        Relay    // 信令服务器中继，只用于显式的 *ViaRelay 接口，不参与直连选择
+    };
+
+    using Message = rtc::message_variant;  // 二进制帧或文本
+    using MessageCallback = std::function<void(Message message)>;
+    using EventCallback = std::function<void()>;
+
+    explicit Transport(Kind kind) : kind_(kind) {}
+    virtual ~Transport() = default;
+
+    Transport(const Transport&) = delete;
+    Transport& operator=(const Transport&) = delete;
+
+    Kind kind() const { return kind_; }
+    const char* name() const { return kindName(kind_); }
+    static const char* kindName(Kind kind);
+
+    virtual ChannelState state() const = 0;
+    bool isOpen() const { return state() == ChannelState::Open; }
+
+    // 发送一条消息，所有权交给传输层；未打开时返回 false，发送出错时抛出异常
+    bool send(Message message);
+
+    // 已提交但尚未发出 (中继为尚未确认) 的字节数，上层据此做背压
+    virtual size_t bufferedAmount() const = 0;
+
+    // 测得的往返时延，0 表示未测得
+    virtual uint64_t rttMicros() const { return 0; }
+
+    // 发送消息用的系统调用次数，0 表示不统计 (由网络库发送的传输)
+    virtual uint64_t writeCalls() const { return 0; }
+
+    virtual void close() = 0;
+
+    // 可在任意时刻设置，回调执行时不持有传输的锁
+    void setOnMessage(MessageCallback callback) { onMessage_.set(std::move(callback)); }
+    void setOnOpen(EventCallback callback) { onOpen_.set(std::move(callback)); }
+    void setOnClosed(EventCallback callback) { onClosed_.set(std::move(callback)); }
+    void setOnError(std::function<void(const std::string&)> callback) { onError_.set(std::move(callback)); }
+
+    // bufferedAmount() 降到 lowWater 以下时回调
+    void setOnWritable(EventCallback callback, size_t lowWater) {
+        onWritable_.set(std::move(callback));
+        setWritableThreshold(lowWater);
+    }
+
+    TransportStats stats() const;
+
+protected:
+    virtual bool write(Message message) = 0;
+    virtual void setWritableThreshold(size_t /*lowWater*/) {}
+
+    // 由实现在收到消息、状态变化时调用
+    void received(Message message);
+    void countReceived(size_t bytes);
+    void opened() { onOpen_(); }
+    void closed() { onClosed_(); }
+    void failed(const std::string& error) { onError_(error); }
+    void writable() { onWritable_(); }
+
+private:
+    static size_t sizeOf(const Message& message);
+
+    Kind kind_;
+    CallbackSlot<MessageCallback> onMessage_;
+    CallbackSlot<EventCallback> onOpen_;
+    CallbackSlot<EventCallback> onClosed_;
+    CallbackSlot<EventCallback> onWritable_;
+    CallbackSlot<std::function<void(const std::string&)>> onError_;
+
+    std::atomic<uint64_t> messagesSent_{0};
+    std::atomic<uint64_t> bytesSent_{0};
+    std::atomic<uint64_t> messagesReceived_{0};
+    std::atomic<uint64_t> bytesReceived_{0};
+    std::atomic<uint64_t> sendFailures_{0};
+};
+
+/**
+ * WebRTC DataChannel 传输
+ *
+ * 创建后先设置回调再调用 start()：DataChannel 在设置 onMessage 之前收到的消息会先排队，
+ * 不会在回调就绪前丢失。
+ */
+class DataChannelTransport : public Transport, public std::enable_shared_from_this<DataChannelTransport> {
+public:
+    static std::shared_ptr<DataChannelTransport> create(std::shared_ptr<rtc::DataChannel> channel,
+                                                        std::weak_ptr<rtc::PeerConnection> connection);
+
+    void start();
+
+    ChannelState state() const override;
+    size_t bufferedAmount() const override { return channel_->bufferedAmount(); }
+    uint64_t rttMicros() const override;
+    void close() override { channel_->close(); }
+
+protected:
+    bool write(Message message) override { return channel_->send(std::move(message)); }
+    void setWritableThreshold(size_t lowWater) override { channel_->setBufferedAmountLowThreshold(lowWater); }
+
+private:
+    DataChannelTransport(std::shared_ptr<rtc::DataChannel> channel, std::weak_ptr<rtc::PeerConnection> connection)
+        : Transport(Kind::WebRtc), channel_(std::move(channel)), connection_(std::move(connection)) {}
+
+    std::shared_ptr<rtc::DataChannel> channel_;
+    std::weak_ptr<rtc::PeerConnection> connection_;
+};
+
+/**
+ * 信令服务器中继传输
+ *
+ * 消息为已序列化的中继 payload (JSON 文本)，由 writer 交给可靠中继会话或直接写入信令连接。
+ * 接收方向与确认、序号、子协议帧复用信令连接，由客户端解码后通过 received()/acknowledged() 通知。
+ */
+class RelayTransport : public Transport {
+public:
+    using Writer = std::function<bool(std::string payload)>;
+
+    RelayTransport(Writer writer, std::shared_ptr<RelaySession> session)
+        : Transport(Kind::Relay), writer_(std::move(writer)), session_(std::move(session)) {}
+
+    ChannelState state() const override { return open_ ? ChannelState::Open : ChannelState::Closed; }
+    size_t bufferedAmount() const override;
+    void close() override;
+
+    void received(size_t payloadSize) { countReceived(payloadSize); }
+    void acknowledged() { writable(); }
+
+protected:
+    bool write(Message message) override;
+
+private:
+    Writer writer_;
+    std::shared_ptr<RelaySession> session_;  // 不可靠中继时为空
+    std::atomic<bool> open_{true};
+};
+
+/**
+ * 一个 Peer 的全部传输
+ *
+ * 直连消息经由 select() 选出的传输发送：已打开的直连传输都测得时延时选时延最小的，
+ * 否则按 Transport::Kind 的顺序。每 kReselectInterval 评估一次，有传输加入时立即评估；
+ * 已选的传输仍打开时，其他传输须连续 kSwitchSamples 次评估都更优 (时延低 kSwitchMarginPercent% 以上)
+ * 且已选传输没有积压 (bufferedAmount() 为 0) 才切换。所选传输关闭时立即重选。
+ * 不是线程安全的，由客户端的 peerMutex_ 保护。
+ */
+class TransportSet {
+public:
+    static constexpr std::chrono::milliseconds kReselectInterval{1000};
+    static constexpr int kSwitchSamples = 3;
+    static constexpr uint64_t kSwitchMarginPercent = 20;
+
+    // 同类传输只保留一个 (重新建立连接时替换)，返回被替换的旧传输
+    std::shared_ptr<Transport> add(std::shared_ptr<Transport> transport);
+
+    // 移除 kind 类的传输并返回它
+    std::shared_ptr<Transport> remove(Transport::Kind kind);
+
+    std::shared_ptr<Transport> find(Transport::Kind kind) const;
+
+    // 当前用于直连消息的传输，没有已打开的直连传输时为空
+    std::shared_ptr<Transport> select() const;
+
+    // 代表直连状态的传输：select() 的结果，否则为第一个直连传输 (可能尚未打开或已关闭)
+    std::shared_ptr<Transport> direct() const;
+
+    const std::vector<std::shared_ptr<Transport>>& all() const { return transports_; }
+    bool empty() const { return transports_.empty(); }
+
+private:
+    std::vector<std::shared_ptr<Transport>> transports_;
+    mutable std::shared_ptr<Transport> selected_;
+    mutable std::shared_ptr<Transport> candidate_;  // 优于 selected_ 的传输，连续 candidateSamples_ 次
+    mutable int candidateSamples_ = 0;
+    mutable std::chrono::steady_clock::time_point reselectAt_;
+};
+
+} // namespace p2p
@@ -0,0 +1,387 @@
+// common/include/json_stream.hpp
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define P2P_JSON_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace p2p {
+
+// ==================== 流式 JSON 读写 (不构建 DOM) ====================
+
+namespace detail {
+
+inline unsigned countTrailingZeros(uint32_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(bits));
+#endif
+}
+
+// 返回 [p, end) 中第一个 '"'、'\\' 或控制字符的位置，找不到返回 end
+inline const char* findJsonSpecial(const char* p, const char* end) {
+#ifdef P2P_JSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i ctrlMax = _mm_set1_epi8(0x1F);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(chunk, ctrlMax), chunk));  // chunk <= 0x1F
+        int bits = _mm_movemask_epi8(special);
+        if (bits != 0) {
+            return p + countTrailingZeros(static_cast<uint32_t>(bits));
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\' || c < 0x20) {
+            return p;
+        }
+    }
+    return end;
+}
+
+template <typename String>
+inline void appendUtf8(String& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+inline bool parseHex4(const char* p, const char* end, uint32_t& value) {
+    if (end - p < 4) return false;
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= static_cast<uint32_t>(c - '0');
+        else if (c >= 'a' && c <= 'f') value |= static_cast<uint32_t>(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') value |= static_cast<uint32_t>(c - 'A' + 10);
+        else return false;
+    }
+    return true;
+}
+
+} // namespace detail
+
+// 以下写入函数对 std::string 和 std::pmr::string 等任意 basic_string<char> 通用
+
+// 追加转义后的字符串内容 (不含引号)；无需转义的连续片段整段拷贝
+template <typename String>
+inline void appendJsonEscaped(String& out, std::string_view str) {
+    static const char* hex = "0123456789abcdef";
+    const char* p = str.data();
+    const char* end = p + str.size();
+
+    while (p < end) {
+        const char* special = detail::findJsonSpecial(p, end);
+        out.append(p, static_cast<size_t>(special - p));
+        if (special == end) break;
+
+        unsigned char c = static_cast<unsigned char>(*special);
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xF];
+                break;
+        }
+        p = special + 1;
+    }
+}
+
+template <typename String>
+inline void appendJsonString(String& out, std::string_view str) {
+    out += '"';
+    appendJsonEscaped(out, str);
+    out += '"';
+}
+
+// 反转义 JSON 字符串内容 (不含引号)，失败返回 false
+template <typename String>
+inline bool unescapeJsonString(std::string_view raw, String& out) {
+    const char* p = raw.data();
+    const char* end = p + raw.size();
+    out.reserve(out.size() + raw.size());
+
+    while (p < end) {
+        const char* backslash = static_cast<const char*>(std::memchr(p, '\\', static_cast<size_t>(end - p)));
+        if (!backslash) {
+            out.append(p, static_cast<size_t>(end - p));
+            break;
+        }
+        out.append(p, static_cast<size_t>(backslash - p));
+        p = backslash + 1;
+        if (p >= end) return false;
+
+        switch (*p++) {
+            case '"':  out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/':  out += '/'; break;
+            case 'b':  out += '\b'; break;
+            case 'f':  out += '\f'; break;
+            case 'n':  out += '\n'; break;
+            case 'r':  out += '\r'; break;
+            case 't':  out += '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!detail::parseHex4(p, end, cp)) return false;
+                p += 4;
+                // UTF-16 代理对
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    uint32_t low;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u' ||
+                        !detail::parseHex4(p + 2, end, low) || low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    p += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                detail::appendUtf8(out, cp);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// 指向输入缓冲区的原始 JSON 值
+struct JsonRawValue {
+    std::string_view raw;     // 字符串不含引号，其他类型为完整的 JSON 文本
+    bool present = false;
+    bool isString = false;
+    bool hasEscapes = false;  // 字符串中包含转义序列
+
+    // 字符串返回反转义后的内容，其他类型返回原始 JSON 文本
+    std::string toString() const {
+        std::string result;
+        assignTo(result);
+        return result;
+    }
+    
+    // 同 toString()，写入调用方提供的字符串 (可使用自定义分配器)
+    template <typename String>
+    void assignTo(String& out) const {
+        if (isString && hasEscapes) {
+            out.clear();
+            if (unescapeJsonString(raw, out)) {
+                return;
+            }
+        }
+        out.assign(raw.data(), raw.size());
+    }
+};
+
+namespace detail {
+
+inline const char* skipJsonWhitespace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+    return p;
+}
+
+// p 指向起始引号之后；返回结束引号位置，失败返回 nullptr
+inline const char* scanJsonString(const char* p, const char* end, bool& hasEscapes) {
+    while (p < end) {
+        p = findJsonSpecial(p, end);
+        if (p == end) return nullptr;
+        if (*p == '"') return p;
+        if (*p == '\\') {
+            hasEscapes = true;
+            p += 2;
+        } else {
+            ++p;  // 容忍未转义的控制字符
+        }
+    }
+    return nullptr;
+}
+
+// 严格校验的字符串 (p 指向起始引号之后)：不允许未转义的控制字符，转义序列必须合法；
+// 返回结束引号位置，失败返回 nullptr
+inline const char* scanStrictJsonString(const char* p, const char* end) {
+    while (p < end) {
+        p = findJsonSpecial(p, end);
+        if (p == end) return nullptr;
+        if (*p == '"') return p;
+        if (*p != '\\' || end - p < 2) return nullptr;
+        char c = p[1];
+        if (c == 'u') {
+            uint32_t cp;
+            if (!parseHex4(p + 2, end, cp)) return nullptr;
+            p += 6;
+        } else if (c == '"' || c == '\\' || c == '/' || c == 'b' || c == 'f' || c == 'n' ||
+                   c == 'r' || c == 't') {
+            p += 2;
+        } else {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+inline const char* scanJsonDigits(const char* p, const char* end) {
+    const char* start = p;
+    while (p < end && *p >= '0' && *p <= '9') ++p;
+    return p > start ? p : nullptr;
+}
+
+// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+inline const char* scanJsonNumber(const char* p, const char* end) {
+    if (p < end && *p == '-') ++p;
+    if (p < end && *p == '0') {
+        ++p;
+    } else if (!(p = scanJsonDigits(p, end))) {
+        return nullptr;
+    }
+    if (p < end && *p == '.') {
+        if (!(p = scanJsonDigits(p + 1, end))) return nullptr;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p < end && (*p == '+' || *p == '-')) ++p;
+        if (!(p = scanJsonDigits(p, end))) return nullptr;
+    }
+    return p;
+}
+
+inline const char* scanJsonLiteral(const char* p, const char* end, std::string_view literal) {
+    if (static_cast<size_t>(end - p) < literal.size() ||
+        std::memcmp(p, literal.data(), literal.size()) != 0) {
+        return nullptr;
+    }
+    return p + literal.size();
+}
+
+// 严格校验任意 JSON 值 (RFC 8259，最多嵌套 64 层)，返回其后的位置，失败返回 nullptr。
+// 服务端原样转发嵌套 payload，必须保证转发出去的是合法 JSON
+inline const char* skipJsonValue(const char* p, const char* end, int depth = 0) {
+    if (p >= end) return nullptr;
+
+    switch (*p) {
+        case '"': {
+            const char* close = scanStrictJsonString(p + 1, end);
+            return close ? close + 1 : nullptr;
+        }
+        case '{':
+        case '[': {
+            if (depth == 64) return nullptr;
+            const bool object = *p == '{';
+            const char close = object ? '}' : ']';
+            p = skipJsonWhitespace(p + 1, end);
+            if (p < end && *p == close) return p + 1;
+            while (p < end) {
+                if (object) {
+                    if (*p != '"') return nullptr;
+                    const char* keyEnd = scanStrictJsonString(p + 1, end);
+                    if (!keyEnd) return nullptr;
+                    p = skipJsonWhitespace(keyEnd + 1, end);
+                    if (p >= end || *p != ':') return nullptr;
+                    p = skipJsonWhitespace(p + 1, end);
+                }
+                p = skipJsonValue(p, end, depth + 1);
+                if (!p) return nullptr;
+                p = skipJsonWhitespace(p, end);
+                if (p >= end) return nullptr;
+                if (*p == close) return p + 1;
+                if (*p != ',') return nullptr;
+                p = skipJsonWhitespace(p + 1, end);
+            }
+            return nullptr;
+        }
+        case 't': return scanJsonLiteral(p, end, "true");
+        case 'f': return scanJsonLiteral(p, end, "false");
+        case 'n': return scanJsonLiteral(p, end, "null");
+        default:  return scanJsonNumber(p, end);
+    }
+}
+
+} // namespace detail
+
+// 遍历顶层 JSON 对象的成员，fn(std::string_view key, const JsonRawValue& value)
+// 键按原样比较 (不反转义)，格式错误返回 false
+template <typename Fn>
+bool forEachJsonMember(std::string_view input, Fn&& fn) {
+    const char* p = input.data();
+    const char* end = p + input.size();
+
+    p = detail::skipJsonWhitespace(p, end);
+    if (p >= end || *p != '{') return false;
+    p = detail::skipJsonWhitespace(p + 1, end);
+    if (p < end && *p == '}') return true;
+
+    while (p < end) {
+        if (*p != '"') return false;
+        bool keyEscaped = false;
+        const char* keyEnd = detail::scanJsonString(p + 1, end, keyEscaped);
+        if (!keyEnd) return false;
+        std::string_view key(p + 1, static_cast<size_t>(keyEnd - p - 1));
+
+        p = detail::skipJsonWhitespace(keyEnd + 1, end);
+        if (p >= end || *p != ':') return false;
+        p = detail::skipJsonWhitespace(p + 1, end);
+        if (p >= end) return false;
+
+        JsonRawValue value;
+        value.present = true;
+        if (*p == '"') {
+            const char* close = detail::scanJsonString(p + 1, end, value.hasEscapes);
+            if (!close) return false;
+            value.isString = true;
+            value.raw = std::string_view(p + 1, static_cast<size_t>(close - p - 1));
+            p = close + 1;
+        } else {
+            const char* valueEnd = detail::skipJsonValue(p, end);
+            if (!valueEnd) return false;
+            value.raw = std::string_view(p, static_cast<size_t>(valueEnd - p));
+            p = valueEnd;
+        }
+
+        fn(key, value);
+
+        p = detail::skipJsonWhitespace(p, end);
+        if (p >= end) return false;
+        if (*p == '}') return true;
+        if (*p != ',') return false;
+        p = detail::skipJsonWhitespace(p + 1, end);
+    }
+    return false;
+}
+
+} // namespace p2p
@@ -1,98 +1,356 @@
 // common/include/protocol.hpp
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <stdexcept>
 #include <nlohmann/json.hpp>
 
+#include "json_stream.hpp"
+
 namespace p2p {
 
+// 消息类型列表 (唯一定义处)：枚举、名称表、查找表和分发表都由它生成
+#define P2P_MESSAGE_TYPES(X) \
+    X(Register,        "register")          /* 客户端注册 */ \
+    X(PeerList,        "peer_list")         /* 获取在线用户列表 */ \
+    X(Offer,           "offer")             /* SDP Offer */ \
+    X(Answer,          "answer")            /* SDP Answer */ \
+    X(Candidate,       "candidate")         /* ICE Candidate */ \
+    X(Connect,         "connect")           /* 请求连接到某个peer */ \
+    X(Error,           "error")             /* 错误消息 */ \
+    X(Chat,            "chat")              /* 聊天消息（通过DataChannel） */ \
+    X(RelayAuth,       "relay_auth")        /* 中继认证请求 */ \
+    X(RelayAuthResult, "relay_auth_result") /* 中继认证结果 */ \
+    X(RelayConnect,    "relay_connect")     /* 通过中继连接到peer */ \
+    X(RelayData,       "relay_data")        /* 中继数据 */ \
+    X(RelayDisconnect, "relay_disconnect")  /* 断开中继连接 */ \
+    X(Throttled,       "throttled")         /* 服务端限流通知 */ \
+    X(Attach,          "attach")            /* 网关：在已注册的连接上再注册一个虚拟 ID */ \
+    X(Detach,          "detach")            /* 网关：注销虚拟 ID */
+
 // 消息类型
 enum class MessageType {
-    Register,       // 客户端注册
-    PeerList,       // 获取在线用户列表
-    Offer,          // SDP Offer
-    Answer,         // SDP Answer
-    Candidate,      // ICE Candidate
-    Connect,        // 请求连接到某个peer
-    Error,          // 错误消息
-    Chat,           // 聊天消息（通过DataChannel）
-    
-    // 中继相关消息类型
-    RelayAuth,      // 中继认证请求
-    RelayAuthResult,// 中继认证结果
-    RelayConnect,   // 通过中继连接到peer
-    RelayData,      // 中继数据
-    RelayDisconnect // 断开中继连接
+#define P2P_MESSAGE_TYPE_ENUM(name, str) name,
+    P2P_MESSAGE_TYPES(P2P_MESSAGE_TYPE_ENUM)
+#undef P2P_MESSAGE_TYPE_ENUM
 };
 
-// 消息类型转换
-inline std::string messageTypeToString(MessageType type) {
-    switch (type) {
-        case MessageType::Register: return "register";
-        case MessageType::PeerList: return "peer_list";
-        case MessageType::Offer: return "offer";
-        case MessageType::Answer: return "answer";
-        case MessageType::Candidate: return "candidate";
-        case MessageType::Connect: return "connect";
-        case MessageType::Error: return "error";
-        case MessageType::Chat: return "chat";
-        case MessageType::RelayAuth: return "relay_auth";
-        case MessageType::RelayAuthResult: return "relay_auth_result";
-        case MessageType::RelayConnect: return "relay_connect";
-        case MessageType::RelayData: return "relay_data";
-        case MessageType::RelayDisconnect: return "relay_disconnect";
-        default: return "unknown";
+#define P2P_MESSAGE_TYPE_COUNT(name, str) + 1
+constexpr size_t kMessageTypeCount = 0 P2P_MESSAGE_TYPES(P2P_MESSAGE_TYPE_COUNT);
+#undef P2P_MESSAGE_TYPE_COUNT
+
+#define P2P_MESSAGE_TYPE_NAME(name, str) std::string_view(str),
+inline constexpr std::array<std::string_view, kMessageTypeCount> kMessageTypeNames = {
+    P2P_MESSAGE_TYPES(P2P_MESSAGE_TYPE_NAME)
+};
+#undef P2P_MESSAGE_TYPE_NAME
+
+namespace detail {
+
+// 名称 -> 类型的完美哈希：长度 + 首字符 + 尾字符，冲突在编译期报错
+constexpr size_t kMessageTypeHashSize = 64;
+
+constexpr size_t messageTypeHash(std::string_view str) {
+    if (str.empty()) return 0;
+    return (str.size() + static_cast<unsigned char>(str.front()) +
+            static_cast<unsigned char>(str.back())) % kMessageTypeHashSize;
+}
+
+// 槽位存放 类型下标 + 1，0 表示空槽
+constexpr std::array<uint8_t, kMessageTypeHashSize> buildMessageTypeHashTable() {
+    std::array<uint8_t, kMessageTypeHashSize> table{};
+    for (size_t i = 0; i < kMessageTypeCount; ++i) {
+        auto& slot = table[messageTypeHash(kMessageTypeNames[i])];
+        if (slot != 0) {
+            throw "message type hash collision, adjust messageTypeHash";
+        }
+        slot = static_cast<uint8_t>(i + 1);
     }
+    return table;
+}
+
+inline constexpr auto kMessageTypeHashTable = buildMessageTypeHashTable();
+
+} // namespace detail
+
+// 消息类型转换 (不分配内存)
+constexpr std::string_view messageTypeName(MessageType type) {
+    auto index = static_cast<size_t>(type);
+    return index < kMessageTypeCount ? kMessageTypeNames[index] : std::string_view("unknown");
+}
+
+inline std::string messageTypeToString(MessageType type) {
+    return std::string(messageTypeName(type));
 }
 
-inline MessageType stringToMessageType(const std::string& str) {
-    if (str == "register") return MessageType::Register;
-    if (str == "peer_list") return MessageType::PeerList;
-    if (str == "offer") return MessageType::Offer;
-    if (str == "answer") return MessageType::Answer;
-    if (str == "candidate") return MessageType::Candidate;
-    if (str == "connect") return MessageType::Connect;
-    if (str == "error") return MessageType::Error;
-    if (str == "chat") return MessageType::Chat;
-    if (str == "relay_auth") return MessageType::RelayAuth;
-    if (str == "relay_auth_result") return MessageType::RelayAuthResult;
-    if (str == "relay_connect") return MessageType::RelayConnect;
-    if (str == "relay_data") return MessageType::RelayData;
-    if (str == "relay_disconnect") return MessageType::RelayDisconnect;
+// 未知类型返回 MessageType::Error
+constexpr MessageType stringToMessageType(std::string_view str) {
+    uint8_t slot = detail::kMessageTypeHashTable[detail::messageTypeHash(str)];
+    if (slot != 0 && kMessageTypeNames[slot - 1] == str) {
+        return static_cast<MessageType>(slot - 1);
+    }
     return MessageType::Error;
 }
 
+static_assert(stringToMessageType(messageTypeName(MessageType::RelayData)) == MessageType::RelayData);
+static_assert(stringToMessageType("unknown_type") == MessageType::Error);
+
+// 编译期分发表：以 MessageType 下标索引，未注册的类型为空
+template <typename Handler>
+class MessageDispatchTable {
+public:
+    constexpr MessageDispatchTable() : handlers_{} {}
+    
+    constexpr MessageDispatchTable on(MessageType type, Handler handler) const {
+        MessageDispatchTable table = *this;
+        table.handlers_[static_cast<size_t>(type)] = handler;
+        return table;
+    }
+    
+    constexpr Handler operator[](MessageType type) const {
+        auto index = static_cast<size_t>(type);
+        return index < kMessageTypeCount ? handlers_[index] : Handler{};
+    }
+    
+private:
+    std::array<Handler, kMessageTypeCount> handlers_;
+};
+
+// 协议版本 (在 Register 时协商，取双方支持的较小值)
+// 1: payload 总是字符串，结构化内容需再次序列化为 JSON 字符串
+// 2: 结构化 payload 以嵌套 JSON 对象/数组发送，避免二次转义和二次解析
+// 3: Register 回复会话令牌 (session)；断线后凭令牌重新注册可恢复原 ID 和中继连接
+// 4: 网关模式，一个连接可用 Attach 注册多个虚拟 ID，消息的 from 指明发送者，服务端发出的消息都带 to
+constexpr uint32_t kProtocolVersionStringPayload = 1;
+constexpr uint32_t kProtocolVersionNestedPayload = 2;
+constexpr uint32_t kProtocolVersionSessionResume = 3;
+constexpr uint32_t kProtocolVersionMultiplex = 4;
+constexpr uint32_t kProtocolVersion = kProtocolVersionMultiplex;
+
+// 信令消息的只读视图，字段指向输入缓冲区 (输入须在视图使用期间保持有效)
+struct SignalingMessageView {
+    MessageType type = MessageType::Error;
+    JsonRawValue from;
+    JsonRawValue to;
+    JsonRawValue payload;
+    JsonRawValue session;
+    uint32_t version = 0;
+    
+    // 不构建 DOM 的解析，格式错误返回 false
+    static bool parse(std::string_view input, SignalingMessageView& view) {
+        view = SignalingMessageView();
+        return forEachJsonMember(input, [&view](std::string_view key, const JsonRawValue& value) {
+            if (key == "type") {
+                view.type = value.isString
+                    ? stringToMessageType(value.hasEscapes ? std::string_view(value.toString()) : value.raw)
+                    : MessageType::Error;
+            } else if (key == "from") {
+                view.from = value;
+            } else if (key == "to") {
+                view.to = value;
+            } else if (key == "payload") {
+                view.payload = value;
+            } else if (key == "version") {
+                // 只接受 JSON 数字形式的非负整数；高于本端已知的版本按 kProtocolVersion 处理
+                // (协商本来就取较小值)，逐位截断也避免了溢出
+                uint32_t version = 0;
+                for (char c : value.isString ? std::string_view() : value.raw) {
+                    if (c < '0' || c > '9') { version = 0; break; }
+                    version = std::min(version * 10 + static_cast<uint32_t>(c - '0'), kProtocolVersion);
+                }
+                view.version = version;
+            } else if (key == "session") {
+                view.session = value;
+            }
+        });
+    }
+};
+
+// 按字段序列化信令消息，写入 out 末尾 (SignalingMessage 与 PmrSignalingMessage 共用；
+// 服务端转发时直接替换 from 写出，无需复制消息)。version 为 0、session 为空时不写出
+template <typename String>
+void writeSignalingMessage(String& out, MessageType type, std::string_view from, std::string_view to,
+                           std::string_view payload, bool payloadIsJson, uint32_t version,
+                           std::string_view session = {}) {
+    out.reserve(out.size() + 48 + from.size() + to.size() + payload.size() + payload.size() / 8 +
+                session.size());
+    out += "{\"type\":";
+    appendJsonString(out, messageTypeName(type));
+    out += ",\"from\":";
+    appendJsonString(out, from);
+    out += ",\"to\":";
+    appendJsonString(out, to);
+    out += ",\"payload\":";
+    if (payloadIsJson) {
+        out.append(payload.data(), payload.size());
+    } else {
+        appendJsonString(out, payload);
+    }
+    if (version != 0) {
+        char digits[10];
+        size_t n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + version % 10);
+            version /= 10;
+        } while (version != 0);
+        out += ",\"version\":";
+        while (n > 0) {
+            out += digits[--n];
+        }
+    }
+    if (!session.empty()) {
+        out += ",\"session\":";
+        appendJsonString(out, session);
+    }
+    out += '}';
+}
+
 // 信令消息结构
 struct SignalingMessage {
     MessageType type;
     std::string from;
     std::string to;
     std::string payload;
+    bool payloadIsJson = false;  // payload 为 JSON 文本，按嵌套值写出 (协议版本 2)
+    uint32_t version = 0;        // 协议版本，仅 Register 携带，0 表示不写出
+    std::string session;         // 会话令牌，仅 Register 携带 (协议版本 3)
+    
+    // 设置结构化 payload；nested 为 false 时按版本 1 作为字符串发送
+    void setJsonPayload(std::string jsonText, bool nested) {
+        payload = std::move(jsonText);
+        payloadIsJson = nested;
+    }
     
     nlohmann::json toJson() const {
-        return {
-            {"type", messageTypeToString(type)},
+        nlohmann::json j = {
+            {"type", messageTypeName(type)},
             {"from", from},
             {"to", to},
-            {"payload", payload}
+            {"payload", payloadIsJson ? nlohmann::json::parse(payload) : nlohmann::json(payload)}
         };
+        if (version != 0) {
+            j["version"] = version;
+        }
+        if (!session.empty()) {
+            j["session"] = session;
+        }
+        return j;
     }
     
     static SignalingMessage fromJson(const nlohmann::json& j) {
         SignalingMessage msg;
-        msg.type = stringToMessageType(j.value("type", "error"));
+        auto typeIt = j.find("type");
+        msg.type = (typeIt != j.end() && typeIt->is_string())
+            ? stringToMessageType(typeIt->get_ref<const std::string&>())
+            : MessageType::Error;
         msg.from = j.value("from", "");
         msg.to = j.value("to", "");
-        msg.payload = j.value("payload", "");
+        auto versionIt = j.find("version");
+        if (versionIt != j.end() && versionIt->is_number_unsigned()) {
+            msg.version = static_cast<uint32_t>(
+                std::min<uint64_t>(versionIt->get<uint64_t>(), kProtocolVersion));
+        }
+        msg.session = j.value("session", "");
+        auto payloadIt = j.find("payload");
+        if (payloadIt != j.end() && !payloadIt->is_string()) {
+            msg.payload = payloadIt->dump();
+            msg.payloadIsJson = true;
+        } else {
+            msg.payload = j.value("payload", "");
+        }
         return msg;
     }
     
+    // 直接写入 out 末尾 (可复用同一缓冲区)，不经过 nlohmann::json
+    template <typename String>
+    void serializeTo(String& out) const {
+        writeSignalingMessage(out, type, from, to, payload, payloadIsJson, version, session);
+    }
+    
     std::string serialize() const {
-        return toJson().dump();
+        std::string out;
+        serializeTo(out);
+        return out;
     }
     
-    static SignalingMessage deserialize(const std::string& str) {
-        return fromJson(nlohmann::json::parse(str));
+    static SignalingMessage fromView(const SignalingMessageView& view) {
+        SignalingMessage msg;
+        msg.type = view.type;
+        msg.from = view.from.toString();
+        msg.to = view.to.toString();
+        // 字符串 payload 反转义；嵌套 payload 保留原始 JSON 文本，两者都可直接 json::parse
+        msg.payload = view.payload.toString();
+        msg.payloadIsJson = view.payload.present && !view.payload.isString;
+        msg.version = view.version;
+        msg.session = view.session.toString();
+        return msg;
+    }
+    
+    static SignalingMessage deserialize(std::string_view str) {
+        SignalingMessageView view;
+        if (!SignalingMessageView::parse(str, view)) {
+            throw std::invalid_argument("Malformed signaling message");
+        }
+        return fromView(view);
+    }
+};
+
+// 字段从 std::pmr 内存资源分配的信令消息
+// 服务端用每线程 arena 承载单条消息的全部临时字符串，处理完后整体复位
+struct PmrSignalingMessage {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    
+    MessageType type = MessageType::Error;
+    std::pmr::string from;
+    std::pmr::string to;
+    std::pmr::string payload;
+    bool payloadIsJson = false;
+    uint32_t version = 0;
+    std::pmr::string session;
+    
+    explicit PmrSignalingMessage(allocator_type alloc = {})
+        : from(alloc), to(alloc), payload(alloc), session(alloc) {}
+    
+    PmrSignalingMessage(const PmrSignalingMessage& other, allocator_type alloc)
+        : type(other.type)
+        , from(other.from, alloc)
+        , to(other.to, alloc)
+        , payload(other.payload, alloc)
+        , payloadIsJson(other.payloadIsJson)
+        , version(other.version)
+        , session(other.session, alloc) {}
+    
+    allocator_type get_allocator() const { return from.get_allocator(); }
+    
+    template <typename String>
+    void serializeTo(String& out) const {
+        writeSignalingMessage(out, type, from, to, payload, payloadIsJson, version, session);
+    }
+    
+    static PmrSignalingMessage fromView(const SignalingMessageView& view, allocator_type alloc = {}) {
+        PmrSignalingMessage msg(alloc);
+        msg.type = view.type;
+        view.from.assignTo(msg.from);
+        view.to.assignTo(msg.to);
+        view.payload.assignTo(msg.payload);
+        msg.payloadIsJson = view.payload.present && !view.payload.isString;
+        msg.version = view.version;
+        view.session.assignTo(msg.session);
+        return msg;
+    }
+    
+    // 格式错误抛出 std::invalid_argument
+    static PmrSignalingMessage deserialize(std::string_view str, allocator_type alloc = {}) {
+        SignalingMessageView view;
+        if (!SignalingMessageView::parse(str, view)) {
+            throw std::invalid_argument("Malformed signaling message");
+        }
+        return fromView(view, alloc);
     }
 };
 
@@ -126,11 +384,31 @@ struct RelayDataMessage {
     }
     
     std::string serialize() const {
-        return toJson().dump();
+        const std::string& data = isBinary ? binaryBase64 : textData;
+        std::string out;
+        out.reserve(32 + data.size() + data.size() / 8);
+        out += isBinary ? "{\"is_binary\":true,\"data\":" : "{\"is_binary\":false,\"data\":";
+        appendJsonString(out, data);
+        out += '}';
+        return out;
     }
     
-    static RelayDataMessage deserialize(const std::string& str) {
-        return fromJson(nlohmann::json::parse(str));
+    static RelayDataMessage deserialize(std::string_view str) {
+        RelayDataMessage msg;
+        msg.isBinary = false;
+        JsonRawValue data;
+        bool ok = forEachJsonMember(str, [&](std::string_view key, const JsonRawValue& value) {
+            if (key == "is_binary") {
+                msg.isBinary = (value.raw == "true");
+            } else if (key == "data") {
+                data = value;
+            }
+        });
+        if (!ok) {
+            throw std::invalid_argument("Malformed relay data message");
+        }
+        (msg.isBinary ? msg.binaryBase64 : msg.textData) = data.toString();
+        return msg;
     }
 };
 
@@ -151,36 +429,133 @@ inline std::vector<std::string> getDefaultStunServers() {
 }
 
 // Base64 编码/解码辅助函数
-inline std::string base64Encode(const std::vector<uint8_t>& data) {
-    static const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    std::string result;
+
+// 流式 Base64 编码：数据可分多段追加，跨段不足 3 字节的部分暂存到下一段
+class Base64Encoder {
+public:
+    static size_t encodedSize(size_t size) { return (size + 2) / 3 * 4; }
     
-    size_t i = 0;
-    while (i < data.size()) {
-        uint32_t octet_a = i < data.size() ? data[i++] : 0;
-        uint32_t octet_b = i < data.size() ? data[i++] : 0;
-        uint32_t octet_c = i < data.size() ? data[i++] : 0;
-        
-        uint32_t triple = (octet_a << 16) + (octet_b << 8) + octet_c;
+    template <typename String>
+    void append(String& out, const uint8_t* data, size_t size) {
+        // 先补齐上一段留下的字节
+        while (pendingSize_ > 0 && pendingSize_ < 3 && size > 0) {
+            pending_[pendingSize_++] = *data++;
+            --size;
+        }
+        if (pendingSize_ == 3) {
+            encodeTriple(out, pending_[0], pending_[1], pending_[2]);
+            pendingSize_ = 0;
+        }
         
-        result += chars[(triple >> 18) & 0x3F];
-        result += chars[(triple >> 12) & 0x3F];
-        result += chars[(triple >> 6) & 0x3F];
-        result += chars[triple & 0x3F];
+        size_t full = size - size % 3;
+        for (size_t i = 0; i < full; i += 3) {
+            encodeTriple(out, data[i], data[i + 1], data[i + 2]);
+        }
+        for (size_t i = full; i < size; ++i) {
+            pending_[pendingSize_++] = data[i];
+        }
     }
     
-    size_t mod = data.size() % 3;
-    if (mod == 1) {
-        result[result.size() - 1] = '=';
-        result[result.size() - 2] = '=';
-    } else if (mod == 2) {
-        result[result.size() - 1] = '=';
+    // 写出剩余字节和填充
+    template <typename String>
+    void finish(String& out) {
+        if (pendingSize_ == 1) {
+            encodeTriple(out, pending_[0], 0, 0);
+            out[out.size() - 1] = '=';
+            out[out.size() - 2] = '=';
+        } else if (pendingSize_ == 2) {
+            encodeTriple(out, pending_[0], pending_[1], 0);
+            out[out.size() - 1] = '=';
+        }
+        pendingSize_ = 0;
     }
     
+private:
+    template <typename String>
+    static void encodeTriple(String& out, uint32_t a, uint32_t b, uint32_t c) {
+        static const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        uint32_t triple = (a << 16) + (b << 8) + c;
+        char quad[4] = {
+            chars[(triple >> 18) & 0x3F],
+            chars[(triple >> 12) & 0x3F],
+            chars[(triple >> 6) & 0x3F],
+            chars[triple & 0x3F]
+        };
+        out.append(quad, 4);
+    }
+    
+    uint8_t pending_[3] = {};
+    size_t pendingSize_ = 0;
+};
+
+inline std::string base64Encode(const std::vector<uint8_t>& data) {
+    std::string result;
+    result.reserve(Base64Encoder::encodedSize(data.size()));
+    Base64Encoder encoder;
+    encoder.append(result, data.data(), data.size());
+    encoder.finish(result);
     return result;
 }
 
-inline std::vector<uint8_t> base64Decode(const std::string& encoded) {
+namespace detail {
+
+template <typename It>
+std::string serializeRelayPayload(std::string_view prefix, It first, It last) {
+    size_t total = 0;
+    for (It it = first; it != last; ++it) {
+        total += it->size;
+    }
+    
+    std::string out;
+    out.reserve(prefix.size() + 4 + Base64Encoder::encodedSize(total));
+    out += prefix;
+    out += '"';
+    Base64Encoder encoder;
+    for (It it = first; it != last; ++it) {
+        encoder.append(out, static_cast<const uint8_t*>(it->data), it->size);
+    }
+    encoder.finish(out);
+    out += "\"}";
+    return out;
+}
+
+struct RelayFragment {
+    const void* data;
+    size_t size;
+};
+
+} // namespace detail
+
+// 把分段二进制数据直接编码为中继 payload，不先拼接原始数据
+// 结果与 RelayDataMessage{isBinary = true}.serialize() 相同；元素需有 data、size 成员
+template <typename It>
+std::string serializeRelayBinary(It first, It last) {
+    return detail::serializeRelayPayload("{\"is_binary\":true,\"data\":", first, last);
+}
+
+// 内部子协议帧的中继 payload ("kind" 为帧类型，接收端交给对应的子协议而不是应用)
+template <typename It>
+std::string serializeRelayFrame(uint8_t kind, It first, It last) {
+    std::string prefix = "{\"is_binary\":true,\"kind\":" + std::to_string(kind) + ",\"data\":";
+    return detail::serializeRelayPayload(prefix, first, last);
+}
+
+// 压缩帧的中继 payload ("compressed" 为 true 时 data 是 Base64 编码的压缩帧)
+inline std::string serializeRelayCompressed(const void* frame, size_t size, bool isText) {
+    detail::RelayFragment fragment{frame, size};
+    return detail::serializeRelayPayload(
+        isText ? "{\"is_binary\":false,\"compressed\":true,\"data\":"
+               : "{\"is_binary\":true,\"compressed\":true,\"data\":",
+        &fragment, &fragment + 1);
+}
+
+// 解码结果的最大字节数 (用于预分配输出缓冲区)
+inline size_t base64DecodedMaxSize(size_t encodedSize) {
+    return (encodedSize / 4) * 3 + 3;
+}
+
+// 解码到调用方提供的缓冲区 (至少 base64DecodedMaxSize 字节)，返回写入的字节数
+inline size_t base64Decode(std::string_view encoded, uint8_t* out) {
     static const int decodeTable[256] = {
         -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
         -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
@@ -200,15 +575,7 @@ inline std::vector<uint8_t> base64Decode(const std::string& encoded) {
         -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
     };
     
-    std::vector<uint8_t> result;
-    
-    size_t padding = 0;
-    if (!encoded.empty() && encoded[encoded.size() - 1] == '=') padding++;
-    if (encoded.size() > 1 && encoded[encoded.size() - 2] == '=') padding++;
-    
-    size_t outLen = (encoded.size() / 4) * 3 - padding;
-    result.reserve(outLen);
-    
+    size_t written = 0;
     uint32_t val = 0;
     int valb = -8;
     for (char c : encoded) {
@@ -218,11 +585,17 @@ inline std::vector<uint8_t> base64Decode(const std::string& encoded) {
         val = (val << 6) + v;
         valb += 6;
         if (valb >= 0) {
-            result.push_back(static_cast<uint8_t>((val >> valb) & 0xFF));
+            out[written++] = static_cast<uint8_t>((val >> valb) & 0xFF);
             valb -= 8;
         }
     }
     
+    return written;
+}
+
+inline std::vector<uint8_t> base64Decode(const std::string& encoded) {
+    std::vector<uint8_t> result(base64DecodedMaxSize(encoded.size()));
+    result.resize(base64Decode(std::string_view(encoded), result.data()));
     return result;
 }
 
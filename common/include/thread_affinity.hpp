@@ -0,0 +1,168 @@
+// common/include/thread_affinity.hpp
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+namespace p2p {
+
+// ==================== 线程命名与 CPU 绑定 ====================
+
+/**
+ * 解析 CPU 列表，格式如 "0-3,6"；格式错误时返回空列表
+ */
+inline std::vector<int> parseCpuList(std::string_view text) {
+    std::vector<int> cpus;
+    auto parseNumber = [](std::string_view s, int& out) {
+        if (s.empty() || s.size() > 4) return false;
+        out = 0;
+        for (char c : s) {
+            if (c < '0' || c > '9') return false;
+            out = out * 10 + (c - '0');
+        }
+        return true;
+    };
+    while (!text.empty()) {
+        size_t comma = text.find(',');
+        std::string_view item = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+        while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+        if (item.empty()) continue;
+
+        int first = 0;
+        int last = 0;
+        size_t dash = item.find('-');
+        if (dash == std::string_view::npos) {
+            if (!parseNumber(item, first)) return {};
+            last = first;
+        } else if (!parseNumber(item.substr(0, dash), first) || !parseNumber(item.substr(dash + 1), last) ||
+                   last < first) {
+            return {};
+        }
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+inline std::string formatCpuList(const std::vector<int>& cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        if (i > 0) text += ',';
+        text += std::to_string(cpus[i]);
+    }
+    return text;
+}
+
+/**
+ * 设置当前线程的名字 (Linux 上截断到 15 字符)，便于在 top -H / perf / 调试器中区分
+ */
+inline void setCurrentThreadName(const std::string& name) {
+#if defined(_WIN32)
+    std::wstring wide(name.begin(), name.end());
+    SetThreadDescription(GetCurrentThread(), wide.c_str());
+#elif defined(__linux__)
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#elif defined(__APPLE__)
+    pthread_setname_np(name.c_str());
+#else
+    (void)name;
+#endif
+}
+
+/**
+ * 把当前线程限制在给定的 CPU 上；cpus 为空时不做修改
+ * @return 平台不支持 (macOS) 或 CPU 编号无效时返回 false
+ */
+inline bool setCurrentThreadAffinity(const std::vector<int>& cpus) {
+    if (cpus.empty()) return true;
+#if defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= static_cast<int>(sizeof(DWORD_PTR) * 8)) return false;
+        mask |= DWORD_PTR(1) << cpu;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * 在作用域内临时修改当前线程的 CPU 绑定，析构时恢复
+ *
+ * 新线程继承创建者的 CPU 绑定，第三方库 (libdatachannel) 在此作用域内创建的线程
+ * 因此落在指定的 CPU 上，而调用线程本身的设置不受影响。
+ */
+class ScopedThreadAffinity {
+public:
+    explicit ScopedThreadAffinity(const std::vector<int>& cpus) {
+        if (cpus.empty()) return;
+#if defined(_WIN32)
+        DWORD_PTR mask = 0;
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < static_cast<int>(sizeof(DWORD_PTR) * 8)) mask |= DWORD_PTR(1) << cpu;
+        }
+        previous_ = mask ? SetThreadAffinityMask(GetCurrentThread(), mask) : 0;
+        applied_ = previous_ != 0;
+#elif defined(__linux__)
+        if (pthread_getaffinity_np(pthread_self(), sizeof(previous_), &previous_) == 0) {
+            applied_ = setCurrentThreadAffinity(cpus);
+        }
+#endif
+    }
+
+    ~ScopedThreadAffinity() {
+        if (!applied_) return;
+#if defined(_WIN32)
+        SetThreadAffinityMask(GetCurrentThread(), previous_);
+#elif defined(__linux__)
+        pthread_setaffinity_np(pthread_self(), sizeof(previous_), &previous_);
+#endif
+    }
+
+    ScopedThreadAffinity(const ScopedThreadAffinity&) = delete;
+    ScopedThreadAffinity& operator=(const ScopedThreadAffinity&) = delete;
+
+    bool applied() const { return applied_; }
+
+private:
+    bool applied_ = false;
+#if defined(_WIN32)
+    DWORD_PTR previous_ = 0;
+#elif defined(__linux__)
+    cpu_set_t previous_;
+#endif
+};
+
+/**
+ * 线程启动时调用：设置名字和 CPU 绑定
+ */
+inline void configureCurrentThread(const std::string& name, const std::vector<int>& cpus) {
+    if (!name.empty()) setCurrentThreadName(name);
+    setCurrentThreadAffinity(cpus);
+}
+
+} // namespace p2p
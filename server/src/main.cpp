@@ -1,27 +1,74 @@
 // server/src/main.cpp
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
-#include <set>
+#include <map>
 #include <mutex>
 #include <memory>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <random>
 
 #include <rtc/rtc.hpp>
 #include <nlohmann/json.hpp>
 
 #include "protocol.hpp"
+#include "message_arena.hpp"
+#include "rate_limiter.hpp"
+#include "traffic_stats.hpp"
+#include "thread_affinity.hpp"
 
 using json = nlohmann::json;
 
+// 客户端的中继流量：计数器在锁外累加，会话恢复时随会话沿用
+struct ClientTraffic {
+    std::shared_ptr<TrafficWindow> relaySent = std::make_shared<TrafficWindow>();      // 经中继发出的流量
+    std::shared_ptr<TrafficWindow> relayReceived = std::make_shared<TrafficWindow>();  // 经中继收到的流量
+};
+
 // 客户端信息
 struct ClientInfo {
     std::shared_ptr<rtc::WebSocket> ws;
     std::string id;
     bool relayAuthenticated = false;
+    uint32_t protocolVersion = p2p::kProtocolVersionStringPayload;  // Register 时协商
+    std::string sessionToken;     // 协议版本 3：断线后凭此令牌恢复会话
+    std::shared_ptr<ClientRateLimiter> limiter;  // 与连接回调共享
+    ClientTraffic traffic;
+    
+    // 网关模式 (协议版本 4)：虚拟 ID 与注册它的主 ID 共用连接，主 ID 断开时一并注销
+    std::string owner;                          // 虚拟 ID 所属的主 ID，主 ID 本身为空
+    std::unordered_set<std::string> virtualIds; // 主 ID 在同一连接上注册的虚拟 ID
+};
+
+// 断线后保留中继连接对、等待重连的客户端
+struct DetachedClient {
+    std::string sessionToken;
+    bool relayAuthenticated = false;
+    uint32_t protocolVersion = p2p::kProtocolVersionStringPayload;
+    ClientTraffic traffic;
+    std::chrono::steady_clock::time_point expiresAt;
+};
+
+// 中继连接对的无序键：两个 ID 按字典序排列，查找时不复制字符串
+struct RelayPairKey {
+    std::string_view first;
+    std::string_view second;
+    
+    RelayPairKey(std::string_view a, std::string_view b)
+        : first(std::min(a, b)), second(std::max(a, b)) {}
+    
+    bool operator<(const RelayPairKey& other) const {
+        return std::tie(first, second) < std::tie(other.first, other.second);
+    }
 };
 
 // 中继连接对（用于快速查找）
@@ -37,13 +84,13 @@ struct RelayPair {
         return (peer1 == id) ? peer2 : peer1;
     }
     
+    RelayPairKey key() const {
+        return RelayPairKey(peer1, peer2);
+    }
+    
     // 用于 set 排序
     bool operator<(const RelayPair& other) const {
-        auto a1 = std::min(peer1, peer2);
-        auto a2 = std::max(peer1, peer2);
-        auto b1 = std::min(other.peer1, other.peer2);
-        auto b2 = std::max(other.peer1, other.peer2);
-        return std::tie(a1, a2) < std::tie(b1, b2);
+        return key() < other.key();
     }
     
     bool operator==(const RelayPair& other) const {
@@ -52,13 +99,66 @@ struct RelayPair {
     }
 };
 
+// 支持用 RelayPairKey 直接查找的比较器
+struct RelayPairLess {
+    using is_transparent = void;
+    
+    static RelayPairKey toKey(const RelayPair& pair) { return pair.key(); }
+    static const RelayPairKey& toKey(const RelayPairKey& key) { return key; }
+    
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const {
+        return toKey(a) < toKey(b);
+    }
+};
+
+// 单条消息的处理上下文 (分发表中所有处理函数的统一参数)
+struct MessageContext {
+    std::shared_ptr<rtc::WebSocket> ws;
+    std::string& clientId;     // 连接的主 ID (Register 时写入)
+    std::string_view from;     // 消息声明的发送者，网关连接上为虚拟 ID，由 senderId() 校验
+    std::shared_ptr<ClientRateLimiter> limiter;
+    size_t wireSize;       // 原始消息字节数
+    MessageArena& arena;   // 本条消息的临时分配，处理完后复位
+};
+
+// 中继连接对的运行时状态
+struct RelayPairState {
+    RateLimiter limiter;
+    uint64_t throttledMsgs = 0;
+    std::shared_ptr<TrafficWindow> traffic = std::make_shared<TrafficWindow>();  // 两个方向合计，在锁外累加
+};
+
+// top 视图中的一行
+struct TrafficRow {
+    std::string label;
+    TrafficWindow::Totals shortWindow;
+    TrafficWindow::Totals longWindow;
+    TrafficWindow::Totals total;
+};
+
 class SignalingServer {
 public:
-    SignalingServer(uint16_t port) : port_(port) {
+    SignalingServer(uint16_t port, const std::vector<std::pair<std::string, std::string>>& overrides = {})
+        : port_(port) {
         loadEnvFile();
+        // 命令行参数优先于 .env
+        for (const auto& [key, value] : overrides) {
+            applySetting(key, value);
+        }
     }
     
     void run() {
+        // libdatachannel 的线程池与 I/O 线程 (处理全部客户端消息) 在首次初始化时创建并继承 CPU 绑定
+        if (!networkCpus_.empty()) {
+            p2p::ScopedThreadAffinity affinity(networkCpus_);
+            if (!affinity.applied()) {
+                std::cerr << "[Server] Cannot pin network threads to CPUs " << p2p::formatCpuList(networkCpus_) << std::endl;
+            }
+            rtc::Preload();
+            std::cout << "[Server] Network threads pinned to CPUs " << p2p::formatCpuList(networkCpus_) << std::endl;
+        }
+        
         rtc::WebSocketServer::Configuration config;
         config.port = port_;
         config.enableTls = false;
@@ -69,21 +169,32 @@ public:
             std::cout << "[Server] New client connected" << std::endl;
             
             auto clientId = std::make_shared<std::string>();
+            auto limiter = std::make_shared<ClientRateLimiter>(rateLimits_);
             
             ws->onOpen([this, ws, clientId]() {
                 std::cout << "[Server] WebSocket opened" << std::endl;
             });
             
-            ws->onMessage([this, ws, clientId](auto message) {
+            ws->onMessage([this, ws, clientId, limiter](auto message) {
                 if (std::holds_alternative<std::string>(message)) {
-                    handleMessage(ws, *clientId, std::get<std::string>(message));
+                    const auto& msgStr = std::get<std::string>(message);
+                    // 解析前先按连接限流，被限流的消息不做任何 JSON 处理
+                    if (uint32_t retryAfter = limiter->admit(msgStr.size())) {
+                        ++throttledTotal_;
+                        if (limiter->shouldNotify()) {
+                            // 连接级通知发给连接的主 ID，网关客户端再分发给所有虚拟 ID
+                            sendThrottled(ws, *clientId, "client", retryAfter);
+                        }
+                        return;
+                    }
+                    handleMessage(ws, *clientId, limiter, msgStr);
                 }
             });
             
-            ws->onClosed([this, clientId]() {
+            ws->onClosed([this, ws, clientId]() {
                 if (!clientId->empty()) {
                     std::cout << "[Server] Client disconnected: " << *clientId << std::endl;
-                    removeClient(*clientId);
+                    removeClient(*clientId, ws);
                 }
             });
             
@@ -95,6 +206,10 @@ public:
         std::cout << "[Server] Signaling server started on port " << port_ << std::endl;
         std::cout << "[Server] Relay password: " << (relayPassword_.empty() ? "(not set)" : "(configured)") << std::endl;
         
+        if (metricsInterval_ > 0 || relayGracePeriod_ > 0) {
+            startMaintenanceThread();
+        }
+        
         // 保持运行
         std::string line;
         while (std::getline(std::cin, line)) {
@@ -104,12 +219,21 @@ public:
                 listClients();
             } else if (line == "relay") {
                 listRelayConnections();
+            } else if (line == "limits") {
+                showRateLimits();
+            } else if (line == "top" || line.rfind("top ", 0) == 0) {
+                size_t count = 10;
+                try {
+                    if (line.size() > 4) count = std::stoul(line.substr(4));
+                } catch (...) {}
+                showTopTalkers(count);
             } else if (line == "help") {
-                std::cout << "Commands: list, relay, quit" << std::endl;
+                std::cout << "Commands: list, relay, limits, top [n], quit" << std::endl;
             }
         }
         
         std::cout << "[Server] Shutting down..." << std::endl;
+        stopMaintenanceThread();
     }
     
 private:
@@ -152,66 +276,103 @@ private:
                 value = value.substr(0, value.size() - 1);
             }
             
-            if (key == "RELAY_PASSWORD") {
-                relayPassword_ = value;
-                std::cout << "[Server] Relay password loaded from .env" << std::endl;
+            applySetting(key, value);
+        }
+    }
+    
+    // 应用单个配置项 (.env 与命令行共用)
+    void applySetting(const std::string& key, const std::string& value) {
+        if (key == "RELAY_PASSWORD") {
+            relayPassword_ = value;
+            std::cout << "[Server] Relay password configured" << std::endl;
+            return;
+        }
+        if (key == "NETWORK_CPUS" || key == "MAINTENANCE_CPUS") {
+            auto cpus = p2p::parseCpuList(value);
+            if (cpus.empty() && !value.empty()) {
+                std::cerr << "[Server] Invalid value for " << key << ": " << value << std::endl;
+                return;
             }
+            (key == "NETWORK_CPUS" ? networkCpus_ : maintenanceCpus_) = std::move(cpus);
+            return;
+        }
+        
+        double* target = nullptr;
+        if (key == "RATE_LIMIT_CLIENT_MSGS") target = &rateLimits_.clientMsgsPerSec;
+        else if (key == "RATE_LIMIT_CLIENT_BYTES") target = &rateLimits_.clientBytesPerSec;
+        else if (key == "RATE_LIMIT_RELAY_MSGS") target = &rateLimits_.relayMsgsPerSec;
+        else if (key == "RATE_LIMIT_RELAY_BYTES") target = &rateLimits_.relayBytesPerSec;
+        else if (key == "RATE_LIMIT_BURST") target = &rateLimits_.burstSeconds;
+        else if (key == "METRICS_INTERVAL") target = &metricsInterval_;
+        else if (key == "RELAY_GRACE_PERIOD") target = &relayGracePeriod_;
+        else if (key == "GATEWAY_MAX_IDS") target = &maxVirtualIds_;
+        
+        if (!target) {
+            // .env 可能与其他程序共用，只提示看起来像本服务配置 (多半是拼写错误) 的键
+            for (const char* prefix : {"RATE_LIMIT_", "RELAY_", "GATEWAY_", "METRICS_"}) {
+                if (key.rfind(prefix, 0) == 0) {
+                    std::cerr << "[Server] Unknown setting: " << key << std::endl;
+                    break;
+                }
+            }
+            return;
+        }
+        try {
+            *target = std::max(0.0, std::stod(value));
+        } catch (...) {
+            std::cerr << "[Server] Invalid value for " << key << ": " << value << std::endl;
         }
     }
     
-    void handleMessage(std::shared_ptr<rtc::WebSocket> ws, std::string& clientId, 
+    void handleMessage(std::shared_ptr<rtc::WebSocket> ws, std::string& clientId,
+                       const std::shared_ptr<ClientRateLimiter>& limiter,
                        const std::string& msgStr) {
+        using Handler = void (SignalingServer::*)(MessageContext&, const p2p::PmrSignalingMessage&);
+        static constexpr auto kHandlers = p2p::MessageDispatchTable<Handler>()
+            .on(p2p::MessageType::Register, &SignalingServer::handleRegister)
+            .on(p2p::MessageType::PeerList, &SignalingServer::handlePeerList)
+            .on(p2p::MessageType::Offer, &SignalingServer::handleSignaling)
+            .on(p2p::MessageType::Answer, &SignalingServer::handleSignaling)
+            .on(p2p::MessageType::Candidate, &SignalingServer::handleSignaling)
+            .on(p2p::MessageType::RelayAuth, &SignalingServer::handleRelayAuth)
+            .on(p2p::MessageType::RelayConnect, &SignalingServer::handleRelayConnect)
+            .on(p2p::MessageType::RelayData, &SignalingServer::handleRelayData)
+            .on(p2p::MessageType::RelayDisconnect, &SignalingServer::handleRelayDisconnect)
+            .on(p2p::MessageType::Attach, &SignalingServer::handleAttach)
+            .on(p2p::MessageType::Detach, &SignalingServer::handleDetach);
+        
+        // 解析出的字段和转发用的序列化缓冲区都分配在本线程的 arena 中，返回时整体复位
+        MessageArena& arena = MessageArena::local();
+        MessageArena::Scope arenaScope(arena);
+        
         try {
-            auto msg = p2p::SignalingMessage::deserialize(msgStr);
+            auto msg = p2p::PmrSignalingMessage::deserialize(msgStr, arena.allocator<char>());
             
-            switch (msg.type) {
-                case p2p::MessageType::Register:
-                    handleRegister(ws, clientId, msg);
-                    break;
-                    
-                case p2p::MessageType::PeerList:
-                    handlePeerList(ws, clientId);
-                    break;
-                    
-                case p2p::MessageType::Offer:
-                case p2p::MessageType::Answer:
-                case p2p::MessageType::Candidate:
-                    handleSignaling(clientId, msg);
-                    break;
-                    
-                case p2p::MessageType::RelayAuth:
-                    handleRelayAuth(ws, clientId, msg);
-                    break;
-                    
-                case p2p::MessageType::RelayConnect:
-                    handleRelayConnect(clientId, msg);
-                    break;
-                    
-                case p2p::MessageType::RelayData:
-                    handleRelayData(clientId, msg);
-                    break;
-                    
-                case p2p::MessageType::RelayDisconnect:
-                    handleRelayDisconnect(clientId, msg);
-                    break;
-                    
-                default:
-                    break;
+            if (Handler handler = kHandlers[msg.type]) {
+                std::string_view from = msg.type == p2p::MessageType::Register ? std::string_view() : msg.from;
+                MessageContext ctx{ws, clientId, from, limiter, msgStr.size(), arena};
+                (this->*handler)(ctx, msg);
             }
         } catch (const std::exception& e) {
             std::cerr << "[Server] Error handling message: " << e.what() << std::endl;
         }
     }
     
-    void handleRegister(std::shared_ptr<rtc::WebSocket> ws, std::string& clientId, 
-                        const p2p::SignalingMessage& msg) {
+    void handleRegister(MessageContext& ctx, const p2p::PmrSignalingMessage& msg) {
         std::lock_guard<std::mutex> lock(mutex_);
+        std::string& clientId = ctx.clientId;
         
-        std::string requestedId = msg.payload;
+        std::string requestedId(msg.payload);
+        uint32_t protocolVersion = std::clamp(msg.version, p2p::kProtocolVersionStringPayload, p2p::kProtocolVersion);
         
-        // 如果请求特定ID，检查是否可用
+        // 携带会话令牌时先尝试恢复原会话 (ID、中继认证和中继连接对)
+        if (!msg.session.empty() && resumeSession(ctx, requestedId, msg.session, protocolVersion)) {
+            return;
+        }
+        
+        // 如果请求特定ID，检查是否可用 (等待重连的 ID 也视为占用)
         if (!requestedId.empty()) {
-            if (clients_.count(requestedId)) {
+            if (clients_.count(requestedId) || detachedClients_.count(requestedId)) {
                 // ID已被使用，生成新ID
                 clientId = generateClientId();
             } else {
@@ -222,61 +383,198 @@ private:
         }
         
         ClientInfo info;
-        info.ws = ws;
+        info.ws = ctx.ws;
         info.id = clientId;
         info.relayAuthenticated = false;
+        info.protocolVersion = protocolVersion;
+        info.limiter = ctx.limiter;
+        if (supportsSessionResume(info)) {
+            info.sessionToken = generateSessionToken();
+        }
         clients_[clientId] = info;
         
-        std::cout << "[Server] Client registered: " << clientId << std::endl;
+        std::cout << "[Server] Client registered: " << clientId
+                  << " (protocol v" << info.protocolVersion << ")" << std::endl;
+        
+        sendRegisterResponse(ctx.ws, info, msg.version != 0);
+    }
+    
+    // 凭令牌恢复会话：断线后在宽限期内重连，或旧连接尚未被检测到断开时由新连接接管
+    bool resumeSession(MessageContext& ctx, const std::string& id, std::string_view token, uint32_t protocolVersion) {
+        ClientInfo info;
+        auto detachedIt = detachedClients_.find(id);
+        auto clientIt = clients_.find(id);
+        if (detachedIt != detachedClients_.end() && detachedIt->second.sessionToken == token) {
+            info.relayAuthenticated = detachedIt->second.relayAuthenticated;
+            info.traffic = std::move(detachedIt->second.traffic);
+            detachedClients_.erase(detachedIt);
+        } else if (clientIt != clients_.end() && clientIt->second.sessionToken == token) {
+            removeVirtualIds(clientIt->second);
+            info = std::move(clientIt->second);
+            if (info.ws && info.ws != ctx.ws) {
+                info.ws->close();  // 旧连接的 onClosed 发现 ws 不匹配，不会移除新会话
+            }
+        } else {
+            return false;
+        }
+        
+        ctx.clientId = id;
+        info.ws = ctx.ws;
+        info.id = id;
+        info.protocolVersion = protocolVersion;
+        info.sessionToken = std::string(token);
+        info.limiter = ctx.limiter;
+        clients_[id] = std::move(info);
         
-        // 发送注册确认
+        std::cout << "[Server] Client resumed session: " << id << std::endl;
+        sendRegisterResponse(ctx.ws, clients_[id], true);
+        return true;
+    }
+    
+    // 发送注册确认 (旧客户端不发送 version，也不会收到 version 和会话令牌)
+    void sendRegisterResponse(const std::shared_ptr<rtc::WebSocket>& ws, const ClientInfo& info, bool withVersion) {
         p2p::SignalingMessage response;
         response.type = p2p::MessageType::Register;
-        response.payload = clientId;
+        response.payload = info.id;
+        if (withVersion) {
+            response.version = info.protocolVersion;
+            response.session = info.sessionToken;
+        }
         ws->send(response.serialize());
     }
     
-    void handlePeerList(std::shared_ptr<rtc::WebSocket> ws, const std::string& clientId) {
+    // 网关在已注册的连接上注册虚拟 ID：payload 为 {"id": 请求的 ID, "tag": 请求编号}，
+    // 回复 Attach {"id": 分配的 ID, "tag": 请求编号} 或 {"tag": 请求编号, "error": 原因}
+    void handleAttach(MessageContext& ctx, const p2p::PmrSignalingMessage& msg) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        json request = json::parse(msg.payload.begin(), msg.payload.end());
+        json response = {{"tag", request.value("tag", 0)}};
+        std::string requestedId = request.value("id", "");
+        const std::string& fromId = senderId(ctx);
+        
+        auto ownerIt = clients_.find(fromId);
+        if (ownerIt == clients_.end() || ownerIt->second.ws != ctx.ws || !ownerIt->second.owner.empty()) {
+            response["error"] = "Not registered";
+        } else if (ownerIt->second.protocolVersion < p2p::kProtocolVersionMultiplex) {
+            response["error"] = "Gateway mode requires protocol v" + std::to_string(p2p::kProtocolVersionMultiplex);
+        } else if (ownerIt->second.virtualIds.size() >= static_cast<size_t>(maxVirtualIds_)) {
+            response["error"] = "Too many virtual ids on this connection";
+        } else {
+            std::string id = requestedId;
+            if (id.empty() || clients_.count(id) || detachedClients_.count(id)) {
+                id = generateClientId();
+            }
+            
+            ClientInfo info;
+            info.ws = ctx.ws;
+            info.id = id;
+            info.protocolVersion = ownerIt->second.protocolVersion;
+            info.limiter = ctx.limiter;  // 限流在解析前按连接进行，配额随连接上的 ID 数放大
+            info.owner = ownerIt->first;
+            ownerIt->second.virtualIds.insert(id);
+            updateConnectionBudget(ownerIt->second);
+            clients_[id] = std::move(info);
+            response["id"] = id;
+        }
+        
+        p2p::SignalingMessage reply;
+        reply.type = p2p::MessageType::Attach;
+        reply.to = fromId;
+        reply.setJsonPayload(response.dump(), true);
+        ctx.ws->send(reply.serialize());
+    }
+    
+    // 注销虚拟 ID (由 from 指明)，其中继连接对的另一端收到 RelayDisconnect
+    void handleDetach(MessageContext& ctx, const p2p::PmrSignalingMessage&) {
         std::lock_guard<std::mutex> lock(mutex_);
+        auto it = clients_.find(senderId(ctx));
+        if (it == clients_.end() || it->second.owner.empty() || it->second.ws != ctx.ws) {
+            return;
+        }
+        const std::string& id = it->first;
+        auto ownerIt = clients_.find(it->second.owner);
+        if (ownerIt != clients_.end()) {
+            ownerIt->second.virtualIds.erase(id);
+            updateConnectionBudget(ownerIt->second);
+        }
+        removeRelayPairs(id);
+        clients_.erase(it);
+    }
+    
+    // 注销主 ID 在其连接上注册的全部虚拟 ID (调用方需持有 mutex_)
+    void removeVirtualIds(ClientInfo& owner) {
+        for (const auto& id : owner.virtualIds) {
+            removeRelayPairs(id);
+            clients_.erase(id);
+        }
+        owner.virtualIds.clear();
+        updateConnectionBudget(owner);
+    }
+    
+    // 连接限流配额 = 单客户端配额 × (1 + 虚拟 ID 数)
+    void updateConnectionBudget(ClientInfo& owner) {
+        if (owner.limiter) {
+            owner.limiter->setEndpoints(1 + owner.virtualIds.size());
+        }
+    }
+    
+    // 本条消息的发送者 (调用方需持有 mutex_)：网关连接上的消息以 from 指明虚拟 ID，
+    // from 不是该连接当前注册的虚拟 ID 时按连接的主 ID 处理。
+    // 在处理函数自己的临界区内解析，校验之后该 ID 不会被注销或转给其他连接
+    const std::string& senderId(const MessageContext& ctx) {
+        if (!ctx.from.empty() && ctx.from != ctx.clientId) {
+            auto it = findClient(ctx.from);
+            if (it != clients_.end() && !it->second.owner.empty() && it->second.ws == ctx.ws) {
+                return it->first;
+            }
+        }
+        return ctx.clientId;
+    }
+    
+    void handlePeerList(MessageContext& ctx, const p2p::PmrSignalingMessage&) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const std::string& fromId = senderId(ctx);
         
         json peers = json::array();
         for (const auto& [id, info] : clients_) {
-            if (id != clientId) {
+            if (id != fromId) {
                 peers.push_back(id);
             }
         }
         
         p2p::SignalingMessage response;
         response.type = p2p::MessageType::PeerList;
-        response.payload = peers.dump();
-        ws->send(response.serialize());
+        response.to = fromId;
+        response.setJsonPayload(peers.dump(), supportsNestedPayload(fromId));
+        ctx.ws->send(response.serialize());
     }
     
-    void handleSignaling(const std::string& fromId, const p2p::SignalingMessage& msg) {
+    void handleSignaling(MessageContext& ctx, const p2p::PmrSignalingMessage& msg) {
         std::lock_guard<std::mutex> lock(mutex_);
+        const std::string& fromId = senderId(ctx);
         
-        auto it = clients_.find(msg.to);
+        auto it = findClient(msg.to);
         if (it != clients_.end()) {
-            p2p::SignalingMessage fwdMsg = msg;
-            fwdMsg.from = fromId;
-            it->second.ws->send(fwdMsg.serialize());
+            forwardMessage(ctx, fromId, it->second, msg);
         } else {
             // 目标不存在，发送错误
             auto clientIt = clients_.find(fromId);
             if (clientIt != clients_.end()) {
                 p2p::SignalingMessage errorMsg;
                 errorMsg.type = p2p::MessageType::Error;
-                errorMsg.payload = "Peer not found: " + msg.to;
+                errorMsg.to = fromId;
+                errorMsg.payload = "Peer not found: " + std::string(msg.to);
                 clientIt->second.ws->send(errorMsg.serialize());
             }
         }
     }
     
-    void handleRelayAuth(std::shared_ptr<rtc::WebSocket> ws, const std::string& clientId,
-                         const p2p::SignalingMessage& msg) {
+    void handleRelayAuth(MessageContext& ctx, const p2p::PmrSignalingMessage& msg) {
         std::lock_guard<std::mutex> lock(mutex_);
+        const std::string& clientId = senderId(ctx);
         
-        std::string providedPassword = msg.payload;
+        std::string_view providedPassword = msg.payload;
         bool success = false;
         std::string message;
         
@@ -301,15 +599,17 @@ private:
         
         p2p::SignalingMessage response;
         response.type = p2p::MessageType::RelayAuthResult;
-        response.payload = json({
+        response.to = clientId;
+        response.setJsonPayload(json({
             {"success", success},
             {"message", message}
-        }).dump();
-        ws->send(response.serialize());
+        }).dump(), supportsNestedPayload(clientId));
+        ctx.ws->send(response.serialize());
     }
     
-    void handleRelayConnect(const std::string& fromId, const p2p::SignalingMessage& msg) {
+    void handleRelayConnect(MessageContext& ctx, const p2p::PmrSignalingMessage& msg) {
         std::lock_guard<std::mutex> lock(mutex_);
+        const std::string& fromId = senderId(ctx);
         
         // 检查发送者是否已认证
         auto fromIt = clients_.find(fromId);
@@ -319,72 +619,108 @@ private:
         }
         
         // 检查目标是否存在
-        auto toIt = clients_.find(msg.to);
+        auto toIt = findClient(msg.to);
         if (toIt == clients_.end()) {
-            sendError(fromId, "Peer not found: " + msg.to);
+            sendError(fromId, "Peer not found: " + std::string(msg.to));
             return;
         }
         
         // 建立中继连接对
-        RelayPair pair{fromId, msg.to};
-        relayConnections_.insert(pair);
+        if (!relayConnections_.count(RelayPairKey(fromId, msg.to))) {
+            RelayPairState state;
+            state.limiter = RateLimiter(rateLimits_.relayMsgsPerSec, rateLimits_.relayBytesPerSec,
+                                        rateLimits_.burstSeconds);
+            relayConnections_.emplace(RelayPair{fromId, std::string(msg.to)}, std::move(state));
+        }
         
         // 通知目标客户端有新的中继连接
         p2p::SignalingMessage notifyMsg;
         notifyMsg.type = p2p::MessageType::RelayConnect;
         notifyMsg.from = fromId;
-        notifyMsg.to = msg.to;
+        notifyMsg.to = std::string(msg.to);
+        // 原样转发 payload (客户端的压缩协商信息)
+        notifyMsg.payload = std::string(msg.payload);
+        notifyMsg.payloadIsJson = msg.payloadIsJson && supportsNestedPayload(toIt->second);
         toIt->second.ws->send(notifyMsg.serialize());
         
         std::cout << "[Server] Relay connection established: " << fromId << " <-> " << msg.to << std::endl;
     }
     
-    void handleRelayData(const std::string& fromId, const p2p::SignalingMessage& msg) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        
-        // 检查是否存在中继连接（不再检查发送者是否认证！）
-        RelayPair pair{fromId, msg.to};
-        bool hasRelayConnection = false;
-        
-        for (const auto& conn : relayConnections_) {
-            if (conn == pair) {
-                hasRelayConnection = true;
-                break;
+    void handleRelayData(MessageContext& ctx, const p2p::PmrSignalingMessage& msg) {
+        size_t wireSize = ctx.wireSize;
+        // 流量计数器在锁内取出、释放锁后累加 (计数器为原子操作，读取方自行汇总)
+        std::shared_ptr<TrafficWindow> pairTraffic;
+        std::shared_ptr<TrafficWindow> receiverTraffic;
+        std::shared_ptr<TrafficWindow> senderTraffic;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const std::string& fromId = senderId(ctx);
+            
+            // 检查是否存在中继连接（不再检查发送者是否认证！）
+            auto pairIt = relayConnections_.find(RelayPairKey(fromId, msg.to));
+            if (pairIt == relayConnections_.end()) {
+                sendError(fromId, "No relay connection with " + std::string(msg.to));
+                return;
             }
+            
+            // 按中继对限流 (两个方向共享配额)
+            if (uint32_t retryAfter = pairIt->second.limiter.admit(wireSize, TokenBucket::Clock::now())) {
+                ++pairIt->second.throttledMsgs;
+                ++throttledTotal_;
+                auto fromIt = clients_.find(fromId);
+                if (fromIt != clients_.end() && fromIt->second.limiter && fromIt->second.limiter->shouldNotify()) {
+                    sendThrottled(fromIt->second.ws, fromId, "relay", retryAfter, std::string(msg.to));
+                }
+                return;
+            }
+            
+            // 转发数据到目标
+            auto toIt = findClient(msg.to);
+            if (toIt == clients_.end()) {
+                // 目标断线等待重连：静默丢弃，发送端在对方恢复后从重传缓冲区重发
+                if (detachedClients_.count(std::string(msg.to))) {
+                    ++droppedWhileDetached_;
+                    return;
+                }
+                sendError(fromId, "Peer not found: " + std::string(msg.to));
+                return;
+            }
+            
+            pairTraffic = pairIt->second.traffic;
+            receiverTraffic = toIt->second.traffic.relayReceived;
+            auto fromIt = clients_.find(fromId);
+            if (fromIt != clients_.end()) {
+                senderTraffic = fromIt->second.traffic.relaySent;
+            }
+            
+            forwardMessage(ctx, fromId, toIt->second, msg);
         }
         
-        if (!hasRelayConnection) {
-            sendError(fromId, "No relay connection with " + msg.to);
-            return;
-        }
-        
-        // 转发数据到目标
-        auto toIt = clients_.find(msg.to);
-        if (toIt == clients_.end()) {
-            sendError(fromId, "Peer not found: " + msg.to);
-            return;
+        int64_t nowSec = TrafficWindow::nowSeconds();
+        pairTraffic->add(wireSize, nowSec);
+        receiverTraffic->add(wireSize, nowSec);
+        if (senderTraffic) {
+            senderTraffic->add(wireSize, nowSec);
         }
-        
-        // 转发消息
-        p2p::SignalingMessage fwdMsg = msg;
-        fwdMsg.from = fromId;
-        toIt->second.ws->send(fwdMsg.serialize());
     }
     
-    void handleRelayDisconnect(const std::string& fromId, const p2p::SignalingMessage& msg) {
+    void handleRelayDisconnect(MessageContext& ctx, const p2p::PmrSignalingMessage& msg) {
         std::lock_guard<std::mutex> lock(mutex_);
+        const std::string& fromId = senderId(ctx);
         
         // 移除中继连接对
-        RelayPair pair{fromId, msg.to};
-        relayConnections_.erase(pair);
+        auto pairIt = relayConnections_.find(RelayPairKey(fromId, msg.to));
+        if (pairIt != relayConnections_.end()) {
+            relayConnections_.erase(pairIt);
+        }
         
         // 通知目标客户端中继连接断开
-        auto toIt = clients_.find(msg.to);
+        auto toIt = findClient(msg.to);
         if (toIt != clients_.end()) {
             p2p::SignalingMessage notifyMsg;
             notifyMsg.type = p2p::MessageType::RelayDisconnect;
             notifyMsg.from = fromId;
-            notifyMsg.to = msg.to;
+            notifyMsg.to = std::string(msg.to);
             toIt->second.ws->send(notifyMsg.serialize());
         }
         
@@ -396,17 +732,104 @@ private:
         if (it != clients_.end()) {
             p2p::SignalingMessage errorMsg;
             errorMsg.type = p2p::MessageType::Error;
+            errorMsg.to = clientId;
             errorMsg.payload = message;
             it->second.ws->send(errorMsg.serialize());
         }
     }
     
-    void removeClient(const std::string& clientId) {
+    // 转发消息：from 替换为发送者 ID，直接在 arena 中序列化，不复制消息
+    // 接收方只支持版本 1 时把嵌套 payload 转回字符串；会话令牌不转发
+    void forwardMessage(MessageContext& ctx, const std::string& fromId, const ClientInfo& receiver,
+                        const p2p::PmrSignalingMessage& msg) {
+        std::pmr::string out(ctx.arena.allocator<char>());
+        p2p::writeSignalingMessage(out, msg.type, fromId, msg.to, msg.payload,
+                                   msg.payloadIsJson && supportsNestedPayload(receiver), msg.version);
+        // libdatachannel 的发送队列需要持有独立的 std::string，这是每条转发消息唯一的堆分配
+        receiver.ws->send(std::string(out.data(), out.size()));
+    }
+    
+    // 用 string_view 查找客户端；C++17 的 unordered_map 不支持异构查找，
+    // 借助线程本地的键缓冲区避免每次构造 std::string (调用方需持有 mutex_)
+    std::unordered_map<std::string, ClientInfo>::iterator findClient(std::string_view id) {
+        thread_local std::string key;
+        key.assign(id.data(), id.size());
+        return clients_.find(key);
+    }
+    
+    static bool supportsNestedPayload(const ClientInfo& info) {
+        return info.protocolVersion >= p2p::kProtocolVersionNestedPayload;
+    }
+    
+    static bool supportsSessionResume(const ClientInfo& info) {
+        return info.protocolVersion >= p2p::kProtocolVersionSessionResume;
+    }
+    
+    // 调用方需持有 mutex_
+    bool supportsNestedPayload(const std::string& clientId) const {
+        auto it = clients_.find(clientId);
+        return it != clients_.end() && supportsNestedPayload(it->second);
+    }
+    
+    // 发送限流通知，客户端据此退避；中继对限流时 peer 为对端 ID，客户端据此提前重发被丢弃的可靠中继消息
+    void sendThrottled(const std::shared_ptr<rtc::WebSocket>& ws, const std::string& to, const std::string& scope,
+                       uint32_t retryAfterMs, const std::string& peer = "") {
+        p2p::SignalingMessage notice;
+        notice.type = p2p::MessageType::Throttled;
+        notice.to = to;
+        json payload = {
+            {"scope", scope},
+            {"retry_after_ms", retryAfterMs}
+        };
+        if (!peer.empty()) {
+            payload["peer"] = peer;
+        }
+        notice.payload = payload.dump();
+        try {
+            ws->send(notice.serialize());
+        } catch (const std::exception& e) {
+            std::cerr << "[Server] Failed to send throttle notice: " << e.what() << std::endl;
+        }
+    }
+    
+    void removeClient(const std::string& clientId, const std::shared_ptr<rtc::WebSocket>& ws) {
         std::lock_guard<std::mutex> lock(mutex_);
         
-        // 清理该客户端的所有中继连接
+        // 会话已被新连接接管
+        auto it = clients_.find(clientId);
+        if (it == clients_.end() || it->second.ws != ws) {
+            return;
+        }
+        
+        // 虚拟 ID 不恢复会话，随连接一起注销
+        removeVirtualIds(it->second);
+        
+        // 支持会话恢复的客户端在宽限期内保留中继连接对，等待重连
+        bool hasRelayPairs = std::any_of(relayConnections_.begin(), relayConnections_.end(),
+            [&clientId](const auto& entry) { return entry.first.contains(clientId); });
+        if (hasRelayPairs && relayGracePeriod_ > 0 && supportsSessionResume(it->second)) {
+            DetachedClient detached;
+            detached.sessionToken = it->second.sessionToken;
+            detached.relayAuthenticated = it->second.relayAuthenticated;
+            detached.protocolVersion = it->second.protocolVersion;
+            detached.traffic = it->second.traffic;
+            detached.expiresAt = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(static_cast<int64_t>(relayGracePeriod_ * 1000));
+            detachedClients_[clientId] = std::move(detached);
+            clients_.erase(it);
+            std::cout << "[Server] Holding relay pairs of " << clientId
+                      << " for " << relayGracePeriod_ << "s" << std::endl;
+            return;
+        }
+        
+        removeRelayPairs(clientId);
+        clients_.erase(it);
+    }
+    
+    // 清理该客户端的所有中继连接并通知另一端 (调用方需持有 mutex_)
+    void removeRelayPairs(const std::string& clientId) {
         std::vector<RelayPair> toRemove;
-        for (const auto& conn : relayConnections_) {
+        for (const auto& [conn, state] : relayConnections_) {
             if (conn.contains(clientId)) {
                 toRemove.push_back(conn);
                 
@@ -426,8 +849,21 @@ private:
         for (const auto& conn : toRemove) {
             relayConnections_.erase(conn);
         }
-        
-        clients_.erase(clientId);
+    }
+    
+    // 宽限期已过仍未重连的客户端：拆除中继连接对
+    void expireDetachedClients() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = detachedClients_.begin(); it != detachedClients_.end();) {
+            if (it->second.expiresAt <= now) {
+                std::cout << "[Server] Session expired: " << it->first << std::endl;
+                removeRelayPairs(it->first);
+                it = detachedClients_.erase(it);
+            } else {
+                ++it;
+            }
+        }
     }
     
     std::string generateClientId() {
@@ -435,44 +871,268 @@ private:
         return "peer_" + std::to_string(++counter);
     }
     
+    // 128 位随机会话令牌 (调用方需持有 mutex_)
+    std::string generateSessionToken() {
+        static constexpr char kHex[] = "0123456789abcdef";
+        std::string token;
+        token.reserve(32);
+        for (int i = 0; i < 2; ++i) {
+            uint64_t bits = (static_cast<uint64_t>(sessionRandom_()) << 32) | sessionRandom_();
+            for (int j = 0; j < 16; ++j) {
+                token += kHex[bits & 0xf];
+                bits >>= 4;
+            }
+        }
+        return token;
+    }
+    
     void listClients() {
         std::lock_guard<std::mutex> lock(mutex_);
         std::cout << "Connected clients (" << clients_.size() << "):" << std::endl;
         for (const auto& [id, info] : clients_) {
+            if (!info.owner.empty()) {
+                continue;  // 虚拟 ID 计入所属网关
+            }
             std::cout << "  - " << id 
-                      << (info.relayAuthenticated ? " [relay-auth]" : "") 
-                      << std::endl;
+                      << (info.relayAuthenticated ? " [relay-auth]" : "");
+            if (!info.virtualIds.empty()) {
+                std::cout << " [gateway: " << info.virtualIds.size() << " ids]";
+            }
+            if (info.limiter) {
+                std::cout << " msgs=" << info.limiter->acceptedMsgs
+                          << " bytes=" << info.limiter->acceptedBytes;
+                if (info.limiter->throttledMsgs) {
+                    std::cout << " throttled=" << info.limiter->throttledMsgs;
+                }
+            }
+            std::cout << std::endl;
+        }
+        if (!detachedClients_.empty()) {
+            auto now = std::chrono::steady_clock::now();
+            std::cout << "Awaiting reconnect (" << detachedClients_.size() << "):" << std::endl;
+            for (const auto& [id, detached] : detachedClients_) {
+                auto left = std::chrono::duration_cast<std::chrono::seconds>(detached.expiresAt - now);
+                std::cout << "  - " << id << " expires in " << std::max<int64_t>(0, left.count()) << "s" << std::endl;
+            }
         }
     }
     
     void listRelayConnections() {
         std::lock_guard<std::mutex> lock(mutex_);
         std::cout << "Active relay connections (" << relayConnections_.size() << "):" << std::endl;
-        for (const auto& conn : relayConnections_) {
-            std::cout << "  - " << conn.peer1 << " <-> " << conn.peer2 << std::endl;
+        for (const auto& [conn, state] : relayConnections_) {
+            std::cout << "  - " << conn.peer1 << " <-> " << conn.peer2;
+            auto total = state.traffic->total();
+            std::cout << " msgs=" << total.msgs << " bytes=" << total.bytes;
+            if (state.throttledMsgs) {
+                std::cout << " throttled=" << state.throttledMsgs;
+            }
+            std::cout << std::endl;
+        }
+    }
+    
+    static constexpr int kShortWindow = 10;
+    static constexpr int kLongWindow = 60;
+    
+    // 按短窗口字节数排序的中继对和客户端 (调用方需持有 mutex_)
+    std::vector<TrafficRow> collectTopPairs(size_t count, int64_t nowSec) const {
+        std::vector<TrafficRow> rows;
+        rows.reserve(relayConnections_.size());
+        for (const auto& [conn, state] : relayConnections_) {
+            rows.push_back({conn.peer1 + " <-> " + conn.peer2,
+                            state.traffic->window(nowSec, kShortWindow),
+                            state.traffic->window(nowSec, kLongWindow),
+                            state.traffic->total()});
+        }
+        return sortTop(std::move(rows), count);
+    }
+    
+    std::vector<TrafficRow> collectTopClients(size_t count, int64_t nowSec) const {
+        std::vector<TrafficRow> rows;
+        rows.reserve(clients_.size());
+        for (const auto& [id, info] : clients_) {
+            const TrafficWindow& sent = *info.traffic.relaySent;
+            if (sent.total().msgs == 0) continue;
+            rows.push_back({id,
+                            sent.window(nowSec, kShortWindow),
+                            sent.window(nowSec, kLongWindow),
+                            sent.total()});
+        }
+        return sortTop(std::move(rows), count);
+    }
+    
+    static std::vector<TrafficRow> sortTop(std::vector<TrafficRow> rows, size_t count) {
+        auto heavier = [](const TrafficRow& a, const TrafficRow& b) {
+            return std::tie(a.shortWindow.bytes, a.longWindow.bytes) >
+                   std::tie(b.shortWindow.bytes, b.longWindow.bytes);
+        };
+        if (rows.size() > count) {
+            std::partial_sort(rows.begin(), rows.begin() + count, rows.end(), heavier);
+            rows.resize(count);
+        } else {
+            std::sort(rows.begin(), rows.end(), heavier);
+        }
+        return rows;
+    }
+    
+    void showTopTalkers(size_t count) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t nowSec = TrafficWindow::nowSeconds();
+        
+        auto printRows = [](const std::vector<TrafficRow>& rows) {
+            for (const auto& row : rows) {
+                std::cout << "  - " << row.label
+                          << "  " << row.shortWindow.bytes / kShortWindow << " B/s"
+                          << " " << row.shortWindow.msgs / kShortWindow << " msg/s (" << kShortWindow << "s)"
+                          << "  " << row.longWindow.bytes / kLongWindow << " B/s"
+                          << " " << row.longWindow.msgs / kLongWindow << " msg/s (" << kLongWindow << "s)"
+                          << "  total " << row.total.bytes << " B" << std::endl;
+            }
+        };
+        
+        std::cout << "Top relay pairs:" << std::endl;
+        printRows(collectTopPairs(count, nowSec));
+        std::cout << "Top relay senders:" << std::endl;
+        printRows(collectTopClients(count, nowSec));
+    }
+    
+    // 后台维护线程：清理宽限期已过的会话，周期性输出一行 JSON 指标便于日志采集
+    void startMaintenanceThread() {
+        maintenanceRunning_ = true;
+        maintenanceThread_ = std::thread([this]() {
+            p2p::configureCurrentThread("sig-maint", maintenanceCpus_);
+            using Clock = std::chrono::steady_clock;
+            auto metricsInterval = std::chrono::milliseconds(static_cast<int64_t>(metricsInterval_ * 1000));
+            auto tick = std::chrono::milliseconds(1000);
+            if (metricsInterval.count() > 0 && (relayGracePeriod_ <= 0 || metricsInterval < tick)) {
+                tick = metricsInterval;
+            }
+            auto nextMetrics = Clock::now() + metricsInterval;
+            
+            std::unique_lock<std::mutex> waitLock(maintenanceMutex_);
+            while (!maintenanceCv_.wait_for(waitLock, tick, [this] { return !maintenanceRunning_; })) {
+                if (relayGracePeriod_ > 0) {
+                    expireDetachedClients();
+                }
+                if (metricsInterval.count() > 0 && Clock::now() >= nextMetrics) {
+                    std::cout << "[Metrics] " << buildMetrics().dump() << std::endl;
+                    nextMetrics += metricsInterval;
+                }
+            }
+        });
+    }
+    
+    void stopMaintenanceThread() {
+        {
+            std::lock_guard<std::mutex> lock(maintenanceMutex_);
+            maintenanceRunning_ = false;
+        }
+        maintenanceCv_.notify_all();
+        if (maintenanceThread_.joinable()) {
+            maintenanceThread_.join();
         }
     }
+    
+    json buildMetrics() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t nowSec = TrafficWindow::nowSeconds();
+        
+        json pairs = json::array();
+        for (const auto& row : collectTopPairs(5, nowSec)) {
+            pairs.push_back({
+                {"pair", row.label},
+                {"bytes_per_sec", row.shortWindow.bytes / kShortWindow},
+                {"msgs_per_sec", row.shortWindow.msgs / kShortWindow},
+                {"total_bytes", row.total.bytes}
+            });
+        }
+        
+        MessageArena::Stats arena = MessageArena::stats();
+        
+        return {
+            {"clients", clients_.size()},
+            {"detached_clients", detachedClients_.size()},
+            {"relay_pairs", relayConnections_.size()},
+            {"dropped_while_detached", droppedWhileDetached_},
+            {"throttled", throttledTotal_.load()},
+            {"window_sec", kShortWindow},
+            {"top_pairs", pairs},
+            {"arena", {
+                {"messages", arena.messages},
+                {"overflows", arena.overflows},
+                {"grows", arena.grows}
+            }}
+        };
+    }
+    
+    void showRateLimits() {
+        auto show = [](double v) { return v > 0 ? std::to_string(v) : std::string("unlimited"); };
+        std::cout << "Rate limits (burst " << rateLimits_.burstSeconds << "s):" << std::endl;
+        std::cout << "  client: " << show(rateLimits_.clientMsgsPerSec) << " msgs/s, "
+                  << show(rateLimits_.clientBytesPerSec) << " bytes/s" << std::endl;
+        std::cout << "  relay:  " << show(rateLimits_.relayMsgsPerSec) << " msgs/s, "
+                  << show(rateLimits_.relayBytesPerSec) << " bytes/s" << std::endl;
+        std::cout << "  throttled messages: " << throttledTotal_ << std::endl;
+    }
 
 private:
     uint16_t port_;
     std::string relayPassword_;
     std::unique_ptr<rtc::WebSocketServer> server_;
     std::unordered_map<std::string, ClientInfo> clients_;
-    std::set<RelayPair> relayConnections_;  // 中继连接对
+    std::map<RelayPair, RelayPairState, RelayPairLess> relayConnections_;  // 中继连接对
     std::mutex mutex_;
+    RateLimitConfig rateLimits_;
+    std::atomic<uint64_t> throttledTotal_{0};
+    
+    // 会话恢复 (以下均由 mutex_ 保护)
+    double relayGracePeriod_ = 30;  // 秒，断线客户端的中继连接对保留时长，0 表示立即拆除
+    std::unordered_map<std::string, DetachedClient> detachedClients_;
+    uint64_t droppedWhileDetached_ = 0;  // 目标等待重连期间丢弃的中继消息
+    std::random_device sessionRandom_;
+    
+    double maxVirtualIds_ = 10000;  // 单个网关连接可注册的虚拟 ID 上限
+    
+    // CPU 绑定 (CPU 编号列表，为空表示不限制)
+    std::vector<int> networkCpus_;      // libdatachannel 线程池与 I/O 线程
+    std::vector<int> maintenanceCpus_;  // 后台维护线程
+    
+    // 后台维护 (会话过期、指标输出)
+    double metricsInterval_ = 0;  // 秒，0 表示关闭
+    std::thread maintenanceThread_;
+    std::mutex maintenanceMutex_;
+    std::condition_variable maintenanceCv_;
+    bool maintenanceRunning_ = false;
 };
 
 int main(int argc, char* argv[]) {
     uint16_t port = 8080;
+    std::vector<std::pair<std::string, std::string>> overrides;
     
-    if (argc > 1) {
-        port = static_cast<uint16_t>(std::stoi(argv[1]));
+    // 用法: signaling-server [port] [--key=value ...]
+    // --rate-limit-client-msgs=100 等价于 .env 中的 RATE_LIMIT_CLIENT_MSGS=100
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) == 0) {
+            size_t eqPos = arg.find('=');
+            if (eqPos == std::string::npos) {
+                std::cerr << "Ignoring option without value: " << arg << std::endl;
+                continue;
+            }
+            std::string key = arg.substr(2, eqPos - 2);
+            std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) {
+                return c == '-' ? '_' : static_cast<char>(std::toupper(c));
+            });
+            overrides.emplace_back(key, arg.substr(eqPos + 1));
+        } else {
+            port = static_cast<uint16_t>(std::stoi(arg));
+        }
     }
     
     try {
         rtc::InitLogger(rtc::LogLevel::Warning);
         
-        SignalingServer server(port);
+        SignalingServer server(port, overrides);
         server.run();
         
     } catch (const std::exception& e) {
@@ -0,0 +1,129 @@
+// server/src/message_arena.hpp
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+// 每个工作线程一个的单调 arena：单条消息处理期间的临时对象 (解析出的字段、转发消息、
+// 序列化结果) 都从这里分配，消息处理完后整体复位。
+// 初始块不够时从上游分配，复位时把初始块扩大到本次用量，稳定后每条消息不再调用全局分配器。
+class MessageArena {
+public:
+    static constexpr size_t kInitialSize = 16 * 1024;
+    static constexpr size_t kMaxBlockSize = 4 * 1024 * 1024;  // 超过此大小的消息每次都走上游
+
+    // 所有线程合计
+    struct Stats {
+        uint64_t messages = 0;   // 复位次数
+        uint64_t overflows = 0;  // 超出初始块、向上游申请内存的次数
+        uint64_t grows = 0;      // 初始块扩大次数
+    };
+
+    // 当前线程的 arena (libdatachannel 回调线程各自持有一个)
+    static MessageArena& local() {
+        thread_local MessageArena arena;
+        return arena;
+    }
+
+    static Stats stats() {
+        Stats s;
+        s.messages = counters().messages.load(std::memory_order_relaxed);
+        s.overflows = counters().overflows.load(std::memory_order_relaxed);
+        s.grows = counters().grows.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    std::pmr::memory_resource* resource() { return &*resource_; }
+
+    template <typename T>
+    std::pmr::polymorphic_allocator<T> allocator() { return std::pmr::polymorphic_allocator<T>(resource()); }
+
+    // 释放本条消息的所有分配；上游有分配时按用量扩大初始块
+    void reset() {
+        counters().messages.fetch_add(1, std::memory_order_relaxed);
+        size_t overflow = upstream_.takeAllocated();
+        if (overflow == 0 || blockSize_ >= kMaxBlockSize) {
+            resource_->release();
+            return;
+        }
+
+        size_t newSize = blockSize_;
+        while (newSize < blockSize_ + overflow && newSize < kMaxBlockSize) {
+            newSize *= 2;
+        }
+        resource_.reset();  // 先析构资源 (归还上游内存)，再替换初始块
+        allocateBlock(newSize);
+        counters().grows.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 作用域结束时复位 arena
+    class Scope {
+    public:
+        explicit Scope(MessageArena& arena) : arena_(arena) {}
+        ~Scope() { arena_.reset(); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        MessageArena& arena_;
+    };
+
+    MessageArena(const MessageArena&) = delete;
+    MessageArena& operator=(const MessageArena&) = delete;
+
+private:
+    struct Counters {
+        std::atomic<uint64_t> messages{0};
+        std::atomic<uint64_t> overflows{0};
+        std::atomic<uint64_t> grows{0};
+    };
+
+    static Counters& counters() {
+        static Counters instance;
+        return instance;
+    }
+
+    // 记录上游分配量的 new/delete 资源
+    class UpstreamResource : public std::pmr::memory_resource {
+    public:
+        size_t takeAllocated() {
+            size_t bytes = allocated_;
+            allocated_ = 0;
+            return bytes;
+        }
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            allocated_ += bytes;
+            counters().overflows.fetch_add(1, std::memory_order_relaxed);
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+
+        size_t allocated_ = 0;
+    };
+
+    MessageArena() { allocateBlock(kInitialSize); }
+
+    void allocateBlock(size_t size) {
+        block_ = std::make_unique<std::byte[]>(size);
+        blockSize_ = size;
+        resource_.emplace(block_.get(), blockSize_, &upstream_);
+    }
+
+    UpstreamResource upstream_;
+    std::unique_ptr<std::byte[]> block_;
+    size_t blockSize_ = 0;
+    std::optional<std::pmr::monotonic_buffer_resource> resource_;
+};
@@ -0,0 +1,177 @@
+// server/src/rate_limiter.hpp
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+// 限流配置 (速率为 0 表示不限制)
+struct RateLimitConfig {
+    double clientMsgsPerSec = 0;   // 每客户端消息数/秒
+    double clientBytesPerSec = 0;  // 每客户端字节数/秒
+    double relayMsgsPerSec = 0;    // 每中继对消息数/秒
+    double relayBytesPerSec = 0;   // 每中继对字节数/秒
+    double burstSeconds = 1.0;     // 桶容量 = 速率 * burstSeconds
+
+    bool clientLimited() const { return clientMsgsPerSec > 0 || clientBytesPerSec > 0; }
+    bool relayLimited() const { return relayMsgsPerSec > 0 || relayBytesPerSec > 0; }
+};
+
+// 令牌桶 (非线程安全，由调用方加锁)
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TokenBucket() = default;
+
+    TokenBucket(double ratePerSec, double burstSeconds)
+        : rate_(ratePerSec)
+        , capacity_(std::max(ratePerSec * burstSeconds, 1.0))
+        , tokens_(capacity_)
+        , last_(Clock::now()) {}
+
+    bool unlimited() const { return rate_ <= 0; }
+
+    // 尝试消耗 n 个令牌；桶满时允许透支，保证超过容量的单条消息不会永久被拒
+    bool consume(double n, Clock::time_point now) {
+        if (unlimited()) return true;
+        refill(now);
+        if (tokens_ >= n || tokens_ >= capacity_) {
+            tokens_ -= n;
+            return true;
+        }
+        return false;
+    }
+
+    // 再次有 n 个令牌可用前需要等待的毫秒数
+    uint32_t retryAfterMs(double n) const {
+        if (unlimited()) return 0;
+        double needed = std::min(n, capacity_) - tokens_;
+        if (needed <= 0) return 0;
+        return static_cast<uint32_t>(needed / rate_ * 1000.0) + 1;
+    }
+
+    // 调整速率：容量随之变化，扩容部分立即可用，缩容时截断现有令牌
+    void setRate(double ratePerSec, double burstSeconds, Clock::time_point now) {
+        if (ratePerSec <= 0) {
+            *this = TokenBucket();
+            return;
+        }
+        if (unlimited()) {
+            *this = TokenBucket(ratePerSec, burstSeconds);
+            return;
+        }
+        refill(now);
+        double capacity = std::max(ratePerSec * burstSeconds, 1.0);
+        tokens_ = std::min(capacity, tokens_ + std::max(capacity - capacity_, 0.0));
+        rate_ = ratePerSec;
+        capacity_ = capacity;
+    }
+
+private:
+    void refill(Clock::time_point now) {
+        double elapsed = std::chrono::duration<double>(now - last_).count();
+        last_ = now;
+        if (elapsed > 0) {
+            tokens_ = std::min(capacity_, tokens_ + elapsed * rate_);
+        }
+    }
+
+    double rate_ = 0;
+    double capacity_ = 0;
+    double tokens_ = 0;
+    Clock::time_point last_{};
+};
+
+// 消息数 + 字节数双桶限流器
+class RateLimiter {
+public:
+    RateLimiter() = default;
+
+    RateLimiter(double msgsPerSec, double bytesPerSec, double burstSeconds)
+        : msgs_(msgsPerSec, burstSeconds)
+        , bytes_(bytesPerSec, burstSeconds) {}
+
+    // 通过返回 0，否则返回建议的重试等待毫秒数
+    uint32_t admit(size_t bytes, TokenBucket::Clock::time_point now) {
+        // 先检查再消耗，避免消息桶扣了令牌而字节桶拒绝；
+        // 拒绝时副本未被扣减但已补充到 now，据此计算等待时间
+        TokenBucket msgs = msgs_;
+        TokenBucket data = bytes_;
+        bool msgsOk = msgs.consume(1, now);
+        bool dataOk = data.consume(static_cast<double>(bytes), now);
+        if (!msgsOk || !dataOk) {
+            return std::max(msgsOk ? 0u : msgs.retryAfterMs(1),
+                            dataOk ? 0u : data.retryAfterMs(static_cast<double>(bytes)));
+        }
+        msgs_ = msgs;
+        bytes_ = data;
+        return 0;
+    }
+
+    void setRates(double msgsPerSec, double bytesPerSec, double burstSeconds, TokenBucket::Clock::time_point now) {
+        msgs_.setRate(msgsPerSec, burstSeconds, now);
+        bytes_.setRate(bytesPerSec, burstSeconds, now);
+    }
+
+private:
+    TokenBucket msgs_;
+    TokenBucket bytes_;
+};
+
+// 每个 WebSocket 连接的限流状态与计数器 (线程安全)
+class ClientRateLimiter {
+public:
+    explicit ClientRateLimiter(const RateLimitConfig& config)
+        : config_(config)
+        , limiter_(config.clientMsgsPerSec, config.clientBytesPerSec, config.burstSeconds) {}
+
+    // 连接上承载的 ID 数 (主 ID + 网关虚拟 ID)：配额按 ID 数线性放大，
+    // 使网关连接上的每个端点与独立连接的客户端获得相同的预算
+    void setEndpoints(size_t count) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        count = std::max<size_t>(count, 1);
+        if (count == endpoints_) return;
+        endpoints_ = count;
+        double scale = static_cast<double>(count);
+        limiter_.setRates(config_.clientMsgsPerSec * scale, config_.clientBytesPerSec * scale,
+                          config_.burstSeconds, TokenBucket::Clock::now());
+    }
+
+    // 在解析消息之前调用；通过返回 0，否则返回重试等待毫秒数
+    uint32_t admit(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t retryAfter = limiter_.admit(bytes, TokenBucket::Clock::now());
+        if (retryAfter == 0) {
+            ++acceptedMsgs;
+            acceptedBytes += bytes;
+        } else {
+            ++throttledMsgs;
+            throttledBytes += bytes;
+        }
+        return retryAfter;
+    }
+
+    // 限制被限流通知的发送频率，避免通知本身放大流量
+    bool shouldNotify(std::chrono::milliseconds interval = std::chrono::seconds(1)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = TokenBucket::Clock::now();
+        if (now - lastNotice_ < interval) return false;
+        lastNotice_ = now;
+        return true;
+    }
+
+    std::atomic<uint64_t> acceptedMsgs{0};
+    std::atomic<uint64_t> acceptedBytes{0};
+    std::atomic<uint64_t> throttledMsgs{0};
+    std::atomic<uint64_t> throttledBytes{0};
+
+private:
+    std::mutex mutex_;
+    RateLimitConfig config_;
+    size_t endpoints_ = 1;
+    RateLimiter limiter_;
+    TokenBucket::Clock::time_point lastNotice_{};
+};
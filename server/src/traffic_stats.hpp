@@ -0,0 +1,66 @@
+// server/src/traffic_stats.hpp
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// 滑动窗口流量计数器：按秒分槽，最多覆盖最近 kSlots 秒
+// 线程安全且不加锁 (relaxed 原子操作)：转发路径在全局锁之外累加，top 和指标读取时汇总。
+// 槽进入新的一秒时由一个线程清零，与清零同时发生的累加可能丢失 (只影响窗口值，累计值精确)
+class TrafficWindow {
+public:
+    static constexpr int kSlots = 60;
+
+    struct Totals {
+        uint64_t msgs = 0;
+        uint64_t bytes = 0;
+    };
+
+    static int64_t nowSeconds() {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void add(size_t bytes, int64_t nowSec) {
+        Slot& slot = slots_[static_cast<size_t>(nowSec % kSlots)];
+        int64_t second = slot.second.load(std::memory_order_acquire);
+        if (second < nowSec && slot.second.compare_exchange_strong(second, nowSec, std::memory_order_acq_rel)) {
+            slot.msgs.store(0, std::memory_order_relaxed);
+            slot.bytes.store(0, std::memory_order_relaxed);
+        }
+        slot.msgs.fetch_add(1, std::memory_order_relaxed);
+        slot.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        totalMsgs_.fetch_add(1, std::memory_order_relaxed);
+        totalBytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // 最近 windowSec 秒 (含当前秒) 的累计值
+    Totals window(int64_t nowSec, int windowSec) const {
+        Totals sum;
+        for (const auto& slot : slots_) {
+            int64_t second = slot.second.load(std::memory_order_acquire);
+            if (second > nowSec - windowSec && second <= nowSec) {
+                sum.msgs += slot.msgs.load(std::memory_order_relaxed);
+                sum.bytes += slot.bytes.load(std::memory_order_relaxed);
+            }
+        }
+        return sum;
+    }
+
+    Totals total() const {
+        return Totals{totalMsgs_.load(std::memory_order_relaxed), totalBytes_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    struct Slot {
+        std::atomic<int64_t> second{-1};
+        std::atomic<uint64_t> msgs{0};
+        std::atomic<uint64_t> bytes{0};
+    };
+
+    std::array<Slot, kSlots> slots_{};
+    std::atomic<uint64_t> totalMsgs_{0};
+    std::atomic<uint64_t> totalBytes_{0};
+};
@@ -0,0 +1,103 @@
+// Buffer 池：引用计数、分级复用，以及跨线程释放归还给分配线程的缓存
+#include "p2p/buffer.hpp"
+#include "check.hpp"
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace p2p;
+
+static void testRefCounting() {
+    Buffer buffer = Buffer::copyOf("hello", 5);
+    CHECK(buffer.size() == 5 && buffer.capacity() >= 5 && buffer.useCount() == 1);
+    Buffer copy = buffer;
+    CHECK(copy.data() == buffer.data() && buffer.useCount() == 2);
+    Buffer moved = std::move(copy);
+    CHECK(copy.empty() && buffer.useCount() == 2);
+    moved = Buffer();
+    CHECK(buffer.useCount() == 1);
+    buffer.resize(3);
+    CHECK(buffer.size() == 3);
+    buffer.resize(buffer.capacity() + 1);  // 超过容量时不变
+    CHECK(buffer.size() == 3);
+
+    // 同一线程释放后立即复用
+    const uint8_t* data = buffer.data();
+    buffer = Buffer();
+    auto before = Buffer::poolStats();
+    Buffer again = Buffer::allocate(5);
+    CHECK(again.data() == data);
+    CHECK(Buffer::poolStats().cacheHits == before.cacheHits + 1);
+}
+
+// 一个线程分配、另一个线程释放：块应回到分配线程，而不是堆积在释放线程的缓存里
+static void testProducerConsumer() {
+    std::mutex mutex;
+    std::deque<Buffer> queue;
+    const int count = 50000;
+    auto before = Buffer::poolStats();
+
+    std::thread consumer([&] {
+        for (int received = 0; received < count;) {
+            Buffer buffer;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (queue.empty()) {
+                    continue;
+                }
+                buffer = std::move(queue.front());
+                queue.pop_front();
+            }
+            CHECK(buffer.size() == 1000 && buffer.data()[0] == 0xab);
+            ++received;
+        }
+    });
+    std::thread producer([&] {
+        for (int i = 0; i < count; ++i) {
+            Buffer buffer = Buffer::allocate(1000);
+            buffer.data()[0] = 0xab;
+            for (;;) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (queue.size() < 64) {
+                    queue.push_back(std::move(buffer));
+                    break;
+                }
+            }
+        }
+    });
+    producer.join();
+    consumer.join();
+
+    auto after = Buffer::poolStats();
+    CHECK(after.cacheMisses - before.cacheMisses < static_cast<uint64_t>(count / 10));
+    CHECK(after.remoteReleased - before.remoteReleased > static_cast<uint64_t>(count / 2));
+}
+
+// 分配线程先退出，其他线程之后释放它分配的块
+static void testOwnerExit() {
+    for (int round = 0; round < 20; ++round) {
+        std::vector<Buffer> orphans;
+        std::thread owner([&] {
+            for (int i = 0; i < 100; ++i) {
+                orphans.push_back(Buffer::allocate(300 + i));
+            }
+        });
+        owner.join();
+        std::thread releaser([&] {
+            orphans.clear();
+            Buffer reused = Buffer::allocate(400);
+            CHECK(reused.size() == 400);
+        });
+        releaser.join();
+    }
+}
+
+int main() {
+    testRefCounting();
+    testProducerConsumer();
+    testOwnerExit();
+    std::puts("buffer_pool_test: ok");
+    return 0;
+}
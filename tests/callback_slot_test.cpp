@@ -0,0 +1,119 @@
+// CallbackSlot：任意线程替换回调的同时其他线程调用，回调中替换或清除自身
+#include "callback_slot.hpp"
+#include "check.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace p2p;
+
+// 多个线程调用的同时另一个线程反复替换和清除；回调捕获堆上的状态，释放过早会被 ASan/TSan 发现
+static void testConcurrentSetAndInvoke() {
+    CallbackSlot<std::function<void(int)>> slot;
+    std::atomic<long> calls{0};
+    std::atomic<bool> stop{false};
+
+    std::vector<std::thread> invokers;
+    for (int t = 0; t < 4; ++t) {
+        invokers.emplace_back([&] {
+            while (!stop) {
+                slot(1);
+            }
+        });
+    }
+    for (int i = 0; i < 20000; ++i) {
+        auto state = std::make_shared<std::vector<int>>(8, i);
+        slot.set([&calls, state](int v) { calls += v + (*state)[7] * 0; });
+        if (i % 3 == 0) {
+            slot.set(nullptr);
+        }
+    }
+    stop = true;
+    for (auto& thread : invokers) {
+        thread.join();
+    }
+
+    long before = calls;
+    slot.set([&calls](int v) { calls += v; });
+    slot(5);
+    CHECK(calls == before + 5);
+    slot.set(nullptr);
+    CHECK(!slot);
+    slot(1);  // 未设置时什么都不做
+}
+
+// 回调执行中替换或清除自身：正在执行的旧回调及其捕获的状态要保持有效直到返回
+static void testReentrantReplace() {
+    CallbackSlot<std::function<void()>> slot;
+    int calls = 0;
+    slot.set([&] {
+        ++calls;
+        slot.set([&] { calls += 10; });
+    });
+    slot();
+    slot();
+    CHECK(calls == 11);
+
+    auto state = std::make_shared<int>(42);
+    std::weak_ptr<int> watch = state;
+    int seen = 0;
+    slot.set([&slot, &seen, state] {
+        slot.set(nullptr);
+        seen = *state;  // 自身已被清除，但这次调用仍持有快照
+    });
+    state.reset();
+    slot();
+    CHECK(seen == 42);
+    CHECK(watch.expired());
+    CHECK(!slot);
+}
+
+// 回调中调用另一个槽并替换它，同时其他线程也在替换两个槽
+static void testCrossSlotCalls() {
+    CallbackSlot<std::function<void(int)>> first;
+    CallbackSlot<std::function<void(int)>> second;
+    std::atomic<long> total{0};
+    std::atomic<bool> stop{false};
+
+    second.set([&](int v) { total += v; });
+    first.set([&](int v) {
+        second(v);
+        second.set([&](int w) { total += w; });
+    });
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t) {
+        threads.emplace_back([&] {
+            while (!stop) {
+                first(1);
+            }
+        });
+    }
+    threads.emplace_back([&] {
+        for (int i = 0; i < 5000; ++i) {
+            first.set([&, i](int v) {
+                second(v);
+                second.set(i % 2 ? nullptr : std::function<void(int)>([&](int w) { total += w; }));
+            });
+            std::this_thread::yield();
+        }
+    });
+    threads.back().join();
+    threads.pop_back();
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(total > 0);
+}
+
+int main() {
+    testConcurrentSetAndInvoke();
+    testReentrantReplace();
+    testCrossSlotCalls();
+    std::puts("callback_slot_test: ok");
+    return 0;
+}
@@ -0,0 +1,47 @@
+// tests/check.hpp
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+// 与 assert 不同，Release 构建 (NDEBUG) 下同样检查
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            std::exit(1);                                                             \
+        }                                                                             \
+    } while (0)
+
+#define CHECK_THROWS(expr)                                                            \
+    do {                                                                              \
+        bool thrown = false;                                                          \
+        try {                                                                         \
+            expr;                                                                     \
+        } catch (...) {                                                               \
+            thrown = true;                                                            \
+        }                                                                             \
+        if (!thrown) {                                                                \
+            std::fprintf(stderr, "%s:%d: %s did not throw\n", __FILE__, __LINE__, #expr); \
+            std::exit(1);                                                             \
+        }                                                                             \
+    } while (0)
+
+namespace p2p::test {
+
+// 轮询等待条件成立 (不用 condition_variable::wait_for，部分 TSan 版本不识别其内部的 pthread_cond_clockwait)
+template <typename Pred>
+bool waitFor(Pred pred, std::chrono::milliseconds timeout = std::chrono::seconds(10)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+} // namespace p2p::test
@@ -0,0 +1,208 @@
+// P2PClient：网络线程 (或分发线程) 持续回调的同时，应用线程反复 setOnXxx()，回调中再调用客户端
+// (查询状态、请求 Peer 列表、替换自身)。信令服务器是测试内的回环 WebSocket 服务器，
+// 注册后不停推送 peer_list 和 error，保证 setOnXxx() 与回调真正并发
+#include "p2p/p2p_client.hpp"
+#include "protocol.hpp"
+#include "check.hpp"
+
+#include <rtc/rtc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+using namespace p2p;
+
+namespace {
+
+constexpr uint32_t kAlive = 0x600dcafe;
+
+// 每个回调各自捕获一个 Probe，回调被替换后随之析构；
+// 调用到已销毁或未构造完的回调时 magic 不是 kAlive (ASan/TSan 下也会直接报告)
+struct Probe {
+    std::atomic<uint32_t> magic{kAlive};
+    ~Probe() { magic = 0; }
+};
+
+struct Counters {
+    std::atomic<long> peerLists{0};
+    std::atomic<long> errors{0};
+    std::atomic<long> states{0};
+};
+
+class LoopbackServer {
+public:
+    LoopbackServer() : server_(configuration()) {
+        server_.onClient([this](std::shared_ptr<rtc::WebSocket> ws) {
+            // clients_ 持有连接，回调只持弱引用
+            std::weak_ptr<rtc::WebSocket> weak = ws;
+            ws->onMessage([weak](auto message) {
+                auto ws = weak.lock();
+                if (!ws || !std::holds_alternative<std::string>(message)) {
+                    return;
+                }
+                auto msg = SignalingMessage::deserialize(std::get<std::string>(message));
+                if (msg.type == MessageType::Register) {
+                    send(*ws, MessageType::Register, msg.payload);
+                } else if (msg.type == MessageType::PeerList) {
+                    send(*ws, MessageType::PeerList, "[\"a\",\"b\"]");
+                }
+            });
+            std::lock_guard<std::mutex> lock(mutex_);
+            clients_.push_back(std::move(ws));
+        });
+
+        pump_ = std::thread([this] {
+            while (!stop_) {
+                std::vector<std::shared_ptr<rtc::WebSocket>> clients;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    clients_.erase(std::remove_if(clients_.begin(), clients_.end(),
+                                                  [](const auto& ws) { return ws->isClosed(); }),
+                                   clients_.end());
+                    clients = clients_;
+                }
+                for (const auto& ws : clients) {
+                    if (ws->isOpen()) {
+                        send(*ws, MessageType::PeerList, "[\"a\"]");
+                        send(*ws, MessageType::Error, "pump");
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        });
+    }
+
+    ~LoopbackServer() {
+        stop_ = true;
+        pump_.join();
+        server_.stop();
+    }
+
+    std::string url() const { return "ws://127.0.0.1:" + std::to_string(server_.port()); }
+
+private:
+    static rtc::WebSocketServer::Configuration configuration() {
+        rtc::WebSocketServer::Configuration config;
+        config.port = 0;  // 由系统分配
+        config.bindAddress = "127.0.0.1";
+        return config;
+    }
+
+    static void send(rtc::WebSocket& ws, MessageType type, const std::string& payload) {
+        SignalingMessage msg;
+        msg.type = type;
+        msg.to = "cbtest";
+        msg.payload = payload;
+        try {
+            ws.send(msg.serialize());
+        } catch (const std::exception&) {
+            // 连接正在关闭
+        }
+    }
+
+    rtc::WebSocketServer server_;
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<rtc::WebSocket>> clients_;
+    std::atomic<bool> stop_{false};
+    std::thread pump_;
+};
+
+OnPeerListCallback makeOnPeerList(P2PClient& client, Counters& counters) {
+    return [&client, &counters, probe = std::make_shared<Probe>()](const std::vector<std::string>& peers) {
+        CHECK(probe->magic == kAlive);
+        CHECK(!peers.empty());
+        ++counters.peerLists;
+        (void)client.getConnectedPeers();
+    };
+}
+
+OnErrorCallback makeOnError(P2PClient& client, Counters& counters) {
+    return [&client, &counters, probe = std::make_shared<Probe>()](const Error&) {
+        CHECK(probe->magic == kAlive);
+        long n = ++counters.errors;
+        (void)client.getState();
+        // 回调中替换自身：正在执行的回调对象必须保持有效直到返回
+        if (n % 8 == 0) {
+            client.setOnError(makeOnError(client, counters));
+            CHECK(probe->magic == kAlive);
+        }
+    };
+}
+
+OnStateChangeCallback makeOnState(P2PClient& client, Counters& counters) {
+    return [&client, &counters, probe = std::make_shared<Probe>()](ConnectionState) {
+        CHECK(probe->magic == kAlive);
+        ++counters.states;
+        (void)client.isConnected();
+        client.requestPeerList();
+    };
+}
+
+void runRound(size_t dispatchThreads) {
+    LoopbackServer server;
+
+    ClientConfig config;
+    config.signalingUrl = server.url();
+    config.peerId = "cbtest";
+    config.connectionTimeout = 5000;
+    config.stunServers.clear();
+    config.threading.dispatchThreads = dispatchThreads;
+    config.threading.threadName = "cbtest";
+
+    // 计数器先于客户端构造、晚于客户端析构：析构时的 disconnect() 仍会回调
+    Counters counters;
+    std::atomic<bool> stop{false};
+    P2PClient client(config);
+
+    client.setOnPeerList(makeOnPeerList(client, counters));
+    client.setOnError(makeOnError(client, counters));
+    client.setOnStateChange(makeOnState(client, counters));
+
+    std::vector<std::thread> setters;
+    for (int t = 0; t < 2; ++t) {
+        setters.emplace_back([&, t] {
+            for (long i = 0; !stop; ++i) {
+                if ((i + t) % 4 == 0) {
+                    client.setOnPeerList(nullptr);
+                    client.setOnError(nullptr);
+                } else {
+                    client.setOnPeerList(makeOnPeerList(client, counters));
+                    client.setOnError(makeOnError(client, counters));
+                }
+                client.setOnStateChange(makeOnState(client, counters));
+                std::this_thread::yield();
+            }
+        });
+    }
+
+    // 每轮连接期间都要有回调在 setOnXxx() 进行时发生
+    for (int i = 0; i < 5; ++i) {
+        long peerLists = counters.peerLists;
+        long errors = counters.errors;
+        CHECK(client.connect());
+        CHECK(test::waitFor([&] {
+            return counters.peerLists >= peerLists + 200 && counters.errors >= errors + 200;
+        }));
+        client.disconnect();
+    }
+    stop = true;
+    for (auto& thread : setters) {
+        thread.join();
+    }
+    CHECK(counters.states > 0);
+}
+
+} // namespace
+
+int main() {
+    runRound(0);
+    runRound(2);
+    std::puts("client_callback_test: ok");
+    return 0;
+}
@@ -0,0 +1,208 @@
+// 消息类型查找与分发的微基准：生成的完美哈希查找 + 编译期分发表，对比改造前的逐个字符串比较和 switch
+// 用法: protocol_bench [每组迭代次数]，ctest 以较少的迭代次数运行，只检查两种实现结果一致
+#include "protocol.hpp"
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace p2p;
+
+namespace {
+
+// 改造前的实现 (逐个比较，每次返回新分配的 std::string)
+MessageType legacyStringToMessageType(const std::string& str) {
+    if (str == "register") return MessageType::Register;
+    if (str == "peer_list") return MessageType::PeerList;
+    if (str == "offer") return MessageType::Offer;
+    if (str == "answer") return MessageType::Answer;
+    if (str == "candidate") return MessageType::Candidate;
+    if (str == "connect") return MessageType::Connect;
+    if (str == "error") return MessageType::Error;
+    if (str == "chat") return MessageType::Chat;
+    if (str == "relay_auth") return MessageType::RelayAuth;
+    if (str == "relay_auth_result") return MessageType::RelayAuthResult;
+    if (str == "relay_connect") return MessageType::RelayConnect;
+    if (str == "relay_data") return MessageType::RelayData;
+    if (str == "relay_disconnect") return MessageType::RelayDisconnect;
+    if (str == "throttled") return MessageType::Throttled;
+    if (str == "attach") return MessageType::Attach;
+    if (str == "detach") return MessageType::Detach;
+    return MessageType::Error;
+}
+
+std::string legacyMessageTypeToString(MessageType type) {
+    switch (type) {
+        case MessageType::Register: return "register";
+        case MessageType::PeerList: return "peer_list";
+        case MessageType::Offer: return "offer";
+        case MessageType::Answer: return "answer";
+        case MessageType::Candidate: return "candidate";
+        case MessageType::Connect: return "connect";
+        case MessageType::Error: return "error";
+        case MessageType::Chat: return "chat";
+        case MessageType::RelayAuth: return "relay_auth";
+        case MessageType::RelayAuthResult: return "relay_auth_result";
+        case MessageType::RelayConnect: return "relay_connect";
+        case MessageType::RelayData: return "relay_data";
+        case MessageType::RelayDisconnect: return "relay_disconnect";
+        case MessageType::Throttled: return "throttled";
+        case MessageType::Attach: return "attach";
+        case MessageType::Detach: return "detach";
+        default: return "unknown";
+    }
+}
+
+// 分发目标：与客户端、服务端一样是成员函数
+struct Router {
+    uint64_t sum = 0;
+
+    void onRegister(std::string_view from) { sum += from.size() + 1; }
+    void onPeerList(std::string_view from) { sum += from.size() + 2; }
+    void onSignal(std::string_view from) { sum += from.size() + 3; }
+    void onRelayData(std::string_view from) { sum += from.size() + 4; }
+    void onRelayControl(std::string_view from) { sum += from.size() + 5; }
+    void onError(std::string_view from) { sum += from.size() + 6; }
+
+    using Handler = void (Router::*)(std::string_view);
+
+    static constexpr auto kDispatch = MessageDispatchTable<Handler>()
+        .on(MessageType::Register, &Router::onRegister)
+        .on(MessageType::PeerList, &Router::onPeerList)
+        .on(MessageType::Offer, &Router::onSignal)
+        .on(MessageType::Answer, &Router::onSignal)
+        .on(MessageType::Candidate, &Router::onSignal)
+        .on(MessageType::RelayData, &Router::onRelayData)
+        .on(MessageType::RelayConnect, &Router::onRelayControl)
+        .on(MessageType::RelayDisconnect, &Router::onRelayControl)
+        .on(MessageType::Error, &Router::onError);
+
+    void dispatch(MessageType type, std::string_view from) {
+        if (auto handler = kDispatch[type]) {
+            (this->*handler)(from);
+        }
+    }
+
+    void legacyDispatch(MessageType type, std::string_view from) {
+        switch (type) {
+            case MessageType::Register: onRegister(from); break;
+            case MessageType::PeerList: onPeerList(from); break;
+            case MessageType::Offer:
+            case MessageType::Answer:
+            case MessageType::Candidate: onSignal(from); break;
+            case MessageType::RelayData: onRelayData(from); break;
+            case MessageType::RelayConnect:
+            case MessageType::RelayDisconnect: onRelayControl(from); break;
+            case MessageType::Error: onError(from); break;
+            default: break;
+        }
+    }
+};
+
+// 接近实际流量的类型分布：大部分是中继数据，表尾的类型在逐个比较时最慢
+std::vector<std::string> workload() {
+    std::vector<std::string> names;
+    for (int i = 0; i < 12; ++i) {
+        names.push_back("relay_data");
+    }
+    for (const char* name : {"candidate", "candidate", "offer", "answer", "peer_list", "throttled",
+                             "relay_connect", "detach", "unknown_type"}) {
+        names.push_back(name);
+    }
+    return names;
+}
+
+template <typename Fn>
+double nsPerOp(size_t iterations, size_t batch, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        fn();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / static_cast<double>(iterations * batch);
+}
+
+void report(const char* name, double legacy, double generated) {
+    std::printf("%-22s legacy %7.2f ns/op   generated %7.2f ns/op   x%.1f\n",
+                name, legacy, generated, generated > 0 ? legacy / generated : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    auto names = workload();
+    std::vector<std::string_view> views(names.begin(), names.end());
+
+    // 两种实现对所有名称 (含未知类型) 的结果一致
+    for (const auto& name : names) {
+        CHECK(stringToMessageType(name) == legacyStringToMessageType(name));
+    }
+    for (size_t i = 0; i < kMessageTypeCount; ++i) {
+        auto type = static_cast<MessageType>(i);
+        CHECK(messageTypeName(type) == legacyMessageTypeToString(type));
+        CHECK(stringToMessageType(messageTypeName(type)) == type);
+    }
+    Router a;
+    Router b;
+    for (const auto& name : names) {
+        a.legacyDispatch(legacyStringToMessageType(name), name);
+        b.dispatch(stringToMessageType(name), name);
+    }
+    CHECK(a.sum == b.sum);
+
+    // 迭代之间的结果累加到 volatile，避免被优化掉
+    volatile size_t sink = 0;
+    size_t rounds = iterations / names.size() + 1;
+
+    double legacyLookup = nsPerOp(rounds, names.size(), [&] {
+        size_t acc = 0;
+        for (const auto& name : names) {
+            acc += static_cast<size_t>(legacyStringToMessageType(name));
+        }
+        sink = sink + acc;
+    });
+    double generatedLookup = nsPerOp(rounds, views.size(), [&] {
+        size_t acc = 0;
+        for (auto name : views) {
+            acc += static_cast<size_t>(stringToMessageType(name));
+        }
+        sink = sink + acc;
+    });
+    report("name -> type", legacyLookup, generatedLookup);
+
+    double legacyName = nsPerOp(rounds, kMessageTypeCount, [&] {
+        size_t acc = 0;
+        for (size_t i = 0; i < kMessageTypeCount; ++i) {
+            acc += legacyMessageTypeToString(static_cast<MessageType>(i)).size();
+        }
+        sink = sink + acc;
+    });
+    double generatedName = nsPerOp(rounds, kMessageTypeCount, [&] {
+        size_t acc = 0;
+        for (size_t i = 0; i < kMessageTypeCount; ++i) {
+            acc += messageTypeName(static_cast<MessageType>(i)).size();
+        }
+        sink = sink + acc;
+    });
+    report("type -> name", legacyName, generatedName);
+
+    double legacyDispatch = nsPerOp(rounds, names.size(), [&] {
+        for (const auto& name : names) {
+            a.legacyDispatch(legacyStringToMessageType(name), name);
+        }
+    });
+    double generatedDispatch = nsPerOp(rounds, views.size(), [&] {
+        for (auto name : views) {
+            b.dispatch(stringToMessageType(name), name);
+        }
+    });
+    report("lookup + dispatch", legacyDispatch, generatedDispatch);
+
+    CHECK(a.sum == b.sum);
+    std::puts("protocol_bench: ok");
+    return 0;
+}
@@ -0,0 +1,99 @@
+// 信令消息的流式解析：嵌套 payload 的严格校验 (服务端原样转发)，以及 version 字段
+#include "protocol.hpp"
+#include "check.hpp"
+
+#include <string>
+
+using namespace p2p;
+
+static std::string envelope(const std::string& payload, const std::string& version = "2") {
+    return "{\"type\":\"relay_data\",\"from\":\"a\",\"to\":\"b\",\"payload\":" + payload +
+           ",\"version\":" + version + "}";
+}
+
+static bool parses(const std::string& input) {
+    SignalingMessageView view;
+    return SignalingMessageView::parse(input, view);
+}
+
+static void testNestedPayload() {
+    const std::string valid[] = {
+        "{}",
+        "[]",
+        "{\"a\":[1,-2.5e3,0,0.5,1E+2,true,false,null],\"b\":{\"c\":\"x\\u00e9\\n\\\"\"}}",
+        " [ { } , [ ] , \"\" ] ",
+    };
+    for (const auto& payload : valid) {
+        std::string input = envelope(payload);
+        auto msg = SignalingMessage::deserialize(input);
+        CHECK(msg.payloadIsJson);
+        // 转发形式必须是合法 JSON
+        auto forwarded = nlohmann::json::parse(msg.serialize());
+        CHECK(forwarded["payload"] == nlohmann::json::parse(payload));
+    }
+
+    const std::string malformed[] = {
+        "{\"a\":tru}",
+        "{\"a\":truex}",
+        "{\"a\":1x}",
+        "{\"a\":01}",
+        "{\"a\":-}",
+        "{\"a\":1.}",
+        "{\"a\":1e}",
+        "{\"a\":undefined}",
+        "{\"a\":NaN}",
+        "{\"a\" 1}",
+        "{\"a\":1,}",
+        "{a:1}",
+        "[1,]",
+        "[1 2]",
+        "[1}",
+        "{\"a\":\"\x01\"}",
+        "{\"a\":\"line\nbreak\"}",
+        "[\"\\x\"]",
+        "[\"\\u12g4\"]",
+        "{\"a\":[}",
+        std::string(65, '[') + std::string(65, ']'),
+    };
+    for (const auto& payload : malformed) {
+        CHECK(!parses(envelope(payload)));
+        CHECK_THROWS(SignalingMessage::deserialize(envelope(payload)));
+        CHECK_THROWS(PmrSignalingMessage::deserialize(envelope(payload)));
+    }
+    CHECK(parses(envelope(std::string(64, '[') + std::string(64, ']'))));
+
+    // 字符串 payload 不受影响
+    auto msg = SignalingMessage::deserialize(envelope("\"{not json\""));
+    CHECK(!msg.payloadIsJson && msg.payload == "{not json");
+}
+
+static uint32_t version(const std::string& raw) {
+    SignalingMessageView view;
+    CHECK(SignalingMessageView::parse(envelope("{}", raw), view));
+    return view.version;
+}
+
+static void testVersion() {
+    CHECK(version("1") == 1);
+    CHECK(version("3") == 3);
+    CHECK(version("\"3\"") == 0);
+    CHECK(version("-1") == 0);
+    CHECK(version("2.5") == 0);
+    CHECK(version("true") == 0);
+    // 高于已知版本按 kProtocolVersion 处理，不溢出
+    CHECK(version("99") == kProtocolVersion);
+    CHECK(version("4294967297") == kProtocolVersion);
+    CHECK(version("99999999999999999999999") == kProtocolVersion);
+
+    auto j = nlohmann::json::parse(envelope("{}", "4294967297"));
+    CHECK(SignalingMessage::fromJson(j).version == kProtocolVersion);
+    j["version"] = "3";
+    CHECK(SignalingMessage::fromJson(j).version == 0);
+}
+
+int main() {
+    testNestedPayload();
+    testVersion();
+    std::puts("protocol_test: ok");
+    return 0;
+}
@@ -0,0 +1,90 @@
+// TopicTrie 通配符匹配，以及两个 PubSub 实例之间的订阅传播
+#include "pubsub.hpp"
+#include "check.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace p2p;
+
+static std::vector<size_t> matches(const TopicTrie& trie, const std::string& topic) {
+    SlotSet out;
+    trie.match(topic, out);
+    std::vector<size_t> slots;
+    out.forEach([&](size_t slot) { slots.push_back(slot); });
+    return slots;
+}
+
+static void testTopicTrie() {
+    CHECK(TopicTrie::validPattern("a/*/c"));
+    CHECK(TopicTrie::validPattern("#"));
+    CHECK(TopicTrie::validPattern("a/#"));
+    CHECK(!TopicTrie::validPattern("a/#/c"));
+    CHECK(!TopicTrie::validPattern("a/b*"));
+    CHECK(!TopicTrie::validPattern(""));
+
+    TopicTrie trie;
+    trie.add("a/b/c", 1);
+    trie.add("a/*/c", 2);
+    trie.add("a/#", 3);
+    trie.add("#", 4);
+    trie.add("x/y", 5);
+    trie.add("a", 6);
+    CHECK((matches(trie, "a/b/c") == std::vector<size_t>{1, 2, 3, 4}));
+    CHECK((matches(trie, "a/z/c") == std::vector<size_t>{2, 3, 4}));
+    CHECK((matches(trie, "a") == std::vector<size_t>{3, 4, 6}));  // "a/#" 也匹配父级
+    CHECK((matches(trie, "x/y") == std::vector<size_t>{4, 5}));
+    CHECK((matches(trie, "x/y/z") == std::vector<size_t>{4}));
+
+    trie.remove("#", 4);
+    trie.remove("a/#", 3);
+    CHECK((matches(trie, "a/b/c") == std::vector<size_t>{1, 2}));
+    trie.add("q", 200);  // 超过一个字的槽位
+    CHECK((matches(trie, "q") == std::vector<size_t>{200}));
+}
+
+static void testLoopback() {
+    std::map<std::string, PubSub*> route;
+    auto sender = [&route](std::string self) {
+        return [&route, self](const std::string& to, const ConstBuffer* parts, size_t count) {
+            std::vector<uint8_t> frame;
+            for (size_t i = 0; i < count; ++i) {
+                auto* data = static_cast<const uint8_t*>(parts[i].data);
+                frame.insert(frame.end(), data, data + parts[i].size);
+            }
+            route[to]->handleFrame(self, frame.data(), frame.size());
+            return true;
+        };
+    };
+    PubSub a(sender("A"));
+    PubSub b(sender("B"));
+    route["A"] = &a;
+    route["B"] = &b;
+
+    std::vector<std::string> received;
+    b.setOnPublication([&](const std::string& from, const std::string& topic, const Buffer& data) {
+        received.push_back(from + ":" + topic + ":" + std::string(data.begin(), data.end()));
+    });
+    b.subscribe("chat/*");
+    a.addPeer("B");
+    b.addPeer("A");  // 订阅在加入 Peer 时同步给对方
+
+    CHECK(a.publish("chat/x", std::string_view("hi")) == 1);
+    CHECK(a.publish("news/x", std::string_view("no")) == 0);  // 发送端过滤
+    b.unsubscribe("chat/*");
+    CHECK(a.publish("chat/x", std::string_view("hi")) == 0);
+    b.subscribe("#");
+    CHECK(a.publish("z", std::string_view("zz")) == 1);
+    a.removePeer("B");
+    CHECK(a.publish("z", std::string_view("zz")) == 0);
+
+    CHECK((received == std::vector<std::string>{"A:chat/x:hi", "A:z:zz"}));
+}
+
+int main() {
+    testTopicTrie();
+    testLoopback();
+    std::puts("pubsub_test: ok");
+    return 0;
+}
@@ -0,0 +1,87 @@
+// 服务端令牌桶限流：突发容量、补充速率、重试等待时间，以及网关连接按 ID 数放大配额
+#include "rate_limiter.hpp"
+#include "check.hpp"
+
+using Clock = TokenBucket::Clock;
+using std::chrono::milliseconds;
+
+static void testTokenBucket() {
+    TokenBucket unlimited;
+    CHECK(unlimited.unlimited() && unlimited.consume(1e9, Clock::now()));
+
+    TokenBucket bucket(10, 1.0);  // 10 个/秒，容量 10
+    auto now = Clock::now();
+    for (int i = 0; i < 10; ++i) {
+        CHECK(bucket.consume(1, now));
+    }
+    CHECK(!bucket.consume(1, now));
+    CHECK(bucket.retryAfterMs(1) > 0 && bucket.retryAfterMs(1) <= 101);
+    CHECK(bucket.consume(1, now + milliseconds(100)));  // 补充 1 个
+    CHECK(!bucket.consume(1, now + milliseconds(100)));
+
+    // 桶满时允许一次超过容量的消耗，大消息不会永久被拒
+    TokenBucket bytes(100, 1.0);
+    CHECK(bytes.consume(1000, now));
+    CHECK(!bytes.consume(1, now));
+}
+
+// 消息桶与字节桶都放行才消耗；拒绝时等待时间取两者中较长的
+static void testRateLimiter() {
+    auto now = Clock::now();
+    RateLimiter limiter(1000, 100, 1.0);
+    CHECK(limiter.admit(100, now) == 0);
+    uint32_t retry = limiter.admit(50, now);
+    CHECK(retry >= 400 && retry <= 501);  // 字节桶需要约 0.5 秒
+    CHECK(limiter.admit(50, now + milliseconds(600)) == 0);
+
+    RateLimiter msgs(2, 0, 1.0);  // 只限消息数
+    CHECK(msgs.admit(1 << 20, now) == 0);
+    CHECK(msgs.admit(1 << 20, now) == 0);
+    CHECK(msgs.admit(1, now) > 0);
+}
+
+// 拒绝时按补充到 now 的令牌计算等待时间，只计入实际拒绝的桶
+static void testRetryAfterRefill() {
+    auto now = Clock::now();
+    RateLimiter limiter(1000, 100, 1.0);
+    CHECK(limiter.admit(100, now) == 0);
+    uint32_t retry = limiter.admit(50, now + milliseconds(200));  // 已补充约 20 字节
+    CHECK(retry >= 250 && retry <= 301);
+}
+
+static int admitted(ClientRateLimiter& limiter, int attempts) {
+    int count = 0;
+    for (int i = 0; i < attempts; ++i) {
+        count += limiter.admit(10) == 0;
+    }
+    return count;
+}
+
+static void testEndpointScaling() {
+    RateLimitConfig config;
+    config.clientMsgsPerSec = 10;
+    config.burstSeconds = 1.0;
+    ClientRateLimiter limiter(config);
+    CHECK(admitted(limiter, 50) == 10);
+
+    // 再挂两个虚拟 ID：容量扩大到 30，新增的 20 立即可用
+    limiter.setEndpoints(3);
+    CHECK(admitted(limiter, 50) == 20);
+
+    // 虚拟 ID 注销后容量回到 10，现有令牌被截断
+    limiter.setEndpoints(1);
+    CHECK(admitted(limiter, 50) == 0);
+    CHECK(limiter.throttledMsgs > 0 && limiter.acceptedMsgs == 30);
+
+    CHECK(limiter.shouldNotify(milliseconds(1000)));
+    CHECK(!limiter.shouldNotify(milliseconds(1000)));
+}
+
+int main() {
+    testTokenBucket();
+    testRateLimiter();
+    testRetryAfterRefill();
+    testEndpointScaling();
+    std::puts("rate_limiter_test: ok");
+    return 0;
+}
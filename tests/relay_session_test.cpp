@@ -0,0 +1,301 @@
+// RelaySession：序号、确认、重传计时、信用流控、零窗口探测，以及丢包/丢确认下的端到端模拟
+#include "relay_session.hpp"
+#include "check.hpp"
+
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace p2p;
+using Clock = RelaySession::Clock;
+
+// 只解析 RelaySession 自己生成的 payload 中的数字字段
+static std::optional<uint64_t> field(const std::string& payload, const std::string& key) {
+    auto pos = payload.find("\"" + key + "\":");
+    if (pos == std::string::npos) {
+        return std::nullopt;
+    }
+    pos += key.size() + 3;
+    size_t end = pos;
+    while (end < payload.size() && payload[end] >= '0' && payload[end] <= '9') {
+        ++end;
+    }
+    return RelaySession::parseNumber(std::string_view(payload).substr(pos, end - pos));
+}
+
+static bool flag(const std::string& payload, const std::string& key) {
+    return payload.find("\"" + key + "\":true") != std::string::npos;
+}
+
+// size 字节的 JSON 对象 payload
+static std::string object(size_t size) {
+    return "{\"d\":\"" + std::string(size - 8, 'x') + "\"}";
+}
+
+static void testSequencing() {
+    RelaySession sender(1024);
+    sender.setReliable(true);
+    auto now = Clock::now();
+    CHECK(field(sender.push("{\"a\":1}", now), "seq") == 1u);
+    CHECK(field(sender.push("{\"a\":2}", now), "seq") == 2u);
+    CHECK(sender.unacked().size() == 2);
+
+    sender.acknowledge(1, now);
+    CHECK(sender.unacked().size() == 1 && sender.unacked().front().seq == 2);
+
+    // 重传计时器按 kInitialRto 到期，之后指数退避
+    CHECK(!sender.takeRetransmitDue(now + RelaySession::kInitialRto / 2));
+    CHECK(sender.takeRetransmitDue(now + RelaySession::kInitialRto));
+    CHECK(!sender.takeRetransmitDue(now + RelaySession::kInitialRto * 2));
+    CHECK(sender.takeRetransmitDue(now + RelaySession::kInitialRto * 3));
+    sender.acknowledge(2, now);
+    CHECK(sender.unacked().empty());
+    CHECK(!sender.takeRetransmitDue(now + RelaySession::kMaxRto * 2));
+
+    RelaySession receiver(1024);
+    CHECK(receiver.receive(1, 10) == RelaySession::Receive::Deliver);
+    CHECK(receiver.receive(1, 10) == RelaySession::Receive::Duplicate);
+    CHECK(receiver.receive(3, 10) == RelaySession::Receive::Gap);
+    CHECK(receiver.receive(2, 10) == RelaySession::Receive::Deliver);
+    CHECK(receiver.missing());  // 3 被丢弃，等待重发
+    CHECK(receiver.receive(3, 10) == RelaySession::Receive::Deliver);
+    CHECK(!receiver.missing());
+
+    // 同一缺口在 kResendInterval 内只请求一次重发，缺口位置变化后立即请求
+    CHECK(receiver.receive(5, 10) == RelaySession::Receive::Gap);
+    CHECK(receiver.shouldRequestResend(now));
+    CHECK(!receiver.shouldRequestResend(now + RelaySession::kResendInterval / 2));
+    CHECK(receiver.shouldRequestResend(now + RelaySession::kResendInterval));
+    CHECK(receiver.receive(4, 10) == RelaySession::Receive::Deliver);
+    CHECK(receiver.shouldRequestResend(now + RelaySession::kResendInterval));
+
+    // 序号写入任意 JSON 对象 (空对象、结尾空白)；不是对象的 payload 由调用方拒绝
+    CHECK(sender.push("{}", now) == "{\"seq\":3,\"ack\":0}");
+    CHECK(sender.push(" { } \n", now) == " { \"seq\":4,\"ack\":0}");
+    CHECK(sender.push("{\"a\":[1]}\r\n", now) == "{\"a\":[1],\"seq\":5,\"ack\":0}");
+    CHECK(RelaySession::framable(" {\"a\":1} "));
+    CHECK(!RelaySession::framable(""));
+    CHECK(!RelaySession::framable("{"));
+    CHECK(!RelaySession::framable("[1]"));
+    CHECK(!RelaySession::framable("\"{}\""));
+    CHECK(!RelaySession::framable(std::string("\x01\x02}", 3)));
+
+    CHECK(RelaySession::parseNumber("123") == 123u);
+    CHECK(!RelaySession::parseNumber(""));
+    CHECK(!RelaySession::parseNumber("12a"));
+}
+
+static void testDelayedAck() {
+    RelaySession receiver(1024);
+    auto now = Clock::now();
+    CHECK(!receiver.takeAckDue(now));
+    receiver.receive(1, 10);
+    CHECK(!receiver.takeAckDue(now));  // 第一次调用只启动延迟确认计时
+    CHECK(receiver.takeAckDue(now + RelaySession::kAckDelay));
+
+    receiver.controlPayload(false);
+    receiver.receive(2, RelaySession::kAckBytes);
+    CHECK(receiver.takeAckDue(now));  // 字节数达到阈值立即确认
+}
+
+static void testCredit() {
+    RelaySession sender(1 << 20);
+    CHECK(sender.hasCredit(1 << 20));  // 对方不做流控
+    sender.setPeerWindow(100);
+    CHECK(sender.hasCredit(100) && sender.hasCredit(1000));  // 窗口空闲时超过窗口的消息也能发出
+    // 信用按写入 seq/ack 之后的 payload 计算
+    size_t sent = sender.push(object(40)).size();
+    CHECK(sender.hasCredit(100 - sent) && !sender.hasCredit(101 - sent));
+    sender.updateCredit(sent + 100);
+    CHECK(sender.hasCredit(100));
+    sender.updateCredit(sent + 50);  // 乱序到达的旧信用不回退
+    CHECK(sender.hasCredit(100));
+    sent += sender.push(object(120)).size();
+    CHECK(!sender.hasCredit(1));
+    sender.updateCredit(sent + 100);
+    CHECK(sender.hasCredit(1000));
+    // 重复到达的窗口通告不改变信用 (在途的消息不会被重复计入)
+    uint64_t limit = sent + 100;
+    sent += sender.push(object(60)).size();
+    size_t remaining = limit - sent;
+    for (uint64_t window : {100, 100, 1000}) {
+        sender.setPeerWindow(window);
+        CHECK(sender.hasCredit(remaining) && !sender.hasCredit(remaining + 1));
+    }
+
+    RelaySession receiver(1 << 20);
+    auto now = Clock::now();
+    receiver.setLocalWindow(100);
+    CHECK(receiver.receive(1, 40) == RelaySession::Receive::Deliver);
+    CHECK(!receiver.takeAckDue(now));
+    CHECK(receiver.receive(2, 10) == RelaySession::Receive::Deliver);
+    CHECK(receiver.takeAckDue(now));  // 已消耗半个窗口
+    CHECK(field(receiver.controlPayload(false), "credit") == 150u);
+}
+
+static void testZeroWindowProbe() {
+    RelaySession sender(1 << 20);
+    sender.setReliable(true);
+    sender.setPeerWindow(100);
+    auto now = Clock::now();
+    sender.push(object(108), now);
+    CHECK(!sender.hasCredit(10));
+    sender.creditBlocked(10, now);
+    CHECK(!sender.takeProbeDue(now));
+    CHECK(sender.takeProbeDue(now + RelaySession::kInitialRto));
+    CHECK(flag(sender.controlPayload(false, true), "probe"));
+    sender.updateCredit(1000);
+    CHECK(sender.hasCredit(10));
+    CHECK(!sender.takeProbeDue(now + RelaySession::kMaxRto * 4));
+}
+
+// 两端之间的模拟链路：0 = 30% 丢包，1 = 丢掉最后 10 条 (只能靠重传计时器恢复)，
+// 2 = 1000 字节窗口且一半的确认丢失 (依赖零窗口探测)
+static void simulate(int scenario) {
+    RelaySession a(4 * 1024 * 1024);
+    RelaySession b(4 * 1024 * 1024);
+    a.setReliable(true);
+    b.setReliable(true);
+    if (scenario == 2) {
+        b.setLocalWindow(1000);
+        a.setPeerWindow(1000);
+    }
+    std::mt19937 rng(scenario);
+    std::uniform_real_distribution<> uniform(0, 1);
+    auto now = Clock::now();
+    std::vector<std::string> toB;
+    std::vector<std::string> toA;
+    const int total = 200;
+    int pushed = 0;
+    std::vector<uint64_t> delivered;
+    double loss = scenario == 0 ? 0.3 : 0.0;
+    std::string body = "{\"data\":\"" + std::string(scenario == 2 ? 300 : 10, 'x') + "\"}";
+
+    for (int step = 0; step < 200000 && static_cast<int>(delivered.size()) < total; ++step) {
+        now += std::chrono::milliseconds(5);
+        if (pushed < total) {
+            if (a.hasRoom(body.size()) && a.hasCredit(body.size())) {
+                auto out = a.push(body, now);
+                ++pushed;
+                bool drop = (scenario == 1 && pushed > total - 10) || uniform(rng) < loss;
+                if (!drop) {
+                    toB.push_back(out);
+                }
+            } else if (!a.hasCredit(body.size())) {
+                a.creditBlocked(body.size(), now);
+            }
+        }
+
+        if (a.takeRetransmitDue(now)) {
+            toB.push_back(a.unacked().front().payload);
+        }
+        if (a.takeProbeDue(now)) {
+            toB.push_back(a.controlPayload(false, true));
+        }
+        if (b.takeAckDue(now)) {
+            auto control = b.controlPayload(false);
+            if (scenario != 2 || uniform(rng) > 0.5) {
+                toA.push_back(control);
+            }
+        }
+
+        for (const auto& message : toB) {
+            if (flag(message, "probe")) {
+                toA.push_back(b.controlPayload(false));
+                continue;
+            }
+            if (auto seq = field(message, "seq")) {
+                auto result = b.receive(*seq, message.size());
+                if (result == RelaySession::Receive::Deliver) {
+                    delivered.push_back(*seq);
+                }
+                bool gap = result == RelaySession::Receive::Gap ||
+                           (result == RelaySession::Receive::Deliver && b.missing());
+                bool resend = gap && b.shouldRequestResend(now);
+                if (resend || b.takeAckDue(now)) {
+                    toA.push_back(b.controlPayload(resend));
+                }
+            }
+        }
+        toB.clear();
+
+        for (const auto& message : toA) {
+            if (auto ack = field(message, "ack")) {
+                a.acknowledge(*ack, now);
+            }
+            if (auto credit = field(message, "credit")) {
+                a.updateCredit(*credit);
+            }
+            if (flag(message, "resend")) {
+                for (const auto& outgoing : a.unacked()) {
+                    toB.push_back(outgoing.payload);
+                }
+            }
+        }
+        toA.clear();
+    }
+
+    CHECK(static_cast<int>(delivered.size()) == total);
+    for (size_t i = 0; i < delivered.size(); ++i) {
+        CHECK(delivered[i] == i + 1);
+    }
+}
+
+// 多个线程并发发送：持锁分配序号并入队，释放锁后按客户端 flushRelay 的方式发出，
+// "线上"的序号必须严格递增
+static void testOutboundOrder() {
+    RelaySession session(64 * 1024 * 1024);
+    session.setReliable(true);
+    std::vector<uint64_t> wire;
+    auto flush = [&] {
+        std::lock_guard<std::mutex> sendLock(session.sendMutex());
+        std::string message;
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(session.mutex());
+                if (!session.takeOutbound(message)) {
+                    return;
+                }
+            }
+            wire.push_back(*field(message, "seq"));  // 只有持有 sendMutex 的线程写入
+        }
+    };
+
+    const int perThread = 2000;
+    std::vector<std::thread> senders;
+    for (int t = 0; t < 4; ++t) {
+        senders.emplace_back([&] {
+            for (int i = 0; i < perThread; ++i) {
+                {
+                    std::lock_guard<std::mutex> lock(session.mutex());
+                    session.enqueue(session.push("{\"d\":1}"));
+                }
+                flush();
+            }
+        });
+    }
+    for (auto& thread : senders) {
+        thread.join();
+    }
+
+    CHECK(wire.size() == 4 * perThread);
+    for (size_t i = 0; i < wire.size(); ++i) {
+        CHECK(wire[i] == i + 1);
+    }
+    std::string message;
+    CHECK(!session.takeOutbound(message));
+}
+
+int main() {
+    testSequencing();
+    testOutboundOrder();
+    testDelayedAck();
+    testCredit();
+    testZeroWindowProbe();
+    for (int scenario = 0; scenario < 3; ++scenario) {
+        simulate(scenario);
+    }
+    std::puts("relay_session_test: ok");
+    return 0;
+}
@@ -0,0 +1,94 @@
+// 结构化消息编解码：字段布局、截断数据与越界长度的拒绝、嵌套结构和按类型 ID 分发
+#include "p2p/schema.hpp"
+#include "check.hpp"
+
+#include <cstring>
+
+namespace {
+
+struct Inner {
+    uint8_t a;
+    std::string s;
+    P2P_SCHEMA(7, a, s)
+};
+
+enum class Kind : uint16_t { A = 3 };
+
+struct Position {
+    uint32_t entity;
+    float x, y, z;
+    Kind kind;
+    std::string_view name;
+    p2p::ArrayView<uint16_t> tags;
+    std::vector<int32_t> vals;
+    Inner inner;
+    P2P_SCHEMA(0x0101, entity, x, y, z, kind, name, tags, vals, inner)
+};
+
+} // namespace
+
+static void testDecodeField() {
+    using p2p::schema::decodeField;
+
+    uint8_t bytes[8] = {0x2a, 0, 0, 0, 0xff, 0xff, 0xff, 0xff};
+    const uint8_t* p = bytes;
+    uint32_t value = 0;
+    CHECK(decodeField(p, bytes + 4, value) && value == 42 && p == bytes + 4);
+    p = bytes;
+    CHECK(!decodeField(p, bytes + 3, value));  // 不足 4 字节
+    CHECK(p == bytes);
+
+    // 变长字段：长度前缀超过剩余字节数时拒绝，不越界读取
+    std::string text;
+    p = bytes + 4;
+    CHECK(!decodeField(p, bytes + 8, text));
+    uint8_t encoded[7] = {3, 0, 0, 0, 'a', 'b', 'c'};
+    p = encoded;
+    CHECK(decodeField(p, encoded + sizeof(encoded), text) && text == "abc" && p == encoded + sizeof(encoded));
+
+    std::vector<int32_t> values;
+    uint8_t elements[8] = {2, 0, 0, 0, 1, 0, 0, 0};  // 声明 2 个 int32，只有 1 个
+    p = elements;
+    CHECK(!decodeField(p, elements + sizeof(elements), values));
+}
+
+static void testObject() {
+    std::vector<uint16_t> tags = {1, 2, 3};
+    Position position{42, 1.f, 2.f, 3.f, Kind::A, "player", tags, {-1, 5}, {9, "hello"}};
+    static_assert(p2p::schema::partCount<Position>() == 5 + 2 * 3 + 1 + 2);
+
+    p2p::Buffer encoded = p2p::encodeObject(position);
+    size_t expected = 4 + 4 * 4 + 2 + 4 + 6 + 4 + 6 + 4 + 8 + 1 + 4 + 5;
+    CHECK(encoded.size() == expected);
+
+    Position decoded{};
+    CHECK(p2p::decodeObject(encoded, decoded));
+    CHECK(decoded.entity == 42 && decoded.z == 3.f && decoded.kind == Kind::A && decoded.name == "player");
+    CHECK(decoded.tags.size() == 3 && decoded.tags[2] == 3);
+    CHECK(decoded.vals.size() == 2 && decoded.vals[0] == -1);
+    CHECK(decoded.inner.a == 9 && decoded.inner.s == "hello");
+
+    // 任意截断都被拒绝
+    for (size_t size = 0; size < encoded.size(); ++size) {
+        Position truncated{};
+        CHECK(!p2p::decodeObject(encoded.data(), size, truncated));
+    }
+    // 类型 ID 不符
+    Inner inner{};
+    CHECK(!p2p::decodeObject(encoded, inner));
+
+    p2p::ObjectRouter router;
+    int hits = 0;
+    router.on<Position>([&](const std::string& from, const Position& pos) {
+        hits += pos.entity == 42 && from == "x";
+    });
+    CHECK(router.dispatch("x", encoded) && hits == 1);
+    CHECK(!router.dispatch("x", p2p::encodeObject(inner)));
+}
+
+int main() {
+    testDecodeField();
+    testObject();
+    std::puts("schema_test: ok");
+    return 0;
+}
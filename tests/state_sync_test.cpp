@@ -0,0 +1,134 @@
+// StateSync：快照与增量、删除、重连后的全量同步、缺失批次的重发，以及周期内修改的合并
+#include "state_sync.hpp"
+#include "check.hpp"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace p2p;
+
+namespace {
+
+struct Network {
+    std::mutex mutex;
+    std::deque<std::tuple<std::string, std::string, std::vector<uint8_t>>> queue;  // from, to, frame
+    bool dropFromA = false;
+};
+
+StateSync::SendFrame sender(Network& network, std::string self) {
+    return [&network, self](const std::string& peer, const ConstBuffer* parts, size_t count) {
+        std::vector<uint8_t> frame;
+        for (size_t i = 0; i < count; ++i) {
+            auto* data = static_cast<const uint8_t*>(parts[i].data);
+            frame.insert(frame.end(), data, data + parts[i].size);
+        }
+        std::lock_guard<std::mutex> lock(network.mutex);
+        if (!(network.dropFromA && self == "A")) {
+            network.queue.emplace_back(self, peer, std::move(frame));
+        }
+        return true;
+    };
+}
+
+ConstBuffer text(const std::string& value) {
+    return ConstBuffer(std::string_view(value));
+}
+
+} // namespace
+
+static void testReplication() {
+    Network network;
+    StateSync a(sender(network, "A"), std::chrono::milliseconds(0));
+    StateSync b(sender(network, "B"), std::chrono::milliseconds(0));
+    auto pump = [&] {
+        for (;;) {
+            std::tuple<std::string, std::string, std::vector<uint8_t>> item;
+            {
+                std::lock_guard<std::mutex> lock(network.mutex);
+                if (network.queue.empty()) {
+                    return;
+                }
+                item = std::move(network.queue.front());
+                network.queue.pop_front();
+            }
+            auto& [from, to, frame] = item;
+            (to == "B" ? b : a).handleFrame(from, frame.data(), frame.size());
+        }
+    };
+    int updates = 0;
+    b.setOnUpdate([&](const std::string&, const std::string&, const std::optional<Buffer>&) { ++updates; });
+
+    a.set("x", text("1"));
+    a.addPeer("B");
+    b.addPeer("A");
+    pump();
+    CHECK(b.peerValue("A", "x") && b.peerValue("A", "x")->size() == 1);
+    CHECK(a.stats().snapshotsSent == 1);
+
+    // 大于一帧的一批拆成多帧
+    std::string big(100000, 'z');
+    for (int i = 0; i < 10; ++i) {
+        a.set("k" + std::to_string(i), text(big));
+    }
+    a.erase("x");
+    pump();
+    CHECK(!b.peerValue("A", "x"));
+    CHECK(b.peerState("A").size() == 10);
+    CHECK(a.stats().deltasSent > 0);
+
+    // 重连：双方移除再加入，对方收到新的快照
+    a.removePeer("B");
+    b.removePeer("A");
+    a.set("y", text("2"));
+    a.addPeer("B");
+    b.addPeer("A");
+    pump();
+    CHECK(b.peerState("A").size() == 11);
+
+    // 丢失一批增量后，下一批到达时接收方发现缺口并请求重发
+    {
+        std::lock_guard<std::mutex> lock(network.mutex);
+        network.dropFromA = true;
+    }
+    a.set("lost", text("3"));
+    {
+        std::lock_guard<std::mutex> lock(network.mutex);
+        network.dropFromA = false;
+    }
+    a.set("z", text("4"));
+    pump();
+    CHECK(b.peerState("A").size() == 13);
+    CHECK(a.stats().resyncs > 0);
+    CHECK(updates > 0);
+}
+
+// 一个周期内对同一个键的多次修改只发最后一次
+static void testBatching() {
+    std::atomic<int> frames{0};
+    StateSync sync([&](const std::string&, const ConstBuffer*, size_t) {
+        ++frames;
+        return true;
+    }, std::chrono::milliseconds(30));
+    sync.addPeer("D");
+    CHECK(test::waitFor([&] { return frames >= 1; }));  // 初始快照
+    for (int i = 0; i < 1000; ++i) {
+        sync.set("k", text(std::to_string(i)));
+    }
+    CHECK(test::waitFor([&] { return sync.stats().deltasSent >= 1 && sync.get("k"); }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto stats = sync.stats();
+    CHECK(stats.deltasSent < 20);
+    CHECK(stats.entriesSent < 20);
+    CHECK(std::string(sync.get("k")->begin(), sync.get("k")->end()) == "999");
+}
+
+int main() {
+    testReplication();
+    testBatching();
+    std::puts("state_sync_test: ok");
+    return 0;
+}
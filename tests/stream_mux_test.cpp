@@ -0,0 +1,238 @@
+// StreamMux：帧格式、格式错误的帧、按流的流控，以及多线程下大量并发流的完整性
+#include "stream_mux.hpp"
+#include "check.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace p2p;
+
+using Frame = std::vector<uint8_t>;
+
+static StreamMux::SendFrame queueSender(std::mutex& mutex, std::deque<Frame>& queue) {
+    return [&mutex, &queue](const std::string&, const ConstBuffer* parts, size_t count) {
+        Frame frame;
+        for (size_t i = 0; i < count; ++i) {
+            auto* data = static_cast<const uint8_t*>(parts[i].data);
+            frame.insert(frame.end(), data, data + parts[i].size);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(frame));
+        return true;
+    };
+}
+
+// 单线程：帧按顺序在两端之间转发，直到两个方向都没有帧
+struct Loopback {
+    std::mutex mutex;
+    std::deque<Frame> toB;
+    std::deque<Frame> toA;
+    std::shared_ptr<StreamMux> a;
+    std::shared_ptr<StreamMux> b;
+    std::vector<uint8_t> kinds;  // A 发出的帧类型
+
+    Loopback() {
+        auto always = [](const std::string&, size_t) { return true; };
+        a = std::make_shared<StreamMux>(queueSender(mutex, toB), always, 64 * 1024, 1 << 20);
+        b = std::make_shared<StreamMux>(queueSender(mutex, toA), always, 64 * 1024, 1 << 20);
+    }
+
+    void pump() {
+        for (;;) {
+            Frame frame;
+            bool forB = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!toB.empty()) {
+                    frame = std::move(toB.front());
+                    toB.pop_front();
+                    forB = true;
+                } else if (!toA.empty()) {
+                    frame = std::move(toA.front());
+                    toA.pop_front();
+                } else {
+                    return;
+                }
+            }
+            if (forB) {
+                kinds.push_back(frame[0]);
+                b->handleFrame("A", frame.data(), frame.size());
+                a->resume("B");
+            } else {
+                a->handleFrame("B", frame.data(), frame.size());
+                b->resume("A");
+            }
+        }
+    }
+};
+
+static void testFraming() {
+    Loopback link;
+    std::string received;
+    bool closed = false;
+    link.b->setOnStream([&](Stream stream) {
+        CHECK(stream.peerId() == "A");
+        stream.setOnData([&](const Buffer& data) { received.append(data.begin(), data.end()); });
+        stream.setOnClose([&] { closed = true; });
+    });
+
+    Stream stream = link.a->open("B");
+    CHECK(stream.id() % 2 == 0);  // 本端打开的流为偶数
+    CHECK(stream.write(std::string_view("hello")));
+    stream.close();
+    link.pump();
+
+    CHECK(received == "hello");
+    CHECK(closed);
+    CHECK(link.kinds.size() >= 3);
+    CHECK(link.kinds.front() == 0);  // 打开
+    CHECK(link.kinds[1] == 1);       // 数据
+    CHECK(link.kinds.back() == 3);   // 关闭
+}
+
+static void testMalformedFrames() {
+    Loopback link;
+    auto frame = [&](std::initializer_list<uint8_t> bytes) {
+        Frame data(bytes);
+        link.b->handleFrame("A", data.data(), data.size());
+    };
+    CHECK_THROWS(frame({}));
+    CHECK_THROWS(frame({1}));            // 缺少 id
+    CHECK_THROWS(frame({1, 0x80}));      // 截断的 varint
+    CHECK_THROWS(frame({9, 0}));         // 未知类型
+    CHECK_THROWS(frame({0, 0}));         // 打开帧缺少窗口
+    CHECK_THROWS(frame({0, 1, 0x10}));   // 对方打开的流 id 必须为偶数 (本端视角为奇数)
+    frame({1, 4, 'x'});                  // 不存在的流：忽略
+    frame({3, 4});
+}
+
+// 接收端不处理数据时发送端最多发出一个窗口，回调返回后继续
+static void testFlowControl() {
+    Loopback link;
+    size_t received = 0;
+    link.b->setOnStream([&](Stream stream) {
+        stream.setOnData([&](const Buffer& data) { received += data.size(); });
+    });
+    Stream stream = link.a->open("B");
+    std::string chunk(256 * 1024, 'x');
+    CHECK(stream.write(std::string_view(chunk)));
+    link.pump();
+    CHECK(received == chunk.size());
+    CHECK(stream.bufferedAmount() == 0);
+}
+
+// 两个网络线程双向转发，1000 个流交错写入，检查每个流的内容完整且有序
+static void testConcurrentStreams() {
+    struct Pipe {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Frame> queue;
+        bool stop = false;
+    };
+    Pipe ab;
+    Pipe ba;
+    auto sender = [](Pipe* pipe) {
+        return [pipe](const std::string&, const ConstBuffer* parts, size_t count) {
+            Frame frame;
+            for (size_t i = 0; i < count; ++i) {
+                auto* data = static_cast<const uint8_t*>(parts[i].data);
+                frame.insert(frame.end(), data, data + parts[i].size);
+            }
+            {
+                std::lock_guard<std::mutex> lock(pipe->mutex);
+                pipe->queue.push_back(std::move(frame));
+            }
+            pipe->cv.notify_one();
+            return true;
+        };
+    };
+    auto canSend = [](Pipe* pipe) {
+        return [pipe](const std::string&, size_t) {
+            std::lock_guard<std::mutex> lock(pipe->mutex);
+            return pipe->queue.size() < 64;
+        };
+    };
+    auto a = std::make_shared<StreamMux>(sender(&ab), canSend(&ab), 64 * 1024, 1 << 20);
+    auto b = std::make_shared<StreamMux>(sender(&ba), canSend(&ba), 128 * 1024, 1 << 20);
+    auto worker = [](Pipe* pipe, StreamMux* destination, StreamMux* source) {
+        return std::thread([=] {
+            for (;;) {
+                Frame frame;
+                {
+                    std::unique_lock<std::mutex> lock(pipe->mutex);
+                    pipe->cv.wait(lock, [&] { return pipe->stop || !pipe->queue.empty(); });
+                    if (pipe->queue.empty()) {
+                        return;
+                    }
+                    frame = std::move(pipe->queue.front());
+                    pipe->queue.pop_front();
+                }
+                destination->handleFrame("x", frame.data(), frame.size());
+                source->resume("x");
+            }
+        });
+    };
+
+    std::mutex receivedMutex;
+    std::map<uint64_t, std::string> received;
+    std::atomic<int> closed{0};
+    b->setOnStream([&](Stream stream) {
+        stream.setOnData([&, id = stream.id()](const Buffer& data) {
+            std::lock_guard<std::mutex> lock(receivedMutex);
+            received[id].append(reinterpret_cast<const char*>(data.data()), data.size());
+        });
+        stream.setOnClose([&] { ++closed; });
+    });
+    std::thread t1 = worker(&ab, b.get(), a.get());
+    std::thread t2 = worker(&ba, a.get(), b.get());
+
+    const int count = 1000;
+    std::vector<Stream> streams;
+    std::vector<std::string> data(count);
+    for (int i = 0; i < count; ++i) {
+        streams.push_back(a->open("x"));
+        data[i] = std::string(20000 + i, static_cast<char>('a' + i % 26));
+        for (size_t j = 0; j < data[i].size(); j += 7) {
+            data[i][j] = static_cast<char>(i * 31 + j);
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        CHECK(streams[i].write(std::string_view(data[i]).substr(0, 8000)));
+    }
+    for (int i = 0; i < count; ++i) {
+        CHECK(streams[i].write(std::string_view(data[i]).substr(8000)));
+        streams[i].close();
+    }
+    CHECK(test::waitFor([&] { return closed == count; }, std::chrono::seconds(30)));
+
+    for (Pipe* pipe : {&ab, &ba}) {
+        {
+            std::lock_guard<std::mutex> lock(pipe->mutex);
+            pipe->stop = true;
+        }
+        pipe->cv.notify_all();
+    }
+    t1.join();
+    t2.join();
+
+    std::lock_guard<std::mutex> lock(receivedMutex);
+    CHECK(received.size() == static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i) {
+        CHECK(received[static_cast<uint64_t>(2 * i) ^ 1] == data[i]);
+    }
+}
+
+int main() {
+    testFraming();
+    testMalformedFrames();
+    testFlowControl();
+    testConcurrentStreams();
+    std::puts("stream_mux_test: ok");
+    return 0;
+}
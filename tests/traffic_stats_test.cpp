@@ -0,0 +1,57 @@
+// 服务端滑动窗口流量计数：窗口范围、槽位复用，以及多个线程不加锁并发累加
+#include "traffic_stats.hpp"
+#include "check.hpp"
+
+#include <thread>
+#include <vector>
+
+static void testWindow() {
+    TrafficWindow window;
+    int64_t now = 1000;
+    window.add(100, now - 20);
+    window.add(10, now - 5);
+    window.add(1, now);
+    window.add(1, now);
+
+    auto recent = window.window(now, 10);
+    CHECK(recent.msgs == 3 && recent.bytes == 12);
+    auto minute = window.window(now, 60);
+    CHECK(minute.msgs == 4 && minute.bytes == 112);
+    CHECK(window.window(now, 1).bytes == 2);
+
+    // kSlots 秒后槽位被新的一秒复用，旧值不再计入窗口，累计值不变
+    window.add(5, now - 20 + TrafficWindow::kSlots);
+    auto later = window.window(now - 20 + TrafficWindow::kSlots, TrafficWindow::kSlots);
+    CHECK(later.msgs == 4 && later.bytes == 17);
+    CHECK(window.total().msgs == 5 && window.total().bytes == 117);
+}
+
+// 累计值在并发下精确；同一秒内没有槽位复用，窗口值同样精确
+static void testConcurrentAdd() {
+    TrafficWindow window;
+    const int64_t now = 5000;
+    const int threads = 4;
+    const int perThread = 100000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            for (int i = 0; i < perThread; ++i) {
+                window.add(3, now);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    uint64_t expected = static_cast<uint64_t>(threads) * perThread;
+    CHECK(window.total().msgs == expected && window.total().bytes == expected * 3);
+    auto recent = window.window(now, 10);
+    CHECK(recent.msgs == expected && recent.bytes == expected * 3);
+}
+
+int main() {
+    testWindow();
+    testConcurrentAdd();
+    std::puts("traffic_stats_test: ok");
+    return 0;
+}